@@ -0,0 +1,140 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+/*
+*
+*   Epoch-based reclamation of the published versions.
+*       Reading a version through a handle does not touch reference counters: the nodes are reached
+*       by references, the iterators keep a raw pointer to the handle. Counters are touched when
+*       a reader copies the handle of the latest version to keep it alive while reading, and all
+*       readers then write to the same counter. SharedVersion publishes the versions instead:
+*       a reader enters an epoch (EpochDomain::Guard), takes a raw pointer to the handle,
+*       and the replaced handles are freed only after every reader which could see them has left.
+*
+*/
+namespace pds {
+    class EpochDomain {
+        struct Record;
+
+    public:
+        /*
+        *
+        *   Guard - the calling thread reads the objects of the domain while the guard is alive;
+        *       it also owns a list of the retired objects, which is reclaimed by the later guards.
+        *
+        */
+        class Guard {
+        public:
+            explicit Guard(EpochDomain& domain);
+            Guard(const Guard& other) = delete;
+            Guard& operator=(const Guard& other) = delete;
+            ~Guard();
+
+            // The object is deleted once no reader can see it; it has to be unreachable for the new readers
+            template<typename U>
+            void retire(U* object) {
+                retire(object, [](void* pointer) { delete static_cast<U*>(pointer); });
+            }
+            void retire(void* object, void (*deleter)(void*));
+
+            EpochDomain& domain() const { return m_domain; }
+
+        private:
+            EpochDomain& m_domain;
+            Record* m_record;
+        };
+
+        // Retired objects are reclaimed every RECLAIM_PERIOD retirements of a guard
+        static constexpr std::size_t RECLAIM_PERIOD = 64;
+
+        EpochDomain();
+        EpochDomain(const EpochDomain& other) = delete;
+        EpochDomain& operator=(const EpochDomain& other) = delete;
+        // There must be no guards left; all the retired objects are deleted
+        ~EpochDomain();
+
+        // Advances the epoch if the readers allow it and deletes the objects no reader can see;
+        // returns the number of the deleted objects
+        std::size_t reclaim();
+
+        // Objects retired but not deleted yet
+        std::size_t pending() const;
+
+        std::uint64_t epoch() const { return m_epoch.load(); }
+
+    private:
+        struct Retired {
+            void* object;
+            void (*deleter)(void*);
+            std::uint64_t epoch;
+        };
+
+        // State of one reader; records are reused by the following guards and never freed before the domain
+        struct Record {
+            // epoch the reader has entered, INACTIVE outside of a guard
+            std::atomic<std::uint64_t> epoch{ INACTIVE };
+            std::atomic<bool> owned{ false };
+            std::vector<Retired> retired;
+            std::size_t retiredSinceReclaim = 0;
+            Record* next = nullptr;
+        };
+
+        static constexpr std::uint64_t INACTIVE = 0;
+
+        Record* acquire();
+        void release(Record* record);
+
+        // Moves the epoch forward if every active reader has entered the current one
+        bool tryAdvance();
+        std::size_t reclaim(Record& record);
+
+        const std::uint64_t m_id;
+        std::atomic<std::uint64_t> m_epoch{ 1 };
+        std::atomic<Record*> m_records{ nullptr };
+        std::atomic<std::size_t> m_pending{ 0 };
+    };
+
+    /*
+    *
+    *   SharedVersion - the latest version of a container shared by several threads:
+    *       readers get a reference without copying the handle, publish() replaces the version
+    *       and retires the old handle to the domain. Writers have to be serialized by the caller.
+    *
+    */
+    template<typename Container>
+    class SharedVersion {
+    public:
+        SharedVersion(EpochDomain& domain, Container initial)
+            : m_domain(domain), m_current(new Container(std::move(initial))) {}
+        SharedVersion(const SharedVersion& other) = delete;
+        SharedVersion& operator=(const SharedVersion& other) = delete;
+        // There must be no readers left
+        ~SharedVersion() { delete m_current.load(); }
+
+        // The reference stays valid while the guard is alive
+        const Container& read(const EpochDomain::Guard& guard) const {
+            (void)guard;
+            return *m_current.load();
+        }
+
+        // Copy of the current handle, e.g. to build the next version from it
+        Container load() const {
+            EpochDomain::Guard guard(m_domain);
+            return read(guard);
+        }
+
+        void publish(Container version) {
+            auto next = new Container(std::move(version));
+            EpochDomain::Guard guard(m_domain);
+            guard.retire(m_current.exchange(next));
+        }
+
+    private:
+        EpochDomain& m_domain;
+        std::atomic<Container*> m_current;
+    };
+}
@@ -0,0 +1,319 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <type_traits>
+
+namespace pds {
+
+    /*
+    *
+    *   PackedLeaf - up to 64 integers encoded into one bit-packed block;
+    *       the encoding is chosen per block by the size of the result:
+    *           FRAME_OF_REFERENCE - value - minimum, packed with the width of the largest difference;
+    *               get(i) is O(1)
+    *           DELTA - difference with the previous value - minimal difference, packed;
+    *               monotone columns with a regular step take (almost) no bits per value,
+    *               the sum of the codes before every ANCHOR_STEP-th value is packed after the codes,
+    *               so get(i) unpacks less than ANCHOR_STEP codes; decode() restores the whole block in one pass
+    *       Values are mapped to std::uint64_t keeping their order, so signed types are packed as well.
+    *
+    */
+    template<typename T>
+    class PackedLeaf {
+        static_assert(std::is_integral<T>::value, "PackedLeaf encodes integral types only");
+    public:
+        enum class Encoding : std::uint8_t {
+            FRAME_OF_REFERENCE,
+            DELTA
+        };
+
+        static constexpr std::size_t MAX_SIZE = 64;
+        static constexpr std::size_t ANCHOR_STEP = 8;
+
+        PackedLeaf() = default;
+        PackedLeaf(const T* values, std::size_t count);
+        PackedLeaf(const PackedLeaf& other);
+        PackedLeaf(PackedLeaf&& other) noexcept = default;
+
+        PackedLeaf& operator=(const PackedLeaf& other) = delete;
+        PackedLeaf& operator=(PackedLeaf&& other) noexcept = default;
+
+        ~PackedLeaf() = default;
+
+        std::size_t size() const { return m_size; }
+        Encoding encoding() const { return m_encoding; }
+        std::uint32_t bitWidth() const { return m_width; }
+
+        T get(std::size_t pos) const;
+        // Writes all size() values to out
+        void decode(T* out) const;
+
+        // Bytes of the packed words, the block itself is not included
+        std::size_t packedBytes() const { return words() * sizeof(std::uint64_t); }
+
+    private:
+        static std::uint64_t toOrdered(T value);
+        static T fromOrdered(std::uint64_t value);
+
+        static std::uint32_t bitsFor(std::uint64_t value);
+        static std::size_t wordCount(std::size_t count, std::uint32_t width);
+
+        // Sums of the DELTA codes of the given width: none for the width 0, whose codes are all 0;
+        // a sum of up to MAX_SIZE codes takes 6 bits more than a code, larger ones are kept modulo 2^64
+        static std::size_t anchorCount(std::size_t codes, std::uint32_t width);
+        static std::uint32_t anchorWidth(std::uint32_t width);
+        static std::size_t deltaWordCount(std::size_t codes, std::uint32_t width);
+
+        // the first value of DELTA is stored in m_base, so only size() - 1 codes are packed
+        std::size_t codeCount() const;
+        std::size_t words() const;
+
+        std::uint64_t unpack(std::size_t pos) const;
+        // Sum of the first number * ANCHOR_STEP codes of DELTA, number > 0
+        std::uint64_t anchor(std::size_t number) const;
+
+        // width bits starting from the given bit of the packed words
+        std::uint64_t read(std::size_t bit, std::uint32_t width) const;
+        void write(std::size_t bit, std::uint32_t width, std::uint64_t value);
+
+        // The codes are packed at the start of words allocated words
+        void pack(const std::uint64_t* codes, std::size_t count, std::uint32_t width, std::size_t words);
+
+        std::uint64_t m_base = 0;
+        // minimal difference of neighbouring values for DELTA
+        std::uint64_t m_step = 0;
+        std::unique_ptr<std::uint64_t[]> m_words;
+        std::uint8_t m_size = 0;
+        std::uint8_t m_width = 0;
+        Encoding m_encoding = Encoding::FRAME_OF_REFERENCE;
+    };
+
+    // std::min takes MAX_SIZE by reference, so it needs a definition before C++17
+    template<typename T>
+    constexpr std::size_t PackedLeaf<T>::MAX_SIZE;
+    template<typename T>
+    constexpr std::size_t PackedLeaf<T>::ANCHOR_STEP;
+
+    template<typename T>
+    PackedLeaf<T>::PackedLeaf(const T* values, std::size_t count) : m_size(static_cast<std::uint8_t>(count)) {
+        if (0 == count) {
+            return;
+        }
+        std::uint64_t ordered[MAX_SIZE];
+        std::uint64_t minimum = std::numeric_limits<std::uint64_t>::max();
+        std::uint64_t maximum = 0;
+        for (std::size_t i = 0; i < count; ++i) {
+            ordered[i] = toOrdered(values[i]);
+            minimum = ordered[i] < minimum ? ordered[i] : minimum;
+            maximum = ordered[i] > maximum ? ordered[i] : maximum;
+        }
+        auto forWidth = bitsFor(maximum - minimum);
+
+        // differences are taken modulo 2^64, so the minimal one is searched among their signed values
+        std::uint64_t deltas[MAX_SIZE];
+        std::int64_t minDelta = std::numeric_limits<std::int64_t>::max();
+        std::int64_t maxDelta = std::numeric_limits<std::int64_t>::min();
+        for (std::size_t i = 1; i < count; ++i) {
+            auto delta = static_cast<std::int64_t>(ordered[i] - ordered[i - 1]);
+            minDelta = delta < minDelta ? delta : minDelta;
+            maxDelta = delta > maxDelta ? delta : maxDelta;
+        }
+        std::uint32_t deltaWidth = 0;
+        if (count > 1) {
+            deltaWidth = bitsFor(static_cast<std::uint64_t>(maxDelta) - static_cast<std::uint64_t>(minDelta));
+        }
+
+        if (deltaWordCount(count - 1, deltaWidth) < wordCount(count, forWidth)) {
+            m_encoding = Encoding::DELTA;
+            m_base = ordered[0];
+            m_step = static_cast<std::uint64_t>(minDelta);
+            for (std::size_t i = 1; i < count; ++i) {
+                deltas[i - 1] = (ordered[i] - ordered[i - 1]) - m_step;
+            }
+            pack(deltas, count - 1, deltaWidth, deltaWordCount(count - 1, deltaWidth));
+            auto width = anchorWidth(deltaWidth);
+            std::uint64_t sum = 0;
+            for (std::size_t i = 0; i < anchorCount(count - 1, deltaWidth) * ANCHOR_STEP; ++i) {
+                sum += deltas[i];
+                if ((i + 1) % ANCHOR_STEP == 0) {
+                    write((count - 1) * deltaWidth + (i / ANCHOR_STEP) * width, width, sum);
+                }
+            }
+        }
+        else {
+            m_encoding = Encoding::FRAME_OF_REFERENCE;
+            m_base = minimum;
+            for (std::size_t i = 0; i < count; ++i) {
+                ordered[i] -= minimum;
+            }
+            pack(ordered, count, forWidth, wordCount(count, forWidth));
+        }
+    }
+
+    template<typename T>
+    PackedLeaf<T>::PackedLeaf(const PackedLeaf& other)
+        : m_base(other.m_base), m_step(other.m_step), m_size(other.m_size), m_width(other.m_width), m_encoding(other.m_encoding)
+    {
+        auto words = this->words();
+        if (words) {
+            m_words = std::make_unique<std::uint64_t[]>(words);
+            std::copy(other.m_words.get(), other.m_words.get() + words, m_words.get());
+        }
+    }
+
+    template<typename T>
+    T PackedLeaf<T>::get(std::size_t pos) const {
+        if (m_encoding == Encoding::FRAME_OF_REFERENCE) {
+            return fromOrdered(m_base + unpack(pos));
+        }
+        // otherwise m_encoding == DELTA
+        auto value = m_base + pos * m_step;
+        if (0 == m_width) {
+            return fromOrdered(value);
+        }
+        auto number = pos / ANCHOR_STEP;
+        if (number > 0) {
+            value += anchor(number);
+        }
+        for (auto i = number * ANCHOR_STEP; i < pos; ++i) {
+            value += unpack(i);
+        }
+        return fromOrdered(value);
+    }
+
+    template<typename T>
+    void PackedLeaf<T>::decode(T* out) const {
+        // m_size never exceeds MAX_SIZE; the bound keeps the vectorized loops within a MAX_SIZE buffer
+        // for the compiler, which otherwise reports an overflow of the caller's buffer
+        const std::size_t size = std::min<std::size_t>(m_size, MAX_SIZE);
+        if (0 == size) {
+            return;
+        }
+        if (m_encoding == Encoding::FRAME_OF_REFERENCE) {
+            for (std::size_t i = 0; i < size; ++i) {
+                out[i] = fromOrdered(m_base + unpack(i));
+            }
+            return;
+        }
+        // otherwise m_encoding == DELTA
+        auto value = m_base;
+        out[0] = fromOrdered(value);
+        for (std::size_t i = 1; i < size; ++i) {
+            value += m_step + unpack(i - 1);
+            out[i] = fromOrdered(value);
+        }
+    }
+
+    template<typename T>
+    inline std::uint64_t PackedLeaf<T>::toOrdered(T value) {
+        if (std::is_signed<T>::value) {
+            // flipping the sign bit maps the signed order onto the unsigned one
+            return static_cast<std::uint64_t>(static_cast<std::int64_t>(value)) ^ (std::uint64_t(1) << 63);
+        }
+        return static_cast<std::uint64_t>(value);
+    }
+
+    template<typename T>
+    inline T PackedLeaf<T>::fromOrdered(std::uint64_t value) {
+        if (std::is_signed<T>::value) {
+            return static_cast<T>(static_cast<std::int64_t>(value ^ (std::uint64_t(1) << 63)));
+        }
+        return static_cast<T>(value);
+    }
+
+    template<typename T>
+    inline std::uint32_t PackedLeaf<T>::bitsFor(std::uint64_t value) {
+        std::uint32_t out = 0;
+        while (value) {
+            ++out;
+            value >>= 1;
+        }
+        return out;
+    }
+
+    template<typename T>
+    inline std::size_t PackedLeaf<T>::wordCount(std::size_t count, std::uint32_t width) {
+        return (count * width + 63) / 64;
+    }
+
+    template<typename T>
+    inline std::size_t PackedLeaf<T>::anchorCount(std::size_t codes, std::uint32_t width) {
+        return 0 == width ? 0 : codes / ANCHOR_STEP;
+    }
+
+    template<typename T>
+    inline std::uint32_t PackedLeaf<T>::anchorWidth(std::uint32_t width) {
+        return std::min<std::uint32_t>(width + 6, 64);
+    }
+
+    template<typename T>
+    inline std::size_t PackedLeaf<T>::deltaWordCount(std::size_t codes, std::uint32_t width) {
+        return (codes * width + anchorCount(codes, width) * anchorWidth(width) + 63) / 64;
+    }
+
+    template<typename T>
+    inline std::size_t PackedLeaf<T>::words() const {
+        if (m_encoding == Encoding::DELTA) {
+            return deltaWordCount(codeCount(), m_width);
+        }
+        return wordCount(m_size, m_width);
+    }
+
+    template<typename T>
+    inline std::size_t PackedLeaf<T>::codeCount() const {
+        if (m_encoding == Encoding::DELTA) {
+            return m_size - 1;
+        }
+        return m_size;
+    }
+
+    template<typename T>
+    inline std::uint64_t PackedLeaf<T>::unpack(std::size_t pos) const {
+        if (0 == m_width) {
+            return 0;
+        }
+        return read(pos * m_width, m_width);
+    }
+
+    template<typename T>
+    inline std::uint64_t PackedLeaf<T>::anchor(std::size_t number) const {
+        auto width = anchorWidth(m_width);
+        return read(codeCount() * m_width + (number - 1) * width, width);
+    }
+
+    template<typename T>
+    inline std::uint64_t PackedLeaf<T>::read(std::size_t bit, std::uint32_t width) const {
+        auto word = bit / 64;
+        auto shift = bit % 64;
+        auto out = m_words[word] >> shift;
+        if (shift + width > 64) {
+            out |= m_words[word + 1] << (64 - shift);
+        }
+        return width == 64 ? out : out & ((std::uint64_t(1) << width) - 1);
+    }
+
+    template<typename T>
+    inline void PackedLeaf<T>::write(std::size_t bit, std::uint32_t width, std::uint64_t value) {
+        auto word = bit / 64;
+        auto shift = bit % 64;
+        m_words[word] |= value << shift;
+        if (shift + width > 64) {
+            m_words[word + 1] |= value >> (64 - shift);
+        }
+    }
+
+    template<typename T>
+    void PackedLeaf<T>::pack(const std::uint64_t* codes, std::size_t count, std::uint32_t width, std::size_t words) {
+        m_width = static_cast<std::uint8_t>(width);
+        if (0 == words) {
+            return;
+        }
+        m_words = std::make_unique<std::uint64_t[]>(words);
+        for (std::size_t i = 0; i < count; ++i) {
+            write(i * width, width, codes[i]);
+        }
+    }
+}
@@ -0,0 +1,127 @@
+#pragma once
+#include "Utils.h"
+
+#include <cstddef>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace pds {
+
+    /*
+    *
+    *   MemoryUsage - result of an accounting walk over one or more container versions;
+    *       every heap block is counted once, no matter how many versions reference it.
+    *       Sizes are estimates: the allocator overhead is not included, the control block
+    *       of a std::shared_ptr is approximated by SHARED_CONTROL_BLOCK_SIZE.
+    *
+    */
+    struct MemoryUsage {
+        // PersistentVector
+        std::size_t primeTreeNodes = 0;
+        std::size_t primeTreeNodeBytes = 0;
+        std::size_t leaves = 0;
+        std::size_t leafBytes = 0;
+
+        // PersistentVector roots and version tree nodes, PersistentMap handles, persistent_linked_list roots
+        std::size_t versionNodes = 0;
+        std::size_t versionNodeBytes = 0;
+
+        // persistent_linked_list
+        std::size_t fatNodes = 0;
+        std::size_t fatNodeBytes = 0;
+        std::size_t listNodes = 0;
+        std::size_t listNodeBytes = 0;
+
+        // element copies stored by the containers (every element copy is counted, not every index)
+        std::size_t elements = 0;
+        std::size_t elementBytes = 0;
+
+        std::size_t totalBytes() const;
+    };
+
+    /*
+    *
+    *   VersionsMemoryUsage - split of the memory of several live versions:
+    *       sharedBytes - bytes referenced by at least two of the versions,
+    *       exclusiveBytes[i] - bytes referenced only by the i-th version, i.e. what would be freed
+    *       by dropping it while the others stay alive.
+    *
+    */
+    struct VersionsMemoryUsage {
+        MemoryUsage total;
+        std::size_t sharedBytes = 0;
+        std::vector<std::size_t> exclusiveBytes;
+        std::vector<std::size_t> versionBytes;
+    };
+
+    class MemoryAccountant {
+    public:
+        enum class BlockType {
+            PRIME_TREE_NODE,
+            LEAF,
+            VERSION_NODE,
+            FAT_NODE,
+            LIST_NODE,
+            ELEMENT
+        };
+
+        // Approximate size of the control block allocated together with an object by std::make_shared
+        static constexpr std::size_t SHARED_CONTROL_BLOCK_SIZE = sizeof(void*) + 2 * sizeof(int);
+
+        template<typename U>
+        static constexpr std::size_t sharedBlockSize() {
+            return SHARED_CONTROL_BLOCK_SIZE + sizeof(U);
+        }
+
+        // returns true if the block was not accounted before, so the caller has to walk its children
+        bool visit(const void* block, std::size_t bytes, BlockType type);
+
+        const MemoryUsage& usage() const;
+
+        static VersionsMemoryUsage compare(const std::vector<MemoryAccountant>& accountants);
+
+    private:
+        struct Block {
+            std::size_t bytes;
+            BlockType type;
+        };
+
+        std::unordered_map<const void*, Block> m_blocks;
+        MemoryUsage m_usage;
+    };
+
+    namespace Utils {
+        template <typename T, typename = void>
+        constexpr bool has_memory_accounting = false;
+
+        template <typename T>
+        constexpr bool has_memory_accounting<T, void_t<decltype(std::declval<const T&>().accountMemory(std::declval<MemoryAccountant&>()))>> = true;
+
+        template<typename T>
+        void accountElementMemory(const T& element, MemoryAccountant& accountant, std::true_type) {
+            element.accountMemory(accountant);
+        }
+
+        template<typename T>
+        void accountElementMemory(const T&, MemoryAccountant&, std::false_type) {}
+
+        // Walks the memory owned by an element if it is a persistent container itself
+        template<typename T>
+        void accountElementMemory(const T& element, MemoryAccountant& accountant) {
+            accountElementMemory(element, accountant, std::integral_constant<bool, has_memory_accounting<T>>());
+        }
+    }
+
+    // Shared and exclusive bytes of the versions in [first, last)
+    template<typename InputIt, typename std::enable_if<is_iterator<InputIt>, bool>::type = false>
+    VersionsMemoryUsage versionsMemoryUsage(InputIt first, InputIt last) {
+        std::vector<MemoryAccountant> accountants;
+        for (; first != last; ++first) {
+            accountants.emplace_back();
+            first->accountMemory(accountants.back());
+        }
+        return MemoryAccountant::compare(accountants);
+    }
+}
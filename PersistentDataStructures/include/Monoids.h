@@ -0,0 +1,85 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <type_traits>
+
+/*
+*
+*   Monoids for the annotated PersistentVector<T, Monoid>:
+*       every node caches the combination of the measures of the elements of its subtree,
+*       so aggregate(first, last) is computed in O(log n) instead of a scan of the range.
+*
+*/
+namespace pds {
+    template<typename T>
+    struct SumMonoid {
+        using summary_type = T;
+
+        static summary_type identity() { return T(); }
+        static summary_type measure(const T& element) { return element; }
+        static summary_type combine(const summary_type& left, const summary_type& right) { return left + right; }
+    };
+
+    // identity() is the largest value of T, so the minimum of an empty range is numeric_limits<T>::max()
+    template<typename T>
+    struct MinMonoid {
+        using summary_type = T;
+
+        static summary_type identity() { return std::numeric_limits<T>::max(); }
+        static summary_type measure(const T& element) { return element; }
+        static summary_type combine(const summary_type& left, const summary_type& right) { return std::min(left, right); }
+    };
+
+    // identity() is the lowest value of T, so the maximum of an empty range is numeric_limits<T>::lowest()
+    template<typename T>
+    struct MaxMonoid {
+        using summary_type = T;
+
+        static summary_type identity() { return std::numeric_limits<T>::lowest(); }
+        static summary_type measure(const T& element) { return element; }
+        static summary_type combine(const summary_type& left, const summary_type& right) { return std::max(left, right); }
+    };
+
+    // Polynomial hash of a sequence modulo 2^64: the hash of the elements and BASE^length
+    struct ContentHash {
+        std::uint64_t hash;
+        std::uint64_t power;
+
+        bool operator==(const ContentHash& other) const { return hash == other.hash && power == other.power; }
+        bool operator!=(const ContentHash& other) const { return !(*this == other); }
+    };
+
+    // Merkle-style content hash: combine(left, right) = left * BASE^|right| + right, so the summary depends
+    // on the elements in order only, not on the shape of the trie, and independently built vectors of
+    // the same elements get the same hash. PersistentVector<T, HashMonoid<T>> has O(1) content_hash()
+    // and its operator== rejects the vectors of different hashes without comparing the elements.
+    template<typename T, typename Hash = std::hash<T>>
+    struct HashMonoid {
+        using summary_type = ContentHash;
+
+        static constexpr std::uint64_t BASE = 0x100000001b3ull;
+
+        static summary_type identity() { return { 0, 1 }; }
+        static summary_type measure(const T& element) { return { mix(Hash()(element)), BASE }; }
+        static summary_type combine(const summary_type& left, const summary_type& right) {
+            return { left.hash * right.power + right.hash, left.power * right.power };
+        }
+
+    private:
+        // std::hash of integers is the identity, the bits are spread by the splitmix64 finalizer
+        static std::uint64_t mix(std::uint64_t value) {
+            value += 0x9e3779b97f4a7c15ull;
+            value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ull;
+            value = (value ^ (value >> 27)) * 0x94d049bb133111ebull;
+            return value ^ (value >> 31);
+        }
+    };
+
+    template<typename Monoid>
+    struct is_hash_monoid : std::false_type {};
+
+    template<typename T, typename Hash>
+    struct is_hash_monoid<HashMonoid<T, Hash>> : std::true_type {};
+}
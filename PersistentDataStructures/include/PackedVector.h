@@ -0,0 +1,536 @@
+#pragma once
+#include "Utils.h"
+#include "LeafCodec.h"
+#include "MemoryUsage.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+namespace pds {
+
+    /*
+    *
+    *   PackedVector - persistent vector of integers which keeps its leaves compressed (see PackedLeaf):
+    *       the same 32-ary trie as PersistentVector, but a leaf is one encoded block instead of
+    *       32 separately allocated elements, its encoding is chosen again every time the leaf is
+    *       built or copied on a path. Every modification returns a new version which shares
+    *       all the untouched nodes with the old one.
+    *       Elements are decoded on access, so they are returned by value; the iterator decodes
+    *       a whole leaf at a time. There is no undo/redo history: old versions are kept by their handles.
+    *
+    */
+    template<typename T>
+    class PackedVector {
+        static_assert(std::is_integral<T>::value, "PackedVector stores integral types only");
+
+        class Node;
+
+        static constexpr std::uint32_t DEGREE_OF_TWO = 5;
+        static constexpr std::size_t ARRAY_SIZE = Utils::binPow(DEGREE_OF_TWO);
+        static constexpr std::size_t MASK = ARRAY_SIZE - 1;
+
+    public:
+        class const_iterator {
+        public:
+            using iterator_category = std::input_iterator_tag;
+            using difference_type = std::ptrdiff_t;
+            using value_type = T;
+            using pointer = const T*;
+            using reference = const T&;
+
+            const_iterator(std::size_t pos, const PackedVector* pvector);
+
+            // The reference stays valid until the iterator is moved to the next leaf
+            const T& operator*() const { return m_buffer[m_pos & MASK]; }
+            const T* operator->() const { return &m_buffer[m_pos & MASK]; }
+
+            const_iterator& operator++();
+            const_iterator operator++(int);
+
+            bool operator==(const const_iterator& other) const { return m_pos == other.m_pos && m_pvector == other.m_pvector; }
+            bool operator!=(const const_iterator& other) const { return !(*this == other); }
+
+        private:
+            void load();
+
+            std::size_t m_pos;
+            const PackedVector* m_pvector;
+            std::array<T, ARRAY_SIZE> m_buffer;
+        };
+
+        PackedVector() = default;
+        PackedVector(const PackedVector& other) = default;
+        PackedVector(PackedVector&& other) noexcept = default;
+
+        template<typename InputIt, typename std::enable_if<is_iterator<InputIt>, bool>::type = false>
+        PackedVector(InputIt first, InputIt last);
+
+        PackedVector(std::initializer_list<T> init) : PackedVector(init.begin(), init.end()) {}
+
+        ~PackedVector() = default;
+
+        PackedVector& operator=(const PackedVector& other) = default;
+        PackedVector& operator=(PackedVector&& other) noexcept = default;
+
+        const_iterator cbegin() const;
+        const_iterator cend() const;
+
+        T operator[](std::size_t pos) const;
+        T at(std::size_t pos) const;
+        T front() const;
+        T back() const;
+
+        std::size_t size() const;
+        bool empty() const;
+
+        // Copies the elements [first, last) to out decoding every leaf once; whole leaves
+        // copied to T* are decoded right into the destination.
+        // Throws out_of_range if the range is out of the vector
+        template<typename OutputIt>
+        OutputIt copy_to(OutputIt out, std::size_t first, std::size_t last) const;
+        template<typename OutputIt>
+        OutputIt copy_to(OutputIt out) const;
+
+        std::vector<T> to_std_vector() const;
+
+        PackedVector set(std::size_t pos, T value) const;
+        PackedVector push_back(T value) const;
+        PackedVector pop_back() const;
+
+        bool operator==(const PackedVector& other) const;
+        bool operator!=(const PackedVector& other) const;
+
+        MemoryUsage memoryUsage() const;
+        void accountMemory(MemoryAccountant& accountant) const;
+
+    private:
+        PackedVector(std::shared_ptr<const Node> root, std::size_t size, std::uint32_t depth)
+            : m_root(std::move(root)), m_size(size), m_depth(depth) {}
+
+        // Leaf holding the element pos
+        const PackedLeaf<T>& leafAt(std::size_t pos) const;
+
+        // Copies count elements of the leaf starting with from
+        template<typename OutputIt>
+        static OutputIt copyLeaf(const PackedLeaf<T>& leaf, std::size_t from, std::size_t count, OutputIt out);
+        static T* copyLeaf(const PackedLeaf<T>& leaf, std::size_t from, std::size_t count, T* out);
+
+        /*
+        *
+        *   Node - immutable node of the trie: a leaf holds the encoded elements,
+        *       an interior node holds up to 32 children, all of them but the last one are full.
+        *       Level 0 is the level of the leaves.
+        *
+        */
+        class Node {
+            friend class PackedVector;
+        public:
+            explicit Node(PackedLeaf<T>&& leaf) : m_leaf(std::move(leaf)), m_contentAmount(m_leaf.size()) {}
+            Node(const Node& other);
+            Node() : m_children(std::make_unique<std::array<std::shared_ptr<const Node>, ARRAY_SIZE>>()) {}
+
+            bool isLeaf() const { return nullptr == m_children; }
+
+            const PackedLeaf<T>& leaf(std::size_t pos, std::uint32_t level) const;
+
+            std::shared_ptr<const Node> set(std::size_t pos, std::uint32_t level, T value) const;
+            // pos is the size of the subtree, there has to be room for one more element
+            std::shared_ptr<const Node> push_back(std::size_t pos, std::uint32_t level, T value) const;
+            // pos is the position of the last element; nullptr if the subtree becomes empty
+            std::shared_ptr<const Node> pop_back(std::size_t pos, std::uint32_t level) const;
+
+            const std::shared_ptr<const Node>& firstChild() const { return (*m_children)[0]; }
+            std::size_t size() const { return m_contentAmount; }
+
+            // Path from a new node of the level down to a leaf with the single value
+            static std::shared_ptr<const Node> makePath(std::uint32_t level, T value);
+
+            // Tree over the nodes of one level built level by level; the level of the result is written to depth
+            static std::shared_ptr<const Node> build(std::vector<std::shared_ptr<const Node>>&& nodes, std::uint32_t& depth);
+
+            void accountMemory(MemoryAccountant& accountant) const;
+
+        private:
+            static std::shared_ptr<const Node> makeLeaf(const T* values, std::size_t count);
+
+            PackedLeaf<T> m_leaf;
+            std::unique_ptr<std::array<std::shared_ptr<const Node>, ARRAY_SIZE>> m_children;
+            std::size_t m_contentAmount = 0;
+        };
+
+        std::shared_ptr<const Node> m_root;
+        std::size_t m_size = 0;
+        std::uint32_t m_depth = 0;
+    };
+
+    // std::min takes ARRAY_SIZE by reference, so it needs a definition before C++17
+    template<typename T>
+    constexpr std::size_t PackedVector<T>::ARRAY_SIZE;
+
+
+    /*
+    *
+    *   PackedVector
+    *
+    */
+
+    template<typename T>
+    template<typename InputIt, typename std::enable_if<is_iterator<InputIt>, bool>::type>
+    PackedVector<T>::PackedVector(InputIt first, InputIt last) {
+        std::vector<T> values(first, last);
+        if (values.empty()) {
+            return;
+        }
+        std::vector<std::shared_ptr<const Node>> leaves;
+        leaves.reserve((values.size() + MASK) / ARRAY_SIZE);
+        for (std::size_t i = 0; i < values.size(); i += ARRAY_SIZE) {
+            auto count = std::min(ARRAY_SIZE, values.size() - i);
+            leaves.push_back(std::make_shared<const Node>(PackedLeaf<T>(values.data() + i, count)));
+        }
+        m_size = values.size();
+        m_root = Node::build(std::move(leaves), m_depth);
+    }
+
+    template<typename T>
+    inline typename PackedVector<T>::const_iterator PackedVector<T>::cbegin() const {
+        return const_iterator(0, this);
+    }
+
+    template<typename T>
+    inline typename PackedVector<T>::const_iterator PackedVector<T>::cend() const {
+        return const_iterator(m_size, this);
+    }
+
+    template<typename T>
+    inline T PackedVector<T>::operator[](std::size_t pos) const {
+        return leafAt(pos).get(pos & MASK);
+    }
+
+    template<typename T>
+    T PackedVector<T>::at(std::size_t pos) const {
+        if (pos >= m_size) {
+            throw std::out_of_range("Index is greater than vector size");
+        }
+        return (*this)[pos];
+    }
+
+    template<typename T>
+    inline T PackedVector<T>::front() const {
+        return (*this)[0];
+    }
+
+    template<typename T>
+    inline T PackedVector<T>::back() const {
+        return (*this)[m_size - 1];
+    }
+
+    template<typename T>
+    inline std::size_t PackedVector<T>::size() const {
+        return m_size;
+    }
+
+    template<typename T>
+    inline bool PackedVector<T>::empty() const {
+        return 0 == m_size;
+    }
+
+    template<typename T>
+    template<typename OutputIt>
+    OutputIt PackedVector<T>::copy_to(OutputIt out, std::size_t first, std::size_t last) const {
+        if (first > last || last > m_size) {
+            throw std::out_of_range("Range is out of vector bounds");
+        }
+        while (first < last) {
+            auto from = first & MASK;
+            auto count = std::min(ARRAY_SIZE - from, last - first);
+            out = copyLeaf(leafAt(first), from, count, out);
+            first += count;
+        }
+        return out;
+    }
+
+    template<typename T>
+    template<typename OutputIt>
+    inline OutputIt PackedVector<T>::copy_to(OutputIt out) const {
+        return copy_to(out, 0, m_size);
+    }
+
+    template<typename T>
+    std::vector<T> PackedVector<T>::to_std_vector() const {
+        std::vector<T> out(m_size);
+        copy_to(out.data());
+        return out;
+    }
+
+    template<typename T>
+    PackedVector<T> PackedVector<T>::set(std::size_t pos, T value) const {
+        return PackedVector(m_root->set(pos, m_depth, value), m_size, m_depth);
+    }
+
+    template<typename T>
+    PackedVector<T> PackedVector<T>::push_back(T value) const {
+        if (nullptr == m_root) {
+            return PackedVector(Node::makePath(0, value), 1, 0);
+        }
+        if (m_size == Utils::binPow(DEGREE_OF_TWO * (m_depth + 1))) {
+            // the root is full, the tree grows by one level
+            auto root = std::make_shared<Node>();
+            (*root->m_children)[0] = m_root;
+            (*root->m_children)[1] = Node::makePath(m_depth, value);
+            root->m_contentAmount = 2;
+            return PackedVector(std::move(root), m_size + 1, m_depth + 1);
+        }
+        return PackedVector(m_root->push_back(m_size, m_depth, value), m_size + 1, m_depth);
+    }
+
+    template<typename T>
+    PackedVector<T> PackedVector<T>::pop_back() const {
+        auto root = m_root->pop_back(m_size - 1, m_depth);
+        auto depth = m_depth;
+        if (nullptr != root && !root->isLeaf() && 1 == root->size()) {
+            root = root->firstChild();
+            --depth;
+        }
+        return PackedVector(std::move(root), m_size - 1, depth);
+    }
+
+    template<typename T>
+    bool PackedVector<T>::operator==(const PackedVector& other) const {
+        if (m_size != other.m_size) {
+            return false;
+        }
+        if (m_root == other.m_root) {
+            return true;
+        }
+        return std::equal(cbegin(), cend(), other.cbegin());
+    }
+
+    template<typename T>
+    inline bool PackedVector<T>::operator!=(const PackedVector& other) const {
+        return !(*this == other);
+    }
+
+    template<typename T>
+    MemoryUsage PackedVector<T>::memoryUsage() const {
+        MemoryAccountant accountant;
+        accountMemory(accountant);
+        return accountant.usage();
+    }
+
+    template<typename T>
+    void PackedVector<T>::accountMemory(MemoryAccountant& accountant) const {
+        if (nullptr != m_root) {
+            m_root->accountMemory(accountant);
+        }
+    }
+
+    template<typename T>
+    inline const PackedLeaf<T>& PackedVector<T>::leafAt(std::size_t pos) const {
+        return m_root->leaf(pos, m_depth);
+    }
+
+    template<typename T>
+    template<typename OutputIt>
+    OutputIt PackedVector<T>::copyLeaf(const PackedLeaf<T>& leaf, std::size_t from, std::size_t count, OutputIt out) {
+        std::array<T, ARRAY_SIZE> buffer;
+        leaf.decode(buffer.data());
+        return std::copy(buffer.begin() + from, buffer.begin() + from + count, out);
+    }
+
+    template<typename T>
+    T* PackedVector<T>::copyLeaf(const PackedLeaf<T>& leaf, std::size_t from, std::size_t count, T* out) {
+        if (0 == from && count == leaf.size()) {
+            leaf.decode(out);
+            return out + count;
+        }
+        std::array<T, ARRAY_SIZE> buffer;
+        leaf.decode(buffer.data());
+        return std::copy(buffer.begin() + from, buffer.begin() + from + count, out);
+    }
+
+
+    /*
+    *
+    *   const_iterator
+    *
+    */
+
+    template<typename T>
+    PackedVector<T>::const_iterator::const_iterator(std::size_t pos, const PackedVector* pvector)
+        : m_pos(pos), m_pvector(pvector)
+    {
+        load();
+    }
+
+    template<typename T>
+    inline typename PackedVector<T>::const_iterator& PackedVector<T>::const_iterator::operator++() {
+        ++m_pos;
+        if (0 == (m_pos & MASK)) {
+            load();
+        }
+        return *this;
+    }
+
+    template<typename T>
+    inline typename PackedVector<T>::const_iterator PackedVector<T>::const_iterator::operator++(int) {
+        auto out = *this;
+        ++(*this);
+        return out;
+    }
+
+    template<typename T>
+    inline void PackedVector<T>::const_iterator::load() {
+        if (m_pos < m_pvector->size()) {
+            m_pvector->leafAt(m_pos).decode(m_buffer.data());
+        }
+    }
+
+
+    /*
+    *
+    *   Node
+    *
+    */
+
+    template<typename T>
+    PackedVector<T>::Node::Node(const Node& other)
+        : m_leaf(other.m_leaf), m_contentAmount(other.m_contentAmount)
+    {
+        if (nullptr != other.m_children) {
+            m_children = std::make_unique<std::array<std::shared_ptr<const Node>, ARRAY_SIZE>>(*other.m_children);
+        }
+    }
+
+    template<typename T>
+    const PackedLeaf<T>& PackedVector<T>::Node::leaf(std::size_t pos, std::uint32_t level) const {
+        auto node = this;
+        for (; level > 0; --level) {
+            node = (*node->m_children)[Utils::getId(pos, level, DEGREE_OF_TWO)].get();
+            pos &= Utils::getMask(level, DEGREE_OF_TWO);
+        }
+        return node->m_leaf;
+    }
+
+    template<typename T>
+    std::shared_ptr<const typename PackedVector<T>::Node> PackedVector<T>::Node::set(std::size_t pos, std::uint32_t level, T value) const {
+        if (isLeaf()) {
+            T values[ARRAY_SIZE];
+            m_leaf.decode(values);
+            values[pos] = value;
+            return makeLeaf(values, m_contentAmount);
+        }
+        // otherwise the node is interior
+        auto id = Utils::getId(pos, level, DEGREE_OF_TWO);
+        auto mask = Utils::getMask(level, DEGREE_OF_TWO);
+        auto out = std::make_shared<Node>(*this);
+        (*out->m_children)[id] = (*m_children)[id]->set(pos & mask, level - 1, value);
+        return out;
+    }
+
+    template<typename T>
+    std::shared_ptr<const typename PackedVector<T>::Node> PackedVector<T>::Node::push_back(std::size_t pos, std::uint32_t level, T value) const {
+        if (isLeaf()) {
+            T values[ARRAY_SIZE];
+            m_leaf.decode(values);
+            values[m_contentAmount] = value;
+            return makeLeaf(values, m_contentAmount + 1);
+        }
+        // otherwise the node is interior
+        auto id = Utils::getId(pos, level, DEGREE_OF_TWO);
+        auto mask = Utils::getMask(level, DEGREE_OF_TWO);
+        auto out = std::make_shared<Node>(*this);
+        if (id < m_contentAmount) {
+            (*out->m_children)[id] = (*m_children)[id]->push_back(pos & mask, level - 1, value);
+        }
+        else {
+            (*out->m_children)[id] = makePath(level - 1, value);
+            out->m_contentAmount = id + 1;
+        }
+        return out;
+    }
+
+    template<typename T>
+    std::shared_ptr<const typename PackedVector<T>::Node> PackedVector<T>::Node::pop_back(std::size_t pos, std::uint32_t level) const {
+        if (isLeaf()) {
+            if (1 == m_contentAmount) {
+                return nullptr;
+            }
+            T values[ARRAY_SIZE];
+            m_leaf.decode(values);
+            return makeLeaf(values, m_contentAmount - 1);
+        }
+        // otherwise the node is interior
+        auto id = Utils::getId(pos, level, DEGREE_OF_TWO);
+        auto mask = Utils::getMask(level, DEGREE_OF_TWO);
+        auto child = (*m_children)[id]->pop_back(pos & mask, level - 1);
+        if (nullptr == child && 0 == id) {
+            return nullptr;
+        }
+        auto out = std::make_shared<Node>(*this);
+        if (nullptr != child) {
+            (*out->m_children)[id] = std::move(child);
+        }
+        else {
+            (*out->m_children)[id].reset();
+            out->m_contentAmount = id;
+        }
+        return out;
+    }
+
+    template<typename T>
+    std::shared_ptr<const typename PackedVector<T>::Node> PackedVector<T>::Node::makePath(std::uint32_t level, T value) {
+        if (0 == level) {
+            return makeLeaf(&value, 1);
+        }
+        auto out = std::make_shared<Node>();
+        (*out->m_children)[0] = makePath(level - 1, value);
+        out->m_contentAmount = 1;
+        return out;
+    }
+
+    template<typename T>
+    std::shared_ptr<const typename PackedVector<T>::Node> PackedVector<T>::Node::build(std::vector<std::shared_ptr<const Node>>&& nodes, std::uint32_t& depth) {
+        depth = 0;
+        while (nodes.size() > 1) {
+            std::vector<std::shared_ptr<const Node>> upper;
+            upper.reserve((nodes.size() + MASK) / ARRAY_SIZE);
+            for (std::size_t i = 0; i < nodes.size(); i += ARRAY_SIZE) {
+                auto node = std::make_shared<Node>();
+                auto count = std::min(ARRAY_SIZE, nodes.size() - i);
+                std::move(nodes.begin() + i, nodes.begin() + i + count, node->m_children->begin());
+                node->m_contentAmount = count;
+                upper.push_back(std::move(node));
+            }
+            nodes = std::move(upper);
+            ++depth;
+        }
+        return std::move(nodes.front());
+    }
+
+    template<typename T>
+    void PackedVector<T>::Node::accountMemory(MemoryAccountant& accountant) const {
+        if (isLeaf()) {
+            accountant.visit(this, MemoryAccountant::sharedBlockSize<Node>() + m_leaf.packedBytes(), MemoryAccountant::BlockType::LEAF);
+            return;
+        }
+        auto bytes = MemoryAccountant::sharedBlockSize<Node>() + sizeof(std::array<std::shared_ptr<const Node>, ARRAY_SIZE>);
+        if (accountant.visit(this, bytes, MemoryAccountant::BlockType::PRIME_TREE_NODE)) {
+            for (std::size_t i = 0; i < m_contentAmount; ++i) {
+                (*m_children)[i]->accountMemory(accountant);
+            }
+        }
+    }
+
+    template<typename T>
+    inline std::shared_ptr<const typename PackedVector<T>::Node> PackedVector<T>::Node::makeLeaf(const T* values, std::size_t count) {
+        return std::make_shared<const Node>(PackedLeaf<T>(values, count));
+    }
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <exception>
+#include <iterator>
+#include <thread>
+
+namespace pds {
+    namespace Utils {
+        // Ranges shorter than this are sorted by the calling thread
+        constexpr std::size_t PARALLEL_SORT_MIN_SIZE = 1 << 14;
+
+        /*
+        *
+        *   Stable merge sort: the halves are sorted by different threads
+        *       while there are threads left, then merged by std::inplace_merge;
+        *       cmp is called concurrently, so it has to be safe to call from several threads.
+        *
+        */
+        template<typename RandomIt, typename Compare>
+        void parallelStableSort(RandomIt first, RandomIt last, Compare cmp, std::size_t threads) {
+            auto size = static_cast<std::size_t>(std::distance(first, last));
+            if (threads <= 1 || size < PARALLEL_SORT_MIN_SIZE) {
+                std::stable_sort(first, last, cmp);
+                return;
+            }
+            auto middle = first + static_cast<typename std::iterator_traits<RandomIt>::difference_type>(size / 2);
+            std::exception_ptr error;
+            std::thread left([&]() {
+                try {
+                    parallelStableSort(first, middle, cmp, threads / 2);
+                }
+                catch (...) {
+                    error = std::current_exception();
+                }
+            });
+            try {
+                parallelStableSort(middle, last, cmp, threads - threads / 2);
+            }
+            catch (...) {
+                left.join();
+                throw;
+            }
+            left.join();
+            if (error) {
+                std::rethrow_exception(error);
+            }
+            std::inplace_merge(first, middle, last, cmp);
+        }
+
+        template<typename RandomIt, typename Compare>
+        void parallelStableSort(RandomIt first, RandomIt last, Compare cmp) {
+            parallelStableSort(first, last, cmp, std::max<std::size_t>(1, std::thread::hardware_concurrency()));
+        }
+    }
+}
@@ -0,0 +1,314 @@
+#pragma once
+#include "Utils.h"
+#include "MemoryUsage.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace pds {
+
+    /*
+    *
+    *   PersistentBitVector - persistent vector of bits packed into 64-bit words: the trie of PackedVector,
+    *       but a leaf holds 2048 bits in 32 words and every node keeps the number of the set bits under it.
+    *       count() is O(1) and find_first()/find_next() skip the subtrees without set bits.
+    *       The operators &, | and ^ combine two versions of the same size word by word and only walk
+    *       the subtrees the versions do not share: a shared subtree is its own & and |, and its ^ is zero.
+    *       Subtrees filled with one value are shared too, so a fresh vector of n equal bits takes O(log n) nodes.
+    *       There is no undo/redo history: old versions are kept by their handles.
+    *
+    */
+    class PersistentBitVector {
+        class Node;
+        class LeafNode;
+        class InteriorNode;
+
+        static constexpr std::uint32_t DEGREE_OF_TWO = 5;
+        static constexpr std::size_t ARRAY_SIZE = Utils::binPow(DEGREE_OF_TWO);
+        static constexpr std::size_t MASK = ARRAY_SIZE - 1;
+        static constexpr std::uint32_t WORD_DEGREE = 6;
+        static constexpr std::size_t WORD_BITS = Utils::binPow(WORD_DEGREE);
+        // A leaf is ARRAY_SIZE words
+        static constexpr std::uint32_t LEAF_DEGREE = DEGREE_OF_TWO + WORD_DEGREE;
+        static constexpr std::size_t LEAF_BITS = Utils::binPow(LEAF_DEGREE);
+
+        using Words = std::array<std::uint64_t, ARRAY_SIZE>;
+
+    public:
+        // Returned by the searches when there is no set bit
+        static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+        class const_iterator {
+        public:
+            using iterator_category = std::input_iterator_tag;
+            using difference_type = std::ptrdiff_t;
+            using value_type = bool;
+            using pointer = const bool*;
+            using reference = bool;
+
+            const_iterator(std::size_t pos, const PersistentBitVector* pvector);
+
+            bool operator*() const;
+
+            const_iterator& operator++();
+            const_iterator operator++(int);
+
+            bool operator==(const const_iterator& other) const { return m_pos == other.m_pos && m_pvector == other.m_pvector; }
+            bool operator!=(const const_iterator& other) const { return !(*this == other); }
+
+        private:
+            void load();
+
+            std::size_t m_pos;
+            const PersistentBitVector* m_pvector;
+            const Words* m_words = nullptr;
+        };
+
+        PersistentBitVector() = default;
+        PersistentBitVector(const PersistentBitVector& other) = default;
+        PersistentBitVector(PersistentBitVector&& other) noexcept = default;
+
+        PersistentBitVector(std::size_t count, bool value);
+
+        template<typename InputIt, typename std::enable_if<is_iterator<InputIt>, bool>::type = false>
+        PersistentBitVector(InputIt first, InputIt last);
+
+        PersistentBitVector(std::initializer_list<bool> init) : PersistentBitVector(init.begin(), init.end()) {}
+
+        ~PersistentBitVector() = default;
+
+        PersistentBitVector& operator=(const PersistentBitVector& other) = default;
+        PersistentBitVector& operator=(PersistentBitVector&& other) noexcept = default;
+
+        const_iterator cbegin() const;
+        const_iterator cend() const;
+
+        bool operator[](std::size_t pos) const;
+        bool at(std::size_t pos) const;
+        bool front() const;
+        bool back() const;
+
+        std::size_t size() const;
+        bool empty() const;
+
+        // Number of the set bits, O(1)
+        std::size_t count() const;
+        bool any() const;
+        bool all() const;
+
+        // Position of the first set bit, npos if there is none
+        std::size_t find_first() const;
+        // Position of the first set bit after pos, npos if there is none
+        std::size_t find_next(std::size_t pos) const;
+
+        PersistentBitVector set(std::size_t pos, bool value = true) const;
+        PersistentBitVector flip(std::size_t pos) const;
+        PersistentBitVector push_back(bool value) const;
+        PersistentBitVector pop_back() const;
+
+        // Throw invalid_argument if the sizes of the vectors differ
+        PersistentBitVector operator&(const PersistentBitVector& other) const;
+        PersistentBitVector operator|(const PersistentBitVector& other) const;
+        PersistentBitVector operator^(const PersistentBitVector& other) const;
+
+        bool operator==(const PersistentBitVector& other) const;
+        bool operator!=(const PersistentBitVector& other) const;
+
+        MemoryUsage memoryUsage() const;
+        void accountMemory(MemoryAccountant& accountant) const;
+
+    private:
+        enum class Operation {
+            AND,
+            OR,
+            XOR
+        };
+
+        PersistentBitVector(std::shared_ptr<const Node> root, std::size_t size, std::uint32_t depth)
+            : m_root(std::move(root)), m_size(size), m_depth(depth) {}
+
+        // Takes the packed bits of a vector of the size, the bits after the last one are zero
+        PersistentBitVector(std::vector<std::uint64_t>&& words, std::size_t size);
+
+        // Words of the leaf holding the bit pos
+        const Words& leafAt(std::size_t pos) const;
+
+        PersistentBitVector combine(const PersistentBitVector& other, Operation operation) const;
+
+        // Number of the bits under a full node of the level
+        static std::size_t capacity(std::uint32_t level);
+        // Level of the root of a vector of the size
+        static std::uint32_t depthOf(std::size_t size);
+
+        using Children = std::array<std::shared_ptr<const Node>, ARRAY_SIZE>;
+
+        /*
+        *
+        *   Node - immutable node of the trie: a leaf holds the words of its bits, the bits after
+        *       the last one are zero; an interior node holds up to 32 children, all of them but the last one
+        *       are full. Level 0 is the level of the leaves. Positions passed to a node are relative to it.
+        *       Node is the header of both kinds, the storage is in LeafNode or InteriorNode only,
+        *       so neither kind carries the array of the other.
+        *
+        */
+        class Node {
+            friend class PersistentBitVector;
+        public:
+            bool isLeaf() const { return m_leaf; }
+            // All the bits under the node are set
+            bool isFull() const { return m_count == m_bits; }
+
+            const Words& leaf(std::size_t pos, std::uint32_t level) const;
+
+            std::shared_ptr<const Node> set(std::size_t pos, std::uint32_t level, bool value) const;
+            // There has to be room for one more bit under the node
+            std::shared_ptr<const Node> push_back(std::uint32_t level, bool value) const;
+            // nullptr if the subtree becomes empty
+            std::shared_ptr<const Node> pop_back(std::uint32_t level) const;
+
+            std::size_t findFrom(std::size_t pos, std::uint32_t level) const;
+
+            bool equals(const Node& other) const;
+
+            // Path from a new node of the level down to a leaf with the single bit
+            static std::shared_ptr<const Node> makePath(std::uint32_t level, bool value);
+
+            // Subtree of the bits of the value; full subtrees of a level are made once and stored in full
+            static std::shared_ptr<const Node> fill(std::size_t bits, std::uint32_t level, bool value,
+                std::vector<std::shared_ptr<const Node>>& full);
+
+            // Tree over the nodes of one level built level by level; the level of the result is written to depth
+            static std::shared_ptr<const Node> build(std::vector<std::shared_ptr<const Node>>&& nodes, std::uint32_t& depth);
+
+            // Nodes of the same level and size; the zero subtrees of ^ are made by fill() with the cache zeros
+            static std::shared_ptr<const Node> combine(const std::shared_ptr<const Node>& left,
+                const std::shared_ptr<const Node>& right, std::uint32_t level, Operation operation,
+                std::vector<std::shared_ptr<const Node>>& zeros);
+
+            void accountMemory(MemoryAccountant& accountant) const;
+
+        protected:
+            explicit Node(bool leaf) : m_leaf(leaf) {}
+            Node(const Node& other) = default;
+
+        private:
+            const LeafNode& asLeaf() const;
+            LeafNode& asLeaf();
+            const InteriorNode& asInterior() const;
+            InteriorNode& asInterior();
+
+            // Copy of the node of its own kind
+            std::shared_ptr<Node> copy() const;
+
+            bool m_leaf;
+            std::size_t m_bits = 0;
+            std::size_t m_count = 0;
+        };
+
+        class LeafNode : public Node {
+        public:
+            LeafNode(const Words& words, std::size_t bits);
+
+            Words m_words;
+        };
+
+        class InteriorNode : public Node {
+        public:
+            InteriorNode() : Node(false) {}
+
+            // Appends the child to a new interior node
+            void attach(std::shared_ptr<const Node> child);
+
+            Children m_children{};
+            std::size_t m_contentAmount = 0;
+        };
+
+        std::shared_ptr<const Node> m_root;
+        std::size_t m_size = 0;
+        std::uint32_t m_depth = 0;
+    };
+
+
+    template<typename InputIt, typename std::enable_if<is_iterator<InputIt>, bool>::type>
+    PersistentBitVector::PersistentBitVector(InputIt first, InputIt last) {
+        std::vector<std::uint64_t> words;
+        std::size_t size = 0;
+        for (; first != last; ++first, ++size) {
+            auto bit = size & (WORD_BITS - 1);
+            if (0 == bit) {
+                words.push_back(0);
+            }
+            if (*first) {
+                words.back() |= 1ull << bit;
+            }
+        }
+        *this = PersistentBitVector(std::move(words), size);
+    }
+
+    inline bool PersistentBitVector::operator[](std::size_t pos) const {
+        auto& words = leafAt(pos);
+        return 0 != ((words[(pos & (LEAF_BITS - 1)) >> WORD_DEGREE] >> (pos & (WORD_BITS - 1))) & 1ull);
+    }
+
+    inline std::size_t PersistentBitVector::size() const {
+        return m_size;
+    }
+
+    inline bool PersistentBitVector::empty() const {
+        return 0 == m_size;
+    }
+
+    inline const PersistentBitVector::Words& PersistentBitVector::leafAt(std::size_t pos) const {
+        return m_root->leaf(pos, m_depth);
+    }
+
+    inline const PersistentBitVector::Words& PersistentBitVector::Node::leaf(std::size_t pos, std::uint32_t level) const {
+        auto node = this;
+        for (; level > 0; --level) {
+            auto shift = LEAF_DEGREE + (level - 1) * DEGREE_OF_TWO;
+            node = node->asInterior().m_children[(pos >> shift) & MASK].get();
+        }
+        return node->asLeaf().m_words;
+    }
+
+    inline const PersistentBitVector::LeafNode& PersistentBitVector::Node::asLeaf() const {
+        return static_cast<const LeafNode&>(*this);
+    }
+
+    inline PersistentBitVector::LeafNode& PersistentBitVector::Node::asLeaf() {
+        return static_cast<LeafNode&>(*this);
+    }
+
+    inline const PersistentBitVector::InteriorNode& PersistentBitVector::Node::asInterior() const {
+        return static_cast<const InteriorNode&>(*this);
+    }
+
+    inline PersistentBitVector::InteriorNode& PersistentBitVector::Node::asInterior() {
+        return static_cast<InteriorNode&>(*this);
+    }
+
+    inline bool PersistentBitVector::const_iterator::operator*() const {
+        return 0 != (((*m_words)[(m_pos & (LEAF_BITS - 1)) >> WORD_DEGREE] >> (m_pos & (WORD_BITS - 1))) & 1ull);
+    }
+
+    inline PersistentBitVector::const_iterator& PersistentBitVector::const_iterator::operator++() {
+        ++m_pos;
+        if (0 == (m_pos & (LEAF_BITS - 1))) {
+            load();
+        }
+        return *this;
+    }
+
+    inline PersistentBitVector::const_iterator PersistentBitVector::const_iterator::operator++(int) {
+        auto out = *this;
+        ++(*this);
+        return out;
+    }
+}
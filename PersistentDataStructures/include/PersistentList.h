@@ -1,23 +1,29 @@
 #pragma once
+#include "MemoryUsage.h"
+#include "Statistics.h"
+#include "RefCountPolicy.h"
+#include "ReclamationQueue.h"
+
 #include <memory>
 #include <vector>
+#include <stack>
 #include <iterator>
 
 namespace pds
 {
-	template <typename T>
+	template <typename T, typename RefCount>
 	class root_node;
 
-	template <typename T>
+	template <typename T, typename RefCount>
 	class list_fat_node;
 
-	template <typename T>
+	template <typename T, typename RefCount>
 	class node
 	{
 		int m_version;
 		T m_value;
-		std::shared_ptr<list_fat_node<T>> m_prev;
-		std::shared_ptr<list_fat_node<T>> m_next;
+		typename RefCount::template pointer<list_fat_node<T, RefCount>> m_prev;
+		typename RefCount::template pointer<list_fat_node<T, RefCount>> m_next;
 
 	public:
 		int get_version() const
@@ -30,42 +36,49 @@ namespace pds
 			return m_value;
 		}
 
-		std::shared_ptr<list_fat_node<T>> get_prev()
+		typename RefCount::template pointer<list_fat_node<T, RefCount>> get_prev()
 		{
 			return m_prev;
 		}
 
-		std::shared_ptr<list_fat_node<T>> get_next()
+		typename RefCount::template pointer<list_fat_node<T, RefCount>> get_next()
 		{
 			return m_next;
 		}
 
-		void set_prev(std::shared_ptr<list_fat_node<T>> prev)
+		void set_prev(typename RefCount::template pointer<list_fat_node<T, RefCount>> prev)
 		{
 			m_prev = prev;
 		}
 
-		void set_next(std::shared_ptr<list_fat_node<T>> next)
+		void set_next(typename RefCount::template pointer<list_fat_node<T, RefCount>> next)
 		{
 			m_next = next;
 		}
 
-		node(int version, T value, std::shared_ptr<list_fat_node<T>> prev,
-             std::shared_ptr<list_fat_node<T>> next) : m_version(version), m_value(value),
+		void releaseChildren(ReclamationQueue& queue)
+		{
+			queue.push(std::move(m_prev));
+			queue.push(std::move(m_next));
+		}
+
+		node(int version, T value, typename RefCount::template pointer<list_fat_node<T, RefCount>> prev,
+             typename RefCount::template pointer<list_fat_node<T, RefCount>> next) : m_version(version), m_value(value),
 		                                                    m_prev(prev), m_next(next)
 		{
+			PDS_COUNT(NODE_ALLOCATIONS, 1);
 		}
 	};
 
-	template <typename T>
+	template <typename T, typename RefCount>
 	class root_node
 	{
 		int m_version;
 		int m_size;
-		std::shared_ptr<root_node<T>> m_parent;
-		std::shared_ptr<root_node<T>> m_child;
-		std::shared_ptr<list_fat_node<T>> m_front;
-		std::shared_ptr<list_fat_node<T>> m_back;
+		typename RefCount::template pointer<root_node<T, RefCount>> m_parent;
+		typename RefCount::template pointer<root_node<T, RefCount>> m_child;
+		typename RefCount::template pointer<list_fat_node<T, RefCount>> m_front;
+		typename RefCount::template pointer<list_fat_node<T, RefCount>> m_back;
 
 	public:
 		int get_version() const
@@ -78,45 +91,53 @@ namespace pds
 			return m_size;
 		}
 
-		std::shared_ptr<root_node<T>> get_parent()
+		typename RefCount::template pointer<root_node<T, RefCount>> get_parent()
 		{
 			return m_parent;
 		}
 
-		std::shared_ptr<list_fat_node<T>> front()
+		typename RefCount::template pointer<list_fat_node<T, RefCount>> front()
 		{
 			return m_front;
 		}
 
-		std::shared_ptr<list_fat_node<T>> back()
+		typename RefCount::template pointer<list_fat_node<T, RefCount>> back()
 		{
 			return m_back;
 		}
 
 
-		void set_front(std::shared_ptr<list_fat_node<T>> front)
+		void set_front(typename RefCount::template pointer<list_fat_node<T, RefCount>> front)
 		{
 			m_front = front;
 		}
 
-		void set_back(std::shared_ptr<list_fat_node<T>> back)
+		void set_back(typename RefCount::template pointer<list_fat_node<T, RefCount>> back)
 		{
 			m_back = back;
 		}
 
-		std::shared_ptr<root_node<T>> get_child()
+		typename RefCount::template pointer<root_node<T, RefCount>> get_child()
 		{
 			return m_child;
 		}
 
-		void set_child(std::shared_ptr<root_node<T>> child)
+		void set_child(typename RefCount::template pointer<root_node<T, RefCount>> child)
 		{
 			m_child = child;
 		}
 
-		root_node(int version, int size, std::shared_ptr<list_fat_node<T>> front,
-                  std::shared_ptr<list_fat_node<T>> back,
-                  std::shared_ptr<root_node<T>> parent)
+		void releaseChildren(ReclamationQueue& queue)
+		{
+			queue.push(std::move(m_parent));
+			queue.push(std::move(m_child));
+			queue.push(std::move(m_front));
+			queue.push(std::move(m_back));
+		}
+
+		root_node(int version, int size, typename RefCount::template pointer<list_fat_node<T, RefCount>> front,
+                  typename RefCount::template pointer<list_fat_node<T, RefCount>> back,
+                  typename RefCount::template pointer<root_node<T, RefCount>> parent)
 		{
 			m_version = version;
 			m_size = size;
@@ -126,38 +147,41 @@ namespace pds
 		}
 	};
 
-	template <typename T>
+	template <typename T, typename RefCount>
 	class list_fat_node
 	{
-		const int m_maxSize = 2;
+		const std::size_t m_maxSize = 2;
 
 	public:
-		std::vector<std::shared_ptr<node<T>>> m_nodes;
+		std::vector<typename RefCount::template pointer<node<T, RefCount>>> m_nodes;
 
-		std::vector<std::shared_ptr<node<T>>>& get_nodes()
+		std::vector<typename RefCount::template pointer<node<T, RefCount>>>& get_nodes()
 		{
 			return m_nodes;
 		}
 
-		list_fat_node() : m_nodes(std::vector<std::shared_ptr<node<T>>>())
+		list_fat_node() : m_nodes(std::vector<typename RefCount::template pointer<node<T, RefCount>>>())
 		{
+			PDS_COUNT(NODE_ALLOCATIONS, 1);
 		}
 
-		list_fat_node(std::shared_ptr<node<T>> node) : m_nodes(std::vector<std::shared_ptr<node<T>>>{node})
+		list_fat_node(typename RefCount::template pointer<node<T, RefCount>> n) : m_nodes(std::vector<typename RefCount::template pointer<node<T, RefCount>>>{n})
 		{
+			PDS_COUNT(NODE_ALLOCATIONS, 1);
 		}
 
-		void add_node(std::shared_ptr<node<T>> n)
+		void add_node(typename RefCount::template pointer<node<T, RefCount>> n)
 		{
 			m_nodes.push_back(n);
 		}
 
-		std::shared_ptr<node<T>> find_node(std::shared_ptr<root_node<T>> version_node)
+		typename RefCount::template pointer<node<T, RefCount>> find_node(typename RefCount::template pointer<root_node<T, RefCount>> version_node)
 		{
 			auto it = version_node;
 			while (it != nullptr)
 			{
-				for (int i = 0; i < m_nodes.size(); i++)
+				PDS_COUNT(FIND_NODE_STEPS, 1);
+				for (std::size_t i = 0; i < m_nodes.size(); i++)
 				{
 					if (m_nodes[i]->get_version() == it->get_version())
 					{
@@ -180,21 +204,30 @@ namespace pds
 			return m_nodes.size() == 0;
 		}
 
-		static std::shared_ptr<list_fat_node<T>> update_next(std::shared_ptr<list_fat_node<T>> fat_node,
-		                                                     std::shared_ptr<list_fat_node<T>> next_node,
-		                                                     std::shared_ptr<root_node<T>> version_node)
+		void releaseChildren(ReclamationQueue& queue)
+		{
+			for (auto& n : m_nodes)
+			{
+				queue.push(std::move(n));
+			}
+			m_nodes.clear();
+		}
+
+		static typename RefCount::template pointer<list_fat_node<T, RefCount>> update_next(typename RefCount::template pointer<list_fat_node<T, RefCount>> fat_node,
+		                                                     typename RefCount::template pointer<list_fat_node<T, RefCount>> next_node,
+		                                                     typename RefCount::template pointer<root_node<T, RefCount>> version_node)
 		{
 			auto found_node = fat_node->find_node(version_node);
-			auto new_node = std::make_shared<node<T>>(version_node->get_version(), found_node->get_value(),
+			auto new_node = RefCount::template make<node<T, RefCount>>(version_node->get_version(), found_node->get_value(),
                                                       found_node->get_prev(), next_node);
 
 			if (fat_node->is_full())
 			{
-				auto fat = std::make_shared<list_fat_node<T>>();
+				auto fat = RefCount::template make<list_fat_node<T, RefCount>>();
 				fat->add_node(new_node);
 				if (found_node->get_prev() != nullptr)
 				{
-					new_node->set_prev(list_fat_node<T>::update_next(found_node->get_prev(), fat, version_node));
+					new_node->set_prev(list_fat_node<T, RefCount>::update_next(found_node->get_prev(), fat, version_node));
 				}
 				else
 				{
@@ -208,18 +241,18 @@ namespace pds
 			return fat_node;
 		}
 
-		static std::shared_ptr<list_fat_node<T>> update_prev(std::shared_ptr<list_fat_node<T>> fat_node,
-		                                                     std::shared_ptr<list_fat_node<T>> prev_node,
-		                                                     std::shared_ptr<root_node<T>> version_node)
+		static typename RefCount::template pointer<list_fat_node<T, RefCount>> update_prev(typename RefCount::template pointer<list_fat_node<T, RefCount>> fat_node,
+		                                                     typename RefCount::template pointer<list_fat_node<T, RefCount>> prev_node,
+		                                                     typename RefCount::template pointer<root_node<T, RefCount>> version_node)
 		{
 			auto found_node = fat_node->find_node(version_node);
-			auto new_node = std::make_shared<node<T>>(version_node->get_version(), found_node->get_value(),
+			auto new_node = RefCount::template make<node<T, RefCount>>(version_node->get_version(), found_node->get_value(),
                                                       prev_node,
                                                       found_node->get_next());
 
 			if (fat_node->is_full())
 			{
-				auto fat = std::make_shared<list_fat_node<T>>();
+				auto fat = RefCount::template make<list_fat_node<T, RefCount>>();
 				fat->add_node(new_node);
 				if (found_node->get_next() != nullptr)
 				{
@@ -237,11 +270,11 @@ namespace pds
 		}
 	};
 
-	template <typename T>
+	template <typename T, typename RefCount = AtomicRefCount>
 	class list_const_iterator
 	{
-		std::shared_ptr<list_fat_node<T>> m_node;
-		std::shared_ptr<root_node<T>> m_root;
+		typename RefCount::template pointer<list_fat_node<T, RefCount>> m_node;
+		typename RefCount::template pointer<root_node<T, RefCount>> m_root;
 
 	public:
 		using pointer = const T*;
@@ -249,8 +282,8 @@ namespace pds
 
 		list_const_iterator() = delete;
 
-		list_const_iterator(std::shared_ptr<list_fat_node<T>> node,
-		                    std::shared_ptr<root_node<T>> root)
+		list_const_iterator(typename RefCount::template pointer<list_fat_node<T, RefCount>> node,
+		                    typename RefCount::template pointer<root_node<T, RefCount>> root)
 		{
 			m_node = node;
 			m_root = root;
@@ -276,74 +309,74 @@ namespace pds
 		inline bool operator!=(const list_const_iterator& other) const;
 	};
 
-	template <typename T>
-	inline const T& list_const_iterator<T>::operator*() const
+	template <typename T, typename RefCount>
+	inline const T& list_const_iterator<T, RefCount>::operator*() const
 	{
 		return m_node->find_node(m_root)->get_value();
 	}
 
-	template <typename T>
-	inline const T* list_const_iterator<T>::operator->() const
+	template <typename T, typename RefCount>
+	inline const T* list_const_iterator<T, RefCount>::operator->() const
 	{
 		return &(m_node->find_node(m_root)->get_value());
 	}
 
-	template <typename T>
-	inline list_const_iterator<T>& list_const_iterator<T>::operator++()
+	template <typename T, typename RefCount>
+	inline list_const_iterator<T, RefCount>& list_const_iterator<T, RefCount>::operator++()
 	{
 		m_node = m_node->find_node(m_root)->get_next();
 		return *this;
 	}
 
-	template <typename T>
-	inline list_const_iterator<T>& list_const_iterator<T>::operator--()
+	template <typename T, typename RefCount>
+	inline list_const_iterator<T, RefCount>& list_const_iterator<T, RefCount>::operator--()
 	{
 		m_node = m_node->find_node(m_root)->get_prev();
 		return *this;
 	}
 
-	template <typename T>
-	inline const list_const_iterator<T> list_const_iterator<T>::operator++(int)
+	template <typename T, typename RefCount>
+	inline const list_const_iterator<T, RefCount> list_const_iterator<T, RefCount>::operator++(int)
 	{
 		auto copy = *this;
 		m_node = m_node->find_node(m_root)->get_next();
 		return copy;
 	}
 
-	template <typename T>
-	inline const list_const_iterator<T> list_const_iterator<T>::operator--(int)
+	template <typename T, typename RefCount>
+	inline const list_const_iterator<T, RefCount> list_const_iterator<T, RefCount>::operator--(int)
 	{
 		auto copy = *this;
 		m_node = m_node->find_node(m_root)->get_prev();
 		return copy;
 	}
 
-	template <typename T>
-	inline bool list_const_iterator<T>::operator==(const list_const_iterator<T>& other) const
+	template <typename T, typename RefCount>
+	inline bool list_const_iterator<T, RefCount>::operator==(const list_const_iterator<T, RefCount>& other) const
 	{
 		return m_node == other.m_node && m_root->get_version() == other.m_root->get_version();
 	}
 
-	template <typename T>
-	inline bool list_const_iterator<T>::operator!=(const list_const_iterator<T>& other) const
+	template <typename T, typename RefCount>
+	inline bool list_const_iterator<T, RefCount>::operator!=(const list_const_iterator<T, RefCount>& other) const
 	{
 		return !(*this == other);
 	}
 
-	template <typename T>
+	template <typename T, typename RefCount = AtomicRefCount>
 	class persistent_linked_list
 	{
-		///Persistent list
-		std::shared_ptr<int> m_versionPtr;
-		std::shared_ptr<root_node<T>> m_root;
+		///Persistent list, RefCount selects atomic or single-threaded reference counting (see RefCountPolicy.h)
+		typename RefCount::template pointer<int> m_versionPtr;
+		typename RefCount::template pointer<root_node<T, RefCount>> m_root;
 
-		persistent_linked_list(std::shared_ptr<int> version, std::shared_ptr<root_node<T>> root)
+		persistent_linked_list(typename RefCount::template pointer<int> version, typename RefCount::template pointer<root_node<T, RefCount>> root)
 		{
 			m_versionPtr = std::move(version);
 			m_root = root;
 		}
 
-		std::shared_ptr<list_fat_node<T>> get_node_by_index(int index)
+		typename RefCount::template pointer<list_fat_node<T, RefCount>> get_node_by_index(int index)
 		{
 			auto it = m_root->front();
 			for (auto i = 0; i < index; i++)
@@ -354,81 +387,81 @@ namespace pds
 			return it;
 		}
 
-		persistent_linked_list<T> remove_by_node(std::shared_ptr<list_fat_node<T>> fat_node)
+		persistent_linked_list<T, RefCount> remove_by_node(typename RefCount::template pointer<list_fat_node<T, RefCount>> fat_node)
 		{
 			auto del_node = fat_node->find_node(m_root);
 			if (del_node->get_prev() == nullptr && del_node->get_next() == nullptr)
 			{
-				auto newV = std::make_shared<root_node<T>>(++(*m_versionPtr), m_root->size() - 1,
-                                                           std::make_shared<list_fat_node<T>>(),
-                                                           std::make_shared<list_fat_node<T>>(), m_root);
-				return persistent_linked_list<T>(m_versionPtr, newV);
+				auto newV = RefCount::template make<root_node<T, RefCount>>(++(*m_versionPtr), m_root->size() - 1,
+                                                           RefCount::template make<list_fat_node<T, RefCount>>(),
+                                                           RefCount::template make<list_fat_node<T, RefCount>>(), m_root);
+				return persistent_linked_list<T, RefCount>(m_versionPtr, newV);
 			}
 
-			auto new_version = std::make_shared<root_node<T>>(++(*m_versionPtr), m_root->size() - 1, m_root->front(),
+			auto new_version = RefCount::template make<root_node<T, RefCount>>(++(*m_versionPtr), m_root->size() - 1, m_root->front(),
                                                               m_root->back(),
                                                               m_root);
 			if (del_node->get_next() == nullptr)
 			{
-				auto new_left = list_fat_node<T>::update_next(del_node->get_prev(), nullptr, new_version);
+				auto new_left = list_fat_node<T, RefCount>::update_next(del_node->get_prev(), nullptr, new_version);
 				if (fat_node == m_root->back())
 				{
 					new_version->set_back(new_left);
 				}
 
-				return persistent_linked_list<T>(m_versionPtr, new_version);
+				return persistent_linked_list<T, RefCount>(m_versionPtr, new_version);
 			}
 
 			if (del_node->get_prev() == nullptr)
 			{
-				auto new_right = list_fat_node<T>::update_prev(del_node->get_next(), nullptr, new_version);
+				auto new_right = list_fat_node<T, RefCount>::update_prev(del_node->get_next(), nullptr, new_version);
 				if (fat_node == m_root->front())
 				{
 					new_version->set_front(new_right);
 				}
 
-				return persistent_linked_list<T>(m_versionPtr, new_version);
+				return persistent_linked_list<T, RefCount>(m_versionPtr, new_version);
 			}
 
 			if (!del_node->get_next()->is_full())
 			{
-				auto new_left = list_fat_node<T>::update_next(del_node->get_prev(), del_node->get_next(),
+				auto new_left = list_fat_node<T, RefCount>::update_next(del_node->get_prev(), del_node->get_next(),
 				                                              new_version);
-				auto new_right = list_fat_node<T>::update_prev(del_node->get_next(), del_node->get_prev(),
+				auto new_right = list_fat_node<T, RefCount>::update_prev(del_node->get_next(), del_node->get_prev(),
 				                                               new_version);
-				return persistent_linked_list<T>(m_versionPtr, new_version);
+				return persistent_linked_list<T, RefCount>(m_versionPtr, new_version);
 			}
 
-			auto fake_left = std::make_shared<list_fat_node<T>>();
-			auto new_right_node = list_fat_node<T>::update_prev(del_node->get_next(), fake_left, new_version);
-			auto new_left_node = list_fat_node<T>::update_next(del_node->get_prev(), new_right_node, new_version);
+			auto fake_left = RefCount::template make<list_fat_node<T, RefCount>>();
+			auto new_right_node = list_fat_node<T, RefCount>::update_prev(del_node->get_next(), fake_left, new_version);
+			auto new_left_node = list_fat_node<T, RefCount>::update_next(del_node->get_prev(), new_right_node, new_version);
 			new_right_node->get_nodes()[0]->set_prev(new_left_node);
 
-			return persistent_linked_list<T>(m_versionPtr, new_version);
+			return persistent_linked_list<T, RefCount>(m_versionPtr, new_version);
 		}
 
-		persistent_linked_list<T> init_root(T value)
+		persistent_linked_list<T, RefCount> init_root(T value)
 		{
 			auto v = ++(*m_versionPtr);
-			auto new_node = std::make_shared<node<T>>(v, value, std::shared_ptr<list_fat_node<T>>(nullptr),
-                                                      std::shared_ptr<list_fat_node<T>>(nullptr));
-			auto new_fat_node = std::make_shared<list_fat_node<T>>(new_node);
+			auto new_node = RefCount::template make<node<T, RefCount>>(v, value, typename RefCount::template pointer<list_fat_node<T, RefCount>>(nullptr),
+                                                      typename RefCount::template pointer<list_fat_node<T, RefCount>>(nullptr));
+			auto new_fat_node = RefCount::template make<list_fat_node<T, RefCount>>(new_node);
 
-			auto new_version = std::make_shared<root_node<T>>(v, m_root->size() + 1, new_fat_node, new_fat_node,
+			auto new_version = RefCount::template make<root_node<T, RefCount>>(v, m_root->size() + 1, new_fat_node, new_fat_node,
                                                               m_root);
 
-			return persistent_linked_list<T>(m_versionPtr, new_version);
+			return persistent_linked_list<T, RefCount>(m_versionPtr, new_version);
 		}
 
 	public:
-		using const_iterator = list_const_iterator<T>;
+		using const_iterator = list_const_iterator<T, RefCount>;
 		using const_reverse_iterator = std::reverse_iterator<const_iterator>;
 
-		persistent_linked_list(): m_versionPtr(std::make_shared<int>(0)),
-		                          m_root(std::make_shared<root_node<T>>(
-			                          ++(*m_versionPtr), 0, std::make_shared<list_fat_node<T>>(),
-			                          std::make_shared<list_fat_node<T>>(),
-			                          std::shared_ptr<root_node<T>>(nullptr)))
+		persistent_linked_list(): m_versionPtr(RefCount::template make<int>(0)),
+		                          m_root(RefCount::template make<root_node<T, RefCount>>(
+			                          ++(*m_versionPtr), 0, RefCount::template make<list_fat_node<T, RefCount>>(),
+			                          RefCount::template make<list_fat_node<T, RefCount>>(),
+			                          typename RefCount::template pointer<root_node<T, RefCount>>(nullptr)))
 		{
 		}
 
@@ -442,20 +475,20 @@ namespace pds
 		persistent_linked_list(InputIterator first, InputIterator last)
 		{
 			int v = 1;
-			m_versionPtr = std::make_shared<int>(v);
+			m_versionPtr = RefCount::template make<int>(v);
 			int size = 0;
 
-			auto prev_node = std::shared_ptr<node<T>>(nullptr);
-			auto prev_fat = std::shared_ptr<list_fat_node<T>>(nullptr);
+			auto prev_node = typename RefCount::template pointer<node<T, RefCount>>(nullptr);
+			auto prev_fat = typename RefCount::template pointer<list_fat_node<T, RefCount>>(nullptr);
 
-			std::shared_ptr<list_fat_node<T>> front;
+			typename RefCount::template pointer<list_fat_node<T, RefCount>> front;
 
 			for (; first != last; ++first)
 			{
 				size++;
-				auto new_node = std::make_shared<node<T>>(v, *first, prev_fat,
-                                                          std::shared_ptr<list_fat_node<T>>(nullptr));
-				auto new_fat = std::make_shared<list_fat_node<T>>(new_node);
+				auto new_node = RefCount::template make<node<T, RefCount>>(v, *first, prev_fat,
+                                                          typename RefCount::template pointer<list_fat_node<T, RefCount>>(nullptr));
+				auto new_fat = RefCount::template make<list_fat_node<T, RefCount>>(new_node);
 
 				if (size == 1)
 				{
@@ -470,8 +503,8 @@ namespace pds
 				prev_fat = new_fat;
 			}
 
-			m_root = std::make_shared<root_node<T>>(v, size, front, prev_fat,
-                                                    std::shared_ptr<root_node<T>>(nullptr));
+			m_root = RefCount::template make<root_node<T, RefCount>>(v, size, front, prev_fat,
+                                                    typename RefCount::template pointer<root_node<T, RefCount>>(nullptr));
 		}
 
 		const_iterator cbegin() const
@@ -504,17 +537,17 @@ namespace pds
 			return m_root->back()->find_node(m_root)->get_value();
 		}
 
-		persistent_linked_list<T> pop_back()
+		persistent_linked_list<T, RefCount> pop_back()
 		{
 			return remove_by_node(m_root->back());
 		}
 
-		persistent_linked_list<T> pop_front()
+		persistent_linked_list<T, RefCount> pop_front()
 		{
 			return remove_by_node(m_root->front());
 		}
 
-		persistent_linked_list<T> insert(int index, T value)
+		persistent_linked_list<T, RefCount> insert(int index, T value)
 		{
 			if (index < 0 || index > m_root->size())
 			{
@@ -527,29 +560,29 @@ namespace pds
 			}
 
 			auto v = ++(*m_versionPtr);
-			auto new_node = std::make_shared<node<T>>(v, value, std::shared_ptr<list_fat_node<T>>(nullptr),
-                                                      std::shared_ptr<list_fat_node<T>>(nullptr));
-			auto new_fat_node = std::make_shared<list_fat_node<T>>(new_node);
+			auto new_node = RefCount::template make<node<T, RefCount>>(v, value, typename RefCount::template pointer<list_fat_node<T, RefCount>>(nullptr),
+                                                      typename RefCount::template pointer<list_fat_node<T, RefCount>>(nullptr));
+			auto new_fat_node = RefCount::template make<list_fat_node<T, RefCount>>(new_node);
 
 			auto front = m_root->front();
 			if (front->is_empty())
 			{
-				return persistent_linked_list<T>(m_versionPtr,
-				                                 std::make_shared<root_node<T>>(
+				return persistent_linked_list<T, RefCount>(m_versionPtr,
+				                                 RefCount::template make<root_node<T, RefCount>>(
 					                                 v, m_root->size() + 1, new_fat_node, new_fat_node, m_root));
 			}
 
-			auto newVersion = std::make_shared<root_node<T>>(v, m_root->size() + 1, m_root->front(), m_root->back(),
+			auto newVersion = RefCount::template make<root_node<T, RefCount>>(v, m_root->size() + 1, m_root->front(), m_root->back(),
                                                              m_root);
 			if (index == 0)
 			{
-				new_node->set_next(list_fat_node<T>::update_prev(front, new_fat_node, newVersion));
+				new_node->set_next(list_fat_node<T, RefCount>::update_prev(front, new_fat_node, newVersion));
 				newVersion->set_front(new_fat_node);
-				return persistent_linked_list<T>(m_versionPtr, newVersion);
+				return persistent_linked_list<T, RefCount>(m_versionPtr, newVersion);
 			}
 
 			auto prev_inserting = get_node_by_index(index - 1);
-			new_node->set_prev(list_fat_node<T>::update_next(prev_inserting, new_fat_node, newVersion));
+			new_node->set_prev(list_fat_node<T, RefCount>::update_next(prev_inserting, new_fat_node, newVersion));
 			auto next_inserting = prev_inserting->find_node(m_root)->get_next();
 
 			if (next_inserting == nullptr)
@@ -558,13 +591,13 @@ namespace pds
 			}
 			else
 			{
-				new_node->set_next(list_fat_node<T>::update_prev(next_inserting, new_fat_node, newVersion));
+				new_node->set_next(list_fat_node<T, RefCount>::update_prev(next_inserting, new_fat_node, newVersion));
 			}
 
-			return persistent_linked_list<T>(m_versionPtr, newVersion);
+			return persistent_linked_list<T, RefCount>(m_versionPtr, newVersion);
 		}
 
-		persistent_linked_list<T> set(int index, T value)
+		persistent_linked_list<T, RefCount> set(int index, T value)
 		{
 			if (index < 0 || index > m_root->size())
 			{
@@ -576,21 +609,21 @@ namespace pds
 
 			auto v = ++(*m_versionPtr);
 			auto newNode
-				= std::make_shared<node<T>>(v, value, foundNode->get_prev(), foundNode->get_next());
-			auto newVersion = std::make_shared<root_node<T>>(v, m_root->size(), m_root->front(), m_root->back(),
+				= RefCount::template make<node<T, RefCount>>(v, value, foundNode->get_prev(), foundNode->get_next());
+			auto newVersion = RefCount::template make<root_node<T, RefCount>>(v, m_root->size(), m_root->front(), m_root->back(),
                                                              m_root);
 
 			if (!setFatNode->is_full())
 			{
 				setFatNode->add_node(newNode);
-				return persistent_linked_list<T>(m_versionPtr, newVersion);
+				return persistent_linked_list<T, RefCount>(m_versionPtr, newVersion);
 			}
 
-			auto newFatNode = std::make_shared<list_fat_node<T>>(newNode);
+			auto newFatNode = RefCount::template make<list_fat_node<T, RefCount>>(newNode);
 
 			if (newNode->get_prev() != nullptr)
 			{
-				newNode->set_prev(list_fat_node<T>::update_next(foundNode->get_prev(), newFatNode, newVersion));
+				newNode->set_prev(list_fat_node<T, RefCount>::update_next(foundNode->get_prev(), newFatNode, newVersion));
 			}
 			else
 			{
@@ -599,17 +632,17 @@ namespace pds
 
 			if (newNode->get_next() != nullptr)
 			{
-				newNode->set_next(list_fat_node<T>::update_prev(foundNode->get_next(), newFatNode, newVersion));
+				newNode->set_next(list_fat_node<T, RefCount>::update_prev(foundNode->get_next(), newFatNode, newVersion));
 			}
 			else
 			{
 				newVersion->set_back(newFatNode);
 			}
 
-			return persistent_linked_list<T>(m_versionPtr, newVersion);
+			return persistent_linked_list<T, RefCount>(m_versionPtr, newVersion);
 		}
 
-		persistent_linked_list<T> push_back(T value)
+		persistent_linked_list<T, RefCount> push_back(T value)
 		{
 			if (m_root->size() == 0)
 			{
@@ -617,15 +650,15 @@ namespace pds
 			}
 
 			auto v = ++(*m_versionPtr);
-			auto newNode = std::make_shared<node<T>>(v, value, std::shared_ptr<list_fat_node<T>>(nullptr),
-                                                     std::shared_ptr<list_fat_node<T>>(nullptr));
-			auto newFatNode = std::make_shared<list_fat_node<T>>(newNode);
+			auto newNode = RefCount::template make<node<T, RefCount>>(v, value, typename RefCount::template pointer<list_fat_node<T, RefCount>>(nullptr),
+                                                     typename RefCount::template pointer<list_fat_node<T, RefCount>>(nullptr));
+			auto newFatNode = RefCount::template make<list_fat_node<T, RefCount>>(newNode);
 
-			auto newVersion = std::make_shared<root_node<T>>(v, m_root->size() + 1, m_root->front(), newFatNode,
+			auto newVersion = RefCount::template make<root_node<T, RefCount>>(v, m_root->size() + 1, m_root->front(), newFatNode,
                                                              m_root);
-			newNode->set_prev(list_fat_node<T>::update_next(m_root->back(), newFatNode, newVersion));
+			newNode->set_prev(list_fat_node<T, RefCount>::update_next(m_root->back(), newFatNode, newVersion));
 
-			return persistent_linked_list<T>(m_versionPtr, newVersion);
+			return persistent_linked_list<T, RefCount>(m_versionPtr, newVersion);
 		}
 
 		int size() const
@@ -638,7 +671,7 @@ namespace pds
 			return m_root->size() == 0;
 		}
 
-		persistent_linked_list<T> push_front(T value)
+		persistent_linked_list<T, RefCount> push_front(T value)
 		{
 			if (m_root->size() == 0)
 			{
@@ -646,32 +679,32 @@ namespace pds
 			}
 
 			auto v = ++(*m_versionPtr);
-			auto newNode = std::make_shared<node<T>>(v, value, std::shared_ptr<list_fat_node<T>>(nullptr),
-                                                     std::shared_ptr<list_fat_node<T>>(nullptr));
-			auto newFatNode = std::make_shared<list_fat_node<T>>(newNode);
+			auto newNode = RefCount::template make<node<T, RefCount>>(v, value, typename RefCount::template pointer<list_fat_node<T, RefCount>>(nullptr),
+                                                     typename RefCount::template pointer<list_fat_node<T, RefCount>>(nullptr));
+			auto newFatNode = RefCount::template make<list_fat_node<T, RefCount>>(newNode);
 
-			auto newVersion = std::make_shared<root_node<T>>(v, m_root->size() + 1, newFatNode, m_root->back(),
+			auto newVersion = RefCount::template make<root_node<T, RefCount>>(v, m_root->size() + 1, newFatNode, m_root->back(),
                                                              m_root);
-			newNode->set_next(list_fat_node<T>::update_prev(m_root->front(), newFatNode, newVersion));
+			newNode->set_next(list_fat_node<T, RefCount>::update_prev(m_root->front(), newFatNode, newVersion));
 
-			return persistent_linked_list<T>(m_versionPtr, newVersion);
+			return persistent_linked_list<T, RefCount>(m_versionPtr, newVersion);
 		}
 
-		persistent_linked_list<T> undo()
+		persistent_linked_list<T, RefCount> undo()
 		{
 			if (m_root->get_parent() == nullptr)
 			{
 				return *this;
 			}
 			auto p = m_root->get_parent();
-			auto new_root = std::make_shared<root_node<T>>(p->get_version(), p->size(), p->front(), p->back(),
+			auto new_root = RefCount::template make<root_node<T, RefCount>>(p->get_version(), p->size(), p->front(), p->back(),
                                                            p->get_parent());
 			new_root->set_child(m_root);
 
-			return persistent_linked_list<T>(m_versionPtr, new_root);
+			return persistent_linked_list<T, RefCount>(m_versionPtr, new_root);
 		}
 
-		persistent_linked_list<T> redo()
+		persistent_linked_list<T, RefCount> redo()
 		{
 			if (m_root->get_child() == nullptr)
 			{
@@ -679,11 +712,78 @@ namespace pds
 			}
 
 			auto p = m_root->get_child();
-			auto new_root = std::make_shared<root_node<T>>(p->get_version(), p->size(), p->front(), p->back(),
+			auto new_root = RefCount::template make<root_node<T, RefCount>>(p->get_version(), p->size(), p->front(), p->back(),
                                                            m_root);
 			new_root->set_child(p->get_child());
 
-			return persistent_linked_list<T>(m_versionPtr, new_root);
+			return persistent_linked_list<T, RefCount>(m_versionPtr, new_root);
+		}
+
+		// Drops this handle, the nodes left without owners are freed by the steps of the queue
+		// one by one instead of recursively (see ReclamationQueue.h); the list is left in the moved-from state
+		void retire(ReclamationQueue& queue) &&
+		{
+			queue.push(std::move(m_versionPtr));
+			queue.push(std::move(m_root));
+		}
+
+		// Memory held by this version including its undo/redo history
+		MemoryUsage memoryUsage() const
+		{
+			MemoryAccountant accountant;
+			accountMemory(accountant);
+			return accountant.usage();
+		}
+
+		void accountMemory(MemoryAccountant& accountant) const
+		{
+			using BlockType = MemoryAccountant::BlockType;
+			accountant.visit(m_versionPtr.get(), MemoryAccountant::sharedBlockSize<int>(), BlockType::VERSION_NODE);
+
+			// versions and nodes are linked in long chains, so they are walked without recursion
+			std::stack<typename RefCount::template pointer<root_node<T, RefCount>>> roots;
+			std::stack<typename RefCount::template pointer<list_fat_node<T, RefCount>>> fat_nodes;
+			roots.push(m_root);
+			while (!roots.empty())
+			{
+				auto root = roots.top();
+				roots.pop();
+				if (accountant.visit(root.get(), MemoryAccountant::sharedBlockSize<root_node<T, RefCount>>(), BlockType::VERSION_NODE))
+				{
+					roots.push(root->get_parent());
+					roots.push(root->get_child());
+					fat_nodes.push(root->front());
+					fat_nodes.push(root->back());
+				}
+			}
+
+			while (!fat_nodes.empty())
+			{
+				auto fat_node = fat_nodes.top();
+				fat_nodes.pop();
+				if (fat_node == nullptr)
+				{
+					continue;
+				}
+				auto fat_node_bytes = MemoryAccountant::sharedBlockSize<list_fat_node<T, RefCount>>()
+					+ fat_node->get_nodes().capacity() * sizeof(typename RefCount::template pointer<node<T, RefCount>>);
+				if (!accountant.visit(fat_node.get(), fat_node_bytes, BlockType::FAT_NODE))
+				{
+					continue;
+				}
+				for (auto& n : fat_node->get_nodes())
+				{
+					// the value is stored inside the node, so it is accounted separately from the node itself
+					auto node_bytes = MemoryAccountant::sharedBlockSize<node<T, RefCount>>() - sizeof(T);
+					if (accountant.visit(n.get(), node_bytes, BlockType::LIST_NODE))
+					{
+						accountant.visit(&n->get_value(), sizeof(T), BlockType::ELEMENT);
+						Utils::accountElementMemory(n->get_value(), accountant);
+						fat_nodes.push(n->get_prev());
+						fat_nodes.push(n->get_next());
+					}
+				}
+			}
 		}
 	};
 }
@@ -1,5 +1,8 @@
 #pragma once
 #include "PersistentVector.h"
+#include "MemoryUsage.h"
+#include "ReclamationQueue.h"
+#include "Statistics.h"
 #include "Utils.h"
 
 #include <memory>
@@ -10,10 +13,11 @@
 #include <utility>
 
 namespace pds {
-    template<typename Key, typename T, typename Hash = std::hash<Key>>
+    // RefCount selects atomic or single-threaded reference counting of the buckets (see RefCountPolicy.h)
+    template<typename Key, typename T, typename Hash = std::hash<Key>, typename RefCount = AtomicRefCount>
     class PersistentMap;
 
-    template<typename Key, typename T, typename Hash>
+    template<typename Key, typename T, typename Hash, typename RefCount>
     class PersistentMap {
         static constexpr std::size_t DEFAULT_INITIAL_SIZE = 256;
     public:
@@ -21,9 +25,9 @@ namespace pds {
         using const_iterator = map_const_iterator;
 
         class map_const_iterator {
-            const typename PersistentVector<PersistentVector<std::pair<Key, T>>>::const_iterator m_outer_end;
-            typename PersistentVector<PersistentVector<std::pair<Key, T>>>::const_iterator m_outer;
-            typename PersistentVector<std::pair<Key, T>>::const_iterator m_inner;
+            const typename PersistentVector<PersistentVector<std::pair<Key, T>, void, RefCount>, void, RefCount>::const_iterator m_outer_end;
+            typename PersistentVector<PersistentVector<std::pair<Key, T>, void, RefCount>, void, RefCount>::const_iterator m_outer;
+            typename PersistentVector<std::pair<Key, T>, void, RefCount>::const_iterator m_inner;
         public:
             using iterator_category = std::random_access_iterator_tag;
             using difference_type = std::ptrdiff_t;
@@ -32,9 +36,9 @@ namespace pds {
             using reference = const T&;
 
             map_const_iterator() = delete;
-            map_const_iterator(typename PersistentVector<PersistentVector<std::pair<Key, T>>>::const_iterator m_outer_end,
-                                typename PersistentVector<PersistentVector<std::pair<Key, T>>>::const_iterator m_outer,
-                                typename PersistentVector<std::pair<Key, T>>::const_iterator m_inner)
+            map_const_iterator(typename PersistentVector<PersistentVector<std::pair<Key, T>, void, RefCount>, void, RefCount>::const_iterator m_outer_end,
+                                typename PersistentVector<PersistentVector<std::pair<Key, T>, void, RefCount>, void, RefCount>::const_iterator m_outer,
+                                typename PersistentVector<std::pair<Key, T>, void, RefCount>::const_iterator m_inner)
                                 : m_outer_end(m_outer_end), m_outer(m_outer), m_inner(m_inner) {}
             map_const_iterator(const map_const_iterator& other) = default;
             map_const_iterator(map_const_iterator&& other) = default;
@@ -57,7 +61,7 @@ namespace pds {
         PersistentMap(std::size_t initial_size, const Hash& hash) :
             m_hash(hash),
             m_size(0),
-            m_vector(std::make_shared<PersistentVector<PersistentVector<std::pair<Key, T>>>>(initial_size)) {}
+            m_vector(RefCount::template make<PersistentVector<PersistentVector<std::pair<Key, T>, void, RefCount>, void, RefCount>>(initial_size)) {}
 
         PersistentMap() : PersistentMap(DEFAULT_INITIAL_SIZE, Hash()) {}
         PersistentMap(const PersistentMap& other) = default;
@@ -114,8 +118,16 @@ namespace pds {
         // if element does not exist throws out_of_range
         PersistentMap erase(const Key& key) const;
 
+        // Memory held by this version including its undo/redo history
+        MemoryUsage memoryUsage() const;
+        void accountMemory(MemoryAccountant& accountant) const;
+
+        // Drops this handle, the buckets left without owners are freed by the steps of the queue
+        // (see ReclamationQueue.h); the map is left in the moved-from state
+        void retire(ReclamationQueue& queue) &&;
+
     private:
-        PersistentMap(const Hash& hash, std::size_t size, std::shared_ptr<PersistentVector<PersistentVector<std::pair<Key, T>>>> vector) :
+        PersistentMap(const Hash& hash, std::size_t size, typename RefCount::template pointer<PersistentVector<PersistentVector<std::pair<Key, T>, void, RefCount>, void, RefCount>> vector) :
             m_hash(hash),
             m_size(size),
             m_vector(vector) {}
@@ -126,13 +138,13 @@ namespace pds {
         template<typename InputIt, typename std::enable_if<is_iterator<InputIt>, bool>::type = false>
         static std::vector<std::vector<std::pair<Key, T>>> getReallocatedVector(InputIt begin, InputIt end, std::size_t size, const Hash& hashFunc);
 
-        static std::vector<PersistentVector<std::pair<Key, T>>> getReallocatedVectorOfPersistentVectors(std::vector<std::vector<std::pair<Key, T>>> resetVector, std::size_t size);
+        static std::vector<PersistentVector<std::pair<Key, T>, void, RefCount>> getReallocatedVectorOfPersistentVectors(std::vector<std::vector<std::pair<Key, T>>> resetVector, std::size_t size);
 
-        std::vector<PersistentVector<std::pair<Key, T>>> getReallocatedVectorOfPersistentVectors(const Key& key, T value) const;
+        std::vector<PersistentVector<std::pair<Key, T>, void, RefCount>> getReallocatedVectorOfPersistentVectors(const Key& key, T value) const;
 
         Hash m_hash;
         std::size_t m_size;
-        std::shared_ptr<PersistentVector<PersistentVector<std::pair<Key, T>>>> m_vector;
+        typename RefCount::template pointer<PersistentVector<PersistentVector<std::pair<Key, T>, void, RefCount>, void, RefCount>> m_vector;
     };
 
     /*
@@ -148,21 +160,21 @@ namespace pds {
     *
     */
 
-    template<typename Key, typename T, typename Hash>
-    inline const std::pair<Key, T>& PersistentMap<Key, T, Hash>::map_const_iterator::operator*() const {
+    template<typename Key, typename T, typename Hash, typename RefCount>
+    inline const std::pair<Key, T>& PersistentMap<Key, T, Hash, RefCount>::map_const_iterator::operator*() const {
         return *m_inner;
     }
 
-    template<typename Key, typename T, typename Hash>
-    inline const std::pair<Key, T>* PersistentMap<Key, T, Hash>::map_const_iterator::operator->() const {
+    template<typename Key, typename T, typename Hash, typename RefCount>
+    inline const std::pair<Key, T>* PersistentMap<Key, T, Hash, RefCount>::map_const_iterator::operator->() const {
         return &(**this);
     }
 
-    template<typename Key, typename T, typename Hash>
-    inline typename PersistentMap<Key, T, Hash>::map_const_iterator& PersistentMap<Key, T, Hash>::map_const_iterator::operator++() {
+    template<typename Key, typename T, typename Hash, typename RefCount>
+    inline typename PersistentMap<Key, T, Hash, RefCount>::map_const_iterator& PersistentMap<Key, T, Hash, RefCount>::map_const_iterator::operator++() {
         ++m_inner;
         if (m_inner == m_outer->cend()) {
-            m_outer = std::find_if(++m_outer, m_outer_end, [](const PersistentVector<std::pair<Key, T>>& pvector) { return !pvector.empty(); });
+            m_outer = std::find_if(++m_outer, m_outer_end, [](const PersistentVector<std::pair<Key, T>, void, RefCount>& pvector) { return !pvector.empty(); });
             if (m_outer != m_outer_end) {
                 m_inner = m_outer->cbegin();
             }
@@ -170,20 +182,20 @@ namespace pds {
         return *this;
     }
 
-    template<typename Key, typename T, typename Hash>
-    inline typename PersistentMap<Key, T, Hash>::map_const_iterator PersistentMap<Key, T, Hash>::map_const_iterator::operator++(int) {
+    template<typename Key, typename T, typename Hash, typename RefCount>
+    inline typename PersistentMap<Key, T, Hash, RefCount>::map_const_iterator PersistentMap<Key, T, Hash, RefCount>::map_const_iterator::operator++(int) {
         auto copy = *this;
         operator++();
         return copy;
     }
 
-    template<typename Key, typename T, typename Hash>
-    inline bool PersistentMap<Key, T, Hash>::map_const_iterator::operator==(const map_const_iterator& other) const {
+    template<typename Key, typename T, typename Hash, typename RefCount>
+    inline bool PersistentMap<Key, T, Hash, RefCount>::map_const_iterator::operator==(const map_const_iterator& other) const {
         return m_outer == other.m_outer;
     }
 
-    template<typename Key, typename T, typename Hash>
-    inline bool PersistentMap<Key, T, Hash>::map_const_iterator::operator!=(const map_const_iterator& other) const {
+    template<typename Key, typename T, typename Hash, typename RefCount>
+    inline bool PersistentMap<Key, T, Hash, RefCount>::map_const_iterator::operator!=(const map_const_iterator& other) const {
         return !(*this == other);
     }
 
@@ -194,9 +206,9 @@ namespace pds {
     *
     */
 
-    template<typename Key, typename T, typename Hash>
+    template<typename Key, typename T, typename Hash, typename RefCount>
     template<typename InputIt, typename std::enable_if<is_iterator<InputIt>, bool>::type>
-    PersistentMap<Key, T, Hash>::PersistentMap(InputIt first, InputIt last, std::size_t initial_size, const Hash& hashFunc) : PersistentMap(initial_size, hashFunc) {
+    PersistentMap<Key, T, Hash, RefCount>::PersistentMap(InputIt first, InputIt last, std::size_t initial_size, const Hash& hashFunc) : PersistentMap(initial_size, hashFunc) {
         std::vector<std::vector<std::pair<Key, T>>> resetVector(initial_size);
         m_size = 0;
         for (auto it = first; it != last; ++it) {
@@ -206,82 +218,85 @@ namespace pds {
             }
         }
         auto vectorOfPersistentVectors = getReallocatedVectorOfPersistentVectors(resetVector, initial_size);
-        m_vector = std::make_shared<PersistentVector<PersistentVector<std::pair<Key, T>>>>(vectorOfPersistentVectors.cbegin(), vectorOfPersistentVectors.cend());
+        m_vector = RefCount::template make<PersistentVector<PersistentVector<std::pair<Key, T>, void, RefCount>, void, RefCount>>(vectorOfPersistentVectors.cbegin(), vectorOfPersistentVectors.cend());
     }
 
-    template<typename Key, typename T, typename Hash>
-    inline typename PersistentMap<Key, T, Hash>::const_iterator PersistentMap<Key, T, Hash>::cbegin() const {
-        auto it = std::find_if(m_vector->cbegin(), m_vector->cend(), [](const PersistentVector<std::pair<Key, T>>& pvector) { return !pvector.empty(); });
+    template<typename Key, typename T, typename Hash, typename RefCount>
+    inline typename PersistentMap<Key, T, Hash, RefCount>::const_iterator PersistentMap<Key, T, Hash, RefCount>::cbegin() const {
+        auto it = std::find_if(m_vector->cbegin(), m_vector->cend(), [](const PersistentVector<std::pair<Key, T>, void, RefCount>& pvector) { return !pvector.empty(); });
         return const_iterator(m_vector->cend(), it, it == m_vector->cend() ? m_vector->cbegin()->cbegin() : it->cbegin());
     }
 
-    template<typename Key, typename T, typename Hash>
-    inline typename PersistentMap<Key, T, Hash>::const_iterator PersistentMap<Key, T, Hash>::cend() const {
+    template<typename Key, typename T, typename Hash, typename RefCount>
+    inline typename PersistentMap<Key, T, Hash, RefCount>::const_iterator PersistentMap<Key, T, Hash, RefCount>::cend() const {
         return const_iterator(m_vector->cend(), m_vector->cend(), m_vector->cbegin()->cbegin());
     }
 
-    template<typename Key, typename T, typename Hash>
-    inline const T& PersistentMap<Key, T, Hash>::operator[](const Key& key) const {
+    template<typename Key, typename T, typename Hash, typename RefCount>
+    inline const T& PersistentMap<Key, T, Hash, RefCount>::operator[](const Key& key) const {
+        PDS_COUNT(BUCKET_LOOKUPS, 1);
         auto hash = m_hash(key) % m_vector->size();
-        auto it = std::find_if((*m_vector)[hash].cbegin(), (*m_vector)[hash].cend(), [&key](const std::pair<Key, T>& wrapper) { return key == wrapper.first; });
+        auto it = std::find_if((*m_vector)[hash].cbegin(), (*m_vector)[hash].cend(), [&key](const std::pair<Key, T>& wrapper) { PDS_COUNT(BUCKET_PROBES, 1); return key == wrapper.first; });
         return it->second;
     }
 
-    template<typename Key, typename T, typename Hash>
-    inline const T& PersistentMap<Key, T, Hash>::at(const Key& key) const {
+    template<typename Key, typename T, typename Hash, typename RefCount>
+    inline const T& PersistentMap<Key, T, Hash, RefCount>::at(const Key& key) const {
+        PDS_COUNT(BUCKET_LOOKUPS, 1);
         auto hash = m_hash(key) % m_vector->size();
         const auto& subseq = (*m_vector)[hash];
         if (subseq.empty()) {
             throw std::out_of_range("Key not found");
         }
-        auto it = std::find_if(subseq.cbegin(), subseq.cend(), [&key](const std::pair<Key, T>& wrapper) { return key == wrapper.first; });
+        auto it = std::find_if(subseq.cbegin(), subseq.cend(), [&key](const std::pair<Key, T>& wrapper) { PDS_COUNT(BUCKET_PROBES, 1); return key == wrapper.first; });
         if (it == subseq.cend()) {
             throw std::out_of_range("Key not found");
         }
         return it->second;
     }
 
-    template<typename Key, typename T, typename Hash>
-    inline PersistentMap<Key, T, Hash> PersistentMap<Key, T, Hash>::set(const Key& key, const T& value) const {
+    template<typename Key, typename T, typename Hash, typename RefCount>
+    inline PersistentMap<Key, T, Hash, RefCount> PersistentMap<Key, T, Hash, RefCount>::set(const Key& key, const T& value) const {
+        PDS_COUNT(BUCKET_LOOKUPS, 1);
         std::size_t newSize = m_size;
         auto hash = m_hash(key) % m_vector->size();
-        std::shared_ptr<PersistentVector<PersistentVector<std::pair<Key, T>>>> outVector;
+        typename RefCount::template pointer<PersistentVector<PersistentVector<std::pair<Key, T>, void, RefCount>, void, RefCount>> outVector;
         if ((*m_vector)[hash].empty()) {
             ++newSize;
             if (newSize > m_vector->size() / 2) {
                 auto reallocatedVector = getReallocatedVectorOfPersistentVectors(key, value);
-                outVector = std::make_shared<PersistentVector<PersistentVector<std::pair<Key, T>>>>(
+                outVector = RefCount::template make<PersistentVector<PersistentVector<std::pair<Key, T>, void, RefCount>, void, RefCount>>(
                     m_vector->reset(reallocatedVector.cbegin(), reallocatedVector.cend()));
             }
             else {
-                outVector = std::make_shared<PersistentVector<PersistentVector<std::pair<Key, T>>>>(
+                outVector = RefCount::template make<PersistentVector<PersistentVector<std::pair<Key, T>, void, RefCount>, void, RefCount>>(
                     m_vector->set(hash, (*m_vector)[hash].push_back(std::move(std::pair<Key, T>(key, value)))));
             }
         }
         else {
-            auto collided = std::find_if((*m_vector)[hash].cbegin(), (*m_vector)[hash].cend(), [&key](const std::pair<Key, T>& wrapper) { return key == wrapper.first; });
+            auto collided = std::find_if((*m_vector)[hash].cbegin(), (*m_vector)[hash].cend(), [&key](const std::pair<Key, T>& wrapper) { PDS_COUNT(BUCKET_PROBES, 1); return key == wrapper.first; });
             if (collided == (*m_vector)[hash].cend()) {
                 ++newSize;
                 if (newSize > m_vector->size() / 2) {
                     auto reallocatedVector = getReallocatedVectorOfPersistentVectors(key, value);
-                    outVector = std::make_shared<PersistentVector<PersistentVector<std::pair<Key, T>>>>(
+                    outVector = RefCount::template make<PersistentVector<PersistentVector<std::pair<Key, T>, void, RefCount>, void, RefCount>>(
                         m_vector->reset(reallocatedVector.cbegin(), reallocatedVector.cend()));
                 }
                 else {
-                    outVector = std::make_shared<PersistentVector<PersistentVector<std::pair<Key, T>>>>(
+                    outVector = RefCount::template make<PersistentVector<PersistentVector<std::pair<Key, T>, void, RefCount>, void, RefCount>>(
                         m_vector->set(hash, (*m_vector)[hash].push_back(std::move(std::pair<Key, T>(key, value)))));
                 }
             }
             else {
-                outVector = std::make_shared<PersistentVector<PersistentVector<std::pair<Key, T>>>>(
+                outVector = RefCount::template make<PersistentVector<PersistentVector<std::pair<Key, T>, void, RefCount>, void, RefCount>>(
                     m_vector->set(hash, (*m_vector)[hash].set(collided.getId(), std::move(std::pair<Key, T>(key, value)))));
             }
         }
-        return PersistentMap<Key, T, Hash>(m_hash, newSize, outVector);
+        return PersistentMap<Key, T, Hash, RefCount>(m_hash, newSize, outVector);
     }
 
-    template<typename Key, typename T, typename Hash>
-    inline bool PersistentMap<Key, T, Hash>::operator==(const PersistentMap& other) const {
+    template<typename Key, typename T, typename Hash, typename RefCount>
+    inline bool PersistentMap<Key, T, Hash, RefCount>::operator==(const PersistentMap& other) const {
         bool equals = true;
         if (this != &other && m_vector != other.m_vector) {
             if (m_size != other.m_size) {
@@ -301,13 +316,13 @@ namespace pds {
         return equals;
     }
 
-    template<typename Key, typename T, typename Hash>
-    inline bool PersistentMap<Key, T, Hash>::operator!=(const PersistentMap& other) const {
+    template<typename Key, typename T, typename Hash, typename RefCount>
+    inline bool PersistentMap<Key, T, Hash, RefCount>::operator!=(const PersistentMap& other) const {
         return !(*this == other);
     }
 
-    template<typename Key, typename T, typename Hash>
-    inline void PersistentMap<Key, T, Hash>::swap(PersistentMap& other) {
+    template<typename Key, typename T, typename Hash, typename RefCount>
+    inline void PersistentMap<Key, T, Hash, RefCount>::swap(PersistentMap& other) {
         if (this != &other) {
             std::swap(m_hash, other.m_hash);
             std::swap(m_size, other.m_size);
@@ -315,89 +330,112 @@ namespace pds {
         }
     }
 
-    template<typename Key, typename T, typename Hash>
-    inline std::size_t PersistentMap<Key, T, Hash>::size() const {
+    template<typename Key, typename T, typename Hash, typename RefCount>
+    inline std::size_t PersistentMap<Key, T, Hash, RefCount>::size() const {
         return m_size;
     }
 
-    template<typename Key, typename T, typename Hash>
-    inline bool PersistentMap<Key, T, Hash>::empty() const {
+    template<typename Key, typename T, typename Hash, typename RefCount>
+    inline bool PersistentMap<Key, T, Hash, RefCount>::empty() const {
         return 0 == size();
     }
 
-    template<typename Key, typename T, typename Hash>
-    inline bool PersistentMap<Key, T, Hash>::canUndo() const {
+    template<typename Key, typename T, typename Hash, typename RefCount>
+    inline bool PersistentMap<Key, T, Hash, RefCount>::canUndo() const {
         return m_vector->canUndo();
     }
 
-    template<typename Key, typename T, typename Hash>
-    inline bool PersistentMap<Key, T, Hash>::canRedo() const {
+    template<typename Key, typename T, typename Hash, typename RefCount>
+    inline bool PersistentMap<Key, T, Hash, RefCount>::canRedo() const {
         return m_vector->canRedo();
     }
 
-    template<typename Key, typename T, typename Hash>
-    inline PersistentMap<Key, T, Hash> PersistentMap<Key, T, Hash>::undo() const {
-        auto outVector = std::make_shared<PersistentVector<PersistentVector<std::pair<Key, T>>>>(m_vector->undo());
+    template<typename Key, typename T, typename Hash, typename RefCount>
+    inline PersistentMap<Key, T, Hash, RefCount> PersistentMap<Key, T, Hash, RefCount>::undo() const {
+        auto outVector = RefCount::template make<PersistentVector<PersistentVector<std::pair<Key, T>, void, RefCount>, void, RefCount>>(m_vector->undo());
         std::size_t newSize = 0;
         for (auto it = outVector->cbegin(); it != outVector->cend(); ++it) {
             newSize += it->size();
         }
-        return PersistentMap<Key, T, Hash>(m_hash, newSize, outVector);
+        return PersistentMap<Key, T, Hash, RefCount>(m_hash, newSize, outVector);
     }
 
-    template<typename Key, typename T, typename Hash>
-    inline PersistentMap<Key, T, Hash> PersistentMap<Key, T, Hash>::redo() const {
-        auto outVector = std::make_shared<PersistentVector<PersistentVector<std::pair<Key, T>>>>(m_vector->redo());
+    template<typename Key, typename T, typename Hash, typename RefCount>
+    inline PersistentMap<Key, T, Hash, RefCount> PersistentMap<Key, T, Hash, RefCount>::redo() const {
+        auto outVector = RefCount::template make<PersistentVector<PersistentVector<std::pair<Key, T>, void, RefCount>, void, RefCount>>(m_vector->redo());
         std::size_t newSize = 0;
         for (auto it = outVector->cbegin(); it != outVector->cend(); ++it) {
             newSize += it->size();
         }
-        return PersistentMap<Key, T, Hash>(m_hash, newSize, outVector);
+        return PersistentMap<Key, T, Hash, RefCount>(m_hash, newSize, outVector);
     }
 
-    template<typename Key, typename T, typename Hash>
-    inline PersistentMap<Key, T, Hash> PersistentMap<Key, T, Hash>::clear() const {
-        auto outVector = std::make_shared<PersistentVector<PersistentVector<std::pair<Key, T>>>>(m_vector->clear());
+    template<typename Key, typename T, typename Hash, typename RefCount>
+    inline PersistentMap<Key, T, Hash, RefCount> PersistentMap<Key, T, Hash, RefCount>::clear() const {
+        auto outVector = RefCount::template make<PersistentVector<PersistentVector<std::pair<Key, T>, void, RefCount>, void, RefCount>>(m_vector->clear());
         std::size_t newSize = 0;
-        return PersistentMap<Key, T, Hash>(m_hash, newSize, outVector);
+        return PersistentMap<Key, T, Hash, RefCount>(m_hash, newSize, outVector);
     }
 
-    template<typename Key, typename T, typename Hash>
-    inline std::size_t PersistentMap<Key, T, Hash>::count(const Key& key) const {
+    template<typename Key, typename T, typename Hash, typename RefCount>
+    inline std::size_t PersistentMap<Key, T, Hash, RefCount>::count(const Key& key) const {
         return find(key) == cend() ? 0 : 1;
     }
 
-    template<typename Key, typename T, typename Hash>
-    inline typename PersistentMap<Key, T, Hash>::const_iterator PersistentMap<Key, T, Hash>::find(const Key& key) const {
+    template<typename Key, typename T, typename Hash, typename RefCount>
+    inline typename PersistentMap<Key, T, Hash, RefCount>::const_iterator PersistentMap<Key, T, Hash, RefCount>::find(const Key& key) const {
+        PDS_COUNT(BUCKET_LOOKUPS, 1);
         auto hash = m_hash(key) % m_vector->size();
-        auto inner = std::find_if((*m_vector)[hash].cbegin(), (*m_vector)[hash].cend(), [&key](const std::pair<Key, T>& wrapper) { return key == wrapper.first; });
+        auto inner = std::find_if((*m_vector)[hash].cbegin(), (*m_vector)[hash].cend(), [&key](const std::pair<Key, T>& wrapper) { PDS_COUNT(BUCKET_PROBES, 1); return key == wrapper.first; });
         return inner == (*m_vector)[hash].cend() ? 
             const_iterator(m_vector->cend(), m_vector->cend(), inner) :
-            const_iterator(m_vector->cend(), typename PersistentVector<PersistentVector<std::pair<Key, T>>>::const_iterator(hash, m_vector.get()), inner);
+            const_iterator(m_vector->cend(), typename PersistentVector<PersistentVector<std::pair<Key, T>, void, RefCount>, void, RefCount>::const_iterator(hash, m_vector.get()), inner);
     }
 
-    template<typename Key, typename T, typename Hash>
-    inline bool PersistentMap<Key, T, Hash>::contains(const Key& key) const {
+    template<typename Key, typename T, typename Hash, typename RefCount>
+    inline bool PersistentMap<Key, T, Hash, RefCount>::contains(const Key& key) const {
         return count(key) > 0;
     }
 
-    template<typename Key, typename T, typename Hash>
-    inline PersistentMap<Key, T, Hash> PersistentMap<Key, T, Hash>::erase(const Key& key) const {
+    template<typename Key, typename T, typename Hash, typename RefCount>
+    inline PersistentMap<Key, T, Hash, RefCount> PersistentMap<Key, T, Hash, RefCount>::erase(const Key& key) const {
+        PDS_COUNT(BUCKET_LOOKUPS, 1);
         auto hash = m_hash(key) % m_vector->size();
         std::vector<std::pair<Key, T>> v((*m_vector)[hash].cbegin(), (*m_vector)[hash].cend());
-        auto target = std::find_if(v.begin(), v.end(), [&key](const std::pair<Key, T>& wrapper) { return key == wrapper.first; });
+        auto target = std::find_if(v.begin(), v.end(), [&key](const std::pair<Key, T>& wrapper) { PDS_COUNT(BUCKET_PROBES, 1); return key == wrapper.first; });
         if (target == v.end()) {
             throw std::out_of_range("Key not found");
         }
         std::size_t newSize = m_size - 1;
         v.erase(target);
-        PersistentVector<std::pair<Key, T>> newSeq(v.begin(), v.end());
-        auto outVector = std::make_shared<PersistentVector<PersistentVector<std::pair<Key, T>>>>(m_vector->set(hash, newSeq));
-        return PersistentMap<Key, T, Hash>(m_hash, newSize, outVector);
+        PersistentVector<std::pair<Key, T>, void, RefCount> newSeq(v.begin(), v.end());
+        auto outVector = RefCount::template make<PersistentVector<PersistentVector<std::pair<Key, T>, void, RefCount>, void, RefCount>>(m_vector->set(hash, newSeq));
+        return PersistentMap<Key, T, Hash, RefCount>(m_hash, newSize, outVector);
+    }
+
+    template<typename Key, typename T, typename Hash, typename RefCount>
+    MemoryUsage PersistentMap<Key, T, Hash, RefCount>::memoryUsage() const {
+        MemoryAccountant accountant;
+        accountMemory(accountant);
+        return accountant.usage();
+    }
+
+    template<typename Key, typename T, typename Hash, typename RefCount>
+    void PersistentMap<Key, T, Hash, RefCount>::accountMemory(MemoryAccountant& accountant) const {
+        auto handleBytes = MemoryAccountant::sharedBlockSize<PersistentVector<PersistentVector<std::pair<Key, T>, void, RefCount>, void, RefCount>>();
+        if (accountant.visit(m_vector.get(), handleBytes, MemoryAccountant::BlockType::VERSION_NODE)) {
+            m_vector->accountMemory(accountant);
+        }
+    }
+
+    template<typename Key, typename T, typename Hash, typename RefCount>
+    void PersistentMap<Key, T, Hash, RefCount>::retire(ReclamationQueue& queue) && {
+        queue.push(std::move(m_vector));
+        m_size = 0;
     }
 
-    template<typename Key, typename T, typename Hash>
-    inline bool PersistentMap<Key, T, Hash>::insertToSequenceAsHash(std::vector<std::vector<std::pair<Key, T>>>& sequence, const Key& key, const T& value, std::size_t hash) {
+    template<typename Key, typename T, typename Hash, typename RefCount>
+    inline bool PersistentMap<Key, T, Hash, RefCount>::insertToSequenceAsHash(std::vector<std::vector<std::pair<Key, T>>>& sequence, const Key& key, const T& value, std::size_t hash) {
         bool found = false;
         if (sequence[hash].empty()) {
             sequence[hash].emplace_back(key, value);
@@ -417,9 +455,9 @@ namespace pds {
         return !found;
     }
 
-    template<typename Key, typename T, typename Hash>
+    template<typename Key, typename T, typename Hash, typename RefCount>
     template<typename InputIt, typename std::enable_if<is_iterator<InputIt>, bool>::type>
-    inline std::vector<std::vector<std::pair<Key, T>>> PersistentMap<Key, T, Hash>::getReallocatedVector(InputIt begin, InputIt end, std::size_t size, const Hash& hashFunc) {
+    inline std::vector<std::vector<std::pair<Key, T>>> PersistentMap<Key, T, Hash, RefCount>::getReallocatedVector(InputIt begin, InputIt end, std::size_t size, const Hash& hashFunc) {
         std::vector<std::vector<std::pair<Key, T>>> resetVector(size);
         for (auto it = begin; it != end; ++it) {
             for (auto it_in = it->cbegin(); it_in != it->cend(); ++it_in) {
@@ -430,19 +468,20 @@ namespace pds {
         return resetVector;
     }
 
-    template<typename Key, typename T, typename Hash>
-    inline std::vector<PersistentVector<std::pair<Key, T>>> 
-        PersistentMap<Key, T, Hash>::getReallocatedVectorOfPersistentVectors(std::vector<std::vector<std::pair<Key, T>>> resetVector, std::size_t size)
+    template<typename Key, typename T, typename Hash, typename RefCount>
+    inline std::vector<PersistentVector<std::pair<Key, T>, void, RefCount>> 
+        PersistentMap<Key, T, Hash, RefCount>::getReallocatedVectorOfPersistentVectors(std::vector<std::vector<std::pair<Key, T>>> resetVector, std::size_t size)
     {
-        std::vector<PersistentVector<std::pair<Key, T>>> out(size);
+        std::vector<PersistentVector<std::pair<Key, T>, void, RefCount>> out(size);
         for (std::size_t i = 0; i < resetVector.size(); ++i) {
-            out[i] = PersistentVector<std::pair<Key, T>>(resetVector[i].cbegin(), resetVector[i].cend());
+            out[i] = PersistentVector<std::pair<Key, T>, void, RefCount>(resetVector[i].cbegin(), resetVector[i].cend());
         }
         return out;
     }
 
-    template<typename Key, typename T, typename Hash>
-    inline std::vector<PersistentVector<std::pair<Key, T>>> PersistentMap<Key, T, Hash>::getReallocatedVectorOfPersistentVectors(const Key& key, T value) const {
+    template<typename Key, typename T, typename Hash, typename RefCount>
+    inline std::vector<PersistentVector<std::pair<Key, T>, void, RefCount>> PersistentMap<Key, T, Hash, RefCount>::getReallocatedVectorOfPersistentVectors(const Key& key, T value) const {
+        PDS_COUNT(MAP_REHASHES, 1);
         auto resetVector = getReallocatedVector(m_vector->cbegin(), m_vector->cend(), m_vector->size() * 2, m_hash);
         auto hash = m_hash(key) % (m_vector->size() * 2);
         if (!resetVector[hash].empty()) {
@@ -1,21 +1,46 @@
 ﻿#pragma once
 #include "Utils.h"
-
+#include "MemoryUsage.h"
+#include "Monoids.h"
+#include "Statistics.h"
+#include "ParallelSort.h"
+#include "RefCountPolicy.h"
+#include "ReclamationQueue.h"
+
+#include <algorithm>
 #include <memory>
 #include <array>
 #include <stack>
 #include <stdexcept>
+#include <exception>
+#include <functional>
 #include <iterator>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
 #include <utility>
+#include <vector>
 
 namespace pds {
-    template<typename T>
+    // Monoid, if not void, annotates every node with the summary of its subtree (see aggregate);
+    // RefCount selects atomic or single-threaded reference counting of the nodes (see RefCountPolicy.h)
+    template<typename T, typename Monoid = void, typename RefCount = AtomicRefCount>
     class PersistentVector;
 
-    template<typename T>
+    // Lazy pipelines over the vectors, see VectorView.h
+    template<typename Source, typename Value, typename Stage>
+    class VectorView;
+
+    namespace Utils {
+        struct IdentityStage;
+    }
+
+    template<typename T, typename Monoid = void, typename RefCount = AtomicRefCount>
     class vector_const_iterator {
         std::size_t m_id;
-        const PersistentVector<T>* m_pvector;
+        const PersistentVector<T, Monoid, RefCount>* m_pvector;
     public:
         using iterator_category = std::random_access_iterator_tag;
         using difference_type = std::ptrdiff_t;
@@ -24,7 +49,7 @@ namespace pds {
         using reference = const T&;
 
         vector_const_iterator() = delete;
-        vector_const_iterator(std::size_t id, const PersistentVector<T>* pvector) : m_id(id), m_pvector(pvector) {}
+        vector_const_iterator(std::size_t id, const PersistentVector<T, Monoid, RefCount>* pvector) : m_id(id), m_pvector(pvector) {}
         vector_const_iterator(const vector_const_iterator& other) = default;
         vector_const_iterator(vector_const_iterator&& other) = default;
 
@@ -58,14 +83,50 @@ namespace pds {
         std::size_t getId() const;
     };
 
-    template<typename T>
-    inline vector_const_iterator<T> operator+(const typename vector_const_iterator<T>::difference_type lhs, const vector_const_iterator<T>& rhs);
-    template<typename T>
-    inline vector_const_iterator<T> operator-(const typename vector_const_iterator<T>::difference_type lhs, const vector_const_iterator<T>& rhs);
+    template<typename T, typename Monoid, typename RefCount>
+    inline vector_const_iterator<T, Monoid, RefCount> operator+(const typename vector_const_iterator<T, Monoid, RefCount>::difference_type lhs, const vector_const_iterator<T, Monoid, RefCount>& rhs);
+    template<typename T, typename Monoid, typename RefCount>
+    inline vector_const_iterator<T, Monoid, RefCount> operator-(const typename vector_const_iterator<T, Monoid, RefCount>::difference_type lhs, const vector_const_iterator<T, Monoid, RefCount>& rhs);
 
     constexpr std::uint32_t m_primeTreeNodeSize = 5;
 
-	template<typename T>
+    /*
+    *
+    *   PrimeTreeNodeSummary - summary of a subtree cached in every PrimeTreeNode of PersistentVector<T, Monoid, RefCount>;
+    *       Monoid has to provide (see Monoids.h):
+    *           using summary_type = ...;
+    *           static summary_type identity();
+    *           static summary_type measure(const T& element);
+    *           static summary_type combine(const summary_type& left, const summary_type& right);
+    *       combine has to be associative, it is applied to the summaries in the order of the elements.
+    *       Without a monoid the summary is empty and takes no space in the node.
+    *
+    */
+    template<typename Monoid>
+    struct PrimeTreeNodeSummary {
+        typename Monoid::summary_type m_summary = Monoid::identity();
+    };
+
+    template<>
+    struct PrimeTreeNodeSummary<void> {};
+
+    /*
+    *
+    *   InternStatistics - counters of an intern table of PersistentVector (see PersistentVector::intern);
+    *       bytesSaved is estimated the same way as MemoryUsage: by the sizes of the nodes and elements
+    *       which the interned versions reference instead of their own equal copies.
+    *
+    */
+    struct InternStatistics {
+        std::size_t visitedNodes = 0;
+        // nodes replaced by an equal node from the table
+        std::size_t sharedNodes = 0;
+        // elements of the replaced leaves which were not shared with the leaf from the table
+        std::size_t sharedElements = 0;
+        std::size_t bytesSaved = 0;
+    };
+
+	template<typename T, typename Monoid, typename RefCount>
 	class PersistentVector {
         template<std::uint32_t degreeOfTwo>
         class PrimeTreeNode;
@@ -79,13 +140,59 @@ namespace pds {
 
         class PrimeVectorTree;
 
+        // Pointers of the nodes and elements, their counters are updated as RefCount says (see RefCountPolicy.h)
+        template<typename U>
+        using SharedPtr = typename RefCount::template pointer<U>;
+
+        template<typename U>
+        using WeakPtr = typename RefCount::template weak_pointer<U>;
+
+        template<typename U, typename... Args>
+        static SharedPtr<U> makeShared(Args&&... args) {
+            return RefCount::template make<U>(std::forward<Args>(args)...);
+        }
+
 	public:
-        using const_iterator = vector_const_iterator<T>;
+        using const_iterator = vector_const_iterator<T, Monoid, RefCount>;
         using const_reverse_iterator = std::reverse_iterator<const_iterator>;
 
+        /*
+        *
+        *   InternTable - canonical nodes for intern(): leaves are looked up by the hash of their elements,
+        *       interior nodes by the addresses of their (already interned) children.
+        *       The table holds weak references only, so the nodes are freed together with the last
+        *       version using them; the entries of the freed nodes are dropped during the lookups.
+        *       The table is not thread-safe.
+        *
+        */
+        class InternTable {
+        public:
+            // Number of entries, including the ones of the freed nodes which were not dropped yet
+            std::size_t size() const { return m_nodes.size(); }
+
+            const InternStatistics& statistics() const { return m_statistics; }
+
+            // Drops the entries of the freed nodes
+            void purge();
+
+        private:
+            friend class PersistentVector;
+
+            using Node = PrimeTreeNode<m_primeTreeNodeSize>;
+
+            // Node equal to the given one from the table; the node itself is added if there is none
+            template<typename Hash>
+            SharedPtr<Node> intern(const SharedPtr<Node>& node, const Hash& hash);
+
+            static bool equal(const Node& left, const Node& right);
+
+            std::unordered_multimap<std::size_t, WeakPtr<Node>> m_nodes;
+            InternStatistics m_statistics;
+        };
+
 
         PersistentVector() :
-            m_versionTreeNode(std::make_shared<VectorVersionTreeNode>(std::make_shared<PrimeTreeRoot<m_primeTreeNodeSize>>())) {}
+            m_versionTreeNode(makeShared<VectorVersionTreeNode>(makeShared<PrimeTreeRoot<m_primeTreeNodeSize>>())) { cacheReadPath(); }
         PersistentVector(const PersistentVector& other) = default;
         PersistentVector(PersistentVector&& other) noexcept = default;
 
@@ -97,6 +204,16 @@ namespace pds {
 
         PersistentVector(std::initializer_list<T> init) : PersistentVector(init.begin(), init.end()) {}
 
+        // Vector over [first, last) built by several threads: the leaves of the contiguous parts
+        // of the range are made by different threads, the interior levels are built bottom-up after them;
+        // T has to be safe to construct from the elements of the range concurrently.
+        // Ranges shorter than PARALLEL_BUILD_MIN_SIZE are built by the calling thread
+        template<typename RandomIt>
+        static PersistentVector build_parallel(RandomIt first, RandomIt last,
+                                               std::size_t threads = std::thread::hardware_concurrency());
+
+        static constexpr std::size_t PARALLEL_BUILD_MIN_SIZE = 1 << 14;
+
         ~PersistentVector() = default;
 
         // TODO: we should probably delete them
@@ -112,15 +229,70 @@ namespace pds {
 
         const T& at(std::size_t pos) const;
 
-        PersistentVector set(std::size_t pos, const T& value) const;
+        // Writes (*this)[index] to out for every index; the lookups are done in batches
+        // which descend the tree level by level, prefetching the next level for the whole batch,
+        // so the cache misses of different lookups overlap
+        template<typename InputIt, typename OutputIt, typename std::enable_if<is_iterator<InputIt>, bool>::type = false>
+        OutputIt get_many(InputIt first, InputIt last, OutputIt out) const;
+        template<typename Indexes, typename OutputIt>
+        OutputIt get_many(const Indexes& indexes, OutputIt out) const;
+
+        // Writes the element pos of every version given by its number of undo() steps back from this one
+        // (0 is this version) without making the versions: the history is walked once, then the tries
+        // of all the versions are descended together level by level, and the versions which enter
+        // the same node (neighbouring ones, in the order of the steps) share the rest of the descent.
+        // Throws out_of_range if a version is out of the history or pos is out of a version
+        template<typename InputIt, typename OutputIt, typename std::enable_if<is_iterator<InputIt>, bool>::type = false>
+        OutputIt get_history(std::size_t pos, InputIt first, InputIt last, OutputIt out) const;
+        template<typename Steps, typename OutputIt>
+        OutputIt get_history(std::size_t pos, const Steps& steps, OutputIt out) const;
+
+        // Copies the elements [first, last) to out; every leaf of the range is visited once,
+        // while the iterators descend from the root for every element.
+        // Throws out_of_range if the range is out of the vector
+        template<typename OutputIt>
+        OutputIt copy_to(OutputIt out, std::size_t first, std::size_t last) const;
+        template<typename OutputIt>
+        OutputIt copy_to(OutputIt out) const;
+
+        std::vector<T> to_std_vector() const;
+
+        // Lazy view of the elements (of [first, last)), transform() and filter() stages are added to it
+        // and run only when the view is consumed or materialized (see VectorView.h).
+        // Throws out_of_range if the range is out of the vector
+        VectorView<PersistentVector, T, Utils::IdentityStage> view() const;
+        VectorView<PersistentVector, T, Utils::IdentityStage> view(std::size_t first, std::size_t last) const;
+
+        // Overloads for rvalues edit the nodes owned only by the consumed version in place
+        // instead of copying them; the history stays the same as for the lvalue overloads,
+        // the consumed version is rebuilt from its successor if it is reached by undo.
+        // The source vector is left in the moved-from state. The sole ownership found by use_count()
+        // is followed by an acquire fence, so the former owners may have been released by other threads.
+        PersistentVector set(std::size_t pos, const T& value) const&;
+        PersistentVector set(std::size_t pos, const T& value) &&;
+        PersistentVector set(std::size_t pos, T&& value) const&;
+        PersistentVector set(std::size_t pos, T&& value) &&;
+
+        // Read-modify-write in one descent: fn gets a copy of the element as an rvalue and returns
+        // the new value, T fn(T&&); the path is copied on the way down as by set
+        template<typename F>
+        PersistentVector update(std::size_t pos, F fn) const&;
+        template<typename F>
+        PersistentVector update(std::size_t pos, F fn) &&;
+        // The same for every element of [first, last) as one version, each node of the range is copied once.
+        // Throws out_of_range if the range is out of the vector
+        template<typename F>
+        PersistentVector update_range(std::size_t first, std::size_t last, F fn) const;
 
 		bool operator==(const PersistentVector& other) const;
 		bool operator!=(const PersistentVector& other) const;
 
 		void swap(PersistentVector& other);
 
-        PersistentVector resize(std::size_t size) const;
-        PersistentVector resize(std::size_t size, const T& value) const;
+        PersistentVector resize(std::size_t size) const&;
+        PersistentVector resize(std::size_t size) &&;
+        PersistentVector resize(std::size_t size, const T& value) const&;
+        PersistentVector resize(std::size_t size, const T& value) &&;
 
 
         template<typename InputIt, typename std::enable_if<is_iterator<InputIt>, bool>::type = false>
@@ -140,18 +312,128 @@ namespace pds {
         const T& front() const;
         const T& back() const;
 
-        PersistentVector push_back(const T& value) const;
-        PersistentVector push_back(T&& value) const;
-        PersistentVector pop_back() const;
+        PersistentVector push_back(const T& value) const&;
+        PersistentVector push_back(const T& value) &&;
+        PersistentVector push_back(T&& value) const&;
+        PersistentVector push_back(T&& value) &&;
+        PersistentVector pop_back() const&;
+        PersistentVector pop_back() &&;
 
         template<typename... Args>
-        PersistentVector emplace_back(Args&&... args) const;
+        PersistentVector emplace_back(Args&&... args) const&;
+        template<typename... Args>
+        PersistentVector emplace_back(Args&&... args) &&;
+
+        // Deque operations: the elements pushed to the front gather in a leaf of their own, which joins
+        // a separate tree of such leaves when it is full, and pop_front moves an offset past the first
+        // element of the tree, as pop_back does with the front tree once nothing is left after it;
+        // they are O(1) amortized and reads, aggregates and copies stay as fast as over one tree.
+        // A version made by them is not edited in place, intern and shrinking resize rebuild it into one tree
+        PersistentVector push_front(const T& value) const;
+        PersistentVector push_front(T&& value) const;
+        template<typename... Args>
+        PersistentVector emplace_front(Args&&... args) const;
+        PersistentVector pop_front() const;
+
+        // Appends the whole range as one version: the rightmost path is copied once,
+        // the elements after the partial last leaf are packed into new leaves which are attached
+        // to the tree one by one, so an element costs neither a path copy nor a descent
+        template<typename InputIt, typename std::enable_if<is_iterator<InputIt>, bool>::type = false>
+        PersistentVector append(InputIt first, InputIt last) const&;
+        template<typename InputIt, typename std::enable_if<is_iterator<InputIt>, bool>::type = false>
+        PersistentVector append(InputIt first, InputIt last) &&;
+
+        // Only for the vectors annotated by a monoid: combination of the measures of the elements
+        // in [first, last) in O(log n), the cached summaries of the whole subtrees are reused
+        template<typename M = Monoid>
+        typename M::summary_type aggregate(std::size_t first, std::size_t last) const;
+        // Summary of the first count elements
+        template<typename M = Monoid>
+        typename M::summary_type prefix(std::size_t count) const;
+        template<typename M = Monoid>
+        typename M::summary_type summary() const;
+
+        // Hash of the elements in order, equal for the vectors of equal elements however they were built;
+        // O(1) for the vectors annotated by HashMonoid (the root summary), otherwise the elements
+        // are hashed by std::hash<T> in O(n). It is the std::hash of the vector
+        std::size_t content_hash() const;
+
+        // Stable sort into the next version: the elements are shared with this version, not copied,
+        // the halves are sorted by different threads (cmp has to be safe to call concurrently)
+        // and the tree is built bottom-up from the sorted leaves
+        template<typename Compare = std::less<T>>
+        PersistentVector sorted(Compare cmp = Compare()) const;
+
+        // Equal version in which the leaves and subtrees equal to the ones already in the table
+        // are replaced by them, so the versions built independently from the same data (e.g. by reset())
+        // share their memory; T has to be hashable by Hash and comparable by operator==.
+        // The result takes the place of this version in the history: its undo leads to the parent
+        // of this version and it has no redo, so this version is freed with its last handle.
+        template<typename Hash = std::hash<T>>
+        PersistentVector intern(InternTable& table, Hash hash = Hash()) const;
+
+        // Binary search in a vector sorted by cmp: interior nodes are searched by the last elements
+        // of their children, so the elements of only one leaf are compared one by one
+        template<typename Key, typename Compare = std::less<>>
+        const_iterator lower_bound(const Key& value, Compare cmp = Compare()) const;
+        template<typename Key, typename Compare = std::less<>>
+        const_iterator upper_bound(const Key& value, Compare cmp = Compare()) const;
+        template<typename Key, typename Compare = std::less<>>
+        std::pair<const_iterator, const_iterator> equal_range(const Key& value, Compare cmp = Compare()) const;
+
+        // Memory held by this version including its undo/redo history
+        MemoryUsage memoryUsage() const;
+        void accountMemory(MemoryAccountant& accountant) const;
+
+        // Drops this handle; the nodes left without owners are freed by the steps of the queue
+        // instead of all at once (see ReclamationQueue.h). The vector is left in the moved-from state.
+        void retire(ReclamationQueue& queue) &&;
 
     private:
-        PersistentVector(std::shared_ptr<VectorVersionTreeNode> versionTreeNode)
-            : m_versionTreeNode(versionTreeNode) {}
+        // Views materialize their results into a new vector by append_inplace
+        template<typename Source, typename Value, typename Stage>
+        friend class VectorView;
+
+        PersistentVector(SharedPtr<VectorVersionTreeNode> versionTreeNode)
+            : m_versionTreeNode(std::move(versionTreeNode)) { cacheReadPath(); }
 
-        void push_back_inplace(const T& value);
+        // Copies the read path of the version into the handle; has to be called
+        // after the root of a version that stays with this handle is edited in place
+        void cacheReadPath();
+
+        // The element is constructed in place from the forwarded arguments
+        template<typename... Args>
+        void emplace_back_inplace(Args&&... args);
+
+        // Only for a new vector without history: the range is added to its root
+        template<typename InputIt>
+        void append_inplace(InputIt first, InputIt last);
+
+        // Version which follows the current one and has the given root
+        PersistentVector makeNextVersion(SharedPtr<PrimeTreeRoot<m_primeTreeNodeSize>> newRoot) const;
+
+        // Operation which rebuilds a version edited in place from the version that took over its root
+        enum class RestoreOperation {
+            NONE,
+            SET,
+            PUSH_BACK,
+            POP_BACK,
+            RESIZE
+        };
+
+        // The version is referenced only by this handle, so its root can be edited in place
+        bool canEditInPlace() const;
+
+        std::size_t contentHash(std::true_type) const;
+        std::size_t contentHash(std::false_type) const;
+
+        // Vectors of different content hashes are different; without HashMonoid nothing is known
+        bool mayBeEqual(const PersistentVector& other, std::true_type) const;
+        bool mayBeEqual(const PersistentVector& other, std::false_type) const;
+
+        // Hands the root edited in place over to the next version; the current version remembers
+        // how to restore itself from the next one
+        PersistentVector makeEditedVersion(RestoreOperation operation, std::size_t pos, SharedPtr<T> value);
 
         using NodeCreationStatus = bool;
         static constexpr NodeCreationStatus NODE_DUPLICATE = true;
@@ -166,7 +448,7 @@ namespace pds {
         * 
         */
         template<std::uint32_t degreeOfTwo>
-        class PrimeTreeNode {
+        class PrimeTreeNode : private PrimeTreeNodeSummary<Monoid> {
         public:
             using NodeType = bool;
             static constexpr NodeType NODE = true;
@@ -174,46 +456,130 @@ namespace pds {
 
         public:
             PrimeTreeNode() = delete;
-            PrimeTreeNode(std::shared_ptr<T> insertingElement);
-            PrimeTreeNode(std::shared_ptr<PrimeTreeNode<degreeOfTwo>> child);
-            PrimeTreeNode(std::shared_ptr<PrimeTreeNode<degreeOfTwo>> oldChild, 
-                          std::shared_ptr<PrimeTreeNode<degreeOfTwo>> newChild);
+            PrimeTreeNode(SharedPtr<T> insertingElement);
+            PrimeTreeNode(SharedPtr<PrimeTreeNode<degreeOfTwo>> child);
+            PrimeTreeNode(SharedPtr<PrimeTreeNode<degreeOfTwo>> oldChild, 
+                          SharedPtr<PrimeTreeNode<degreeOfTwo>> newChild);
             PrimeTreeNode(const PrimeTreeNode& other);
-            PrimeTreeNode(PrimeTreeNode&& other) = default;
+            PrimeTreeNode(PrimeTreeNode&& other) = delete;
 
             PrimeTreeNode& operator=(const PrimeTreeNode& other) = delete;
             PrimeTreeNode& operator=(PrimeTreeNode&& other) = delete;
 
-            ~PrimeTreeNode() = default;
+            ~PrimeTreeNode();
+
+            const T& get(std::size_t pos, std::uint32_t level) const;
+            const SharedPtr<T>& getShared(std::size_t pos, std::uint32_t level) const;
 
-            T& get(std::size_t pos, std::uint32_t level);
+            // Bulk construction from a range of elements or children, which are moved from
+            template<typename It>
+            static SharedPtr<PrimeTreeNode> makeLeaf(It first, It last);
+            template<typename It>
+            static SharedPtr<PrimeTreeNode> makeNode(It first, It last);
 
-            NodeCreationStatus emplace_back(std::shared_ptr<T>&& value, std::shared_ptr<PrimeTreeNode>& primeTreeNode) const;
+            // Appends the elements of the subtree to out in their order
+            void collect(std::vector<SharedPtr<T>>& out) const;
 
-            std::shared_ptr<PrimeTreeNode> pop_back() const;
+            // Copies the elements [first, last) of the subtree to out
+            template<typename OutputIt>
+            OutputIt copyTo(OutputIt out, std::size_t first, std::size_t last, std::uint32_t level) const;
 
-            std::shared_ptr<PrimeTreeNode> reduce_size(std::size_t pos, std::uint32_t level) const;
+            const T& back() const;
 
-            std::shared_ptr<PrimeTreeNode> set(std::size_t pos, std::uint32_t level, std::shared_ptr<T>&& value);
+            // Position in the subtree of the first element satisfying pred; it has to exist
+            template<typename Predicate>
+            std::size_t partitionPoint(std::uint32_t level, Predicate pred) const;
 
-            std::shared_ptr<PrimeTreeNode> getFirstChild() const;
+            // Recomputes the cached summary after the content of the node was changed
+            void updateSummary() { updateSummary(std::is_void<Monoid>()); }
 
-            std::shared_ptr<PrimeTreeNode> getFirstNodeWithSomeChildren() const;
+            template<typename M = Monoid>
+            const typename M::summary_type& summary() const { return this->m_summary; }
+
+            // Summary of the elements [first, last) of the subtree
+            template<typename M = Monoid>
+            typename M::summary_type aggregate(std::size_t first, std::size_t last, std::uint32_t level) const;
+
+            // Calls fn for the elements [first, last), first < last, of the subtree from the last one to the first one
+            template<typename F>
+            void forEachBackward(std::size_t first, std::size_t last, std::uint32_t level, F& fn) const;
+
+            // The node holds its content in the reverse order of the vector (the front part of PrimeTreeRoot),
+            // so its summary and aggregate combine the content from the last to the first
+            void setReversed();
+
+            // Raw arrays for the batched descent of get_many
+            const SharedPtr<PrimeTreeNode>* children() const { return m_children.data(); }
+            const SharedPtr<T>* values() const { return m_values.data(); }
+
+            NodeCreationStatus emplace_back(SharedPtr<T>&& value, SharedPtr<PrimeTreeNode>& primeTreeNode) const;
+
+            SharedPtr<PrimeTreeNode> pop_back() const;
+
+            SharedPtr<PrimeTreeNode> reduce_size(std::size_t pos, std::uint32_t level) const;
+
+            SharedPtr<PrimeTreeNode> set(std::size_t pos, std::uint32_t level, SharedPtr<T>&& value);
+
+            SharedPtr<PrimeTreeNode> getFirstChild() const;
+
+            SharedPtr<PrimeTreeNode> getFirstNodeWithSomeChildren() const;
             
             // Set primeTreeNode only if the result is a new node (not node duplicate)
-            NodeCreationStatus emplace_back_inplace(std::shared_ptr<T>&& value, std::shared_ptr<PrimeTreeNode>& primeTreeNode);
+            NodeCreationStatus emplace_back_inplace(SharedPtr<T>&& value, SharedPtr<PrimeTreeNode>& primeTreeNode);
+
+            // The same for a whole leaf placed after the last leaf of the subtree, which has to be full
+            NodeCreationStatus append_leaf_inplace(SharedPtr<PrimeTreeNode>&& leaf, SharedPtr<PrimeTreeNode>& primeTreeNode);
+
+            // Returns the replaced element
+            SharedPtr<T> set_inplace(std::size_t pos, std::uint32_t level, SharedPtr<T>&& value);
+
+            // The element is replaced by fn applied to its copy, the replaced one is returned
+            template<typename F>
+            SharedPtr<T> update_inplace(std::size_t pos, std::uint32_t level, F& fn);
+
+            // The same for the elements [first, last), first < last, of the subtree
+            template<typename F>
+            void update_range_inplace(std::size_t first, std::size_t last, std::uint32_t level, F& fn);
+
+            // Returns the removed element, isEmpty is set if the node has no content left
+            SharedPtr<T> pop_back_inplace(bool& isEmpty);
+
+            // All the leaves of the subtree are full, so emplace_back creates a new node instead of changing it
+            bool full() const;
+
+            // Nodes referenced from other trees are replaced by their copies before being modified in place
+            static void detach(SharedPtr<PrimeTreeNode>& node);
+            static void detachForAppend(SharedPtr<PrimeTreeNode>& node);
 
             std::size_t size() const;
 
             NodeType type() const;
 
+            void accountMemory(MemoryAccountant& accountant) const;
+
+            // Moves the children (and the elements which are containers themselves) to the queue
+            void releaseChildren(ReclamationQueue& queue);
+
         private:
             static constexpr std::size_t ARRAY_SIZE = Utils::binPow(degreeOfTwo);
 
+            void updateSummary(std::true_type) {}
+            void updateSummary(std::false_type);
+
+            using Children = std::array<SharedPtr<PrimeTreeNode>, ARRAY_SIZE>;
+            using Values = std::array<SharedPtr<T>, ARRAY_SIZE>;
+
+            // The header and the slots are one block with the node (and its control block):
+            // a level of a descent is one dependent load less than with a separately allocated array.
+            // The type chooses the active member of the union
             NodeType m_type;
-            std::unique_ptr<std::array<std::shared_ptr<PrimeTreeNode>, ARRAY_SIZE>> m_children;
-            std::unique_ptr<std::array<std::shared_ptr<T>, ARRAY_SIZE>> m_values;
-            std::size_t m_contentAmount;
+            // Takes the padding after the type, see setReversed
+            bool m_reversed = false;
+            std::uint32_t m_contentAmount;
+            union {
+                Children m_children;
+                Values m_values;
+            };
         };
 
 
@@ -222,43 +588,205 @@ namespace pds {
         *   PrimeTreeRoot - корень первичного дерева, которое эмулирует вектор;
         *       хранит указатель на узел дерева (который может быть листом),
         *       а также размер вектора; один корень соответствует одной версии вектора.
+        *       Векторы размера не больше SMALL_SIZE хранят элементы в небольшом блоке вместо дерева.
+        *       A root made by push_front/pop_front is not plain: the elements pushed to the front are kept
+        *       apart from the tree (the body) and the elements popped from the front stay in the body
+        *       behind an offset, so neither operation moves the elements of the body.
         *
         */
         template<std::uint32_t degreeOfTwo>
         class PrimeTreeRoot {
         public:
-            PrimeTreeRoot() : m_child(nullptr), m_size(0), m_depth(0) {}
-            PrimeTreeRoot(std::shared_ptr<PrimeTreeNode<degreeOfTwo>> child, std::size_t size);
-            PrimeTreeRoot(const PrimeTreeRoot& other) = delete;
+            // Most of the PersistentMap buckets are shorter, so they need a block of SMALL_SIZE slots instead of a leaf
+            static constexpr std::size_t SMALL_SIZE = 4;
+
+        public:
+            PrimeTreeRoot() : m_small(nullptr), m_size(0), m_depth(0) {}
+            // The size has to be greater than SMALL_SIZE
+            PrimeTreeRoot(SharedPtr<PrimeTreeNode<degreeOfTwo>> child, std::size_t size);
+            PrimeTreeRoot(const PrimeTreeRoot& other);
             PrimeTreeRoot(PrimeTreeRoot&& other) = delete;
 
             PrimeTreeRoot& operator=(const PrimeTreeRoot& other) = delete;
             PrimeTreeRoot& operator=(PrimeTreeRoot&& other) = delete;
 
-            ~PrimeTreeRoot() = default;
+            ~PrimeTreeRoot();
 
             const T& operator[](std::size_t pos) const;
 
-            std::shared_ptr<PrimeTreeRoot> emplace_back(std::shared_ptr<T>&& value) const;
-            void emplace_back_inplace(std::shared_ptr<T>&& value);
+            // Number of lookups get_many keeps in flight
+            static constexpr std::size_t GET_MANY_BATCH_SIZE = 16;
+
+            // count must not exceed GET_MANY_BATCH_SIZE
+            template<typename OutputIt>
+            OutputIt get_many(const std::size_t* positions, std::size_t count, OutputIt out) const;
+
+            SharedPtr<PrimeTreeRoot> emplace_back(SharedPtr<T>&& value) const;
+            void emplace_back_inplace(SharedPtr<T>&& value);
+
+            // The value goes to the head leaf; a full head is appended to the front tree as a whole leaf
+            SharedPtr<PrimeTreeRoot> emplace_front(SharedPtr<T>&& value) const;
+            // The head, then the front tree leaf by leaf, then the body by the offset
+            SharedPtr<PrimeTreeRoot> pop_front() const;
+
+            // Neither elements before the body nor an offset: the body is the whole vector
+            bool isPlain() const;
+
+            // Elements are added one by one until the last leaf is full, then by whole leaves
+            template<typename InputIt>
+            void append_inplace(InputIt first, InputIt last);
+
+            // Root over the given elements; the tree is built level by level starting from the leaves
+            static SharedPtr<PrimeTreeRoot> build(std::vector<SharedPtr<T>>&& values);
+
+            // Root over copies of the elements of the range, the leaves are made by threads threads
+            template<typename RandomIt>
+            static SharedPtr<PrimeTreeRoot> buildParallel(RandomIt first, RandomIt last, std::size_t threads);
+
+            void collect(std::vector<SharedPtr<T>>& out) const;
+
+            template<typename OutputIt>
+            OutputIt copyTo(OutputIt out, std::size_t first, std::size_t last) const;
 
-            std::shared_ptr<PrimeTreeRoot> pop_back() const;
+            template<typename M = Monoid>
+            typename M::summary_type aggregate(std::size_t first, std::size_t last) const;
+
+            // Position of the first element satisfying pred, or size() if there is none;
+            // the elements satisfying pred have to follow all the others
+            template<typename Predicate>
+            std::size_t partitionPoint(Predicate pred) const;
+
+            // The body, then the front tree by its offset, then the head
+            SharedPtr<PrimeTreeRoot> pop_back() const;
+
+            template<typename Hash>
+            SharedPtr<PrimeTreeRoot> intern(InternTable& table, const Hash& hash) const;
+
+            // Top node of the tree, nullptr for a small vector and for a root which is not plain
+            const PrimeTreeNode<degreeOfTwo>* tree() const { return isSmall() || !isPlain() ? nullptr : m_child.get(); }
+            std::uint32_t depth() const { return m_depth; }
 
             // Size have to be different with the current size
-            std::shared_ptr<PrimeTreeRoot> resize(std::size_t size) const;
-            std::shared_ptr<PrimeTreeRoot> resize(std::size_t size, const T& value) const;
+            SharedPtr<PrimeTreeRoot> resize(std::size_t size) const;
+            SharedPtr<PrimeTreeRoot> resize(std::size_t size, const T& value) const;
             
-            std::shared_ptr<PrimeTreeRoot> set(std::size_t pos, std::shared_ptr<T>&& value);
+            SharedPtr<PrimeTreeRoot> set(std::size_t pos, SharedPtr<T>&& value);
+
+            // Return the replaced and the removed element
+            SharedPtr<T> set_inplace(std::size_t pos, SharedPtr<T>&& value);
+            SharedPtr<T> pop_back_inplace();
+
+            // fn is applied to a copy of the element and the result replaces it, see PersistentVector::update
+            template<typename F>
+            SharedPtr<PrimeTreeRoot> update(std::size_t pos, F& fn) const;
+            template<typename F>
+            SharedPtr<T> update_inplace(std::size_t pos, F& fn);
+
+            // first < last
+            template<typename F>
+            SharedPtr<PrimeTreeRoot> update_range(std::size_t first, std::size_t last, F& fn) const;
 
             std::size_t size() const;
 
+            void accountMemory(MemoryAccountant& accountant) const;
+
+            void releaseChildren(ReclamationQueue& queue);
+
         private:
+            // Everything which makes a root not plain, in a block of its own so that a plain root pays only
+            // a null pointer for it; shared by the versions until one of them edits it
+            struct FrontPart {
+                // The elements before the body in the reverse order: head is the leaf of the last pushed ones
+                // (the first element of the vector is its last one), the earlier ones are the full leaves of front
+                SharedPtr<PrimeTreeNode<degreeOfTwo>> head;
+                SharedPtr<PrimeTreeNode<degreeOfTwo>> front;
+                std::size_t frontSize = 0;
+                // Number of the elements popped from the back out of the front tree, which is done once the body is empty
+                std::size_t frontOffset = 0;
+                std::uint32_t frontDepth = 0;
+                // Number of the elements popped from the front of the body
+                std::size_t offset = 0;
+
+                void releaseChildren(ReclamationQueue& queue);
+            };
+
+            // Elements of a small body; the block is shared by the versions until one of them edits it
+            struct SmallBlock {
+                std::array<SharedPtr<T>, SMALL_SIZE> values;
+
+                // the elements themselves are freed with the block unless they hold versions too
+                void releaseChildren(ReclamationQueue& queue);
+            };
+
             void setSize(std::size_t size);
 
+            // Depth of the tree of a vector of the given size
+            static std::uint32_t depthOf(std::size_t size);
+
+            // The body is the small vector, its offset does not matter; m_small is the active member then
+            bool isSmall() const;
+
+            // Switch the active member of the union to a null m_small or a null m_child before the size crosses SMALL_SIZE
+            void makeSmallBody();
+            void makeTreeBody();
+
+            // The small block of a nonempty body is copied before an edit if another version shares it
+            void detachSmall();
+
+            // Number of the elements before the body
+            std::size_t frontSize() const;
+
+            // Number of the elements popped from the front of the body
+            std::size_t offset() const;
+
+            // The front part to be edited in place: made for a plain root, copied if another version shares it
+            FrontPart& editFront();
+
+            // The root becomes plain again once its front part is left empty; references to the part are invalidated
+            void dropEmptyFront();
+
+            // Element pos of the vector for pos < frontSize()
+            const SharedPtr<T>& getFront(std::size_t pos) const;
+
+            // Element pos of the body, the offset is not applied
+            const SharedPtr<T>& getBody(std::size_t pos) const;
+
+            void emplace_front_inplace(SharedPtr<T>&& value);
+            void pop_front_inplace();
+
+            // Forgets the body once all its elements are popped from the front
+            void clearBody();
+
+            // The body is rebuilt over the given elements, without an offset
+            void resetBody(std::vector<SharedPtr<T>>&& values);
+
+            // Forgets the front tree once all its elements are popped; the front part has to be edited in place
+            void clearFront();
+
+            // Plain root over the same elements
+            SharedPtr<PrimeTreeRoot> flatten() const;
+
+            // Builds the interior levels over the leaves of a vector of the given size
+            static SharedPtr<PrimeTreeRoot> buildFromLeaves(std::vector<SharedPtr<PrimeTreeNode<degreeOfTwo>>>&& level, std::size_t size);
+
+            // Root of a small vector made of the first size elements
+            SharedPtr<PrimeTreeRoot> makeSmallPrefix(std::size_t size) const;
+
         private:
-            std::shared_ptr<PrimeTreeNode<degreeOfTwo>> m_child;
+            using Child = SharedPtr<PrimeTreeNode<degreeOfTwo>>;
+            using Small = SharedPtr<SmallBlock>;
+
+            // A small body takes the slot of the tree, so a larger vector pays nothing for it
+            union {
+                Child m_child;
+                // nullptr for an empty body
+                Small m_small;
+            };
+            // Size of the body, the popped elements before the offset included
             std::size_t m_size;
             std::uint32_t m_depth;
+            // nullptr for a plain root
+            SharedPtr<FrontPart> m_frontPart;
         };
 
 
@@ -275,19 +803,19 @@ namespace pds {
         class VectorVersionTreeNode {
         public:
             VectorVersionTreeNode() = delete;
-            VectorVersionTreeNode(const VectorVersionTreeNode& other) = default;
-            VectorVersionTreeNode(VectorVersionTreeNode&& other) = default;
-            VectorVersionTreeNode(std::shared_ptr<PrimeTreeRoot<m_primeTreeNodeSize>> root, std::shared_ptr<VectorVersionTreeNode> parent) :
+            VectorVersionTreeNode(const VectorVersionTreeNode& other) = delete;
+            VectorVersionTreeNode(VectorVersionTreeNode&& other) = delete;
+            VectorVersionTreeNode(SharedPtr<PrimeTreeRoot<m_primeTreeNodeSize>> root, SharedPtr<VectorVersionTreeNode> parent) :
                 m_root(std::move(root)),
-                m_parent(parent),
+                m_parent(std::move(parent)),
                 m_redoChild(nullptr),
                 m_myOrig(nullptr) {}
-            VectorVersionTreeNode(std::shared_ptr<VectorVersionTreeNode> other, std::shared_ptr<VectorVersionTreeNode> redoChild) :
-                m_root(other->m_root),
+            VectorVersionTreeNode(SharedPtr<VectorVersionTreeNode> other, SharedPtr<VectorVersionTreeNode> redoChild) :
+                m_root(other->getSharedRoot()),
                 m_parent(other->m_parent),
-                m_redoChild(redoChild),
-                m_myOrig(other) {}
-            VectorVersionTreeNode(std::shared_ptr<PrimeTreeRoot<m_primeTreeNodeSize>> root)
+                m_redoChild(std::move(redoChild)),
+                m_myOrig(std::move(other)) {}
+            VectorVersionTreeNode(SharedPtr<PrimeTreeRoot<m_primeTreeNodeSize>> root)
                 : VectorVersionTreeNode(std::move(root), nullptr) {}
 
             VectorVersionTreeNode& operator=(const VectorVersionTreeNode& other) = delete;
@@ -297,26 +825,60 @@ namespace pds {
 
             PrimeTreeRoot<m_primeTreeNodeSize>& getRoot() { return *m_root; }
 
-            std::shared_ptr<VectorVersionTreeNode> getParent() const {
+            // Restores the root of a version edited in place on the first call
+            SharedPtr<PrimeTreeRoot<m_primeTreeNodeSize>> getSharedRoot();
+
+            bool ownsRoot() const { return m_root.use_count() == 1; }
+
+            SharedPtr<PrimeTreeRoot<m_primeTreeNodeSize>> releaseRoot() { return std::move(m_root); }
+
+            // The root was handed over to successor and edited in place; the operation applied
+            // to the successor's root gives the root of this version back
+            void setRestoreOperation(VectorVersionTreeNode* successor, RestoreOperation operation,
+                                     std::size_t pos, SharedPtr<T> value);
+
+            SharedPtr<VectorVersionTreeNode> getParent() const {
                 return m_parent;
             }
 
-            std::shared_ptr<VectorVersionTreeNode> getRedoChild() const {
+            SharedPtr<VectorVersionTreeNode> getRedoChild() const {
                 return m_redoChild;
             }
 
-            std::shared_ptr<VectorVersionTreeNode> getOrig() const {
+            SharedPtr<VectorVersionTreeNode> getOrig() const {
                 return m_myOrig;
             }
 
+            // Walks the whole version tree reachable from the node
+            void accountMemory(MemoryAccountant& accountant) const;
+
+            // Moves the root and the linked versions to the queue; a version edited in place
+            // is referenced only by this node, so it goes to the queue unrestored
+            void releaseChildren(ReclamationQueue& queue);
+
         private:
-            std::shared_ptr<PrimeTreeRoot<m_primeTreeNodeSize>> m_root;
-            std::shared_ptr<VectorVersionTreeNode> m_parent;
-            std::shared_ptr<VectorVersionTreeNode> m_redoChild;
-            std::shared_ptr<VectorVersionTreeNode> m_myOrig;
+            SharedPtr<PrimeTreeRoot<m_primeTreeNodeSize>> m_root;
+            SharedPtr<VectorVersionTreeNode> m_parent;
+            SharedPtr<VectorVersionTreeNode> m_redoChild;
+            SharedPtr<VectorVersionTreeNode> m_myOrig;
+
+            // Only the successor references a version edited in place until the version is restored,
+            // so the raw pointer stays valid whenever the restoration can be requested
+            VectorVersionTreeNode* m_successor = nullptr;
+            RestoreOperation m_restoreOperation = RestoreOperation::NONE;
+            std::size_t m_restorePos = 0;
+            SharedPtr<T> m_restoreValue;
+            std::once_flag m_restored;
         };
 
-        std::shared_ptr<VectorVersionTreeNode> m_versionTreeNode;
+        SharedPtr<VectorVersionTreeNode> m_versionTreeNode;
+
+        // Read path of the version, owned through m_versionTreeNode: element reads and size()
+        // start right from the handle instead of going through the version node and the root
+        const PrimeTreeRoot<m_primeTreeNodeSize>* m_root = nullptr;
+        const PrimeTreeNode<m_primeTreeNodeSize>* m_tree = nullptr;
+        std::size_t m_size = 0;
+        std::uint32_t m_depth = 0;
 	};
 
 /*
@@ -332,120 +894,123 @@ namespace pds {
     * 
     */
     
-    template<typename T>
-    inline vector_const_iterator<T>& vector_const_iterator<T>::operator+=(const difference_type shift) {
+    template<typename T, typename Monoid, typename RefCount>
+    inline vector_const_iterator<T, Monoid, RefCount>& vector_const_iterator<T, Monoid, RefCount>::operator+=(const difference_type shift) {
         m_id += shift;
         return *this;
     }
 
-    template<typename T>
-    inline vector_const_iterator<T>& vector_const_iterator<T>::operator-=(const difference_type shift) {
+    template<typename T, typename Monoid, typename RefCount>
+    inline vector_const_iterator<T, Monoid, RefCount>& vector_const_iterator<T, Monoid, RefCount>::operator-=(const difference_type shift) {
         m_id -= shift;
         return *this;
     }
 
-    template<typename T>
-    inline const T& vector_const_iterator<T>::operator*() const {
+    template<typename T, typename Monoid, typename RefCount>
+    inline const T& vector_const_iterator<T, Monoid, RefCount>::operator*() const {
+        PDS_COUNT(ITERATOR_DESCENTS, 1);
         return (*m_pvector)[m_id];
     }
 
-    template<typename T>
-    inline const T* vector_const_iterator<T>::operator->() const {
+    template<typename T, typename Monoid, typename RefCount>
+    inline const T* vector_const_iterator<T, Monoid, RefCount>::operator->() const {
+        PDS_COUNT(ITERATOR_DESCENTS, 1);
         return &(*m_pvector)[m_id];
     }
 
-    template<typename T>
-    inline const T& vector_const_iterator<T>::operator[](const difference_type shift) const {
+    template<typename T, typename Monoid, typename RefCount>
+    inline const T& vector_const_iterator<T, Monoid, RefCount>::operator[](const difference_type shift) const {
+        PDS_COUNT(ITERATOR_DESCENTS, 1);
         return (*m_pvector)[m_id + shift];
     }
 
-    template<typename T>
-    inline vector_const_iterator<T>& vector_const_iterator<T>::operator++() {
+    template<typename T, typename Monoid, typename RefCount>
+    inline vector_const_iterator<T, Monoid, RefCount>& vector_const_iterator<T, Monoid, RefCount>::operator++() {
         ++m_id;
         return *this;
     }
 
-    template<typename T>
-    inline vector_const_iterator<T>& vector_const_iterator<T>::operator--() {
+    template<typename T, typename Monoid, typename RefCount>
+    inline vector_const_iterator<T, Monoid, RefCount>& vector_const_iterator<T, Monoid, RefCount>::operator--() {
         --m_id;
         return *this;
     }
 
-    template<typename T>
-    inline vector_const_iterator<T> vector_const_iterator<T>::operator++(int) {
+    template<typename T, typename Monoid, typename RefCount>
+    inline vector_const_iterator<T, Monoid, RefCount> vector_const_iterator<T, Monoid, RefCount>::operator++(int) {
         auto copy = *this;
         ++m_id;
         return copy;
     }
 
-    template<typename T>
-    inline vector_const_iterator<T> vector_const_iterator<T>::operator--(int) {
+    template<typename T, typename Monoid, typename RefCount>
+    inline vector_const_iterator<T, Monoid, RefCount> vector_const_iterator<T, Monoid, RefCount>::operator--(int) {
         auto copy = *this;
         --m_id;
         return copy;
     }
 
-    template<typename T>
-    inline typename vector_const_iterator<T>::difference_type vector_const_iterator<T>::operator-(const vector_const_iterator& other) const {
-        return static_cast<vector_const_iterator<T>::difference_type>(m_id - other.m_id);
+    template<typename T, typename Monoid, typename RefCount>
+    inline typename vector_const_iterator<T, Monoid, RefCount>::difference_type vector_const_iterator<T, Monoid, RefCount>::operator-(const vector_const_iterator& other) const {
+        return static_cast<vector_const_iterator<T, Monoid, RefCount>::difference_type>(m_id - other.m_id);
     }
 
-    template<typename T>
-    inline vector_const_iterator<T> vector_const_iterator<T>::operator+(const difference_type shift) const {
+    template<typename T, typename Monoid, typename RefCount>
+    inline vector_const_iterator<T, Monoid, RefCount> vector_const_iterator<T, Monoid, RefCount>::operator+(const difference_type shift) const {
         auto copy = *this;
         copy += shift;
         return copy;
     }
 
-    template<typename T>
-    inline vector_const_iterator<T> vector_const_iterator<T>::operator-(const difference_type shift) const {
+    template<typename T, typename Monoid, typename RefCount>
+    inline vector_const_iterator<T, Monoid, RefCount> vector_const_iterator<T, Monoid, RefCount>::operator-(const difference_type shift) const {
         auto copy = *this;
         copy -= shift;
         return copy;
     }
 
-    template<typename T>
-    inline bool vector_const_iterator<T>::operator==(const vector_const_iterator<T>& other) const {
+    template<typename T, typename Monoid, typename RefCount>
+    inline bool vector_const_iterator<T, Monoid, RefCount>::operator==(const vector_const_iterator<T, Monoid, RefCount>& other) const {
         return m_id == other.m_id;
     }
 
-    template<typename T>
-    inline bool vector_const_iterator<T>::operator!=(const vector_const_iterator<T>& other) const {
+    template<typename T, typename Monoid, typename RefCount>
+    inline bool vector_const_iterator<T, Monoid, RefCount>::operator!=(const vector_const_iterator<T, Monoid, RefCount>& other) const {
         return !(*this == other);
     }
 
-    template<typename T>
-    inline bool vector_const_iterator<T>::operator<(const vector_const_iterator<T>& other) const {
+    template<typename T, typename Monoid, typename RefCount>
+    inline bool vector_const_iterator<T, Monoid, RefCount>::operator<(const vector_const_iterator<T, Monoid, RefCount>& other) const {
         return m_id < other.m_id;
     }
 
-    template<typename T>
-    inline bool vector_const_iterator<T>::operator>(const vector_const_iterator<T>& other) const {
+    template<typename T, typename Monoid, typename RefCount>
+    inline bool vector_const_iterator<T, Monoid, RefCount>::operator>(const vector_const_iterator<T, Monoid, RefCount>& other) const {
         return other < *this;
     }
 
-    template<typename T>
-    inline bool vector_const_iterator<T>::operator>=(const vector_const_iterator<T>& other) const {
+    template<typename T, typename Monoid, typename RefCount>
+    inline bool vector_const_iterator<T, Monoid, RefCount>::operator>=(const vector_const_iterator<T, Monoid, RefCount>& other) const {
         return !(*this < other);
     }
 
-    template<typename T>
-    inline bool vector_const_iterator<T>::operator<=(const vector_const_iterator<T>& other) const {
+    template<typename T, typename Monoid, typename RefCount>
+    inline bool vector_const_iterator<T, Monoid, RefCount>::operator<=(const vector_const_iterator<T, Monoid, RefCount>& other) const {
         return !(other < *this);
     }
 
-    template<typename T>
-    inline std::size_t vector_const_iterator<T>::getId() const {
+    template<typename T, typename Monoid, typename RefCount>
+    inline std::size_t vector_const_iterator<T, Monoid, RefCount>::getId() const {
         return m_id;
     }
 
-    template<typename T>
-    inline vector_const_iterator<T> operator+(const typename vector_const_iterator<T>::difference_type lhs, const vector_const_iterator<T>& rhs) {
+    template<typename T, typename Monoid, typename RefCount>
+    inline vector_const_iterator<T, Monoid, RefCount> operator+(const typename vector_const_iterator<T, Monoid, RefCount>::difference_type lhs, const vector_const_iterator<T, Monoid, RefCount>& rhs) {
         return rhs + lhs;
     }
 
-    template<typename T>
-    inline vector_const_iterator<T> operator-(const typename vector_const_iterator<T>::difference_type lhs, const vector_const_iterator<T>& rhs) {
+    template<typename T, typename Monoid, typename RefCount>
+    inline vector_const_iterator<T, Monoid, RefCount> operator-(const typename vector_const_iterator<T, Monoid, RefCount>::difference_type lhs, const vector_const_iterator<T, Monoid, RefCount>& rhs) {
         return rhs - lhs;
     }
 
@@ -455,77 +1020,254 @@ namespace pds {
     *   Persistent vector
     * 
     */
-    template<typename T>
-    PersistentVector<T>::PersistentVector(std::size_t count) : PersistentVector<T>::PersistentVector() {
+    template<typename T, typename Monoid, typename RefCount>
+    PersistentVector<T, Monoid, RefCount>::PersistentVector(std::size_t count) : PersistentVector<T, Monoid, RefCount>::PersistentVector() {
         for (size_t i = 0; i < count; ++i) {
-            push_back_inplace(T());
+            emplace_back_inplace();
         }
+        cacheReadPath();
     }
 
-    template<typename T>
-    PersistentVector<T>::PersistentVector(std::size_t count, const T& value) : PersistentVector<T>::PersistentVector() {
+    template<typename T, typename Monoid, typename RefCount>
+    PersistentVector<T, Monoid, RefCount>::PersistentVector(std::size_t count, const T& value) : PersistentVector<T, Monoid, RefCount>::PersistentVector() {
         for (size_t i = 0; i < count; ++i) {
-            push_back_inplace(value);
+            emplace_back_inplace(value);
         }
+        cacheReadPath();
     }
 
-    template<typename T>
+    template<typename T, typename Monoid, typename RefCount>
     template<typename InputIt, typename std::enable_if<is_iterator<InputIt>, bool>::type>
-    PersistentVector<T>::PersistentVector(InputIt first, InputIt last) : PersistentVector<T>::PersistentVector() {
-        for (; first != last; ++first) {
-            push_back_inplace(*first);
-        }
+    PersistentVector<T, Monoid, RefCount>::PersistentVector(InputIt first, InputIt last) : PersistentVector<T, Monoid, RefCount>::PersistentVector() {
+        append_inplace(first, last);
     }
 
-    template<typename T>
-    typename PersistentVector<T>::const_iterator PersistentVector<T>::cbegin() const {
+    template<typename T, typename Monoid, typename RefCount>
+    template<typename RandomIt>
+    PersistentVector<T, Monoid, RefCount> PersistentVector<T, Monoid, RefCount>::build_parallel(RandomIt first, RandomIt last, std::size_t threads) {
+        auto root = PrimeTreeRoot<m_primeTreeNodeSize>::buildParallel(first, last, threads);
+        return PersistentVector<T, Monoid, RefCount>(makeShared<VectorVersionTreeNode>(std::move(root)));
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    typename PersistentVector<T, Monoid, RefCount>::const_iterator PersistentVector<T, Monoid, RefCount>::cbegin() const {
         return const_iterator(0, this);
     }
 
-    template<typename T>
-    typename PersistentVector<T>::const_iterator PersistentVector<T>::cend() const {
+    template<typename T, typename Monoid, typename RefCount>
+    typename PersistentVector<T, Monoid, RefCount>::const_iterator PersistentVector<T, Monoid, RefCount>::cend() const {
         return const_iterator(size(), this);
     }
 
-    template<typename T>
-    typename PersistentVector<T>::const_reverse_iterator PersistentVector<T>::crbegin() const {
+    template<typename T, typename Monoid, typename RefCount>
+    typename PersistentVector<T, Monoid, RefCount>::const_reverse_iterator PersistentVector<T, Monoid, RefCount>::crbegin() const {
         return const_reverse_iterator(cend());
     }
 
-    template<typename T>
-    typename PersistentVector<T>::const_reverse_iterator PersistentVector<T>::crend() const {
+    template<typename T, typename Monoid, typename RefCount>
+    typename PersistentVector<T, Monoid, RefCount>::const_reverse_iterator PersistentVector<T, Monoid, RefCount>::crend() const {
         return const_reverse_iterator(cbegin());
     }
 
-    template<typename T>
-    inline const T& PersistentVector<T>::operator[](std::size_t pos) const {
-        return m_versionTreeNode->getRoot()[pos];
+    template<typename T, typename Monoid, typename RefCount>
+    inline const T& PersistentVector<T, Monoid, RefCount>::operator[](std::size_t pos) const {
+        if (nullptr == m_tree) {
+            return (*m_root)[pos];
+        }
+        return m_tree->get(pos, m_depth - 1);
     }
 
-    template<typename T>
-    inline const T& PersistentVector<T>::at(std::size_t pos) const {
+    template<typename T, typename Monoid, typename RefCount>
+    inline const T& PersistentVector<T, Monoid, RefCount>::at(std::size_t pos) const {
         if (pos >= size()) {
             throw std::out_of_range("Index is greater than vector size");
         }
         return (*this)[pos];
     }
 
-    template<typename T>
-    inline PersistentVector<T> PersistentVector<T>::set(std::size_t pos, const T& value) const {
-        auto newRoot = m_versionTreeNode->getRoot().set(pos, std::move(std::make_shared<T>(value)));
-        auto newVectorVersionTreeNode = nullptr == m_versionTreeNode->getRedoChild() ? m_versionTreeNode : m_versionTreeNode->getOrig();
-        auto newVersionTreeNode = std::make_shared<VectorVersionTreeNode>(newRoot, newVectorVersionTreeNode);
-        return PersistentVector<T>(newVersionTreeNode);
+    template<typename T, typename Monoid, typename RefCount>
+    template<typename InputIt, typename OutputIt, typename std::enable_if<is_iterator<InputIt>, bool>::type>
+    OutputIt PersistentVector<T, Monoid, RefCount>::get_many(InputIt first, InputIt last, OutputIt out) const {
+        using Root = PrimeTreeRoot<m_primeTreeNodeSize>;
+        const auto& root = *m_root;
+        std::size_t positions[Root::GET_MANY_BATCH_SIZE];
+        std::size_t count = 0;
+        for (; first != last; ++first) {
+            positions[count++] = static_cast<std::size_t>(*first);
+            if (count == Root::GET_MANY_BATCH_SIZE) {
+                out = root.get_many(positions, count, out);
+                count = 0;
+            }
+        }
+        return root.get_many(positions, count, out);
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<typename Indexes, typename OutputIt>
+    inline OutputIt PersistentVector<T, Monoid, RefCount>::get_many(const Indexes& indexes, OutputIt out) const {
+        return get_many(std::begin(indexes), std::end(indexes), out);
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<typename InputIt, typename OutputIt, typename std::enable_if<is_iterator<InputIt>, bool>::type>
+    OutputIt PersistentVector<T, Monoid, RefCount>::get_history(std::size_t pos, InputIt first, InputIt last, OutputIt out) const {
+        using Node = PrimeTreeNode<m_primeTreeNodeSize>;
+        std::vector<std::size_t> steps;
+        for (; first != last; ++first) {
+            steps.push_back(static_cast<std::size_t>(*first));
+        }
+        std::vector<std::size_t> order(steps.size());
+        for (std::size_t i = 0; i < order.size(); ++i) {
+            order[i] = i;
+        }
+        std::stable_sort(order.begin(), order.end(), [&steps](std::size_t left, std::size_t right) { return steps[left] < steps[right]; });
+
+        // the roots are collected by one walk of the history
+        std::vector<SharedPtr<PrimeTreeRoot<m_primeTreeNodeSize>>> roots(steps.size());
+        auto version = m_versionTreeNode;
+        std::size_t step = 0;
+        for (auto i : order) {
+            for (; step < steps[i] && nullptr != version; ++step) {
+                version = version->getParent();
+            }
+            if (nullptr == version) {
+                throw std::out_of_range("Version is out of the history");
+            }
+            roots[i] = version->getSharedRoot();
+        }
+
+        // a descent is owned by a version, leader[i] is the version whose descent the version i follows
+        struct Descent {
+            const Node* node;
+            std::uint32_t level;
+            std::size_t version;
+        };
+        std::vector<const T*> values(steps.size());
+        std::vector<std::size_t> leader(steps.size());
+        std::vector<Descent> descents;
+        std::uint32_t level = 0;
+        for (auto i : order) {
+            leader[i] = i;
+            const auto& root = *roots[i];
+            if (pos >= root.size()) {
+                throw std::out_of_range("Index is greater than vector size");
+            }
+            if (nullptr == root.tree()) {
+                values[i] = &root[pos];
+            }
+            else {
+                descents.push_back({ root.tree(), root.depth() - 1, i });
+                level = std::max(level, root.depth() - 1);
+            }
+        }
+        for (;; --level) {
+            std::size_t kept = 0;
+            for (std::size_t i = 0; i < descents.size(); ++i) {
+                if (kept > 0 && descents[kept - 1].node == descents[i].node) {
+                    leader[descents[i].version] = descents[kept - 1].version;
+                }
+                else {
+                    descents[kept++] = descents[i];
+                }
+            }
+            descents.resize(kept);
+            if (0 == level) {
+                break;
+            }
+            // the nodes of the next level are prefetched for all the descents, so their cache misses overlap
+            auto id = Utils::getId(pos & Utils::getMask(level + 1, m_primeTreeNodeSize), level, m_primeTreeNodeSize);
+            for (auto& descent : descents) {
+                if (descent.level == level) {
+                    descent.node = descent.node->children()[id].get();
+                    --descent.level;
+                    Utils::prefetch(descent.node);
+                }
+            }
+        }
+        for (const auto& descent : descents) {
+            values[descent.version] = &descent.node->get(pos & Utils::getMask(1, m_primeTreeNodeSize), 0);
+        }
+
+        for (std::size_t i = 0; i < steps.size(); ++i) {
+            auto owner = i;
+            while (leader[owner] != owner) {
+                owner = leader[owner];
+            }
+            *out++ = *values[owner];
+        }
+        return out;
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<typename Steps, typename OutputIt>
+    inline OutputIt PersistentVector<T, Monoid, RefCount>::get_history(std::size_t pos, const Steps& steps, OutputIt out) const {
+        return get_history(pos, std::begin(steps), std::end(steps), out);
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    inline PersistentVector<T, Monoid, RefCount> PersistentVector<T, Monoid, RefCount>::set(std::size_t pos, const T& value) const& {
+        return makeNextVersion(m_versionTreeNode->getRoot().set(pos, makeShared<T>(value)));
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    inline PersistentVector<T, Monoid, RefCount> PersistentVector<T, Monoid, RefCount>::set(std::size_t pos, const T& value) && {
+        if (!canEditInPlace()) {
+            return static_cast<const PersistentVector&>(*this).set(pos, value);
+        }
+        auto previous = m_versionTreeNode->getRoot().set_inplace(pos, makeShared<T>(value));
+        return makeEditedVersion(RestoreOperation::SET, pos, std::move(previous));
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    inline PersistentVector<T, Monoid, RefCount> PersistentVector<T, Monoid, RefCount>::set(std::size_t pos, T&& value) const& {
+        return makeNextVersion(m_versionTreeNode->getRoot().set(pos, makeShared<T>(std::move(value))));
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    inline PersistentVector<T, Monoid, RefCount> PersistentVector<T, Monoid, RefCount>::set(std::size_t pos, T&& value) && {
+        if (!canEditInPlace()) {
+            return static_cast<const PersistentVector&>(*this).set(pos, std::move(value));
+        }
+        auto previous = m_versionTreeNode->getRoot().set_inplace(pos, makeShared<T>(std::move(value)));
+        return makeEditedVersion(RestoreOperation::SET, pos, std::move(previous));
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<typename F>
+    inline PersistentVector<T, Monoid, RefCount> PersistentVector<T, Monoid, RefCount>::update(std::size_t pos, F fn) const& {
+        return makeNextVersion(m_versionTreeNode->getRoot().update(pos, fn));
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<typename F>
+    inline PersistentVector<T, Monoid, RefCount> PersistentVector<T, Monoid, RefCount>::update(std::size_t pos, F fn) && {
+        if (!canEditInPlace()) {
+            return static_cast<const PersistentVector&>(*this).update(pos, std::move(fn));
+        }
+        auto previous = m_versionTreeNode->getRoot().update_inplace(pos, fn);
+        return makeEditedVersion(RestoreOperation::SET, pos, std::move(previous));
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<typename F>
+    PersistentVector<T, Monoid, RefCount> PersistentVector<T, Monoid, RefCount>::update_range(std::size_t first, std::size_t last, F fn) const {
+        if (first > last || last > size()) {
+            throw std::out_of_range("Range is out of vector bounds");
+        }
+        if (first == last) {
+            return PersistentVector<T, Monoid, RefCount>(*this);
+        }
+        return makeNextVersion(m_versionTreeNode->getRoot().update_range(first, last, fn));
     }
 
-    template<typename T>
-    bool PersistentVector<T>::operator==(const PersistentVector<T>& other) const {
+    template<typename T, typename Monoid, typename RefCount>
+    bool PersistentVector<T, Monoid, RefCount>::operator==(const PersistentVector<T, Monoid, RefCount>& other) const {
         bool out = false;
         if (m_versionTreeNode == other.m_versionTreeNode)
         {
             out = true;
         }
-        else if (size() == other.size()) {
+        else if (size() == other.size() && mayBeEqual(other, is_hash_monoid<Monoid>())) {
             out = true;
             for (auto it = cbegin(), it1 = other.cbegin(); it != cend() && out == true; ++it, ++it1) {
                 if (*it != *it1) {
@@ -536,281 +1278,1475 @@ namespace pds {
         return out;
     }
 
-    template<typename T>
-    bool PersistentVector<T>::operator!=(const PersistentVector<T>& other) const {
+    template<typename T, typename Monoid, typename RefCount>
+    bool PersistentVector<T, Monoid, RefCount>::operator!=(const PersistentVector<T, Monoid, RefCount>& other) const {
         return !(*this == other);
     }
 
-    template<typename T>
-    void PersistentVector<T>::swap(PersistentVector<T>& other) {
+    template<typename T, typename Monoid, typename RefCount>
+    void PersistentVector<T, Monoid, RefCount>::swap(PersistentVector<T, Monoid, RefCount>& other) {
         if (this != &other) {
             std::swap(m_versionTreeNode, other.m_versionTreeNode);
+            std::swap(m_root, other.m_root);
+            std::swap(m_tree, other.m_tree);
+            std::swap(m_size, other.m_size);
+            std::swap(m_depth, other.m_depth);
         }
     }
 
-    template<typename T>
-    inline PersistentVector<T> PersistentVector<T>::resize(std::size_t size) const {
+    template<typename T, typename Monoid, typename RefCount>
+    inline PersistentVector<T, Monoid, RefCount> PersistentVector<T, Monoid, RefCount>::resize(std::size_t size) const& {
         if (size == this->size()) {
-            return PersistentVector<T>(*this);
+            return PersistentVector<T, Monoid, RefCount>(*this);
+        }
+        return makeNextVersion(m_versionTreeNode->getRoot().resize(size));
+    }
+
+    // Only growth is done in place: shrinking copies just the rightmost path anyway
+    template<typename T, typename Monoid, typename RefCount>
+    inline PersistentVector<T, Monoid, RefCount> PersistentVector<T, Monoid, RefCount>::resize(std::size_t size) && {
+        auto oldSize = this->size();
+        if (size <= oldSize || !canEditInPlace()) {
+            return static_cast<const PersistentVector&>(*this).resize(size);
         }
-        auto newRoot = m_versionTreeNode->getRoot().resize(size);
-        auto newVectorVersionTreeNode = nullptr == m_versionTreeNode->getRedoChild() ? m_versionTreeNode : m_versionTreeNode->getOrig();
-        auto newVersionTreeNode = std::make_shared<VectorVersionTreeNode>(newRoot, newVectorVersionTreeNode);
-        return PersistentVector<T>(newVersionTreeNode);
+        for (auto i = oldSize; i < size; ++i) {
+            emplace_back_inplace();
+        }
+        return makeEditedVersion(RestoreOperation::RESIZE, oldSize, nullptr);
     }
 
-    template<typename T>
-    inline PersistentVector<T> PersistentVector<T>::resize(std::size_t size, const T& value) const {
+    template<typename T, typename Monoid, typename RefCount>
+    inline PersistentVector<T, Monoid, RefCount> PersistentVector<T, Monoid, RefCount>::resize(std::size_t size, const T& value) const& {
         if (size == this->size()) {
-            return PersistentVector<T>(*this);
+            return PersistentVector<T, Monoid, RefCount>(*this);
+        }
+        return makeNextVersion(m_versionTreeNode->getRoot().resize(size, value));
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    inline PersistentVector<T, Monoid, RefCount> PersistentVector<T, Monoid, RefCount>::resize(std::size_t size, const T& value) && {
+        auto oldSize = this->size();
+        if (size <= oldSize || !canEditInPlace()) {
+            return static_cast<const PersistentVector&>(*this).resize(size, value);
         }
-        auto newRoot = m_versionTreeNode->getRoot().resize(size, value);
-        auto newVectorVersionTreeNode = nullptr == m_versionTreeNode->getRedoChild() ? m_versionTreeNode : m_versionTreeNode->getOrig();
-        auto newVersionTreeNode = std::make_shared<VectorVersionTreeNode>(newRoot, newVectorVersionTreeNode);
-        return PersistentVector<T>(newVersionTreeNode);
+        for (auto i = oldSize; i < size; ++i) {
+            emplace_back_inplace(value);
+        }
+        return makeEditedVersion(RestoreOperation::RESIZE, oldSize, nullptr);
     }
 
-    template<typename T>
-    inline std::size_t PersistentVector<T>::size() const {
-        return m_versionTreeNode->getRoot().size();
+    template<typename T, typename Monoid, typename RefCount>
+    inline std::size_t PersistentVector<T, Monoid, RefCount>::size() const {
+        return m_size;
     }
 
-    template<typename T>
-    inline bool PersistentVector<T>::empty() const {
+    template<typename T, typename Monoid, typename RefCount>
+    inline bool PersistentVector<T, Monoid, RefCount>::empty() const {
         return 0 == size();
     }
 
-    template<typename T>
-    inline bool PersistentVector<T>::canUndo() const {
+    template<typename T, typename Monoid, typename RefCount>
+    inline bool PersistentVector<T, Monoid, RefCount>::canUndo() const {
         return nullptr != m_versionTreeNode->getParent();
     }
 
-    template<typename T>
-    inline bool PersistentVector<T>::canRedo() const {
+    template<typename T, typename Monoid, typename RefCount>
+    inline bool PersistentVector<T, Monoid, RefCount>::canRedo() const {
         return nullptr != m_versionTreeNode->getRedoChild();
     }
 
-    template<typename T>
-    inline PersistentVector<T> PersistentVector<T>::undo() const {
-        auto newVersion = std::make_shared<VectorVersionTreeNode>(m_versionTreeNode->getParent(), m_versionTreeNode);
+    template<typename T, typename Monoid, typename RefCount>
+    inline PersistentVector<T, Monoid, RefCount> PersistentVector<T, Monoid, RefCount>::undo() const {
+        auto newVersion = makeShared<VectorVersionTreeNode>(m_versionTreeNode->getParent(), m_versionTreeNode);
         return PersistentVector(newVersion);
     }
 
-    template<typename T>
-    inline PersistentVector<T> PersistentVector<T>::redo() const {
+    template<typename T, typename Monoid, typename RefCount>
+    inline PersistentVector<T, Monoid, RefCount> PersistentVector<T, Monoid, RefCount>::redo() const {
         auto redoChild = m_versionTreeNode->getRedoChild();
         return PersistentVector(redoChild);
     }
 
-    template<typename T>
-    inline const T& PersistentVector<T>::front() const {
+    template<typename T, typename Monoid, typename RefCount>
+    inline const T& PersistentVector<T, Monoid, RefCount>::front() const {
         return (*this)[0];
     }
 
-    template<typename T>
-    inline const T& PersistentVector<T>::back() const {
+    template<typename T, typename Monoid, typename RefCount>
+    inline const T& PersistentVector<T, Monoid, RefCount>::back() const {
         return (*this)[size() - 1];
     }
 
-    template<typename T>
-    inline PersistentVector<T> PersistentVector<T>::push_back(const T& value) const {
-        return push_back(std::move(T(value)));
+    template<typename T, typename Monoid, typename RefCount>
+    inline PersistentVector<T, Monoid, RefCount> PersistentVector<T, Monoid, RefCount>::push_back(const T& value) const& {
+        return emplace_back(value);
     }
 
-    template<typename T>
-    inline PersistentVector<T> PersistentVector<T>::push_back(T&& value) const {
-        auto newRoot = m_versionTreeNode->getRoot().emplace_back(std::move(std::make_shared<T>(value)));
-        auto newVectorVersionTreeNode = nullptr == m_versionTreeNode->getRedoChild() ? m_versionTreeNode : m_versionTreeNode->getOrig();
-        auto newVersionTreeNode = std::make_shared<VectorVersionTreeNode>(newRoot, newVectorVersionTreeNode);
-        return PersistentVector<T>(newVersionTreeNode);
+    template<typename T, typename Monoid, typename RefCount>
+    inline PersistentVector<T, Monoid, RefCount> PersistentVector<T, Monoid, RefCount>::push_back(const T& value) && {
+        return std::move(*this).emplace_back(value);
     }
 
-    template<typename T>
-    inline PersistentVector<T> PersistentVector<T>::pop_back() const {
-        auto newRoot = m_versionTreeNode->getRoot().pop_back();
-        auto newVectorVersionTreeNode = nullptr == m_versionTreeNode->getRedoChild() ? m_versionTreeNode : m_versionTreeNode->getOrig();
-        auto newVersionTreeNode = std::make_shared<VectorVersionTreeNode>(newRoot, newVectorVersionTreeNode);
-        return PersistentVector<T>(newVersionTreeNode);
+    template<typename T, typename Monoid, typename RefCount>
+    inline PersistentVector<T, Monoid, RefCount> PersistentVector<T, Monoid, RefCount>::push_back(T&& value) const& {
+        return emplace_back(std::move(value));
     }
 
-    template<typename T>
-    template<typename InputIt, typename std::enable_if<is_iterator<InputIt>, bool>::type>
-    inline PersistentVector<T> PersistentVector<T>::reset(InputIt first, InputIt last) const {
-        auto newRoot = std::make_shared<PrimeTreeRoot<m_primeTreeNodeSize>>();
-        for (; first != last; ++first) {
-            newRoot->emplace_back_inplace(std::move(std::make_shared<T>(T(*first))));
-        }
-        auto newVectorVersionTreeNode = nullptr == m_versionTreeNode->getRedoChild() ? m_versionTreeNode : m_versionTreeNode->getOrig();
-        auto newVersionTreeNode = std::make_shared<VectorVersionTreeNode>(newRoot, newVectorVersionTreeNode);
-        return PersistentVector<T>(newVersionTreeNode);
+    template<typename T, typename Monoid, typename RefCount>
+    inline PersistentVector<T, Monoid, RefCount> PersistentVector<T, Monoid, RefCount>::push_back(T&& value) && {
+        return std::move(*this).emplace_back(std::move(value));
     }
 
-    template<typename T>
-    template<typename ...Args>
-    inline PersistentVector<T> PersistentVector<T>::emplace_back(Args && ...args) const {
-        auto newRoot = m_versionTreeNode->getRoot().emplace_back(std::move(std::make_shared<T, Args...>(args...)));
-        auto newVectorVersionTreeNode = nullptr == m_versionTreeNode->getRedoChild() ? m_versionTreeNode : m_versionTreeNode->getOrig();
-        auto newVersionTreeNode = std::make_shared<VectorVersionTreeNode>(newRoot, newVectorVersionTreeNode);
-        return PersistentVector<T>(newVersionTreeNode);
+    template<typename T, typename Monoid, typename RefCount>
+    inline PersistentVector<T, Monoid, RefCount> PersistentVector<T, Monoid, RefCount>::pop_back() const& {
+        return makeNextVersion(m_versionTreeNode->getRoot().pop_back());
     }
 
-    template<typename T>
-    inline PersistentVector<T> PersistentVector<T>::clear() const {
-        return resize(0);
+    template<typename T, typename Monoid, typename RefCount>
+    inline PersistentVector<T, Monoid, RefCount> PersistentVector<T, Monoid, RefCount>::pop_back() && {
+        if (!canEditInPlace()) {
+            return static_cast<const PersistentVector&>(*this).pop_back();
+        }
+        auto removed = m_versionTreeNode->getRoot().pop_back_inplace();
+        return makeEditedVersion(RestoreOperation::PUSH_BACK, 0, std::move(removed));
     }
 
-    template<typename T>
-    inline void PersistentVector<T>::push_back_inplace(const T& value) {
-        m_versionTreeNode->getRoot().emplace_back_inplace(std::move(std::make_shared<T>(T(value))));
+    template<typename T, typename Monoid, typename RefCount>
+    template<typename InputIt, typename std::enable_if<is_iterator<InputIt>, bool>::type>
+    inline PersistentVector<T, Monoid, RefCount> PersistentVector<T, Monoid, RefCount>::reset(InputIt first, InputIt last) const {
+        auto newRoot = makeShared<PrimeTreeRoot<m_primeTreeNodeSize>>();
+        newRoot->append_inplace(first, last);
+        return makeNextVersion(std::move(newRoot));
     }
 
+    template<typename T, typename Monoid, typename RefCount>
+    template<typename ...Args>
+    inline PersistentVector<T, Monoid, RefCount> PersistentVector<T, Monoid, RefCount>::emplace_back(Args && ...args) const& {
+        return makeNextVersion(m_versionTreeNode->getRoot().emplace_back(makeShared<T>(std::forward<Args>(args)...)));
+    }
 
-    /*
-    * 
-    *   PrimeTreeRoot
-    * 
-    */
+    template<typename T, typename Monoid, typename RefCount>
+    template<typename ...Args>
+    inline PersistentVector<T, Monoid, RefCount> PersistentVector<T, Monoid, RefCount>::emplace_back(Args && ...args) && {
+        if (!canEditInPlace()) {
+            return static_cast<const PersistentVector&>(*this).emplace_back(std::forward<Args>(args)...);
+        }
+        emplace_back_inplace(std::forward<Args>(args)...);
+        return makeEditedVersion(RestoreOperation::POP_BACK, 0, nullptr);
+    }
 
-    template<typename T>
-    template<std::uint32_t degreeOfTwo>
-    PersistentVector<T>::PrimeTreeRoot<degreeOfTwo>::PrimeTreeRoot(std::shared_ptr<PrimeTreeNode<degreeOfTwo>> child, 
-                                                                   std::size_t size)
-        : m_child(child),
-        m_size(size)
-    {
-        setSize(size);
+    template<typename T, typename Monoid, typename RefCount>
+    inline PersistentVector<T, Monoid, RefCount> PersistentVector<T, Monoid, RefCount>::push_front(const T& value) const {
+        return emplace_front(value);
     }
 
-    template<typename T>
-    template<std::uint32_t degreeOfTwo>
-    inline const T& PersistentVector<T>::PrimeTreeRoot<degreeOfTwo>::operator[](std::size_t pos) const {
-        return m_child->get(pos, m_depth - 1);
+    template<typename T, typename Monoid, typename RefCount>
+    inline PersistentVector<T, Monoid, RefCount> PersistentVector<T, Monoid, RefCount>::push_front(T&& value) const {
+        return emplace_front(std::move(value));
     }
 
-    template<typename T>
-    template<std::uint32_t degreeOfTwo>
-    inline std::size_t PersistentVector<T>::PrimeTreeRoot<degreeOfTwo>::size() const {
-        return m_size;
+    template<typename T, typename Monoid, typename RefCount>
+    template<typename ...Args>
+    inline PersistentVector<T, Monoid, RefCount> PersistentVector<T, Monoid, RefCount>::emplace_front(Args && ...args) const {
+        return makeNextVersion(m_versionTreeNode->getRoot().emplace_front(makeShared<T>(std::forward<Args>(args)...)));
     }
 
-    template<typename T>
-    template<std::uint32_t degreeOfTwo>
-    inline void PersistentVector<T>::PrimeTreeRoot<degreeOfTwo>::setSize(std::size_t size) {
-        m_size = size;
-        m_depth = 0;
-        if (size) {
-            --size;
-        }
-        while (size) {
-            ++m_depth;
-            size >>= degreeOfTwo;
-        }
+    template<typename T, typename Monoid, typename RefCount>
+    inline PersistentVector<T, Monoid, RefCount> PersistentVector<T, Monoid, RefCount>::pop_front() const {
+        return makeNextVersion(m_versionTreeNode->getRoot().pop_front());
     }
 
-    template<typename T>
-    template<std::uint32_t degreeOfTwo>
-    typename std::shared_ptr<typename PersistentVector<T>::template PrimeTreeRoot<degreeOfTwo>>
-        PersistentVector<T>::PrimeTreeRoot<degreeOfTwo>::emplace_back(std::shared_ptr<T>&& value) const
-    {
-        std::shared_ptr<PrimeTreeNode<degreeOfTwo>> child;
-        std::shared_ptr<PrimeTreeNode<degreeOfTwo>> childOfNewRoot;
-        if (nullptr == m_child.get()) {
-            childOfNewRoot = std::make_shared<PrimeTreeNode<degreeOfTwo>>(std::move(value));
-        }
-        else {
-            auto childCreationStatus = m_child->emplace_back(std::move(value), child);
-            if (childCreationStatus == NEW_NODE) {
-                childOfNewRoot = std::make_shared<PrimeTreeNode<degreeOfTwo>>(m_child, child);
-            }
-            // otherwise childCreationStatus == NODE_DUPLICATE
-            else {
-                childOfNewRoot = child;
-            }
+    template<typename T, typename Monoid, typename RefCount>
+    template<typename InputIt, typename std::enable_if<is_iterator<InputIt>, bool>::type>
+    PersistentVector<T, Monoid, RefCount> PersistentVector<T, Monoid, RefCount>::append(InputIt first, InputIt last) const& {
+        if (first == last) {
+            return PersistentVector<T, Monoid, RefCount>(*this);
         }
-        return std::make_shared<PrimeTreeRoot<degreeOfTwo>>(childOfNewRoot, m_size + 1);
+        PDS_COUNT(PATH_COPIES, 1);
+        auto newRoot = makeShared<PrimeTreeRoot<m_primeTreeNodeSize>>(m_versionTreeNode->getRoot());
+        newRoot->append_inplace(first, last);
+        return makeNextVersion(std::move(newRoot));
     }
 
-    template<typename T>
-    template<std::uint32_t degreeOfTwo>
-    typename std::shared_ptr<typename PersistentVector<T>::template PrimeTreeRoot<degreeOfTwo>>
-        PersistentVector<T>::PrimeTreeRoot<degreeOfTwo>::pop_back() const
-    {
-        std::shared_ptr<PrimeTreeNode<degreeOfTwo>> child = m_child->pop_back();
-        std::shared_ptr<PrimeTreeNode<degreeOfTwo>> childOfNewRoot;
-        if (nullptr != child && child->type() == PrimeTreeNode<degreeOfTwo>::NODE && child->size() == 1) {
-            childOfNewRoot = child->getFirstChild();
+    template<typename T, typename Monoid, typename RefCount>
+    template<typename InputIt, typename std::enable_if<is_iterator<InputIt>, bool>::type>
+    PersistentVector<T, Monoid, RefCount> PersistentVector<T, Monoid, RefCount>::append(InputIt first, InputIt last) && {
+        if (first == last) {
+            return std::move(*this);
         }
-        else {
-            childOfNewRoot = child;
+        if (!canEditInPlace()) {
+            return static_cast<const PersistentVector&>(*this).append(first, last);
         }
-        return std::make_shared<PrimeTreeRoot<degreeOfTwo>>(childOfNewRoot, m_size - 1);
+        auto oldSize = size();
+        m_versionTreeNode->getRoot().append_inplace(first, last);
+        return makeEditedVersion(RestoreOperation::RESIZE, oldSize, nullptr);
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<typename Compare>
+    PersistentVector<T, Monoid, RefCount> PersistentVector<T, Monoid, RefCount>::sorted(Compare cmp) const {
+        std::vector<SharedPtr<T>> values;
+        values.reserve(size());
+        m_versionTreeNode->getRoot().collect(values);
+        Utils::parallelStableSort(values.begin(), values.end(), [&cmp](const SharedPtr<T>& left, const SharedPtr<T>& right) {
+            return cmp(*left, *right);
+        });
+        return makeNextVersion(PrimeTreeRoot<m_primeTreeNodeSize>::build(std::move(values)));
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<typename Hash>
+    PersistentVector<T, Monoid, RefCount> PersistentVector<T, Monoid, RefCount>::intern(InternTable& table, Hash hash) const {
+        auto root = m_versionTreeNode->getRoot().intern(table, hash);
+        auto parent = m_versionTreeNode->getParent();
+        if (nullptr != parent) {
+            // a parent edited in place is restored from this version, which the interned one does not keep
+            parent->getSharedRoot();
+        }
+        return PersistentVector<T, Monoid, RefCount>(makeShared<VectorVersionTreeNode>(std::move(root), std::move(parent)));
     }
 
-    template<typename T>
-    template<std::uint32_t degreeOfTwo>
-    void PersistentVector<T>::PrimeTreeRoot<degreeOfTwo>::emplace_back_inplace(std::shared_ptr<T>&& value)
-    {
-        if (nullptr == m_child.get()) {
-            m_child = std::make_shared<PrimeTreeNode<degreeOfTwo>>(std::move(value));
-        }
-        else {
-            std::shared_ptr<PrimeTreeNode<degreeOfTwo>> child;
-            auto childCreationStatus = m_child->emplace_back_inplace(std::move(value), child);
-            if (childCreationStatus == NEW_NODE) {
-                m_child = std::make_shared<PrimeTreeNode<degreeOfTwo>>(m_child, child);
-            }
-        }
-        setSize(size() + 1);
+    template<typename T, typename Monoid, typename RefCount>
+    template<typename Key, typename Compare>
+    typename PersistentVector<T, Monoid, RefCount>::const_iterator PersistentVector<T, Monoid, RefCount>::lower_bound(const Key& value, Compare cmp) const {
+        auto pos = m_root->partitionPoint([&value, &cmp](const T& element) {
+            return !cmp(element, value);
+        });
+        return const_iterator(pos, this);
     }
 
-    template<typename T>
-    template<std::uint32_t degreeOfTwo>
-    typename std::shared_ptr<typename PersistentVector<T>::template PrimeTreeRoot<degreeOfTwo>>
-        PersistentVector<T>::PrimeTreeRoot<degreeOfTwo>::set(std::size_t pos, std::shared_ptr<T>&& value)
-    {
-        return std::make_shared<PrimeTreeRoot<degreeOfTwo>>(m_child->set(pos, m_depth - 1, std::move(value)), m_size);
+    template<typename T, typename Monoid, typename RefCount>
+    template<typename Key, typename Compare>
+    typename PersistentVector<T, Monoid, RefCount>::const_iterator PersistentVector<T, Monoid, RefCount>::upper_bound(const Key& value, Compare cmp) const {
+        auto pos = m_root->partitionPoint([&value, &cmp](const T& element) {
+            return cmp(value, element);
+        });
+        return const_iterator(pos, this);
     }
-    
-    template<typename T>
-    template<std::uint32_t degreeOfTwo>
-    typename std::shared_ptr<typename PersistentVector<T>::template PrimeTreeRoot<degreeOfTwo>>
-        PersistentVector<T>::PrimeTreeRoot<degreeOfTwo>::resize(std::size_t size) const
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<typename Key, typename Compare>
+    std::pair<typename PersistentVector<T, Monoid, RefCount>::const_iterator, typename PersistentVector<T, Monoid, RefCount>::const_iterator>
+        PersistentVector<T, Monoid, RefCount>::equal_range(const Key& value, Compare cmp) const
     {
-        std::shared_ptr<PrimeTreeRoot<degreeOfTwo>> out;
-        if (size < m_size) {
-            auto child = m_child->reduce_size(size, m_depth - 1);
-            if (child != nullptr && child->type() == PrimeTreeNode<degreeOfTwo>::NODE && child->size() == 1) {
-                child = child->getFirstNodeWithSomeChildren();
-            }
-            out = std::make_shared<PrimeTreeRoot<degreeOfTwo>>(std::move(child), size);
-            
-        }
-        else {
-            out = std::make_shared<PrimeTreeRoot<degreeOfTwo>>(m_child, m_size);
-            for (auto i = m_size; i < size; ++i) {
-                out->emplace_back_inplace(std::make_shared<T>(std::move(T())));
-            }
-        }
-        return out;
+        return std::make_pair(lower_bound(value, cmp), upper_bound(value, cmp));
     }
 
-    template<typename T>
+    template<typename T, typename Monoid, typename RefCount>
+    template<typename M>
+    typename M::summary_type PersistentVector<T, Monoid, RefCount>::aggregate(std::size_t first, std::size_t last) const {
+        if (first > last || last > size()) {
+            throw std::out_of_range("Range is out of vector bounds");
+        }
+        return m_root->aggregate(first, last);
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<typename M>
+    inline typename M::summary_type PersistentVector<T, Monoid, RefCount>::prefix(std::size_t count) const {
+        return aggregate(0, count);
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<typename M>
+    inline typename M::summary_type PersistentVector<T, Monoid, RefCount>::summary() const {
+        return aggregate(0, size());
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    inline std::size_t PersistentVector<T, Monoid, RefCount>::content_hash() const {
+        return contentHash(is_hash_monoid<Monoid>());
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<typename OutputIt>
+    OutputIt PersistentVector<T, Monoid, RefCount>::copy_to(OutputIt out, std::size_t first, std::size_t last) const {
+        if (first > last || last > size()) {
+            throw std::out_of_range("Range is out of vector bounds");
+        }
+        return m_root->copyTo(out, first, last);
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<typename OutputIt>
+    inline OutputIt PersistentVector<T, Monoid, RefCount>::copy_to(OutputIt out) const {
+        return copy_to(out, 0, size());
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    std::vector<T> PersistentVector<T, Monoid, RefCount>::to_std_vector() const {
+        std::vector<T> out;
+        out.reserve(size());
+        copy_to(std::back_inserter(out));
+        return out;
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    inline PersistentVector<T, Monoid, RefCount> PersistentVector<T, Monoid, RefCount>::clear() const {
+        return resize(0);
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<typename ...Args>
+    inline void PersistentVector<T, Monoid, RefCount>::emplace_back_inplace(Args && ...args) {
+        m_versionTreeNode->getRoot().emplace_back_inplace(makeShared<T>(std::forward<Args>(args)...));
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    inline PersistentVector<T, Monoid, RefCount> PersistentVector<T, Monoid, RefCount>::makeNextVersion(SharedPtr<PrimeTreeRoot<m_primeTreeNodeSize>> newRoot) const {
+        auto parent = nullptr == m_versionTreeNode->getRedoChild() ? m_versionTreeNode : m_versionTreeNode->getOrig();
+        return PersistentVector<T, Monoid, RefCount>(makeShared<VectorVersionTreeNode>(std::move(newRoot), std::move(parent)));
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<typename InputIt>
+    inline void PersistentVector<T, Monoid, RefCount>::append_inplace(InputIt first, InputIt last) {
+        m_versionTreeNode->getRoot().append_inplace(first, last);
+        cacheReadPath();
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    inline void PersistentVector<T, Monoid, RefCount>::cacheReadPath() {
+        m_root = &m_versionTreeNode->getRoot();
+        m_tree = m_root->tree();
+        m_size = m_root->size();
+        m_depth = m_root->depth();
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    inline bool PersistentVector<T, Monoid, RefCount>::canEditInPlace() const {
+        // a version reached by undo is excluded: its successors take the original version as the parent
+        // so are the versions made by push_front/pop_front: the in-place operations expect a plain root
+        if (m_versionTreeNode.use_count() != 1 || canRedo() || !m_versionTreeNode->ownsRoot() || !m_root->isPlain()) {
+            return false;
+        }
+        Utils::acquireSoleOwnership();
+        return true;
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    inline std::size_t PersistentVector<T, Monoid, RefCount>::contentHash(std::true_type) const {
+        return static_cast<std::size_t>(summary().hash);
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    std::size_t PersistentVector<T, Monoid, RefCount>::contentHash(std::false_type) const {
+        // the same hash as the summary of HashMonoid<T>
+        using M = HashMonoid<T>;
+        auto out = M::identity();
+        for (auto it = cbegin(); it != cend(); ++it) {
+            out = M::combine(out, M::measure(*it));
+        }
+        return static_cast<std::size_t>(out.hash);
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    inline bool PersistentVector<T, Monoid, RefCount>::mayBeEqual(const PersistentVector& other, std::true_type) const {
+        return summary() == other.summary();
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    inline bool PersistentVector<T, Monoid, RefCount>::mayBeEqual(const PersistentVector&, std::false_type) const {
+        return true;
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    PersistentVector<T, Monoid, RefCount> PersistentVector<T, Monoid, RefCount>::makeEditedVersion(RestoreOperation operation, std::size_t pos, SharedPtr<T> value) {
+        PDS_COUNT(IN_PLACE_EDITS, 1);
+        auto successor = makeShared<VectorVersionTreeNode>(m_versionTreeNode->releaseRoot(), m_versionTreeNode);
+        m_versionTreeNode->setRestoreOperation(successor.get(), operation, pos, std::move(value));
+        m_versionTreeNode.reset();
+        return PersistentVector<T, Monoid, RefCount>(std::move(successor));
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    MemoryUsage PersistentVector<T, Monoid, RefCount>::memoryUsage() const {
+        MemoryAccountant accountant;
+        accountMemory(accountant);
+        return accountant.usage();
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    void PersistentVector<T, Monoid, RefCount>::accountMemory(MemoryAccountant& accountant) const {
+        if (accountant.visit(m_versionTreeNode.get(), MemoryAccountant::sharedBlockSize<VectorVersionTreeNode>(), MemoryAccountant::BlockType::VERSION_NODE)) {
+            m_versionTreeNode->accountMemory(accountant);
+        }
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    void PersistentVector<T, Monoid, RefCount>::retire(ReclamationQueue& queue) && {
+        queue.push(std::move(m_versionTreeNode));
+    }
+
+
+    /*
+    * 
+    *   PrimeTreeRoot
+    * 
+    */
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<std::uint32_t degreeOfTwo>
+    PersistentVector<T, Monoid, RefCount>::PrimeTreeRoot<degreeOfTwo>::PrimeTreeRoot(SharedPtr<PrimeTreeNode<degreeOfTwo>> child, 
+                                                                   std::size_t size)
+        : m_child(std::move(child)),
+        m_size(size)
+    {
+        setSize(size);
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<std::uint32_t degreeOfTwo>
+    PersistentVector<T, Monoid, RefCount>::PrimeTreeRoot<degreeOfTwo>::PrimeTreeRoot(const PrimeTreeRoot& other)
+        : m_size(other.m_size),
+        m_depth(other.m_depth),
+        m_frontPart(other.m_frontPart)
+    {
+        if (isSmall()) {
+            new (&m_small) Small(other.m_small);
+        }
+        else {
+            new (&m_child) Child(other.m_child);
+        }
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<std::uint32_t degreeOfTwo>
+    PersistentVector<T, Monoid, RefCount>::PrimeTreeRoot<degreeOfTwo>::~PrimeTreeRoot() {
+        if (isSmall()) {
+            m_small.~Small();
+        }
+        else {
+            m_child.~Child();
+        }
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<std::uint32_t degreeOfTwo>
+    inline const T& PersistentVector<T, Monoid, RefCount>::PrimeTreeRoot<degreeOfTwo>::operator[](std::size_t pos) const {
+        auto frontCount = frontSize();
+        if (pos < frontCount) {
+            return *getFront(pos);
+        }
+        pos += offset() - frontCount;
+        if (isSmall()) {
+            return *m_small->values[pos];
+        }
+        return m_child->get(pos, m_depth - 1);
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<std::uint32_t degreeOfTwo>
+    template<typename OutputIt>
+    OutputIt PersistentVector<T, Monoid, RefCount>::PrimeTreeRoot<degreeOfTwo>::get_many(const std::size_t* positions, std::size_t count, OutputIt out) const {
+        if (!isPlain()) {
+            for (std::size_t i = 0; i < count; ++i, ++out) {
+                *out = (*this)[positions[i]];
+            }
+            return out;
+        }
+        if (isSmall()) {
+            for (std::size_t i = 0; i < count; ++i, ++out) {
+                *out = *m_small->values[positions[i]];
+            }
+            return out;
+        }
+        constexpr std::size_t idMask = Utils::binPow(degreeOfTwo) - 1;
+        // every level costs two dependent loads: the slot in the array of the node and the node it points to,
+        // both are prefetched for the whole batch before the first of them is used
+        const PrimeTreeNode<degreeOfTwo>* nodes[GET_MANY_BATCH_SIZE];
+        for (std::size_t i = 0; i < count; ++i) {
+            nodes[i] = m_child.get();
+        }
+        for (auto level = m_depth - 1; level > 0; --level) {
+            const SharedPtr<PrimeTreeNode<degreeOfTwo>>* slots[GET_MANY_BATCH_SIZE];
+            for (std::size_t i = 0; i < count; ++i) {
+                slots[i] = nodes[i]->children() + ((positions[i] >> (level * degreeOfTwo)) & idMask);
+                Utils::prefetch(slots[i]);
+            }
+            for (std::size_t i = 0; i < count; ++i) {
+                nodes[i] = slots[i]->get();
+                Utils::prefetch(nodes[i]);
+            }
+        }
+        const SharedPtr<T>* slots[GET_MANY_BATCH_SIZE];
+        for (std::size_t i = 0; i < count; ++i) {
+            slots[i] = nodes[i]->values() + (positions[i] & idMask);
+            Utils::prefetch(slots[i]);
+        }
+        const T* values[GET_MANY_BATCH_SIZE];
+        for (std::size_t i = 0; i < count; ++i) {
+            values[i] = slots[i]->get();
+            Utils::prefetch(values[i]);
+        }
+        for (std::size_t i = 0; i < count; ++i, ++out) {
+            *out = *values[i];
+        }
+        return out;
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<std::uint32_t degreeOfTwo>
+    typename RefCount::template pointer<typename PersistentVector<T, Monoid, RefCount>::template PrimeTreeRoot<degreeOfTwo>>
+        PersistentVector<T, Monoid, RefCount>::PrimeTreeRoot<degreeOfTwo>::build(std::vector<SharedPtr<T>>&& values)
+    {
+        auto size = values.size();
+        if (size <= SMALL_SIZE) {
+            auto out = makeShared<PrimeTreeRoot<degreeOfTwo>>();
+            if (0 != size) {
+                out->m_small = makeShared<SmallBlock>();
+                std::move(values.begin(), values.end(), out->m_small->values.begin());
+            }
+            out->setSize(size);
+            return out;
+        }
+        constexpr std::size_t arraySize = Utils::binPow(degreeOfTwo);
+        std::vector<SharedPtr<PrimeTreeNode<degreeOfTwo>>> level;
+        level.reserve((size + arraySize - 1) / arraySize);
+        for (std::size_t i = 0; i < size; i += arraySize) {
+            level.push_back(PrimeTreeNode<degreeOfTwo>::makeLeaf(values.begin() + i, values.begin() + std::min(size, i + arraySize)));
+        }
+        return buildFromLeaves(std::move(level), size);
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<std::uint32_t degreeOfTwo>
+    template<typename RandomIt>
+    typename RefCount::template pointer<typename PersistentVector<T, Monoid, RefCount>::template PrimeTreeRoot<degreeOfTwo>>
+        PersistentVector<T, Monoid, RefCount>::PrimeTreeRoot<degreeOfTwo>::buildParallel(RandomIt first, RandomIt last, std::size_t threads)
+    {
+        auto size = static_cast<std::size_t>(std::distance(first, last));
+        if (threads <= 1 || size < PARALLEL_BUILD_MIN_SIZE) {
+            auto out = makeShared<PrimeTreeRoot<degreeOfTwo>>();
+            out->append_inplace(first, last);
+            return out;
+        }
+        constexpr std::size_t arraySize = Utils::binPow(degreeOfTwo);
+        std::vector<SharedPtr<PrimeTreeNode<degreeOfTwo>>> level((size + arraySize - 1) / arraySize);
+        threads = std::min(threads, level.size());
+        // every thread makes the leaves of its own part of the level
+        auto makeLeaves = [&](std::size_t firstLeaf, std::size_t lastLeaf) {
+            std::array<SharedPtr<T>, arraySize> values;
+            for (auto id = firstLeaf; id < lastLeaf; ++id) {
+                auto begin = id * arraySize;
+                auto count = std::min(arraySize, size - begin);
+                for (std::size_t i = 0; i < count; ++i) {
+                    values[i] = makeShared<T>(first[static_cast<typename std::iterator_traits<RandomIt>::difference_type>(begin + i)]);
+                }
+                level[id] = PrimeTreeNode<degreeOfTwo>::makeLeaf(values.begin(), values.begin() + count);
+            }
+        };
+        std::vector<std::exception_ptr> errors(threads);
+        std::vector<std::thread> workers;
+        workers.reserve(threads - 1);
+        try {
+            for (std::size_t t = 1; t < threads; ++t) {
+                workers.emplace_back([&, t]() {
+                    try {
+                        makeLeaves(level.size() * t / threads, level.size() * (t + 1) / threads);
+                    }
+                    catch (...) {
+                        errors[t] = std::current_exception();
+                    }
+                });
+            }
+        }
+        catch (...) {
+            // a thread failed to start: the started ones use the locals and must not outlive them
+            for (auto& worker : workers) {
+                worker.join();
+            }
+            throw;
+        }
+        try {
+            makeLeaves(0, level.size() / threads);
+        }
+        catch (...) {
+            errors[0] = std::current_exception();
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        for (const auto& error : errors) {
+            if (error) {
+                std::rethrow_exception(error);
+            }
+        }
+        return buildFromLeaves(std::move(level), size);
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<std::uint32_t degreeOfTwo>
+    typename RefCount::template pointer<typename PersistentVector<T, Monoid, RefCount>::template PrimeTreeRoot<degreeOfTwo>>
+        PersistentVector<T, Monoid, RefCount>::PrimeTreeRoot<degreeOfTwo>::buildFromLeaves(std::vector<SharedPtr<PrimeTreeNode<degreeOfTwo>>>&& level, std::size_t size)
+    {
+        constexpr std::size_t arraySize = Utils::binPow(degreeOfTwo);
+        // every level but the last one is full, the same shape emplace_back produces
+        while (level.size() > 1) {
+            std::vector<SharedPtr<PrimeTreeNode<degreeOfTwo>>> upper;
+            upper.reserve((level.size() + arraySize - 1) / arraySize);
+            for (std::size_t i = 0; i < level.size(); i += arraySize) {
+                upper.push_back(PrimeTreeNode<degreeOfTwo>::makeNode(level.begin() + i, level.begin() + std::min(level.size(), i + arraySize)));
+            }
+            level = std::move(upper);
+        }
+        return makeShared<PrimeTreeRoot<degreeOfTwo>>(std::move(level.front()), size);
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<std::uint32_t degreeOfTwo>
+    void PersistentVector<T, Monoid, RefCount>::PrimeTreeRoot<degreeOfTwo>::collect(std::vector<SharedPtr<T>>& out) const {
+        // the front part is stored backwards, so it is walked from its last leaf to its first one
+        auto push = [&out](const SharedPtr<T>& value) { out.push_back(value); };
+        if (nullptr != m_frontPart && nullptr != m_frontPart->head) {
+            m_frontPart->head->forEachBackward(0, m_frontPart->head->size(), 0, push);
+        }
+        if (nullptr != m_frontPart && nullptr != m_frontPart->front) {
+            m_frontPart->front->forEachBackward(m_frontPart->frontOffset, m_frontPart->frontSize, m_frontPart->frontDepth - 1, push);
+        }
+        if (isSmall()) {
+            if (0 != m_size) {
+                out.insert(out.end(), m_small->values.begin() + offset(), m_small->values.begin() + m_size);
+            }
+        }
+        else {
+            auto begin = out.size();
+            m_child->collect(out);
+            out.erase(out.begin() + begin, out.begin() + begin + offset());
+        }
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<std::uint32_t degreeOfTwo>
+    template<typename OutputIt>
+    OutputIt PersistentVector<T, Monoid, RefCount>::PrimeTreeRoot<degreeOfTwo>::copyTo(OutputIt out, std::size_t first, std::size_t last) const {
+        auto frontCount = frontSize();
+        if (first < frontCount) {
+            // the elements [first, last) of the front part are its slots [frontCount - last, frontCount - first)
+            // read backwards: the ones of the head, then the ones of the front tree
+            auto copy = [&out](const SharedPtr<T>& value) { *out++ = *value; };
+            auto& part = *m_frontPart;
+            auto slotsFirst = frontCount - std::min(last, frontCount);
+            auto slotsLast = frontCount - first;
+            auto treeSize = part.frontSize - part.frontOffset;
+            if (slotsLast > treeSize) {
+                part.head->forEachBackward(std::max(slotsFirst, treeSize) - treeSize, slotsLast - treeSize, 0, copy);
+            }
+            if (slotsFirst < treeSize) {
+                part.front->forEachBackward(slotsFirst + part.frontOffset, std::min(slotsLast, treeSize) + part.frontOffset, part.frontDepth - 1, copy);
+            }
+            first = std::min(last, frontCount);
+        }
+        if (first == last) {
+            return out;
+        }
+        first += offset() - frontCount;
+        last += offset() - frontCount;
+        if (isSmall()) {
+            for (; first < last; ++first) {
+                *out++ = *m_small->values[first];
+            }
+            return out;
+        }
+        return m_child->copyTo(out, first, last, m_depth - 1);
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<std::uint32_t degreeOfTwo>
+    template<typename Hash>
+    typename RefCount::template pointer<typename PersistentVector<T, Monoid, RefCount>::template PrimeTreeRoot<degreeOfTwo>>
+        PersistentVector<T, Monoid, RefCount>::PrimeTreeRoot<degreeOfTwo>::intern(InternTable& table, const Hash& hash) const
+    {
+        if (!isPlain()) {
+            return flatten()->intern(table, hash);
+        }
+        if (isSmall()) {
+            return makeShared<PrimeTreeRoot<degreeOfTwo>>(*this);
+        }
+        return makeShared<PrimeTreeRoot<degreeOfTwo>>(table.intern(m_child, hash), m_size);
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<std::uint32_t degreeOfTwo>
+    template<typename Predicate>
+    std::size_t PersistentVector<T, Monoid, RefCount>::PrimeTreeRoot<degreeOfTwo>::partitionPoint(Predicate pred) const {
+        if (!isPlain()) {
+            // the elements are not in one tree, so the search goes by positions
+            std::size_t first = 0;
+            for (auto count = size(); count > 0;) {
+                auto step = count / 2;
+                if (!pred((*this)[first + step])) {
+                    first += step + 1;
+                    count -= step + 1;
+                }
+                else {
+                    count = step;
+                }
+            }
+            return first;
+        }
+        if (isSmall()) {
+            if (0 == m_size) {
+                return 0;
+            }
+            auto& values = m_small->values;
+            auto it = std::partition_point(values.begin(), values.begin() + m_size, [&pred](const SharedPtr<T>& element) {
+                return !pred(*element);
+            });
+            return static_cast<std::size_t>(it - values.begin());
+        }
+        if (!pred(m_child->back())) {
+            return m_size;
+        }
+        return m_child->partitionPoint(m_depth - 1, pred);
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<std::uint32_t degreeOfTwo>
+    template<typename M>
+    typename M::summary_type PersistentVector<T, Monoid, RefCount>::PrimeTreeRoot<degreeOfTwo>::aggregate(std::size_t first, std::size_t last) const {
+        auto out = M::identity();
+        auto frontCount = frontSize();
+        if (first < frontCount) {
+            // the slots are found as by copyTo; the front nodes combine their content backwards themselves
+            auto& part = *m_frontPart;
+            auto slotsFirst = frontCount - std::min(last, frontCount);
+            auto slotsLast = frontCount - first;
+            auto treeSize = part.frontSize - part.frontOffset;
+            if (slotsLast > treeSize) {
+                out = part.head->aggregate(std::max(slotsFirst, treeSize) - treeSize, slotsLast - treeSize, 0);
+            }
+            if (slotsFirst < treeSize) {
+                auto treeFirst = slotsFirst + part.frontOffset;
+                auto treeLast = std::min(slotsLast, treeSize) + part.frontOffset;
+                if (0 == treeFirst && part.frontSize == treeLast) {
+                    out = M::combine(out, part.front->summary());
+                }
+                else {
+                    out = M::combine(out, part.front->aggregate(treeFirst, treeLast, part.frontDepth - 1));
+                }
+            }
+            first = std::min(last, frontCount);
+        }
+        if (first == last) {
+            return out;
+        }
+        first += offset() - frontCount;
+        last += offset() - frontCount;
+        if (isSmall()) {
+            for (; first < last; ++first) {
+                out = M::combine(out, M::measure(*m_small->values[first]));
+            }
+            return out;
+        }
+        if (0 == first && m_size == last) {
+            return M::combine(out, m_child->summary());
+        }
+        return M::combine(out, m_child->aggregate(first, last, m_depth - 1));
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<std::uint32_t degreeOfTwo>
+    inline std::size_t PersistentVector<T, Monoid, RefCount>::PrimeTreeRoot<degreeOfTwo>::size() const {
+        return frontSize() + m_size - offset();
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<std::uint32_t degreeOfTwo>
+    inline bool PersistentVector<T, Monoid, RefCount>::PrimeTreeRoot<degreeOfTwo>::isPlain() const {
+        return nullptr == m_frontPart;
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<std::uint32_t degreeOfTwo>
+    inline std::size_t PersistentVector<T, Monoid, RefCount>::PrimeTreeRoot<degreeOfTwo>::frontSize() const {
+        if (nullptr == m_frontPart) {
+            return 0;
+        }
+        return m_frontPart->frontSize - m_frontPart->frontOffset + (nullptr == m_frontPart->head ? 0 : m_frontPart->head->size());
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<std::uint32_t degreeOfTwo>
+    inline std::size_t PersistentVector<T, Monoid, RefCount>::PrimeTreeRoot<degreeOfTwo>::offset() const {
+        return nullptr == m_frontPart ? 0 : m_frontPart->offset;
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<std::uint32_t degreeOfTwo>
+    typename PersistentVector<T, Monoid, RefCount>::template PrimeTreeRoot<degreeOfTwo>::FrontPart&
+        PersistentVector<T, Monoid, RefCount>::PrimeTreeRoot<degreeOfTwo>::editFront()
+    {
+        if (nullptr == m_frontPart) {
+            m_frontPart = makeShared<FrontPart>();
+        }
+        else if (m_frontPart.use_count() == 1) {
+            Utils::acquireSoleOwnership();
+        }
+        else {
+            m_frontPart = makeShared<FrontPart>(*m_frontPart);
+        }
+        return *m_frontPart;
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<std::uint32_t degreeOfTwo>
+    void PersistentVector<T, Monoid, RefCount>::PrimeTreeRoot<degreeOfTwo>::dropEmptyFront() {
+        if (nullptr != m_frontPart && nullptr == m_frontPart->head && nullptr == m_frontPart->front && 0 == m_frontPart->offset) {
+            m_frontPart.reset();
+        }
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<std::uint32_t degreeOfTwo>
+    inline const typename RefCount::template pointer<T>& PersistentVector<T, Monoid, RefCount>::PrimeTreeRoot<degreeOfTwo>::getFront(std::size_t pos) const {
+        pos = frontSize() - 1 - pos;
+        auto& part = *m_frontPart;
+        auto treeSize = part.frontSize - part.frontOffset;
+        if (pos < treeSize) {
+            return part.front->getShared(pos + part.frontOffset, part.frontDepth - 1);
+        }
+        return part.head->values()[pos - treeSize];
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<std::uint32_t degreeOfTwo>
+    inline const typename RefCount::template pointer<T>& PersistentVector<T, Monoid, RefCount>::PrimeTreeRoot<degreeOfTwo>::getBody(std::size_t pos) const {
+        return isSmall() ? m_small->values[pos] : m_child->getShared(pos, m_depth - 1);
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<std::uint32_t degreeOfTwo>
+    void PersistentVector<T, Monoid, RefCount>::PrimeTreeRoot<degreeOfTwo>::accountMemory(MemoryAccountant& accountant) const {
+        if (nullptr != m_frontPart && accountant.visit(m_frontPart.get(), MemoryAccountant::sharedBlockSize<FrontPart>(), MemoryAccountant::BlockType::VERSION_NODE)) {
+            if (nullptr != m_frontPart->head) {
+                m_frontPart->head->accountMemory(accountant);
+            }
+            if (nullptr != m_frontPart->front) {
+                m_frontPart->front->accountMemory(accountant);
+            }
+        }
+        if (!isSmall()) {
+            m_child->accountMemory(accountant);
+        }
+        else if (nullptr != m_small && accountant.visit(m_small.get(), MemoryAccountant::sharedBlockSize<SmallBlock>(), MemoryAccountant::BlockType::LEAF)) {
+            for (std::size_t i = 0; i < m_size; ++i) {
+                auto& value = m_small->values[i];
+                if (accountant.visit(value.get(), MemoryAccountant::sharedBlockSize<T>(), MemoryAccountant::BlockType::ELEMENT)) {
+                    Utils::accountElementMemory(*value, accountant);
+                }
+            }
+        }
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<std::uint32_t degreeOfTwo>
+    void PersistentVector<T, Monoid, RefCount>::PrimeTreeRoot<degreeOfTwo>::releaseChildren(ReclamationQueue& queue) {
+        if (isSmall()) {
+            queue.push(std::move(m_small));
+        }
+        else {
+            queue.push(std::move(m_child));
+        }
+        queue.push(std::move(m_frontPart));
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<std::uint32_t degreeOfTwo>
+    void PersistentVector<T, Monoid, RefCount>::PrimeTreeRoot<degreeOfTwo>::FrontPart::releaseChildren(ReclamationQueue& queue) {
+        queue.push(std::move(head));
+        queue.push(std::move(front));
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<std::uint32_t degreeOfTwo>
+    void PersistentVector<T, Monoid, RefCount>::PrimeTreeRoot<degreeOfTwo>::SmallBlock::releaseChildren(ReclamationQueue& queue) {
+        if (Utils::is_retirable<T>) {
+            for (auto& element : values) {
+                queue.push(std::move(element));
+            }
+        }
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<std::uint32_t degreeOfTwo>
+    inline bool PersistentVector<T, Monoid, RefCount>::PrimeTreeRoot<degreeOfTwo>::isSmall() const {
+        return m_size <= SMALL_SIZE;
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<std::uint32_t degreeOfTwo>
+    void PersistentVector<T, Monoid, RefCount>::PrimeTreeRoot<degreeOfTwo>::makeSmallBody() {
+        m_child.~Child();
+        new (&m_small) Small();
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<std::uint32_t degreeOfTwo>
+    void PersistentVector<T, Monoid, RefCount>::PrimeTreeRoot<degreeOfTwo>::makeTreeBody() {
+        m_small.~Small();
+        new (&m_child) Child();
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<std::uint32_t degreeOfTwo>
+    void PersistentVector<T, Monoid, RefCount>::PrimeTreeRoot<degreeOfTwo>::detachSmall() {
+        if (nullptr == m_small) {
+            m_small = makeShared<SmallBlock>();
+        }
+        else if (m_small.use_count() == 1) {
+            Utils::acquireSoleOwnership();
+        }
+        else {
+            m_small = makeShared<SmallBlock>(*m_small);
+        }
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<std::uint32_t degreeOfTwo>
+    typename RefCount::template pointer<typename PersistentVector<T, Monoid, RefCount>::template PrimeTreeRoot<degreeOfTwo>>
+        PersistentVector<T, Monoid, RefCount>::PrimeTreeRoot<degreeOfTwo>::makeSmallPrefix(std::size_t size) const
+    {
+        auto out = makeShared<PrimeTreeRoot<degreeOfTwo>>();
+        if (0 != size) {
+            out->m_small = makeShared<SmallBlock>();
+        }
+        for (std::size_t i = 0; i < size; ++i) {
+            out->m_small->values[i] = getBody(i);
+        }
+        out->setSize(size);
+        return out;
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<std::uint32_t degreeOfTwo>
+    inline void PersistentVector<T, Monoid, RefCount>::PrimeTreeRoot<degreeOfTwo>::setSize(std::size_t size) {
+        m_size = size;
+        m_depth = depthOf(size);
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<std::uint32_t degreeOfTwo>
+    inline std::uint32_t PersistentVector<T, Monoid, RefCount>::PrimeTreeRoot<degreeOfTwo>::depthOf(std::size_t size) {
+        std::uint32_t depth = 0;
+        if (size) {
+            --size;
+        }
+        while (size) {
+            ++depth;
+            size >>= degreeOfTwo;
+        }
+        return depth;
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<std::uint32_t degreeOfTwo>
+    typename RefCount::template pointer<typename PersistentVector<T, Monoid, RefCount>::template PrimeTreeRoot<degreeOfTwo>>
+        PersistentVector<T, Monoid, RefCount>::PrimeTreeRoot<degreeOfTwo>::emplace_back(SharedPtr<T>&& value) const
+    {
+        PDS_COUNT(PATH_COPIES, 1);
+        if (isSmall() || !isPlain()) {
+            auto out = makeShared<PrimeTreeRoot<degreeOfTwo>>(*this);
+            out->emplace_back_inplace(std::move(value));
+            return out;
+        }
+        SharedPtr<PrimeTreeNode<degreeOfTwo>> child;
+        SharedPtr<PrimeTreeNode<degreeOfTwo>> childOfNewRoot;
+        auto childCreationStatus = m_child->emplace_back(std::move(value), child);
+        if (childCreationStatus == NEW_NODE) {
+            childOfNewRoot = makeShared<PrimeTreeNode<degreeOfTwo>>(m_child, std::move(child));
+        }
+        // otherwise childCreationStatus == NODE_DUPLICATE
+        else {
+            childOfNewRoot = std::move(child);
+        }
+        return makeShared<PrimeTreeRoot<degreeOfTwo>>(std::move(childOfNewRoot), m_size + 1);
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<std::uint32_t degreeOfTwo>
+    typename RefCount::template pointer<typename PersistentVector<T, Monoid, RefCount>::template PrimeTreeRoot<degreeOfTwo>>
+        PersistentVector<T, Monoid, RefCount>::PrimeTreeRoot<degreeOfTwo>::pop_back() const
+    {
+        if (!isPlain()) {
+            PDS_COUNT(PATH_COPIES, 1);
+            auto out = makeShared<PrimeTreeRoot<degreeOfTwo>>(*this);
+            out->pop_back_inplace();
+            return out;
+        }
+        PDS_COUNT(PATH_COPIES, 1);
+        if (m_size <= SMALL_SIZE + 1) {
+            return makeSmallPrefix(m_size - 1);
+        }
+        SharedPtr<PrimeTreeNode<degreeOfTwo>> child = m_child->pop_back();
+        SharedPtr<PrimeTreeNode<degreeOfTwo>> childOfNewRoot;
+        if (nullptr != child && child->type() == PrimeTreeNode<degreeOfTwo>::NODE && child->size() == 1) {
+            childOfNewRoot = child->getFirstChild();
+        }
+        else {
+            childOfNewRoot = std::move(child);
+        }
+        return makeShared<PrimeTreeRoot<degreeOfTwo>>(std::move(childOfNewRoot), m_size - 1);
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<std::uint32_t degreeOfTwo>
+    void PersistentVector<T, Monoid, RefCount>::PrimeTreeRoot<degreeOfTwo>::emplace_back_inplace(SharedPtr<T>&& value)
+    {
+        if (m_size < SMALL_SIZE) {
+            detachSmall();
+            m_small->values[m_size] = std::move(value);
+        }
+        else if (m_size == SMALL_SIZE) {
+            // the vector outgrows its small block and moves to a leaf
+            auto small = std::move(m_small);
+            makeTreeBody();
+            m_child = makeShared<PrimeTreeNode<degreeOfTwo>>(SharedPtr<T>(small->values[0]));
+            SharedPtr<PrimeTreeNode<degreeOfTwo>> unused;
+            for (std::size_t i = 1; i < SMALL_SIZE; ++i) {
+                m_child->emplace_back_inplace(SharedPtr<T>(small->values[i]), unused);
+            }
+            m_child->emplace_back_inplace(std::move(value), unused);
+        }
+        else {
+            PrimeTreeNode<degreeOfTwo>::detachForAppend(m_child);
+            SharedPtr<PrimeTreeNode<degreeOfTwo>> child;
+            auto childCreationStatus = m_child->emplace_back_inplace(std::move(value), child);
+            if (childCreationStatus == NEW_NODE) {
+                m_child = makeShared<PrimeTreeNode<degreeOfTwo>>(std::move(m_child), std::move(child));
+            }
+        }
+        setSize(m_size + 1);
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<std::uint32_t degreeOfTwo>
+    template<typename InputIt>
+    void PersistentVector<T, Monoid, RefCount>::PrimeTreeRoot<degreeOfTwo>::append_inplace(InputIt first, InputIt last)
+    {
+        constexpr std::size_t arraySize = Utils::binPow(degreeOfTwo);
+        for (; first != last && (m_size <= SMALL_SIZE || 0 != (m_size & (arraySize - 1))); ++first) {
+            emplace_back_inplace(makeShared<T>(*first));
+        }
+        std::array<SharedPtr<T>, arraySize> values;
+        while (first != last) {
+            std::size_t count = 0;
+            for (; first != last && count < arraySize; ++first, ++count) {
+                values[count] = makeShared<T>(*first);
+            }
+            auto leaf = PrimeTreeNode<degreeOfTwo>::makeLeaf(values.begin(), values.begin() + count);
+            PrimeTreeNode<degreeOfTwo>::detachForAppend(m_child);
+            SharedPtr<PrimeTreeNode<degreeOfTwo>> child;
+            auto childCreationStatus = m_child->append_leaf_inplace(std::move(leaf), child);
+            if (childCreationStatus == NEW_NODE) {
+                m_child = makeShared<PrimeTreeNode<degreeOfTwo>>(std::move(m_child), std::move(child));
+            }
+            setSize(m_size + count);
+        }
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<std::uint32_t degreeOfTwo>
+    typename RefCount::template pointer<typename PersistentVector<T, Monoid, RefCount>::template PrimeTreeRoot<degreeOfTwo>>
+        PersistentVector<T, Monoid, RefCount>::PrimeTreeRoot<degreeOfTwo>::set(std::size_t pos, SharedPtr<T>&& value)
+    {
+        PDS_COUNT(PATH_COPIES, 1);
+        if (!isPlain()) {
+            auto out = makeShared<PrimeTreeRoot<degreeOfTwo>>(*this);
+            out->set_inplace(pos, std::move(value));
+            return out;
+        }
+        if (isSmall()) {
+            auto out = makeShared<PrimeTreeRoot<degreeOfTwo>>(*this);
+            out->set_inplace(pos, std::move(value));
+            return out;
+        }
+        return makeShared<PrimeTreeRoot<degreeOfTwo>>(m_child->set(pos, m_depth - 1, std::move(value)), m_size);
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<std::uint32_t degreeOfTwo>
+    typename RefCount::template pointer<T> PersistentVector<T, Monoid, RefCount>::PrimeTreeRoot<degreeOfTwo>::set_inplace(std::size_t pos, SharedPtr<T>&& value)
+    {
+        auto frontCount = frontSize();
+        if (pos < frontCount) {
+            pos = frontCount - 1 - pos;
+            auto& part = editFront();
+            auto treeSize = part.frontSize - part.frontOffset;
+            if (pos < treeSize) {
+                PrimeTreeNode<degreeOfTwo>::detach(part.front);
+                return part.front->set_inplace(pos + part.frontOffset, part.frontDepth - 1, std::move(value));
+            }
+            PrimeTreeNode<degreeOfTwo>::detach(part.head);
+            return part.head->set_inplace(pos - treeSize, 0, std::move(value));
+        }
+        pos += offset() - frontCount;
+        if (isSmall()) {
+            detachSmall();
+            std::swap(m_small->values[pos], value);
+            return std::move(value);
+        }
+        PrimeTreeNode<degreeOfTwo>::detach(m_child);
+        return m_child->set_inplace(pos, m_depth - 1, std::move(value));
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<std::uint32_t degreeOfTwo>
+    template<typename F>
+    typename RefCount::template pointer<typename PersistentVector<T, Monoid, RefCount>::template PrimeTreeRoot<degreeOfTwo>>
+        PersistentVector<T, Monoid, RefCount>::PrimeTreeRoot<degreeOfTwo>::update(std::size_t pos, F& fn) const
+    {
+        PDS_COUNT(PATH_COPIES, 1);
+        auto out = makeShared<PrimeTreeRoot<degreeOfTwo>>(*this);
+        out->update_inplace(pos, fn);
+        return out;
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<std::uint32_t degreeOfTwo>
+    template<typename F>
+    typename RefCount::template pointer<T> PersistentVector<T, Monoid, RefCount>::PrimeTreeRoot<degreeOfTwo>::update_inplace(std::size_t pos, F& fn)
+    {
+        auto frontCount = frontSize();
+        if (pos < frontCount) {
+            pos = frontCount - 1 - pos;
+            auto& part = editFront();
+            auto treeSize = part.frontSize - part.frontOffset;
+            if (pos < treeSize) {
+                PrimeTreeNode<degreeOfTwo>::detach(part.front);
+                return part.front->update_inplace(pos + part.frontOffset, part.frontDepth - 1, fn);
+            }
+            PrimeTreeNode<degreeOfTwo>::detach(part.head);
+            return part.head->update_inplace(pos - treeSize, 0, fn);
+        }
+        pos += offset() - frontCount;
+        if (isSmall()) {
+            auto value = makeShared<T>(fn(T(*m_small->values[pos])));
+            detachSmall();
+            std::swap(m_small->values[pos], value);
+            return value;
+        }
+        PrimeTreeNode<degreeOfTwo>::detach(m_child);
+        return m_child->update_inplace(pos, m_depth - 1, fn);
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<std::uint32_t degreeOfTwo>
+    template<typename F>
+    typename RefCount::template pointer<typename PersistentVector<T, Monoid, RefCount>::template PrimeTreeRoot<degreeOfTwo>>
+        PersistentVector<T, Monoid, RefCount>::PrimeTreeRoot<degreeOfTwo>::update_range(std::size_t first, std::size_t last, F& fn) const
+    {
+        PDS_COUNT(PATH_COPIES, 1);
+        auto out = makeShared<PrimeTreeRoot<degreeOfTwo>>(*this);
+        if (isPlain() && !isSmall()) {
+            PrimeTreeNode<degreeOfTwo>::detach(out->m_child);
+            out->m_child->update_range_inplace(first, last, m_depth - 1, fn);
+            return out;
+        }
+        // a node is copied by the first update under it, the next ones find it unshared
+        for (; first < last; ++first) {
+            out->update_inplace(first, fn);
+        }
+        return out;
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<std::uint32_t degreeOfTwo>
+    typename RefCount::template pointer<T> PersistentVector<T, Monoid, RefCount>::PrimeTreeRoot<degreeOfTwo>::pop_back_inplace()
+    {
+        constexpr std::size_t arraySize = Utils::binPow(degreeOfTwo);
+        SharedPtr<T> out;
+        if (m_size == offset()) {
+            auto& part = editFront();
+            if (nullptr != part.front) {
+                // the body is popped out: the last element is the first one pushed to the front, so the front tree
+                // is popped from its start by an offset as the body is popped from the front
+                out = part.front->getShared(part.frontOffset, part.frontDepth - 1);
+                ++part.frontOffset;
+                if (part.frontOffset == part.frontSize) {
+                    clearFront();
+                }
+                else if (part.frontOffset >= arraySize && part.frontOffset >= part.frontSize - part.frontOffset) {
+                    // the rest of the front tree becomes the body, which costs no more than the pops since the offset was zero
+                    std::vector<SharedPtr<T>> values;
+                    values.reserve(part.frontSize - part.frontOffset);
+                    auto push = [&values](const SharedPtr<T>& value) { values.push_back(value); };
+                    part.front->forEachBackward(part.frontOffset, part.frontSize, part.frontDepth - 1, push);
+                    clearFront();
+                    resetBody(std::move(values));
+                }
+            }
+            else {
+                // only the head is left: it loses its first slot
+                out = part.head->values()[0];
+                if (1 == part.head->size()) {
+                    part.head.reset();
+                }
+                else {
+                    auto head = PrimeTreeNode<degreeOfTwo>::makeLeaf(part.head->values() + 1, part.head->values() + part.head->size());
+                    head->setReversed();
+                    part.head = std::move(head);
+                }
+            }
+            dropEmptyFront();
+            return out;
+        }
+        if (isSmall()) {
+            detachSmall();
+            out = std::move(m_small->values[m_size - 1]);
+            if (1 == m_size) {
+                m_small.reset();
+            }
+        }
+        else if (m_size == SMALL_SIZE + 1) {
+            // the only leaf goes back to a small block
+            auto leaf = std::move(m_child);
+            makeSmallBody();
+            m_small = makeShared<SmallBlock>();
+            out = leaf->getShared(SMALL_SIZE, 0);
+            for (std::size_t i = 0; i < SMALL_SIZE; ++i) {
+                m_small->values[i] = leaf->getShared(i, 0);
+            }
+        }
+        else {
+            PrimeTreeNode<degreeOfTwo>::detach(m_child);
+            bool isEmpty = false;
+            out = m_child->pop_back_inplace(isEmpty);
+            if (m_child->type() == PrimeTreeNode<degreeOfTwo>::NODE && m_child->size() == 1) {
+                m_child = m_child->getFirstChild();
+            }
+        }
+        setSize(m_size - 1);
+        if (0 != offset() && offset() == m_size) {
+            clearBody();
+            dropEmptyFront();
+        }
+        return out;
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<std::uint32_t degreeOfTwo>
+    typename RefCount::template pointer<typename PersistentVector<T, Monoid, RefCount>::template PrimeTreeRoot<degreeOfTwo>>
+        PersistentVector<T, Monoid, RefCount>::PrimeTreeRoot<degreeOfTwo>::emplace_front(SharedPtr<T>&& value) const
+    {
+        PDS_COUNT(PATH_COPIES, 1);
+        auto out = makeShared<PrimeTreeRoot<degreeOfTwo>>(*this);
+        out->emplace_front_inplace(std::move(value));
+        return out;
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<std::uint32_t degreeOfTwo>
+    typename RefCount::template pointer<typename PersistentVector<T, Monoid, RefCount>::template PrimeTreeRoot<degreeOfTwo>>
+        PersistentVector<T, Monoid, RefCount>::PrimeTreeRoot<degreeOfTwo>::pop_front() const
+    {
+        PDS_COUNT(PATH_COPIES, 1);
+        auto out = makeShared<PrimeTreeRoot<degreeOfTwo>>(*this);
+        out->pop_front_inplace();
+        return out;
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<std::uint32_t degreeOfTwo>
+    void PersistentVector<T, Monoid, RefCount>::PrimeTreeRoot<degreeOfTwo>::emplace_front_inplace(SharedPtr<T>&& value)
+    {
+        constexpr std::size_t arraySize = Utils::binPow(degreeOfTwo);
+        auto& part = editFront();
+        if (nullptr != part.head && part.head->size() == arraySize) {
+            // the full head is attached to the front tree as is, only the right path of the tree is copied
+            if (nullptr == part.front) {
+                part.front = std::move(part.head);
+            }
+            else {
+                PrimeTreeNode<degreeOfTwo>::detachForAppend(part.front);
+                SharedPtr<PrimeTreeNode<degreeOfTwo>> child;
+                if (part.front->append_leaf_inplace(std::move(part.head), child) == NEW_NODE) {
+                    part.front = makeShared<PrimeTreeNode<degreeOfTwo>>(std::move(part.front), std::move(child));
+                    part.front->setReversed();
+                }
+            }
+            part.frontSize += arraySize;
+            part.frontDepth = depthOf(part.frontSize);
+            part.head.reset();
+        }
+        if (nullptr == part.head) {
+            part.head = makeShared<PrimeTreeNode<degreeOfTwo>>(std::move(value));
+            part.head->setReversed();
+            return;
+        }
+        PrimeTreeNode<degreeOfTwo>::detach(part.head);
+        SharedPtr<PrimeTreeNode<degreeOfTwo>> unused;
+        part.head->emplace_back_inplace(std::move(value), unused);
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<std::uint32_t degreeOfTwo>
+    void PersistentVector<T, Monoid, RefCount>::PrimeTreeRoot<degreeOfTwo>::pop_front_inplace()
+    {
+        constexpr std::size_t arraySize = Utils::binPow(degreeOfTwo);
+        auto& part = editFront();
+        if (nullptr == part.head && nullptr != part.front) {
+            // the last leaf of the front tree becomes the head, it is copied by the first pop from it
+            const auto* node = &part.front;
+            auto last = part.frontSize - 1;
+            for (auto level = part.frontDepth - 1; level > 0; --level) {
+                node = (*node)->children() + ((last >> (level * degreeOfTwo)) & (arraySize - 1));
+            }
+            part.frontSize -= arraySize;
+            if (part.frontOffset > part.frontSize) {
+                // the leaf is popped from the back too: only the rest of it is taken
+                auto values = (*node)->values();
+                part.head = PrimeTreeNode<degreeOfTwo>::makeLeaf(values + (part.frontOffset - part.frontSize), values + arraySize);
+                part.head->setReversed();
+            }
+            else {
+                part.head = *node;
+            }
+            if (part.frontOffset >= part.frontSize) {
+                clearFront();
+            }
+            else {
+                auto front = part.front->reduce_size(part.frontSize, part.frontDepth - 1);
+                if (front->type() == PrimeTreeNode<degreeOfTwo>::NODE && front->size() == 1) {
+                    front = front->getFirstNodeWithSomeChildren();
+                }
+                part.front = std::move(front);
+                part.frontDepth = depthOf(part.frontSize);
+            }
+        }
+        if (nullptr != part.head) {
+            PrimeTreeNode<degreeOfTwo>::detach(part.head);
+            bool isEmpty = false;
+            part.head->pop_back_inplace(isEmpty);
+            if (isEmpty) {
+                part.head.reset();
+            }
+        }
+        else if (++part.offset == m_size) {
+            clearBody();
+        }
+        else if (part.offset >= arraySize && part.offset >= m_size - part.offset) {
+            // the popped elements outnumber the rest: the rest is rebuilt into a tree of its own,
+            // which costs no more than the pops since the last rebuild
+            std::vector<SharedPtr<T>> values;
+            values.reserve(m_size);
+            m_child->collect(values);
+            values.erase(values.begin(), values.begin() + part.offset);
+            resetBody(std::move(values));
+        }
+        dropEmptyFront();
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<std::uint32_t degreeOfTwo>
+    void PersistentVector<T, Monoid, RefCount>::PrimeTreeRoot<degreeOfTwo>::clearBody()
+    {
+        if (isSmall()) {
+            m_small.reset();
+        }
+        else {
+            makeSmallBody();
+        }
+        if (nullptr != m_frontPart) {
+            editFront().offset = 0;
+        }
+        setSize(0);
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<std::uint32_t degreeOfTwo>
+    void PersistentVector<T, Monoid, RefCount>::PrimeTreeRoot<degreeOfTwo>::resetBody(std::vector<SharedPtr<T>>&& values)
+    {
+        auto body = build(std::move(values));
+        clearBody();
+        if (body->isSmall()) {
+            m_small = std::move(body->m_small);
+        }
+        else {
+            makeTreeBody();
+            m_child = std::move(body->m_child);
+        }
+        setSize(body->m_size);
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<std::uint32_t degreeOfTwo>
+    void PersistentVector<T, Monoid, RefCount>::PrimeTreeRoot<degreeOfTwo>::clearFront()
+    {
+        auto& part = *m_frontPart;
+        part.front.reset();
+        part.frontSize = 0;
+        part.frontOffset = 0;
+        part.frontDepth = 0;
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<std::uint32_t degreeOfTwo>
+    typename RefCount::template pointer<typename PersistentVector<T, Monoid, RefCount>::template PrimeTreeRoot<degreeOfTwo>>
+        PersistentVector<T, Monoid, RefCount>::PrimeTreeRoot<degreeOfTwo>::flatten() const
+    {
+        std::vector<SharedPtr<T>> values;
+        values.reserve(size());
+        collect(values);
+        return build(std::move(values));
+    }
+    
+    template<typename T, typename Monoid, typename RefCount>
+    template<std::uint32_t degreeOfTwo>
+    typename RefCount::template pointer<typename PersistentVector<T, Monoid, RefCount>::template PrimeTreeRoot<degreeOfTwo>>
+        PersistentVector<T, Monoid, RefCount>::PrimeTreeRoot<degreeOfTwo>::resize(std::size_t size) const
+    {
+        auto current = this->size();
+        if (!isPlain() && size < current) {
+            return flatten()->resize(size);
+        }
+        PDS_COUNT(PATH_COPIES, 1);
+        SharedPtr<PrimeTreeRoot<degreeOfTwo>> out;
+        if (size < current && size <= SMALL_SIZE) {
+            out = makeSmallPrefix(size);
+        }
+        else if (size < current) {
+            auto child = m_child->reduce_size(size, m_depth - 1);
+            if (child != nullptr && child->type() == PrimeTreeNode<degreeOfTwo>::NODE && child->size() == 1) {
+                child = child->getFirstNodeWithSomeChildren();
+            }
+            out = makeShared<PrimeTreeRoot<degreeOfTwo>>(std::move(child), size);
+            
+        }
+        else {
+            out = makeShared<PrimeTreeRoot<degreeOfTwo>>(*this);
+            for (auto i = current; i < size; ++i) {
+                out->emplace_back_inplace(makeShared<T>());
+            }
+        }
+        return out;
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
     template<std::uint32_t degreeOfTwo>
-    typename std::shared_ptr<typename PersistentVector<T>::template PrimeTreeRoot<degreeOfTwo>>
-        PersistentVector<T>::PrimeTreeRoot<degreeOfTwo>::resize(std::size_t size, const T& value) const
+    typename RefCount::template pointer<typename PersistentVector<T, Monoid, RefCount>::template PrimeTreeRoot<degreeOfTwo>>
+        PersistentVector<T, Monoid, RefCount>::PrimeTreeRoot<degreeOfTwo>::resize(std::size_t size, const T& value) const
     {
-        std::shared_ptr<PrimeTreeRoot<degreeOfTwo>> out;
-        if (size < m_size) {
+        auto current = this->size();
+        if (!isPlain() && size < current) {
+            return flatten()->resize(size, value);
+        }
+        PDS_COUNT(PATH_COPIES, 1);
+        SharedPtr<PrimeTreeRoot<degreeOfTwo>> out;
+        if (size < current && size <= SMALL_SIZE) {
+            out = makeSmallPrefix(size);
+        }
+        else if (size < current) {
             auto child = m_child->reduce_size(size, m_depth - 1);
             if (child != nullptr && child->type() == PrimeTreeNode<degreeOfTwo>::NODE && child->size() == 1) {
                 child = child->getFirstNodeWithSomeChildren();
             }
-            out = std::make_shared<PrimeTreeRoot<degreeOfTwo>>(std::move(child), size);
+            out = makeShared<PrimeTreeRoot<degreeOfTwo>>(std::move(child), size);
         }
         else {
-            out = std::make_shared<PrimeTreeRoot<degreeOfTwo>>(m_child, m_size);
-            for (auto i = m_size; i < size; ++i) {
-                out->emplace_back_inplace(std::make_shared<T>(std::move(T(value))));
+            out = makeShared<PrimeTreeRoot<degreeOfTwo>>(*this);
+            for (auto i = current; i < size; ++i) {
+                out->emplace_back_inplace(makeShared<T>(value));
             }
         }
         return out;
@@ -823,114 +2759,133 @@ namespace pds {
     * 
     */
 
-    template<typename T>
+    template<typename T, typename Monoid, typename RefCount>
+    template<std::uint32_t degreeOfTwo>
+    inline const T& PersistentVector<T, Monoid, RefCount>::PrimeTreeNode<degreeOfTwo>::get(std::size_t pos, std::uint32_t level) const {
+        if (m_type == NODE) {
+            auto id = Utils::getId(pos, level, degreeOfTwo);
+            auto mask = Utils::getMask(level, degreeOfTwo);
+            return m_children[id]->get(pos & mask, level - 1);
+        }
+        // otherwise m_type == LEAF
+        else {
+            return *(m_values[pos]);
+        }
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
     template<std::uint32_t degreeOfTwo>
-    inline T& PersistentVector<T>::PrimeTreeNode<degreeOfTwo>::get(std::size_t pos, std::uint32_t level) {
+    inline const typename RefCount::template pointer<T>& PersistentVector<T, Monoid, RefCount>::PrimeTreeNode<degreeOfTwo>::getShared(std::size_t pos, std::uint32_t level) const {
         if (m_type == NODE) {
             auto id = Utils::getId(pos, level, degreeOfTwo);
             auto mask = Utils::getMask(level, degreeOfTwo);
-            return (*m_children)[id]->get(pos & mask, level - 1);
+            return m_children[id]->getShared(pos & mask, level - 1);
         }
         // otherwise m_type == LEAF
         else {
-            return *((*m_values)[pos]);
+            return m_values[pos];
         }
     }
 
-    template<typename T>
+    template<typename T, typename Monoid, typename RefCount>
     template<std::uint32_t degreeOfTwo>
-    inline typename PersistentVector<T>::NodeCreationStatus PersistentVector<T>::PrimeTreeNode<degreeOfTwo>::emplace_back(
-            std::shared_ptr<T>&& value, 
-            std::shared_ptr<PrimeTreeNode>& primeTreeNode) const
+    inline typename PersistentVector<T, Monoid, RefCount>::NodeCreationStatus PersistentVector<T, Monoid, RefCount>::PrimeTreeNode<degreeOfTwo>::emplace_back(
+            SharedPtr<T>&& value, 
+            SharedPtr<PrimeTreeNode>& primeTreeNode) const
     {
-        PersistentVector<T>::NodeCreationStatus out;
+        PersistentVector<T, Monoid, RefCount>::NodeCreationStatus out;
         if (m_type == LEAF) {
             if (m_contentAmount < Utils::binPow(degreeOfTwo)) {
-                auto this_copy = *this;
-                primeTreeNode = std::make_shared<PrimeTreeNode>(std::move(this_copy));
-                (*(primeTreeNode->m_values))[primeTreeNode->m_contentAmount] = std::move(value);
+                primeTreeNode = makeShared<PrimeTreeNode>(*this);
+                primeTreeNode->m_values[primeTreeNode->m_contentAmount] = std::move(value);
                 ++primeTreeNode->m_contentAmount;
                 out = NODE_DUPLICATE;
             }
             else {
-                primeTreeNode = std::make_shared<PrimeTreeNode>(std::move(value));
+                primeTreeNode = makeShared<PrimeTreeNode>(std::move(value));
                 out = NEW_NODE;
             }
         }
         else {
-            std::shared_ptr<PrimeTreeNode> child;
-            auto childCreationStatus = (*m_children)[m_contentAmount - 1]->emplace_back(std::move(value), child);
+            SharedPtr<PrimeTreeNode> child;
+            auto childCreationStatus = m_children[m_contentAmount - 1]->emplace_back(std::move(value), child);
             if (childCreationStatus == NODE_DUPLICATE) {
-                primeTreeNode = std::make_shared<PrimeTreeNode>(*this);
-                (*primeTreeNode->m_children)[primeTreeNode->m_contentAmount - 1] = std::move(child);
+                primeTreeNode = makeShared<PrimeTreeNode>(*this);
+                primeTreeNode->m_children[primeTreeNode->m_contentAmount - 1] = std::move(child);
                 out = NODE_DUPLICATE;
             }
             else {
                 if (m_contentAmount < Utils::binPow(degreeOfTwo)) {
-                    primeTreeNode = std::make_shared<PrimeTreeNode>(*this);
-                    (*(primeTreeNode->m_children))[primeTreeNode->m_contentAmount] = std::move(child);
+                    primeTreeNode = makeShared<PrimeTreeNode>(*this);
+                    primeTreeNode->m_children[primeTreeNode->m_contentAmount] = std::move(child);
                     ++primeTreeNode->m_contentAmount;
                     out = NODE_DUPLICATE;
                 }
                 else {
-                    primeTreeNode = std::make_shared<PrimeTreeNode>(std::move(child));
+                    primeTreeNode = makeShared<PrimeTreeNode>(std::move(child));
                     out = NEW_NODE;
                 }
             }
         }
+        if (NODE_DUPLICATE == out) {
+            primeTreeNode->updateSummary();
+        }
         return out;
     }
 
-    template<typename T>
+    template<typename T, typename Monoid, typename RefCount>
     template<std::uint32_t degreeOfTwo>
-    inline typename std::shared_ptr<typename PersistentVector<T>::template PrimeTreeNode<degreeOfTwo>> 
-        PersistentVector<T>::PrimeTreeNode<degreeOfTwo>::pop_back() const
+    inline typename RefCount::template pointer<typename PersistentVector<T, Monoid, RefCount>::template PrimeTreeNode<degreeOfTwo>> 
+        PersistentVector<T, Monoid, RefCount>::PrimeTreeNode<degreeOfTwo>::pop_back() const
     {
-        std::shared_ptr<PrimeTreeNode> out;
+        SharedPtr<PrimeTreeNode> out;
         if (m_type == LEAF) {
             if (m_contentAmount > 1) {
-                out = std::make_shared<PrimeTreeNode>(*this);
+                out = makeShared<PrimeTreeNode>(*this);
                 --out->m_contentAmount;
-                (*(out->m_values))[out->m_contentAmount].reset();
+                out->m_values[out->m_contentAmount].reset();
             }
             else {
                 out = nullptr;
             }
         }
         else {
-            std::shared_ptr<PrimeTreeNode> child = (*m_children)[m_contentAmount - 1]->pop_back();
+            SharedPtr<PrimeTreeNode> child = m_children[m_contentAmount - 1]->pop_back();
             if (nullptr != child) {
-                out = std::make_shared<PrimeTreeNode>(*this);
-                (*out->m_children)[out->m_contentAmount - 1] = std::move(child);
+                out = makeShared<PrimeTreeNode>(*this);
+                out->m_children[out->m_contentAmount - 1] = std::move(child);
             }
             else {
                 if (m_contentAmount > 1) {
-                    out = std::make_shared<PrimeTreeNode>(*this);
+                    out = makeShared<PrimeTreeNode>(*this);
                     --out->m_contentAmount;
-                    (*(out->m_children))[out->m_contentAmount].reset();
+                    out->m_children[out->m_contentAmount].reset();
                 }
                 else {
                     out = nullptr;
                 }
             }
         }
+        if (nullptr != out) {
+            out->updateSummary();
+        }
         return out;
     }
 
-    template<typename T>
+    template<typename T, typename Monoid, typename RefCount>
     template<std::uint32_t degreeOfTwo>
-    inline typename std::shared_ptr<typename PersistentVector<T>::template PrimeTreeNode<degreeOfTwo>> 
-        PersistentVector<T>::PrimeTreeNode<degreeOfTwo>::reduce_size(std::size_t pos, std::uint32_t level) const
+    inline typename RefCount::template pointer<typename PersistentVector<T, Monoid, RefCount>::template PrimeTreeNode<degreeOfTwo>> 
+        PersistentVector<T, Monoid, RefCount>::PrimeTreeNode<degreeOfTwo>::reduce_size(std::size_t pos, std::uint32_t level) const
     {
-        std::shared_ptr<PrimeTreeNode<degreeOfTwo>> out;
+        SharedPtr<PrimeTreeNode<degreeOfTwo>> out;
         if (m_type == LEAF) {
             if (!pos) {
                 out = nullptr;
             }
             else {
-                out = std::make_shared<PrimeTreeNode>(m_values->front());
+                out = makeShared<PrimeTreeNode>(m_values.front());
                 for (std::size_t i = 1; i < pos; ++i) {
-                    (*(out->m_values))[i] = (*m_values)[i];
+                    out->m_values[i] = m_values[i];
                 }
                 out->m_contentAmount = pos;
             }
@@ -938,20 +2893,20 @@ namespace pds {
         else {
             auto id = Utils::getId(pos, level, degreeOfTwo);
             auto mask = Utils::getMask(level, degreeOfTwo);
-            auto child = (*m_children)[id]->reduce_size(pos & mask, level - 1);
+            auto child = m_children[id]->reduce_size(pos & mask, level - 1);
             if (nullptr != child) {
-                out = std::make_shared<PrimeTreeNode>(m_children->front());
+                out = makeShared<PrimeTreeNode>(m_children.front());
                 for (std::size_t i = 1; i < id; ++i) {
-                    (*(out->m_children))[i] = (*m_children)[i];
+                    out->m_children[i] = m_children[i];
                 }
-                (*(out->m_children))[id] = child;
+                out->m_children[id] = child;
                 out->m_contentAmount = id + 1;
             }
             else {
                 if (id > 0) {
-                    out = std::make_shared<PrimeTreeNode>(m_children->front());
+                    out = makeShared<PrimeTreeNode>(m_children.front());
                     for (std::size_t i = 1; i < id; ++i) {
-                        (*(out->m_children))[i] = (*m_children)[i];
+                        out->m_children[i] = m_children[i];
                     }
                     out->m_contentAmount = id;
                 }
@@ -960,144 +2915,634 @@ namespace pds {
                 }
             }
         }
+        if (nullptr != out) {
+            out->m_reversed = m_reversed;
+            out->updateSummary();
+        }
         return out;
     }
 
 
-    template<typename T>
+    template<typename T, typename Monoid, typename RefCount>
     template<std::uint32_t degreeOfTwo>
-    inline typename std::shared_ptr<typename PersistentVector<T>::template PrimeTreeNode<degreeOfTwo>> PersistentVector<T>::PrimeTreeNode<degreeOfTwo>::set(
+    inline typename RefCount::template pointer<typename PersistentVector<T, Monoid, RefCount>::template PrimeTreeNode<degreeOfTwo>> PersistentVector<T, Monoid, RefCount>::PrimeTreeNode<degreeOfTwo>::set(
         std::size_t pos,
         std::uint32_t level,
-        std::shared_ptr<T>&& value)
+        SharedPtr<T>&& value)
     {
         auto id = Utils::getId(pos, level, degreeOfTwo);
         auto mask = Utils::getMask(level, degreeOfTwo);
-        std::shared_ptr<PrimeTreeNode<degreeOfTwo>> out;
+        SharedPtr<PrimeTreeNode<degreeOfTwo>> out;
         if (m_type == LEAF) {
-            auto this_copy = *this;
-            out = std::make_shared<PrimeTreeNode>(std::move(this_copy));
-            (*(out->m_values))[pos] = std::move(value);
+            out = makeShared<PrimeTreeNode>(*this);
+            out->m_values[pos] = std::move(value);
         }
         else {
-            out = std::make_shared<PrimeTreeNode>(*this);
-            (*out->m_children)[id] = std::move((*m_children)[id]->set(pos & mask, level - 1, std::move(value)));
+            out = makeShared<PrimeTreeNode>(*this);
+            out->m_children[id] = m_children[id]->set(pos & mask, level - 1, std::move(value));
         }
+        out->updateSummary();
         return out;
     }
 
-    template<typename T>
+    template<typename T, typename Monoid, typename RefCount>
     template<std::uint32_t degreeOfTwo>
-    inline typename std::shared_ptr<typename PersistentVector<T>::template PrimeTreeNode<degreeOfTwo>> PersistentVector<T>::PrimeTreeNode<degreeOfTwo>::getFirstChild() const {
-        return (*m_children)[0];
+    inline typename RefCount::template pointer<typename PersistentVector<T, Monoid, RefCount>::template PrimeTreeNode<degreeOfTwo>> PersistentVector<T, Monoid, RefCount>::PrimeTreeNode<degreeOfTwo>::getFirstChild() const {
+        return m_children[0];
     }
 
-    template<typename T>
+    template<typename T, typename Monoid, typename RefCount>
     template<std::uint32_t degreeOfTwo>
-    inline typename std::shared_ptr<typename PersistentVector<T>::template PrimeTreeNode<degreeOfTwo>> PersistentVector<T>::PrimeTreeNode<degreeOfTwo>::getFirstNodeWithSomeChildren() const {
-        std::shared_ptr<PrimeTreeNode<degreeOfTwo>> out;
-        if ((*m_children)[0]->type() == LEAF) {
-            out = m_children->front();
+    inline typename RefCount::template pointer<typename PersistentVector<T, Monoid, RefCount>::template PrimeTreeNode<degreeOfTwo>> PersistentVector<T, Monoid, RefCount>::PrimeTreeNode<degreeOfTwo>::getFirstNodeWithSomeChildren() const {
+        SharedPtr<PrimeTreeNode<degreeOfTwo>> out;
+        if (m_children[0]->type() == LEAF) {
+            out = m_children.front();
         }
-        else if ((*m_children)[0]->size() > 1) {
-            out = (*m_children)[0];
+        else if (m_children[0]->size() > 1) {
+            out = m_children[0];
         }
         else {
-            out = (*m_children)[0]->getFirstNodeWithSomeChildren();
+            out = m_children[0]->getFirstNodeWithSomeChildren();
         }
         return out;
     }
     
-    template<typename T>
+    template<typename T, typename Monoid, typename RefCount>
     template<std::uint32_t degreeOfTwo>
-    inline typename PersistentVector<T>::NodeCreationStatus PersistentVector<T>::PrimeTreeNode<degreeOfTwo>::emplace_back_inplace(
-        std::shared_ptr<T>&& value,
-        std::shared_ptr<PrimeTreeNode>& primeTreeNode) {
-        PersistentVector<T>::NodeCreationStatus out;
+    inline typename PersistentVector<T, Monoid, RefCount>::NodeCreationStatus PersistentVector<T, Monoid, RefCount>::PrimeTreeNode<degreeOfTwo>::emplace_back_inplace(
+        SharedPtr<T>&& value,
+        SharedPtr<PrimeTreeNode>& primeTreeNode) {
+        PersistentVector<T, Monoid, RefCount>::NodeCreationStatus out;
         if (m_type == LEAF) {
             if (m_contentAmount < Utils::binPow(degreeOfTwo)) {
-                (*(m_values))[m_contentAmount] = std::move(value);
+                m_values[m_contentAmount] = std::move(value);
                 ++m_contentAmount;
                 out = NODE_DUPLICATE;
             }
             else {
-                primeTreeNode = std::make_shared<PrimeTreeNode>(std::move(value));
+                primeTreeNode = makeShared<PrimeTreeNode>(std::move(value));
                 out = NEW_NODE;
             }
         }
         else {
-            std::shared_ptr<PrimeTreeNode> child;
-            auto childCreationStatus = (*m_children)[m_contentAmount - 1]->emplace_back_inplace(std::move(value), child);
+            SharedPtr<PrimeTreeNode> child;
+            detachForAppend(m_children[m_contentAmount - 1]);
+            auto childCreationStatus = m_children[m_contentAmount - 1]->emplace_back_inplace(std::move(value), child);
             out = NODE_DUPLICATE;
             if (childCreationStatus == NEW_NODE) {
                 if (m_contentAmount < Utils::binPow(degreeOfTwo)) {
-                    (*m_children)[m_contentAmount] = std::move(child);
+                    m_children[m_contentAmount] = std::move(child);
                     ++m_contentAmount;
                     out = NODE_DUPLICATE;
                 }
                 else {
-                    primeTreeNode = std::make_shared<PrimeTreeNode>(std::move(child));
+                    primeTreeNode = makeShared<PrimeTreeNode>(std::move(child));
                     out = NEW_NODE;
                 }
             }
         }
+        if (NODE_DUPLICATE == out) {
+            updateSummary();
+        }
+        return out;
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<std::uint32_t degreeOfTwo>
+    typename PersistentVector<T, Monoid, RefCount>::NodeCreationStatus PersistentVector<T, Monoid, RefCount>::PrimeTreeNode<degreeOfTwo>::append_leaf_inplace(
+        SharedPtr<PrimeTreeNode>&& leaf,
+        SharedPtr<PrimeTreeNode>& primeTreeNode)
+    {
+        // a full leaf gets the new one as its sibling
+        if (m_type == LEAF) {
+            primeTreeNode = std::move(leaf);
+            return NEW_NODE;
+        }
+        SharedPtr<PrimeTreeNode> child;
+        detachForAppend(m_children[m_contentAmount - 1]);
+        auto childCreationStatus = m_children[m_contentAmount - 1]->append_leaf_inplace(std::move(leaf), child);
+        if (childCreationStatus == NEW_NODE) {
+            if (m_contentAmount == ARRAY_SIZE) {
+                primeTreeNode = makeShared<PrimeTreeNode>(std::move(child));
+                primeTreeNode->m_reversed = m_reversed;
+                return NEW_NODE;
+            }
+            m_children[m_contentAmount] = std::move(child);
+            ++m_contentAmount;
+        }
+        updateSummary();
+        return NODE_DUPLICATE;
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<std::uint32_t degreeOfTwo>
+    typename RefCount::template pointer<T> PersistentVector<T, Monoid, RefCount>::PrimeTreeNode<degreeOfTwo>::set_inplace(
+        std::size_t pos,
+        std::uint32_t level,
+        SharedPtr<T>&& value)
+    {
+        if (m_type == LEAF) {
+            std::swap(m_values[pos], value);
+            updateSummary();
+            return std::move(value);
+        }
+        // otherwise m_type == NODE
+        auto id = Utils::getId(pos, level, degreeOfTwo);
+        auto mask = Utils::getMask(level, degreeOfTwo);
+        auto& child = m_children[id];
+        detach(child);
+        auto out = child->set_inplace(pos & mask, level - 1, std::move(value));
+        updateSummary();
+        return out;
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<std::uint32_t degreeOfTwo>
+    template<typename F>
+    typename RefCount::template pointer<T> PersistentVector<T, Monoid, RefCount>::PrimeTreeNode<degreeOfTwo>::update_inplace(
+        std::size_t pos,
+        std::uint32_t level,
+        F& fn)
+    {
+        if (m_type == LEAF) {
+            auto value = makeShared<T>(fn(T(*m_values[pos])));
+            std::swap(m_values[pos], value);
+            updateSummary();
+            return value;
+        }
+        // otherwise m_type == NODE
+        auto id = Utils::getId(pos, level, degreeOfTwo);
+        auto mask = Utils::getMask(level, degreeOfTwo);
+        auto& child = m_children[id];
+        detach(child);
+        auto out = child->update_inplace(pos & mask, level - 1, fn);
+        updateSummary();
+        return out;
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<std::uint32_t degreeOfTwo>
+    template<typename F>
+    void PersistentVector<T, Monoid, RefCount>::PrimeTreeNode<degreeOfTwo>::update_range_inplace(
+        std::size_t first,
+        std::size_t last,
+        std::uint32_t level,
+        F& fn)
+    {
+        if (m_type == LEAF) {
+            for (; first < last; ++first) {
+                m_values[first] = makeShared<T>(fn(T(*m_values[first])));
+            }
+            updateSummary();
+            return;
+        }
+        // otherwise m_type == NODE
+        auto mask = Utils::getMask(level, degreeOfTwo);
+        for (auto id = Utils::getId(first, level, degreeOfTwo); id <= Utils::getId(last - 1, level, degreeOfTwo); ++id) {
+            auto begin = id * (mask + 1);
+            auto& child = m_children[id];
+            detach(child);
+            child->update_range_inplace(std::max(first, begin) - begin, std::min(last, begin + mask + 1) - begin, level - 1, fn);
+        }
+        updateSummary();
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<std::uint32_t degreeOfTwo>
+    typename RefCount::template pointer<T> PersistentVector<T, Monoid, RefCount>::PrimeTreeNode<degreeOfTwo>::pop_back_inplace(bool& isEmpty)
+    {
+        SharedPtr<T> out;
+        if (m_type == LEAF) {
+            --m_contentAmount;
+            out = std::move(m_values[m_contentAmount]);
+        }
+        else {
+            auto& child = m_children[m_contentAmount - 1];
+            detach(child);
+            bool isChildEmpty = false;
+            out = child->pop_back_inplace(isChildEmpty);
+            if (isChildEmpty) {
+                child.reset();
+                --m_contentAmount;
+            }
+        }
+        isEmpty = 0 == m_contentAmount;
+        updateSummary();
+        return out;
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<std::uint32_t degreeOfTwo>
+    bool PersistentVector<T, Monoid, RefCount>::PrimeTreeNode<degreeOfTwo>::full() const {
+        return m_contentAmount == ARRAY_SIZE && (m_type == LEAF || m_children[ARRAY_SIZE - 1]->full());
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<std::uint32_t degreeOfTwo>
+    inline void PersistentVector<T, Monoid, RefCount>::PrimeTreeNode<degreeOfTwo>::detach(SharedPtr<PrimeTreeNode>& node) {
+        if (node.use_count() != 1) {
+            node = makeShared<PrimeTreeNode>(*node);
+        }
+        else {
+            Utils::acquireSoleOwnership();
+        }
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<std::uint32_t degreeOfTwo>
+    inline void PersistentVector<T, Monoid, RefCount>::PrimeTreeNode<degreeOfTwo>::detachForAppend(SharedPtr<PrimeTreeNode>& node) {
+        if (node.use_count() == 1) {
+            Utils::acquireSoleOwnership();
+        }
+        else if (!node->full()) {
+            node = makeShared<PrimeTreeNode>(*node);
+        }
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<std::uint32_t degreeOfTwo>
+    template<typename It>
+    typename RefCount::template pointer<typename PersistentVector<T, Monoid, RefCount>::template PrimeTreeNode<degreeOfTwo>>
+        PersistentVector<T, Monoid, RefCount>::PrimeTreeNode<degreeOfTwo>::makeLeaf(It first, It last)
+    {
+        auto out = makeShared<PrimeTreeNode>(std::move(*first));
+        for (++first; first != last; ++first) {
+            out->m_values[out->m_contentAmount++] = std::move(*first);
+        }
+        out->updateSummary();
+        return out;
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<std::uint32_t degreeOfTwo>
+    template<typename It>
+    typename RefCount::template pointer<typename PersistentVector<T, Monoid, RefCount>::template PrimeTreeNode<degreeOfTwo>>
+        PersistentVector<T, Monoid, RefCount>::PrimeTreeNode<degreeOfTwo>::makeNode(It first, It last)
+    {
+        auto out = makeShared<PrimeTreeNode>(std::move(*first));
+        for (++first; first != last; ++first) {
+            out->m_children[out->m_contentAmount++] = std::move(*first);
+        }
+        out->updateSummary();
+        return out;
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<std::uint32_t degreeOfTwo>
+    void PersistentVector<T, Monoid, RefCount>::PrimeTreeNode<degreeOfTwo>::collect(std::vector<SharedPtr<T>>& out) const {
+        if (m_type == NODE) {
+            for (std::size_t i = 0; i < m_contentAmount; ++i) {
+                m_children[i]->collect(out);
+            }
+        }
+        // otherwise m_type == LEAF
+        else {
+            out.insert(out.end(), m_values.begin(), m_values.begin() + m_contentAmount);
+        }
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<std::uint32_t degreeOfTwo>
+    template<typename OutputIt>
+    OutputIt PersistentVector<T, Monoid, RefCount>::PrimeTreeNode<degreeOfTwo>::copyTo(OutputIt out, std::size_t first, std::size_t last, std::uint32_t level) const {
+        if (m_type == LEAF) {
+            // the elements are allocated one by one, so the next ones are requested ahead
+            constexpr std::size_t PREFETCH_DISTANCE = 4;
+            for (auto i = first; i < std::min(last, first + PREFETCH_DISTANCE); ++i) {
+                Utils::prefetch(m_values[i].get());
+            }
+            for (; first < last; ++first) {
+                if (first + PREFETCH_DISTANCE < last) {
+                    Utils::prefetch(m_values[first + PREFETCH_DISTANCE].get());
+                }
+                *out++ = *m_values[first];
+            }
+            return out;
+        }
+        // otherwise m_type == NODE
+        auto shift = level * degreeOfTwo;
+        std::size_t span = std::size_t(1) << shift;
+        auto firstId = first >> shift;
+        auto lastId = (last - 1) >> shift;
+        for (auto id = firstId; id <= lastId; ++id) {
+            std::size_t childFirst = id == firstId ? first & (span - 1) : 0;
+            std::size_t childLast = id == lastId ? ((last - 1) & (span - 1)) + 1 : span;
+            out = m_children[id]->copyTo(out, childFirst, childLast, level - 1);
+        }
+        return out;
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<std::uint32_t degreeOfTwo>
+    const T& PersistentVector<T, Monoid, RefCount>::PrimeTreeNode<degreeOfTwo>::back() const {
+        auto node = this;
+        while (node->m_type == NODE) {
+            node = node->m_children[node->m_contentAmount - 1].get();
+        }
+        return *node->m_values[node->m_contentAmount - 1];
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<std::uint32_t degreeOfTwo>
+    template<typename Predicate>
+    std::size_t PersistentVector<T, Monoid, RefCount>::PrimeTreeNode<degreeOfTwo>::partitionPoint(std::uint32_t level, Predicate pred) const {
+        if (m_type == LEAF) {
+            auto it = std::partition_point(m_values.begin(), m_values.begin() + m_contentAmount, [&pred](const SharedPtr<T>& element) {
+                return !pred(*element);
+            });
+            return static_cast<std::size_t>(it - m_values.begin());
+        }
+        // otherwise m_type == NODE; all the children but the last one are full
+        auto it = std::partition_point(m_children.begin(), m_children.begin() + m_contentAmount, [&pred](const SharedPtr<PrimeTreeNode>& child) {
+            return !pred(child->back());
+        });
+        auto id = static_cast<std::size_t>(it - m_children.begin());
+        return (id << (level * degreeOfTwo)) + (*it)->partitionPoint(level - 1, pred);
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<std::uint32_t degreeOfTwo>
+    template<typename M>
+    typename M::summary_type PersistentVector<T, Monoid, RefCount>::PrimeTreeNode<degreeOfTwo>::aggregate(std::size_t first, std::size_t last, std::uint32_t level) const {
+        auto out = M::identity();
+        if (m_type == LEAF) {
+            for (std::size_t i = first; i < last; ++i) {
+                out = M::combine(out, M::measure(*m_values[m_reversed ? first + last - 1 - i : i]));
+            }
+            return out;
+        }
+        // otherwise m_type == NODE; only the children at the bounds of the range are descended into,
+        // the summaries of the children between them are taken from the cache
+        auto shift = level * degreeOfTwo;
+        std::size_t span = std::size_t(1) << shift;
+        auto firstId = first >> shift;
+        auto lastId = (last - 1) >> shift;
+        for (auto i = firstId; i <= lastId; ++i) {
+            auto id = m_reversed ? firstId + lastId - i : i;
+            std::size_t childFirst = id == firstId ? first & (span - 1) : 0;
+            std::size_t childLast = id == lastId ? ((last - 1) & (span - 1)) + 1 : span;
+            const auto& child = m_children[id];
+            if (0 == childFirst && span == childLast) {
+                out = M::combine(out, child->summary());
+            }
+            else {
+                out = M::combine(out, child->aggregate(childFirst, childLast, level - 1));
+            }
+        }
         return out;
     }
 
-    template<typename T>
+    template<typename T, typename Monoid, typename RefCount>
+    template<std::uint32_t degreeOfTwo>
+    void PersistentVector<T, Monoid, RefCount>::PrimeTreeNode<degreeOfTwo>::updateSummary(std::false_type) {
+        auto summary = Monoid::identity();
+        if (m_type == LEAF) {
+            for (std::size_t i = 0; i < m_contentAmount; ++i) {
+                summary = Monoid::combine(summary, Monoid::measure(*m_values[m_reversed ? m_contentAmount - 1 - i : i]));
+            }
+        }
+        else {
+            for (std::size_t i = 0; i < m_contentAmount; ++i) {
+                summary = Monoid::combine(summary, m_children[m_reversed ? m_contentAmount - 1 - i : i]->summary());
+            }
+        }
+        this->m_summary = std::move(summary);
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<std::uint32_t degreeOfTwo>
+    template<typename F>
+    void PersistentVector<T, Monoid, RefCount>::PrimeTreeNode<degreeOfTwo>::forEachBackward(std::size_t first, std::size_t last, std::uint32_t level, F& fn) const {
+        if (m_type == LEAF) {
+            while (first < last) {
+                fn(m_values[--last]);
+            }
+            return;
+        }
+        // otherwise m_type == NODE
+        auto shift = level * degreeOfTwo;
+        std::size_t span = std::size_t(1) << shift;
+        auto firstId = first >> shift;
+        auto lastId = (last - 1) >> shift;
+        for (auto id = lastId + 1; id-- > firstId;) {
+            std::size_t childFirst = id == firstId ? first & (span - 1) : 0;
+            std::size_t childLast = id == lastId ? ((last - 1) & (span - 1)) + 1 : span;
+            m_children[id]->forEachBackward(childFirst, childLast, level - 1, fn);
+        }
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<std::uint32_t degreeOfTwo>
+    void PersistentVector<T, Monoid, RefCount>::PrimeTreeNode<degreeOfTwo>::setReversed() {
+        m_reversed = true;
+        updateSummary();
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
     template<std::uint32_t degreeOfTwo>
-    std::size_t PersistentVector<T>::PrimeTreeNode<degreeOfTwo>::size() const {
+    std::size_t PersistentVector<T, Monoid, RefCount>::PrimeTreeNode<degreeOfTwo>::size() const {
         return m_contentAmount;
     }
 
-    template<typename T>
+    template<typename T, typename Monoid, typename RefCount>
     template<std::uint32_t degreeOfTwo>
-    inline typename PersistentVector<T>::template PrimeTreeNode<degreeOfTwo>::NodeType PersistentVector<T>::PrimeTreeNode<degreeOfTwo>::type() const {
+    inline typename PersistentVector<T, Monoid, RefCount>::template PrimeTreeNode<degreeOfTwo>::NodeType PersistentVector<T, Monoid, RefCount>::PrimeTreeNode<degreeOfTwo>::type() const {
         return m_type;
     }
 
-    template<typename T>
+    template<typename T, typename Monoid, typename RefCount>
+    template<std::uint32_t degreeOfTwo>
+    void PersistentVector<T, Monoid, RefCount>::PrimeTreeNode<degreeOfTwo>::accountMemory(MemoryAccountant& accountant) const {
+        if (m_type == NODE) {
+            auto bytes = MemoryAccountant::sharedBlockSize<PrimeTreeNode>();
+            if (accountant.visit(this, bytes, MemoryAccountant::BlockType::PRIME_TREE_NODE)) {
+                for (std::size_t i = 0; i < m_contentAmount; ++i) {
+                    m_children[i]->accountMemory(accountant);
+                }
+            }
+        }
+        // otherwise m_type == LEAF
+        else {
+            auto bytes = MemoryAccountant::sharedBlockSize<PrimeTreeNode>();
+            if (accountant.visit(this, bytes, MemoryAccountant::BlockType::LEAF)) {
+                for (std::size_t i = 0; i < m_contentAmount; ++i) {
+                    const auto& value = m_values[i];
+                    if (accountant.visit(value.get(), MemoryAccountant::sharedBlockSize<T>(), MemoryAccountant::BlockType::ELEMENT)) {
+                        Utils::accountElementMemory(*value, accountant);
+                    }
+                }
+            }
+        }
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<std::uint32_t degreeOfTwo>
+    void PersistentVector<T, Monoid, RefCount>::PrimeTreeNode<degreeOfTwo>::releaseChildren(ReclamationQueue& queue) {
+        if (m_type == NODE) {
+            for (std::size_t i = 0; i < m_contentAmount; ++i) {
+                queue.push(std::move(m_children[i]));
+            }
+        }
+        // otherwise m_type == LEAF, at most ARRAY_SIZE elements are freed with it
+        else if (Utils::is_retirable<T>) {
+            for (std::size_t i = 0; i < m_contentAmount; ++i) {
+                queue.push(std::move(m_values[i]));
+            }
+        }
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
     template<std::uint32_t degreeOfTwo>
-    inline PersistentVector<T>::PrimeTreeNode<degreeOfTwo>::PrimeTreeNode(std::shared_ptr<T> insertingElement) : m_type(LEAF) {
-        m_values = std::make_unique<std::array<std::shared_ptr<T>, ARRAY_SIZE>>();
-        (*m_values)[0] = insertingElement;
-        m_contentAmount = 1;
+    inline PersistentVector<T, Monoid, RefCount>::PrimeTreeNode<degreeOfTwo>::PrimeTreeNode(SharedPtr<T> insertingElement)
+        : m_type(LEAF), m_contentAmount(1), m_values()
+    {
+        PDS_COUNT(NODE_ALLOCATIONS, 1);
+        m_values[0] = std::move(insertingElement);
+        updateSummary();
     }
 
-    template<typename T>
+    template<typename T, typename Monoid, typename RefCount>
     template<std::uint32_t degreeOfTwo>
-    inline PersistentVector<T>::PrimeTreeNode<degreeOfTwo>::PrimeTreeNode(std::shared_ptr<PrimeTreeNode<degreeOfTwo>> child) : m_type(NODE) {
-        m_children = std::make_unique<std::array<std::shared_ptr<PrimeTreeNode>, ARRAY_SIZE>>();
-        (*m_children)[0] = child;
-        m_contentAmount = 1;
+    inline PersistentVector<T, Monoid, RefCount>::PrimeTreeNode<degreeOfTwo>::PrimeTreeNode(SharedPtr<PrimeTreeNode<degreeOfTwo>> child)
+        : m_type(NODE), m_contentAmount(1), m_children()
+    {
+        PDS_COUNT(NODE_ALLOCATIONS, 1);
+        m_children[0] = std::move(child);
+        updateSummary();
     }
 
-    template<typename T>
+    template<typename T, typename Monoid, typename RefCount>
     template<std::uint32_t degreeOfTwo>
-    inline PersistentVector<T>::PrimeTreeNode<degreeOfTwo>::PrimeTreeNode(std::shared_ptr<PrimeTreeNode<degreeOfTwo>> oldChild, std::shared_ptr<PrimeTreeNode<degreeOfTwo>> newChild)
-        : m_type(NODE)
+    inline PersistentVector<T, Monoid, RefCount>::PrimeTreeNode<degreeOfTwo>::PrimeTreeNode(SharedPtr<PrimeTreeNode<degreeOfTwo>> oldChild, SharedPtr<PrimeTreeNode<degreeOfTwo>> newChild)
+        : m_type(NODE), m_contentAmount(2), m_children()
     {
-        m_children = std::make_unique<std::array<std::shared_ptr<PrimeTreeNode>, ARRAY_SIZE>>();
-        (*m_children)[0] = oldChild;
-        (*m_children)[1] = newChild;
-        m_contentAmount = 2;
+        PDS_COUNT(NODE_ALLOCATIONS, 1);
+        m_children[0] = std::move(oldChild);
+        m_children[1] = std::move(newChild);
+        updateSummary();
     }
 
-    template<typename T>
+    template<typename T, typename Monoid, typename RefCount>
     template<std::uint32_t degreeOfTwo>
-    inline PersistentVector<T>::PrimeTreeNode<degreeOfTwo>::PrimeTreeNode(const PrimeTreeNode& other)
-        : m_type(other.m_type)
+    inline PersistentVector<T, Monoid, RefCount>::PrimeTreeNode<degreeOfTwo>::PrimeTreeNode(const PrimeTreeNode& other)
+        : PrimeTreeNodeSummary<Monoid>(other), m_type(other.m_type), m_reversed(other.m_reversed), m_contentAmount(other.m_contentAmount)
     {
+        PDS_COUNT(NODE_ALLOCATIONS, 1);
+        PDS_COUNT(PATH_COPY_LENGTH, 1);
+        if (m_type == NODE) {
+            new (&m_children) Children(other.m_children);
+        }
+        // otherwise m_type = LEAF
+        else {
+            new (&m_values) Values(other.m_values);
+        }
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<std::uint32_t degreeOfTwo>
+    inline PersistentVector<T, Monoid, RefCount>::PrimeTreeNode<degreeOfTwo>::~PrimeTreeNode() {
         if (m_type == NODE) {
-            auto children_copy = *(other.m_children);
-            m_children = std::make_unique<std::array<std::shared_ptr<PrimeTreeNode>, ARRAY_SIZE>>(std::move(children_copy));
+            m_children.~Children();
         }
         // otherwise m_type = LEAF
         else {
-            auto values_copy = *(other.m_values);
-            m_values = std::make_unique<std::array<std::shared_ptr<T>, ARRAY_SIZE>>(std::move(values_copy));
+            m_values.~Values();
+        }
+    }
+
+
+    /*
+    *
+    *   InternTable
+    *
+    */
+
+    template<typename T, typename Monoid, typename RefCount>
+    template<typename Hash>
+    typename RefCount::template pointer<typename PersistentVector<T, Monoid, RefCount>::InternTable::Node>
+        PersistentVector<T, Monoid, RefCount>::InternTable::intern(const SharedPtr<Node>& node, const Hash& hash)
+    {
+        ++m_statistics.visitedNodes;
+        auto combine = [](std::size_t seed, std::size_t value) {
+            return seed ^ (value + 0x9e3779b9 + (seed << 6) + (seed >> 2));
+        };
+        auto candidate = node;
+        std::size_t key = combine(node->size(), node->type() == Node::NODE);
+        if (node->type() == Node::NODE) {
+            // the children are interned first, so equal subtrees have equal children addresses
+            std::array<SharedPtr<Node>, Utils::binPow(m_primeTreeNodeSize)> children;
+            bool changed = false;
+            for (std::size_t i = 0; i < node->size(); ++i) {
+                children[i] = intern(node->children()[i], hash);
+                changed = changed || children[i] != node->children()[i];
+                key = combine(key, std::hash<const void*>()(children[i].get()));
+            }
+            if (changed) {
+                candidate = Node::makeNode(children.begin(), children.begin() + node->size());
+            }
+        }
+        // otherwise node->type() == LEAF
+        else {
+            for (std::size_t i = 0; i < node->size(); ++i) {
+                key = combine(key, hash(*node->values()[i]));
+            }
+        }
+
+        auto range = m_nodes.equal_range(key);
+        for (auto it = range.first; it != range.second;) {
+            auto existing = it->second.lock();
+            if (nullptr == existing) {
+                it = m_nodes.erase(it);
+                continue;
+            }
+            if (existing == candidate) {
+                return candidate;
+            }
+            if (equal(*existing, *candidate)) {
+                ++m_statistics.sharedNodes;
+                // the slots are a part of the node block, as PrimeTreeNode::accountMemory counts it
+                m_statistics.bytesSaved += MemoryAccountant::sharedBlockSize<Node>();
+                if (node->type() == Node::LEAF) {
+                    for (std::size_t i = 0; i < node->size(); ++i) {
+                        if (existing->values()[i] != node->values()[i]) {
+                            ++m_statistics.sharedElements;
+                            m_statistics.bytesSaved += MemoryAccountant::sharedBlockSize<T>();
+                        }
+                    }
+                }
+                return existing;
+            }
+            ++it;
         }
-        m_contentAmount = other.m_contentAmount;
+        m_nodes.emplace(key, candidate);
+        return candidate;
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    void PersistentVector<T, Monoid, RefCount>::InternTable::purge() {
+        for (auto it = m_nodes.begin(); it != m_nodes.end();) {
+            if (it->second.expired()) {
+                it = m_nodes.erase(it);
+            }
+            else {
+                ++it;
+            }
+        }
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    bool PersistentVector<T, Monoid, RefCount>::InternTable::equal(const Node& left, const Node& right) {
+        if (left.type() != right.type() || left.size() != right.size()) {
+            return false;
+        }
+        if (left.type() == Node::NODE) {
+            return std::equal(left.children(), left.children() + left.size(), right.children());
+        }
+        // otherwise both nodes are leaves
+        return std::equal(left.values(), left.values() + left.size(), right.values(),
+            [](const SharedPtr<T>& leftValue, const SharedPtr<T>& rightValue) {
+                return leftValue == rightValue || *leftValue == *rightValue;
+            });
     }
 
 
@@ -1107,9 +3552,86 @@ namespace pds {
     * 
     */
 
-    template<typename T>
-    PersistentVector<T>::VectorVersionTreeNode::~VectorVersionTreeNode() {
-        std::stack<std::shared_ptr<VectorVersionTreeNode>> uniqueLinkedParents;
+    template<typename T, typename Monoid, typename RefCount>
+    typename RefCount::template pointer<typename PersistentVector<T, Monoid, RefCount>::template PrimeTreeRoot<m_primeTreeNodeSize>>
+        PersistentVector<T, Monoid, RefCount>::VectorVersionTreeNode::getSharedRoot()
+    {
+        if (RestoreOperation::NONE != m_restoreOperation) {
+            // several threads may undo to the same version at once
+            std::call_once(m_restored, [this]() {
+                auto source = m_successor->getSharedRoot();
+                switch (m_restoreOperation) {
+                case RestoreOperation::SET:
+                    m_root = source->set(m_restorePos, SharedPtr<T>(m_restoreValue));
+                    break;
+                case RestoreOperation::PUSH_BACK:
+                    m_root = source->emplace_back(SharedPtr<T>(m_restoreValue));
+                    break;
+                case RestoreOperation::POP_BACK:
+                    m_root = source->pop_back();
+                    break;
+                case RestoreOperation::RESIZE:
+                    m_root = source->resize(m_restorePos);
+                    break;
+                case RestoreOperation::NONE:
+                    break;
+                }
+            });
+        }
+        return m_root;
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    void PersistentVector<T, Monoid, RefCount>::VectorVersionTreeNode::setRestoreOperation(VectorVersionTreeNode* successor, RestoreOperation operation,
+                                                                          std::size_t pos, SharedPtr<T> value)
+    {
+        m_successor = successor;
+        m_restoreOperation = operation;
+        m_restorePos = pos;
+        m_restoreValue = std::move(value);
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    void PersistentVector<T, Monoid, RefCount>::VectorVersionTreeNode::accountMemory(MemoryAccountant& accountant) const {
+        // the history may be long, so it is walked without recursion
+        std::stack<const VectorVersionTreeNode*> nodes;
+        nodes.push(this);
+        while (!nodes.empty()) {
+            auto current = nodes.top();
+            nodes.pop();
+            // a root restored for an edited version may be written concurrently, it is accounted
+            // through the versions reached by undo, which share it
+            if (RestoreOperation::NONE == current->m_restoreOperation) {
+                auto rootBytes = MemoryAccountant::sharedBlockSize<PrimeTreeRoot<m_primeTreeNodeSize>>();
+                if (accountant.visit(current->m_root.get(), rootBytes, MemoryAccountant::BlockType::VERSION_NODE)) {
+                    current->m_root->accountMemory(accountant);
+                }
+            }
+            else if (accountant.visit(current->m_restoreValue.get(), MemoryAccountant::sharedBlockSize<T>(), MemoryAccountant::BlockType::ELEMENT)) {
+                Utils::accountElementMemory(*current->m_restoreValue, accountant);
+            }
+            for (auto next : { current->m_parent.get(), current->m_redoChild.get(), current->m_myOrig.get() }) {
+                if (accountant.visit(next, MemoryAccountant::sharedBlockSize<VectorVersionTreeNode>(), MemoryAccountant::BlockType::VERSION_NODE)) {
+                    nodes.push(next);
+                }
+            }
+        }
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    void PersistentVector<T, Monoid, RefCount>::VectorVersionTreeNode::releaseChildren(ReclamationQueue& queue) {
+        queue.push(std::move(m_root));
+        queue.push(std::move(m_parent));
+        queue.push(std::move(m_redoChild));
+        queue.push(std::move(m_myOrig));
+        if (Utils::is_retirable<T>) {
+            queue.push(std::move(m_restoreValue));
+        }
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    PersistentVector<T, Monoid, RefCount>::VectorVersionTreeNode::~VectorVersionTreeNode() {
+        std::stack<SharedPtr<VectorVersionTreeNode>> uniqueLinkedParents;
         bool stop = false;
         if (nullptr != m_redoChild) {
             auto currentChild = m_redoChild;
@@ -1151,3 +3673,14 @@ namespace pds {
     };
 
 }
+
+namespace std {
+    template<typename T, typename Monoid, typename RefCount>
+    struct hash<pds::PersistentVector<T, Monoid, RefCount>> {
+        std::size_t operator()(const pds::PersistentVector<T, Monoid, RefCount>& pvector) const {
+            return pvector.content_hash();
+        }
+    };
+}
+
+#include "VectorView.h"
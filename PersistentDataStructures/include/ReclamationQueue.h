@@ -0,0 +1,158 @@
+#pragma once
+#include "Utils.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+/*
+*
+*   Deferred reclamation of the dropped versions.
+*       Dropping the last handle of a large version frees all of its nodes at once on the calling thread,
+*       and the objects linked into long chains are freed recursively. A version retired to
+*       a ReclamationQueue (retire(queue) of the containers) is freed later, one object per step:
+*       an object left without other owners hands the references it holds over to the queue
+*       and only then is deleted, so a step frees a single object and never recurses.
+*       The steps are done either by the owner in bounded slices (reclaim(budget), e.g. after every
+*       operation) or by the background thread of the queue.
+*       An object is known to have no other owners by its reference count, so the versions
+*       must not be resurrected through weak references meanwhile: an InternTable of the retired
+*       versions must not be used concurrently with the background thread. The versions counted by
+*       SingleThreadRefCount may only be reclaimed by the thread using them.
+*
+*/
+namespace pds {
+    class ReclamationQueue {
+    public:
+        // Steps done by the background thread between the checks of the stop request
+        static constexpr std::size_t BACKGROUND_SLICE = 1024;
+
+        ReclamationQueue() = default;
+        ReclamationQueue(const ReclamationQueue& other) = delete;
+        ReclamationQueue& operator=(const ReclamationQueue& other) = delete;
+        // Stops the background thread, the objects left are freed by the destructor
+        ~ReclamationQueue();
+
+        // Takes over the reference (std::shared_ptr or a pointer of a RefCount policy);
+        // the object is freed by a later step if no other owner is left by then
+        template<typename Pointer>
+        void push(Pointer pointer);
+
+        // Does at most budget steps, returns the number of the steps done
+        std::size_t reclaim(std::size_t budget);
+        // Steps until the queue is empty, including the references pushed by the steps
+        std::size_t reclaimAll();
+
+        // References waiting for their step
+        std::size_t pending() const;
+
+        // The steps are done by a thread of the queue until stopBackground() or the destruction
+        void startBackground();
+        void stopBackground();
+
+    private:
+        // Type-erased owning pointer; the deque never moves its elements, so the pointer
+        // stays in the storage where it was constructed until relocate() takes it out
+        struct Item {
+            typename std::aligned_storage<2 * sizeof(void*), alignof(void*)>::type pointer;
+            void (*relocate)(void* from, void* to);
+            void (*step)(void* pointer, ReclamationQueue& queue);
+        };
+
+        template<typename Pointer>
+        static void relocate(void* from, void* to);
+
+        template<typename Pointer>
+        static void step(void* pointer, ReclamationQueue& queue);
+
+        // false if there was nothing to do
+        bool stepOnce();
+
+        void runBackground();
+
+        mutable std::mutex m_mutex;
+        std::condition_variable m_wakeUp;
+        std::deque<Item> m_items;
+        std::thread m_background;
+        bool m_stop = false;
+    };
+
+    namespace Utils {
+        // Nodes of the containers hand their references over by releaseChildren(queue)
+        template <typename T, typename = void>
+        constexpr bool has_release_children = false;
+
+        template <typename T>
+        constexpr bool has_release_children<T, void_t<decltype(std::declval<T&>().releaseChildren(std::declval<ReclamationQueue&>()))>> = true;
+
+        // Containers stored as elements are retired as a whole
+        template <typename T, typename = void>
+        constexpr bool is_retirable = false;
+
+        template <typename T>
+        constexpr bool is_retirable<T, void_t<decltype(std::declval<T&&>().retire(std::declval<ReclamationQueue&>()))>> = true;
+
+        template<typename T>
+        void releaseReferences(T& object, ReclamationQueue& queue, std::true_type, std::false_type) {
+            object.releaseChildren(queue);
+        }
+
+        template<typename T>
+        void releaseReferences(T& object, ReclamationQueue& queue, std::false_type, std::true_type) {
+            std::move(object).retire(queue);
+        }
+
+        template<typename T>
+        void releaseReferences(T&, ReclamationQueue&, std::false_type, std::false_type) {}
+
+        // Hands the references held by an object without other owners over to the queue
+        template<typename T>
+        void releaseReferences(T& object, ReclamationQueue& queue) {
+            releaseReferences(object, queue,
+                std::integral_constant<bool, has_release_children<T>>(),
+                std::integral_constant<bool, !has_release_children<T> && is_retirable<T>>());
+        }
+    }
+
+    template<typename Pointer>
+    void ReclamationQueue::push(Pointer pointer) {
+        static_assert(sizeof(Pointer) <= sizeof(Item::pointer) && alignof(Pointer) <= alignof(Item),
+                      "ReclamationQueue stores pointers of two words");
+        if (nullptr == pointer) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_items.emplace_back();
+            auto& item = m_items.back();
+            new (&item.pointer) Pointer(std::move(pointer));
+            item.relocate = &ReclamationQueue::relocate<Pointer>;
+            item.step = &ReclamationQueue::step<Pointer>;
+        }
+        m_wakeUp.notify_one();
+    }
+
+    template<typename Pointer>
+    void ReclamationQueue::relocate(void* from, void* to) {
+        auto source = static_cast<Pointer*>(from);
+        new (to) Pointer(std::move(*source));
+        source->~Pointer();
+    }
+
+    template<typename Pointer>
+    void ReclamationQueue::step(void* pointer, ReclamationQueue& queue) {
+        auto owned = static_cast<Pointer*>(pointer);
+        if (owned->use_count() == 1) {
+            // the last references may have been dropped by other threads which read the object before
+            Utils::acquireSoleOwnership();
+            Utils::releaseReferences(**owned, queue);
+        }
+        // frees the object if the queue was its last owner; its references are in the queue by now
+        owned->~Pointer();
+    }
+}
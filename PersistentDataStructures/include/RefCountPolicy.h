@@ -0,0 +1,63 @@
+#pragma once
+#include <memory>
+#include <utility>
+
+/*
+*
+*   Reference counting policies of the containers (the RefCount template parameter).
+*       Every path copy of a persistent container copies the pointers to the untouched siblings,
+*       so the reference counters are incremented and decremented far more often than the elements
+*       are written. AtomicRefCount (the default) uses std::shared_ptr, whose counters are updated
+*       with locked instructions. SingleThreadRefCount updates them with plain increments; a version
+*       built with it, and every version sharing nodes with it, must only be used by one thread at a time.
+*       SingleThreadRefCount only takes effect with libstdc++: it is built on the non-atomic lock policy
+*       of its shared_ptr, other standard libraries have none, and there the policy is the atomic one.
+*       is_atomic tells which counters a policy has; define PDS_REQUIRE_SINGLE_THREAD_REFCOUNT
+*       to make the fallback a compile error instead.
+*       A policy provides:
+*           template<typename U> using pointer = ...;       // shared owning pointer
+*           template<typename U> using weak_pointer = ...;
+*           template<typename U, typename... Args> static pointer<U> make(Args&&... args);
+*           static constexpr bool is_atomic = ...;          // the counters are updated atomically
+*
+*/
+namespace pds {
+    struct AtomicRefCount {
+        static constexpr bool is_atomic = true;
+
+        template<typename U>
+        using pointer = std::shared_ptr<U>;
+
+        template<typename U>
+        using weak_pointer = std::weak_ptr<U>;
+
+        template<typename U, typename... Args>
+        static pointer<U> make(Args&&... args) {
+            return std::make_shared<U>(std::forward<Args>(args)...);
+        }
+    };
+
+#if defined(__GLIBCXX__)
+    // libstdc++ exposes the lock policy of shared_ptr; _S_single counters are plain integers
+    struct SingleThreadRefCount {
+        static constexpr bool is_atomic = false;
+
+        template<typename U>
+        using pointer = std::__shared_ptr<U, __gnu_cxx::_S_single>;
+
+        template<typename U>
+        using weak_pointer = std::__weak_ptr<U, __gnu_cxx::_S_single>;
+
+        template<typename U, typename... Args>
+        static pointer<U> make(Args&&... args) {
+            return std::__make_shared<U, __gnu_cxx::_S_single>(std::forward<Args>(args)...);
+        }
+    };
+#else
+    // Other standard libraries have no non-atomic shared_ptr, the policy falls back to the atomic one
+#if defined(PDS_REQUIRE_SINGLE_THREAD_REFCOUNT)
+#error "SingleThreadRefCount needs libstdc++, with this standard library it would be atomic"
+#endif
+    struct SingleThreadRefCount : AtomicRefCount {};
+#endif
+}
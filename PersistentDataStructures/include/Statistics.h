@@ -0,0 +1,102 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/*
+*
+*   Operation counters of the containers.
+*       They are compiled in only if PDS_ENABLE_STATISTICS is defined
+*       (cmake -DPDS_ENABLE_STATISTICS=ON), otherwise PDS_COUNT expands to nothing.
+*       Every thread increments its own counters, so counting does not add contention
+*       between threads; counters of finished threads are kept in the process-wide aggregate.
+*
+*/
+#ifdef PDS_ENABLE_STATISTICS
+#define PDS_COUNT(counter, value) (::pds::Statistics::add(::pds::Statistics::Counter::counter, (value)))
+#else
+#define PDS_COUNT(counter, value) ((void)0)
+#endif
+
+namespace pds {
+    struct OperationCounters {
+        // PrimeTreeNode, list node and fat node allocations
+        std::uint64_t nodeAllocations = 0;
+        // PersistentVector modifications which copy a path from the root
+        std::uint64_t pathCopies = 0;
+        // PrimeTreeNodes copied by these modifications
+        std::uint64_t pathCopyLength = 0;
+        // PersistentVector modifications of a temporary sole version which edit its root in place instead
+        std::uint64_t inPlaceEdits = 0;
+        // versions visited by list_fat_node::find_node
+        std::uint64_t findNodeSteps = 0;
+        // PersistentMap::set calls which reallocated the whole table
+        std::uint64_t mapRehashes = 0;
+        // PersistentMap bucket lookups and the elements compared during them
+        std::uint64_t bucketLookups = 0;
+        std::uint64_t bucketProbes = 0;
+        // vector_const_iterator dereferences, each of them descends the tree from the root
+        std::uint64_t iteratorDescents = 0;
+
+        OperationCounters& operator+=(const OperationCounters& other);
+    };
+
+    namespace Statistics {
+#ifdef PDS_ENABLE_STATISTICS
+        constexpr bool ENABLED = true;
+#else
+        constexpr bool ENABLED = false;
+#endif
+
+        enum class Counter {
+            NODE_ALLOCATIONS,
+            PATH_COPIES,
+            PATH_COPY_LENGTH,
+            IN_PLACE_EDITS,
+            FIND_NODE_STEPS,
+            MAP_REHASHES,
+            BUCKET_LOOKUPS,
+            BUCKET_PROBES,
+            ITERATOR_DESCENTS,
+            COUNTERS_NUMBER
+        };
+
+        class ThreadCounters {
+        public:
+            ThreadCounters();
+            ThreadCounters(const ThreadCounters& other) = delete;
+            ThreadCounters& operator=(const ThreadCounters& other) = delete;
+            ~ThreadCounters();
+
+            // only the owning thread writes, so there is no need in atomic read-modify-write
+            void add(Counter counter, std::uint64_t value) {
+                auto& cell = m_counters[static_cast<std::size_t>(counter)];
+                cell.store(cell.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+            }
+
+            OperationCounters snapshot() const;
+            void reset();
+
+        private:
+            std::array<std::atomic<std::uint64_t>, static_cast<std::size_t>(Counter::COUNTERS_NUMBER)> m_counters;
+        };
+
+        inline ThreadCounters& threadCounters() {
+            static thread_local ThreadCounters counters;
+            return counters;
+        }
+
+        inline void add(Counter counter, std::uint64_t value) {
+            threadCounters().add(counter, value);
+        }
+
+        // counters of the calling thread
+        OperationCounters threadSnapshot();
+        // counters of all threads of the process, including finished ones
+        OperationCounters processSnapshot();
+
+        void resetThread();
+        void resetProcess();
+    }
+}
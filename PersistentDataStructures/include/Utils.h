@@ -1,7 +1,13 @@
 #pragma once
+#include <atomic>
 #include <cstddef>
+#include <cstdint>
 #include <iterator>
 
+#if !defined(__GNUC__) && !defined(__clang__) && (defined(_M_X64) || defined(_M_IX86))
+#include <xmmintrin.h>
+#endif
+
 namespace pds {
 	using version_t = std::uint64_t;
 
@@ -22,8 +28,56 @@ namespace pds {
 			return static_cast<std::size_t>(1) << deg;
 		}
 
-		std::size_t getId(std::size_t pos, std::uint32_t level, std::uint32_t degreeOfTwo);
+		// Used on every level of every descent, so they are inlined
+		inline std::size_t getId(std::size_t pos, std::uint32_t level, std::uint32_t degreeOfTwo) {
+			return pos >> (level * degreeOfTwo);
+		}
+
+		inline std::size_t getMask(std::uint32_t level, std::uint32_t degreeOfTwo) {
+			return ((1ull << static_cast<std::size_t>(degreeOfTwo)) << ((static_cast<std::size_t>(level) - 1ull) * static_cast<std::size_t>(degreeOfTwo))) - 1ull;
+		}
+
+		// Has to follow a use_count() check which found the only owner before the object is written:
+		// use_count() is a relaxed load, the fence orders the write after the releases of the former
+		// owners, which may have been done by other threads still reading the object before them
+		inline void acquireSoleOwnership() {
+			std::atomic_thread_fence(std::memory_order_acquire);
+		}
 
-		std::size_t getMask(std::uint32_t level, std::uint32_t degreeOfTwo);
+		// Asks the processor to start loading the cache line of the address; never faults
+		inline void prefetch(const void* address) {
+#if defined(__GNUC__) || defined(__clang__)
+			__builtin_prefetch(address);
+#elif defined(_M_X64) || defined(_M_IX86)
+			_mm_prefetch(static_cast<const char*>(address), _MM_HINT_T0);
+#else
+			(void)address;
+#endif
+		}
+
+		// Number of the set bits of the word
+		inline std::uint32_t popCount(std::uint64_t word) {
+#if defined(__GNUC__) || defined(__clang__)
+			return static_cast<std::uint32_t>(__builtin_popcountll(word));
+#else
+			word -= (word >> 1) & 0x5555555555555555ull;
+			word = (word & 0x3333333333333333ull) + ((word >> 2) & 0x3333333333333333ull);
+			word = (word + (word >> 4)) & 0x0f0f0f0f0f0f0f0full;
+			return static_cast<std::uint32_t>((word * 0x0101010101010101ull) >> 56);
+#endif
+		}
+
+		// Index of the lowest set bit; the word must not be zero
+		inline std::uint32_t countTrailingZeros(std::uint64_t word) {
+#if defined(__GNUC__) || defined(__clang__)
+			return static_cast<std::uint32_t>(__builtin_ctzll(word));
+#else
+			std::uint32_t out = 0;
+			for (; 0 == (word & 1ull); word >>= 1) {
+				++out;
+			}
+			return out;
+#endif
+		}
 	}
 }
@@ -0,0 +1,256 @@
+#pragma once
+#include "PersistentVector.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/*
+*
+*   VectorView - lazy pipeline of transform() and filter() stages over a range of a PersistentVector
+*       (made by PersistentVector::view()). A view holds the source version and the composed stages only,
+*       adding a stage makes a new view and computes nothing. The pipeline runs when the view is consumed:
+*       for_each() and copy_to() walk the leaves of the range once (as PersistentVector::copy_to does)
+*       and pass every element through all the stages; materialize() packs the results into the leaves
+*       of a new vector as they come, so no stage produces a whole intermediate vector.
+*       for_each_while() and copy_n() stop early: the source is read by chunks of 32 positions
+*       (the leaves of a vector built by push_back; after push_front a chunk may span two leaves),
+*       the walk ends with the chunk of the value that stopped it and no stage is called after that.
+*       The stages are copied into the view and called on every consumption, so they have to be
+*       callable as const; the view keeps its source version alive.
+*
+*/
+namespace pds {
+    namespace Utils {
+        // A stage calls sink for every value it produces from an element of the source
+        struct IdentityStage {
+            template<typename U, typename Sink>
+            void operator()(const U& element, Sink& sink) const {
+                sink(element);
+            }
+        };
+
+        template<typename Inner, typename F>
+        struct TransformStage {
+            template<typename U, typename Sink>
+            void operator()(const U& element, Sink& sink) const {
+                auto transformed = [this, &sink](const auto& value) { sink(function(value)); };
+                inner(element, transformed);
+            }
+
+            Inner inner;
+            F function;
+        };
+
+        template<typename Inner, typename Predicate>
+        struct FilterStage {
+            template<typename U, typename Sink>
+            void operator()(const U& element, Sink& sink) const {
+                auto filtered = [this, &sink](const auto& value) {
+                    if (predicate(value)) {
+                        sink(value);
+                    }
+                };
+                inner(element, filtered);
+            }
+
+            Inner inner;
+            Predicate predicate;
+        };
+
+        // Output iterator handing the assigned elements to a callable, so the leaf walk of copy_to drives the stages
+        template<typename Consumer>
+        class ConsumingIterator {
+        public:
+            using iterator_category = std::output_iterator_tag;
+            using difference_type = std::ptrdiff_t;
+            using value_type = void;
+            using pointer = void;
+            using reference = void;
+
+            explicit ConsumingIterator(Consumer& consumer) : m_consumer(&consumer) {}
+
+            ConsumingIterator& operator*() { return *this; }
+            ConsumingIterator& operator++() { return *this; }
+            ConsumingIterator& operator++(int) { return *this; }
+
+            template<typename U>
+            ConsumingIterator& operator=(const U& value) {
+                (*m_consumer)(value);
+                return *this;
+            }
+
+        private:
+            Consumer* m_consumer;
+        };
+
+        // Vector of the results of a view over Source, counted by the same policy
+        template<typename Source, typename Value>
+        struct MaterializedVector;
+
+        template<typename T, typename Monoid, typename RefCount, typename Value>
+        struct MaterializedVector<PersistentVector<T, Monoid, RefCount>, Value> {
+            using type = PersistentVector<Value, void, RefCount>;
+        };
+    }
+
+    template<typename Source, typename Value, typename Stage>
+    class VectorView {
+    public:
+        using value_type = Value;
+
+        VectorView(Source source, std::size_t first, std::size_t last, Stage stage)
+            : m_source(std::move(source)), m_first(first), m_last(last), m_stage(std::move(stage)) {}
+
+        template<typename F>
+        using transform_view = VectorView<Source,
+            typename std::decay<decltype(std::declval<const F&>()(std::declval<const Value&>()))>::type,
+            Utils::TransformStage<Stage, F>>;
+
+        template<typename Predicate>
+        using filter_view = VectorView<Source, Value, Utils::FilterStage<Stage, Predicate>>;
+
+        // View of function applied to every value of this view
+        template<typename F>
+        transform_view<F> transform(F function) const;
+
+        // View of the values of this view satisfying predicate
+        template<typename Predicate>
+        filter_view<Predicate> filter(Predicate predicate) const;
+
+        // Runs the pipeline, consumer is called with every resulting value in order
+        template<typename Consumer>
+        void for_each(Consumer consumer) const;
+
+        template<typename OutputIt>
+        OutputIt copy_to(OutputIt out) const;
+
+        // Runs the pipeline until consumer returns false; returns false if it was stopped
+        template<typename Consumer>
+        bool for_each_while(Consumer consumer) const;
+
+        // Copies the first count resulting values, or all of them if there are fewer
+        template<typename OutputIt>
+        OutputIt copy_n(std::size_t count, OutputIt out) const;
+
+        // New vector of the resulting values, built bottom-up as by append(); it is a single version
+        typename Utils::MaterializedVector<Source, Value>::type materialize() const;
+
+    private:
+        // Results are appended to the materialized vector by whole leaves
+        static constexpr std::size_t MATERIALIZE_CHUNK = 32;
+        // for_each_while reads the source by chunks of this many positions, aligned as the leaves of a plain vector
+        static constexpr std::size_t LEAF_SIZE = Utils::binPow(m_primeTreeNodeSize);
+
+        Source m_source;
+        std::size_t m_first;
+        std::size_t m_last;
+        Stage m_stage;
+    };
+
+
+    template<typename Source, typename Value, typename Stage>
+    template<typename F>
+    typename VectorView<Source, Value, Stage>::template transform_view<F> VectorView<Source, Value, Stage>::transform(F function) const {
+        return transform_view<F>(m_source, m_first, m_last, Utils::TransformStage<Stage, F>{ m_stage, std::move(function) });
+    }
+
+    template<typename Source, typename Value, typename Stage>
+    template<typename Predicate>
+    typename VectorView<Source, Value, Stage>::template filter_view<Predicate> VectorView<Source, Value, Stage>::filter(Predicate predicate) const {
+        return filter_view<Predicate>(m_source, m_first, m_last, Utils::FilterStage<Stage, Predicate>{ m_stage, std::move(predicate) });
+    }
+
+    template<typename Source, typename Value, typename Stage>
+    template<typename Consumer>
+    void VectorView<Source, Value, Stage>::for_each(Consumer consumer) const {
+        auto sink = [&consumer](const Value& value) { consumer(value); };
+        auto push = [this, &sink](const auto& element) { m_stage(element, sink); };
+        m_source.copy_to(Utils::ConsumingIterator<decltype(push)>(push), m_first, m_last);
+    }
+
+    template<typename Source, typename Value, typename Stage>
+    template<typename OutputIt>
+    OutputIt VectorView<Source, Value, Stage>::copy_to(OutputIt out) const {
+        for_each([&out](const Value& value) { *out++ = value; });
+        return out;
+    }
+
+    template<typename Source, typename Value, typename Stage>
+    template<typename Consumer>
+    bool VectorView<Source, Value, Stage>::for_each_while(Consumer consumer) const {
+        bool running = true;
+        auto sink = [&consumer, &running](const Value& value) {
+            if (running) {
+                running = consumer(value);
+            }
+        };
+        auto push = [this, &sink, &running](const auto& element) {
+            if (running) {
+                m_stage(element, sink);
+            }
+        };
+        for (auto first = m_first; running && first < m_last;) {
+            auto last = std::min(m_last, (first / LEAF_SIZE + 1) * LEAF_SIZE);
+            m_source.copy_to(Utils::ConsumingIterator<decltype(push)>(push), first, last);
+            first = last;
+        }
+        return running;
+    }
+
+    template<typename Source, typename Value, typename Stage>
+    template<typename OutputIt>
+    OutputIt VectorView<Source, Value, Stage>::copy_n(std::size_t count, OutputIt out) const {
+        if (0 == count) {
+            return out;
+        }
+        for_each_while([&out, &count](const Value& value) {
+            *out++ = value;
+            return 0 != --count;
+        });
+        return out;
+    }
+
+    template<typename Source, typename Value, typename Stage>
+    typename Utils::MaterializedVector<Source, Value>::type VectorView<Source, Value, Stage>::materialize() const {
+        typename Utils::MaterializedVector<Source, Value>::type out;
+        std::vector<Value> chunk;
+        chunk.reserve(MATERIALIZE_CHUNK);
+        auto flush = [&out, &chunk]() {
+            out.append_inplace(std::make_move_iterator(chunk.begin()), std::make_move_iterator(chunk.end()));
+            chunk.clear();
+        };
+        for_each([&chunk, &flush](const Value& value) {
+            chunk.push_back(value);
+            if (chunk.size() == MATERIALIZE_CHUNK) {
+                flush();
+            }
+        });
+        flush();
+        return out;
+    }
+
+
+    /*
+    *
+    *   PersistentVector::view
+    *
+    */
+
+    template<typename T, typename Monoid, typename RefCount>
+    inline VectorView<PersistentVector<T, Monoid, RefCount>, T, Utils::IdentityStage> PersistentVector<T, Monoid, RefCount>::view() const {
+        return view(0, size());
+    }
+
+    template<typename T, typename Monoid, typename RefCount>
+    VectorView<PersistentVector<T, Monoid, RefCount>, T, Utils::IdentityStage> PersistentVector<T, Monoid, RefCount>::view(std::size_t first, std::size_t last) const {
+        if (first > last || last > size()) {
+            throw std::out_of_range("Range is out of vector bounds");
+        }
+        return VectorView<PersistentVector, T, Utils::IdentityStage>(*this, first, last, Utils::IdentityStage());
+    }
+}
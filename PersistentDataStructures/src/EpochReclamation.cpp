@@ -0,0 +1,131 @@
+#include "../include/EpochReclamation.h"
+
+namespace pds {
+	namespace {
+		std::atomic<std::uint64_t> nextDomainId{ 1 };
+
+		// Record used by the thread last time, so a thread keeps its record and its cache line;
+		// domain ids are never reused, so the hint of a destroyed domain never matches
+		struct RecordHint {
+			std::uint64_t domainId = 0;
+			void* record = nullptr;
+		};
+
+		thread_local RecordHint recordHint;
+	}
+
+	EpochDomain::Guard::Guard(EpochDomain& domain) : m_domain(domain), m_record(domain.acquire()) {
+		m_record->epoch.store(m_domain.m_epoch.load());
+		// the announcement has to be visible before the reader loads any pointer of the domain
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+	}
+
+	EpochDomain::Guard::~Guard() {
+		m_record->epoch.store(INACTIVE);
+		if (m_record->retiredSinceReclaim >= RECLAIM_PERIOD) {
+			m_record->retiredSinceReclaim = 0;
+			m_domain.tryAdvance();
+			m_domain.reclaim(*m_record);
+		}
+		m_domain.release(m_record);
+	}
+
+	void EpochDomain::Guard::retire(void* object, void (*deleter)(void*)) {
+		m_record->retired.push_back(Retired{ object, deleter, m_domain.m_epoch.load() });
+		++m_record->retiredSinceReclaim;
+		++m_domain.m_pending;
+	}
+
+	EpochDomain::EpochDomain() : m_id(nextDomainId++) {}
+
+	EpochDomain::~EpochDomain() {
+		auto record = m_records.load();
+		while (nullptr != record) {
+			for (auto& retired : record->retired) {
+				retired.deleter(retired.object);
+			}
+			auto next = record->next;
+			delete record;
+			record = next;
+		}
+	}
+
+	std::size_t EpochDomain::reclaim() {
+		// two advances let the objects retired in the current epoch go
+		tryAdvance();
+		tryAdvance();
+		std::size_t out = 0;
+		for (auto record = m_records.load(); nullptr != record; record = record->next) {
+			bool expected = false;
+			if (record->owned.compare_exchange_strong(expected, true)) {
+				out += reclaim(*record);
+				record->owned.store(false);
+			}
+		}
+		return out;
+	}
+
+	std::size_t EpochDomain::pending() const {
+		return m_pending.load();
+	}
+
+	EpochDomain::Record* EpochDomain::acquire() {
+		if (recordHint.domainId == m_id) {
+			auto record = static_cast<Record*>(recordHint.record);
+			bool expected = false;
+			if (record->owned.compare_exchange_strong(expected, true)) {
+				return record;
+			}
+		}
+		for (auto record = m_records.load(); nullptr != record; record = record->next) {
+			bool expected = false;
+			if (record->owned.compare_exchange_strong(expected, true)) {
+				recordHint = RecordHint{ m_id, record };
+				return record;
+			}
+		}
+		// every record is in use, the list only grows
+		auto record = new Record();
+		record->owned.store(true);
+		auto head = m_records.load();
+		do {
+			record->next = head;
+		} while (!m_records.compare_exchange_weak(head, record));
+		recordHint = RecordHint{ m_id, record };
+		return record;
+	}
+
+	void EpochDomain::release(Record* record) {
+		record->owned.store(false);
+	}
+
+	bool EpochDomain::tryAdvance() {
+		auto epoch = m_epoch.load();
+		for (auto record = m_records.load(); nullptr != record; record = record->next) {
+			auto readerEpoch = record->epoch.load();
+			if (INACTIVE != readerEpoch && epoch != readerEpoch) {
+				return false;
+			}
+		}
+		return m_epoch.compare_exchange_strong(epoch, epoch + 1);
+	}
+
+	std::size_t EpochDomain::reclaim(Record& record) {
+		// readers of the epoch e and earlier are gone when the epoch is e + 2
+		auto epoch = m_epoch.load();
+		std::size_t kept = 0;
+		std::size_t out = 0;
+		for (auto& retired : record.retired) {
+			if (retired.epoch + 2 <= epoch) {
+				retired.deleter(retired.object);
+				++out;
+			}
+			else {
+				record.retired[kept++] = retired;
+			}
+		}
+		record.retired.resize(kept);
+		m_pending -= out;
+		return out;
+	}
+}
@@ -0,0 +1,75 @@
+#include "../include/MemoryUsage.h"
+
+namespace pds {
+	std::size_t MemoryUsage::totalBytes() const {
+		return primeTreeNodeBytes + leafBytes + versionNodeBytes + fatNodeBytes + listNodeBytes + elementBytes;
+	}
+
+	bool MemoryAccountant::visit(const void* block, std::size_t bytes, BlockType type) {
+		if (nullptr == block || !m_blocks.emplace(block, Block{ bytes, type }).second) {
+			return false;
+		}
+		switch (type) {
+		case BlockType::PRIME_TREE_NODE:
+			++m_usage.primeTreeNodes;
+			m_usage.primeTreeNodeBytes += bytes;
+			break;
+		case BlockType::LEAF:
+			++m_usage.leaves;
+			m_usage.leafBytes += bytes;
+			break;
+		case BlockType::VERSION_NODE:
+			++m_usage.versionNodes;
+			m_usage.versionNodeBytes += bytes;
+			break;
+		case BlockType::FAT_NODE:
+			++m_usage.fatNodes;
+			m_usage.fatNodeBytes += bytes;
+			break;
+		case BlockType::LIST_NODE:
+			++m_usage.listNodes;
+			m_usage.listNodeBytes += bytes;
+			break;
+		case BlockType::ELEMENT:
+			++m_usage.elements;
+			m_usage.elementBytes += bytes;
+			break;
+		}
+		return true;
+	}
+
+	const MemoryUsage& MemoryAccountant::usage() const {
+		return m_usage;
+	}
+
+	VersionsMemoryUsage MemoryAccountant::compare(const std::vector<MemoryAccountant>& accountants) {
+		constexpr std::size_t SHARED = static_cast<std::size_t>(-1);
+		// block -> index of the only version referencing it, or SHARED
+		std::unordered_map<const void*, std::size_t> owners;
+		MemoryAccountant total;
+		VersionsMemoryUsage out;
+		out.exclusiveBytes.resize(accountants.size(), 0);
+		out.versionBytes.resize(accountants.size(), 0);
+		for (std::size_t i = 0; i < accountants.size(); ++i) {
+			out.versionBytes[i] = accountants[i].m_usage.totalBytes();
+			for (const auto& block : accountants[i].m_blocks) {
+				auto inserted = owners.emplace(block.first, i);
+				if (!inserted.second && inserted.first->second != i) {
+					inserted.first->second = SHARED;
+				}
+				total.visit(block.first, block.second.bytes, block.second.type);
+			}
+		}
+		for (const auto& block : total.m_blocks) {
+			auto owner = owners[block.first];
+			if (owner == SHARED) {
+				out.sharedBytes += block.second.bytes;
+			}
+			else {
+				out.exclusiveBytes[owner] += block.second.bytes;
+			}
+		}
+		out.total = total.m_usage;
+		return out;
+	}
+}
@@ -0,0 +1,487 @@
+#include "../include/PersistentBitVector.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace pds {
+	constexpr std::size_t PersistentBitVector::ARRAY_SIZE;
+	constexpr std::size_t PersistentBitVector::LEAF_BITS;
+	constexpr std::size_t PersistentBitVector::npos;
+
+	PersistentBitVector::PersistentBitVector(std::size_t count, bool value) {
+		if (0 == count) {
+			return;
+		}
+		m_size = count;
+		m_depth = depthOf(count);
+		std::vector<std::shared_ptr<const Node>> full(m_depth + 1);
+		m_root = Node::fill(count, m_depth, value, full);
+	}
+
+	PersistentBitVector::PersistentBitVector(std::vector<std::uint64_t>&& words, std::size_t size) {
+		if (0 == size) {
+			return;
+		}
+		std::vector<std::shared_ptr<const Node>> leaves;
+		leaves.reserve((words.size() + MASK) / ARRAY_SIZE);
+		for (std::size_t i = 0; i < words.size(); i += ARRAY_SIZE) {
+			Words leaf{};
+			auto count = std::min(ARRAY_SIZE, words.size() - i);
+			std::copy(words.begin() + i, words.begin() + i + count, leaf.begin());
+			leaves.push_back(std::make_shared<const LeafNode>(leaf, std::min(LEAF_BITS, size - i * WORD_BITS)));
+		}
+		m_size = size;
+		m_root = Node::build(std::move(leaves), m_depth);
+	}
+
+	PersistentBitVector::const_iterator PersistentBitVector::cbegin() const {
+		return const_iterator(0, this);
+	}
+
+	PersistentBitVector::const_iterator PersistentBitVector::cend() const {
+		return const_iterator(m_size, this);
+	}
+
+	bool PersistentBitVector::at(std::size_t pos) const {
+		if (pos >= m_size) {
+			throw std::out_of_range("Index is greater than vector size");
+		}
+		return (*this)[pos];
+	}
+
+	bool PersistentBitVector::front() const {
+		return (*this)[0];
+	}
+
+	bool PersistentBitVector::back() const {
+		return (*this)[m_size - 1];
+	}
+
+	std::size_t PersistentBitVector::count() const {
+		return nullptr == m_root ? 0 : m_root->m_count;
+	}
+
+	bool PersistentBitVector::any() const {
+		return count() > 0;
+	}
+
+	bool PersistentBitVector::all() const {
+		return count() == m_size;
+	}
+
+	std::size_t PersistentBitVector::find_first() const {
+		return nullptr == m_root ? npos : m_root->findFrom(0, m_depth);
+	}
+
+	std::size_t PersistentBitVector::find_next(std::size_t pos) const {
+		if (nullptr == m_root || pos + 1 >= m_size) {
+			return npos;
+		}
+		return m_root->findFrom(pos + 1, m_depth);
+	}
+
+	PersistentBitVector PersistentBitVector::set(std::size_t pos, bool value) const {
+		if ((*this)[pos] == value) {
+			return *this;
+		}
+		return PersistentBitVector(m_root->set(pos, m_depth, value), m_size, m_depth);
+	}
+
+	PersistentBitVector PersistentBitVector::flip(std::size_t pos) const {
+		return PersistentBitVector(m_root->set(pos, m_depth, !(*this)[pos]), m_size, m_depth);
+	}
+
+	PersistentBitVector PersistentBitVector::push_back(bool value) const {
+		if (nullptr == m_root) {
+			return PersistentBitVector(Node::makePath(0, value), 1, 0);
+		}
+		if (m_size == capacity(m_depth)) {
+			// the root is full, the tree grows by one level
+			auto root = std::make_shared<InteriorNode>();
+			root->attach(m_root);
+			root->attach(Node::makePath(m_depth, value));
+			return PersistentBitVector(std::move(root), m_size + 1, m_depth + 1);
+		}
+		return PersistentBitVector(m_root->push_back(m_depth, value), m_size + 1, m_depth);
+	}
+
+	PersistentBitVector PersistentBitVector::pop_back() const {
+		auto root = m_root->pop_back(m_depth);
+		auto depth = m_depth;
+		if (nullptr != root && !root->isLeaf() && 1 == root->asInterior().m_contentAmount) {
+			root = root->asInterior().m_children.front();
+			--depth;
+		}
+		return PersistentBitVector(std::move(root), m_size - 1, depth);
+	}
+
+	PersistentBitVector PersistentBitVector::operator&(const PersistentBitVector& other) const {
+		return combine(other, Operation::AND);
+	}
+
+	PersistentBitVector PersistentBitVector::operator|(const PersistentBitVector& other) const {
+		return combine(other, Operation::OR);
+	}
+
+	PersistentBitVector PersistentBitVector::operator^(const PersistentBitVector& other) const {
+		return combine(other, Operation::XOR);
+	}
+
+	bool PersistentBitVector::operator==(const PersistentBitVector& other) const {
+		if (m_size != other.m_size) {
+			return false;
+		}
+		if (m_root == other.m_root) {
+			return true;
+		}
+		return m_root->equals(*other.m_root);
+	}
+
+	bool PersistentBitVector::operator!=(const PersistentBitVector& other) const {
+		return !(*this == other);
+	}
+
+	MemoryUsage PersistentBitVector::memoryUsage() const {
+		MemoryAccountant accountant;
+		accountMemory(accountant);
+		return accountant.usage();
+	}
+
+	void PersistentBitVector::accountMemory(MemoryAccountant& accountant) const {
+		if (nullptr != m_root) {
+			m_root->accountMemory(accountant);
+		}
+	}
+
+	PersistentBitVector PersistentBitVector::combine(const PersistentBitVector& other, Operation operation) const {
+		if (m_size != other.m_size) {
+			throw std::invalid_argument("Vectors have different sizes");
+		}
+		if (nullptr == m_root) {
+			return *this;
+		}
+		// vectors of the same size have tries of the same shape
+		std::vector<std::shared_ptr<const Node>> zeros(m_depth + 1);
+		return PersistentBitVector(Node::combine(m_root, other.m_root, m_depth, operation, zeros), m_size, m_depth);
+	}
+
+	std::size_t PersistentBitVector::capacity(std::uint32_t level) {
+		return Utils::binPow(LEAF_DEGREE + level * DEGREE_OF_TWO);
+	}
+
+	std::uint32_t PersistentBitVector::depthOf(std::size_t size) {
+		std::uint32_t out = 0;
+		while (size > capacity(out)) {
+			++out;
+		}
+		return out;
+	}
+
+
+	/*
+	*
+	*	const_iterator
+	*
+	*/
+
+	PersistentBitVector::const_iterator::const_iterator(std::size_t pos, const PersistentBitVector* pvector)
+		: m_pos(pos), m_pvector(pvector)
+	{
+		load();
+	}
+
+	void PersistentBitVector::const_iterator::load() {
+		if (m_pos < m_pvector->size()) {
+			m_words = &m_pvector->leafAt(m_pos);
+		}
+	}
+
+
+	/*
+	*
+	*	Node
+	*
+	*/
+
+	PersistentBitVector::LeafNode::LeafNode(const Words& words, std::size_t bits)
+		: Node(true), m_words(words)
+	{
+		m_bits = bits;
+		for (auto word : m_words) {
+			m_count += Utils::popCount(word);
+		}
+	}
+
+	std::shared_ptr<PersistentBitVector::Node> PersistentBitVector::Node::copy() const {
+		if (isLeaf()) {
+			return std::make_shared<LeafNode>(asLeaf());
+		}
+		return std::make_shared<InteriorNode>(asInterior());
+	}
+
+	std::shared_ptr<const PersistentBitVector::Node> PersistentBitVector::Node::set(std::size_t pos, std::uint32_t level, bool value) const {
+		auto out = copy();
+		if (value) {
+			++out->m_count;
+		}
+		else {
+			--out->m_count;
+		}
+		if (isLeaf()) {
+			auto bit = 1ull << (pos & (WORD_BITS - 1));
+			auto& word = out->asLeaf().m_words[pos >> WORD_DEGREE];
+			word = value ? word | bit : word & ~bit;
+			return out;
+		}
+		// otherwise the node is interior
+		auto shift = LEAF_DEGREE + (level - 1) * DEGREE_OF_TWO;
+		auto id = pos >> shift;
+		out->asInterior().m_children[id] = asInterior().m_children[id]->set(pos & (capacity(level - 1) - 1), level - 1, value);
+		return out;
+	}
+
+	std::shared_ptr<const PersistentBitVector::Node> PersistentBitVector::Node::push_back(std::uint32_t level, bool value) const {
+		auto pos = m_bits;
+		auto out = copy();
+		++out->m_bits;
+		out->m_count += value ? 1 : 0;
+		if (isLeaf()) {
+			out->asLeaf().m_words[pos >> WORD_DEGREE] |= static_cast<std::uint64_t>(value) << (pos & (WORD_BITS - 1));
+			return out;
+		}
+		// otherwise the node is interior
+		auto& interior = out->asInterior();
+		auto id = pos >> (LEAF_DEGREE + (level - 1) * DEGREE_OF_TWO);
+		if (id < interior.m_contentAmount) {
+			interior.m_children[id] = asInterior().m_children[id]->push_back(level - 1, value);
+		}
+		else {
+			interior.m_children[id] = makePath(level - 1, value);
+			interior.m_contentAmount = id + 1;
+		}
+		return out;
+	}
+
+	std::shared_ptr<const PersistentBitVector::Node> PersistentBitVector::Node::pop_back(std::uint32_t level) const {
+		if (1 == m_bits) {
+			return nullptr;
+		}
+		auto pos = m_bits - 1;
+		auto out = copy();
+		--out->m_bits;
+		if (isLeaf()) {
+			auto bit = 1ull << (pos & (WORD_BITS - 1));
+			auto& word = out->asLeaf().m_words[pos >> WORD_DEGREE];
+			out->m_count -= 0 != (word & bit) ? 1 : 0;
+			word &= ~bit;
+			return out;
+		}
+		// otherwise the node is interior
+		auto id = pos >> (LEAF_DEGREE + (level - 1) * DEGREE_OF_TWO);
+		auto& oldChild = asInterior().m_children[id];
+		auto child = oldChild->pop_back(level - 1);
+		out->m_count -= oldChild->m_count - (nullptr == child ? 0 : child->m_count);
+		auto& interior = out->asInterior();
+		if (nullptr != child) {
+			interior.m_children[id] = std::move(child);
+		}
+		else {
+			interior.m_children[id].reset();
+			interior.m_contentAmount = id;
+		}
+		return out;
+	}
+
+	std::size_t PersistentBitVector::Node::findFrom(std::size_t pos, std::uint32_t level) const {
+		if (0 == m_count || pos >= m_bits) {
+			return npos;
+		}
+		if (isLeaf()) {
+			auto& words = asLeaf().m_words;
+			auto id = pos >> WORD_DEGREE;
+			auto word = words[id] & (~0ull << (pos & (WORD_BITS - 1)));
+			while (0 == word) {
+				if (++id == ARRAY_SIZE) {
+					return npos;
+				}
+				word = words[id];
+			}
+			return (id << WORD_DEGREE) + Utils::countTrailingZeros(word);
+		}
+		// otherwise the node is interior
+		auto shift = LEAF_DEGREE + (level - 1) * DEGREE_OF_TWO;
+		auto from = pos & (capacity(level - 1) - 1);
+		auto& interior = asInterior();
+		for (auto id = pos >> shift; id < interior.m_contentAmount; ++id, from = 0) {
+			auto found = interior.m_children[id]->findFrom(from, level - 1);
+			if (npos != found) {
+				return (id << shift) + found;
+			}
+		}
+		return npos;
+	}
+
+	bool PersistentBitVector::Node::equals(const Node& other) const {
+		if (this == &other) {
+			return true;
+		}
+		if (m_count != other.m_count) {
+			return false;
+		}
+		if (isLeaf()) {
+			return asLeaf().m_words == other.asLeaf().m_words;
+		}
+		// otherwise the node is interior, the nodes have the same shape
+		auto& children = asInterior().m_children;
+		auto& otherChildren = other.asInterior().m_children;
+		for (std::size_t i = 0; i < asInterior().m_contentAmount; ++i) {
+			if (!children[i]->equals(*otherChildren[i])) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	std::shared_ptr<const PersistentBitVector::Node> PersistentBitVector::Node::makePath(std::uint32_t level, bool value) {
+		if (0 == level) {
+			Words words{};
+			words[0] = static_cast<std::uint64_t>(value);
+			return std::make_shared<const LeafNode>(words, 1);
+		}
+		auto out = std::make_shared<InteriorNode>();
+		out->attach(makePath(level - 1, value));
+		return out;
+	}
+
+	std::shared_ptr<const PersistentBitVector::Node> PersistentBitVector::Node::fill(std::size_t bits, std::uint32_t level, bool value,
+		std::vector<std::shared_ptr<const Node>>& full)
+	{
+		auto isFull = bits == capacity(level);
+		if (isFull && nullptr != full[level]) {
+			return full[level];
+		}
+		std::shared_ptr<const Node> out;
+		if (0 == level) {
+			Words words{};
+			if (value) {
+				std::fill(words.begin(), words.begin() + (bits >> WORD_DEGREE), ~0ull);
+				if (0 != (bits & (WORD_BITS - 1))) {
+					words[bits >> WORD_DEGREE] = (1ull << (bits & (WORD_BITS - 1))) - 1;
+				}
+			}
+			out = std::make_shared<const LeafNode>(words, bits);
+		}
+		else {
+			auto node = std::make_shared<InteriorNode>();
+			auto childBits = capacity(level - 1);
+			for (auto left = bits; left > 0; left -= std::min(left, childBits)) {
+				node->attach(fill(std::min(left, childBits), level - 1, value, full));
+			}
+			out = std::move(node);
+		}
+		if (isFull) {
+			full[level] = out;
+		}
+		return out;
+	}
+
+	std::shared_ptr<const PersistentBitVector::Node> PersistentBitVector::Node::build(std::vector<std::shared_ptr<const Node>>&& nodes, std::uint32_t& depth) {
+		depth = 0;
+		while (nodes.size() > 1) {
+			std::vector<std::shared_ptr<const Node>> upper;
+			upper.reserve((nodes.size() + MASK) / ARRAY_SIZE);
+			for (std::size_t i = 0; i < nodes.size(); i += ARRAY_SIZE) {
+				auto node = std::make_shared<InteriorNode>();
+				auto count = std::min(ARRAY_SIZE, nodes.size() - i);
+				for (std::size_t j = i; j < i + count; ++j) {
+					node->attach(std::move(nodes[j]));
+				}
+				upper.push_back(std::move(node));
+			}
+			nodes = std::move(upper);
+			++depth;
+		}
+		return std::move(nodes.front());
+	}
+
+	std::shared_ptr<const PersistentBitVector::Node> PersistentBitVector::Node::combine(const std::shared_ptr<const Node>& left,
+		const std::shared_ptr<const Node>& right, std::uint32_t level, Operation operation, std::vector<std::shared_ptr<const Node>>& zeros)
+	{
+		// the subtrees are skipped by their counts and the shared ones
+		switch (operation) {
+		case Operation::AND:
+			if (left == right || 0 == left->m_count || right->isFull()) {
+				return left;
+			}
+			if (0 == right->m_count || left->isFull()) {
+				return right;
+			}
+			break;
+		case Operation::OR:
+			if (left == right || 0 == right->m_count || left->isFull()) {
+				return left;
+			}
+			if (0 == left->m_count || right->isFull()) {
+				return right;
+			}
+			break;
+		case Operation::XOR:
+			if (left == right) {
+				return fill(left->m_bits, level, false, zeros);
+			}
+			if (0 == right->m_count) {
+				return left;
+			}
+			if (0 == left->m_count) {
+				return right;
+			}
+			break;
+		}
+		if (left->isLeaf()) {
+			auto& leftWords = left->asLeaf().m_words;
+			auto& rightWords = right->asLeaf().m_words;
+			Words words;
+			for (std::size_t i = 0; i < ARRAY_SIZE; ++i) {
+				switch (operation) {
+				case Operation::AND:
+					words[i] = leftWords[i] & rightWords[i];
+					break;
+				case Operation::OR:
+					words[i] = leftWords[i] | rightWords[i];
+					break;
+				case Operation::XOR:
+					words[i] = leftWords[i] ^ rightWords[i];
+					break;
+				}
+			}
+			return std::make_shared<const LeafNode>(words, left->m_bits);
+		}
+		// otherwise the nodes are interior
+		auto& leftNode = left->asInterior();
+		auto& rightNode = right->asInterior();
+		auto out = std::make_shared<InteriorNode>();
+		for (std::size_t i = 0; i < leftNode.m_contentAmount; ++i) {
+			out->attach(combine(leftNode.m_children[i], rightNode.m_children[i], level - 1, operation, zeros));
+		}
+		return out;
+	}
+
+	void PersistentBitVector::Node::accountMemory(MemoryAccountant& accountant) const {
+		if (isLeaf()) {
+			accountant.visit(this, MemoryAccountant::sharedBlockSize<LeafNode>(), MemoryAccountant::BlockType::LEAF);
+			return;
+		}
+		auto& interior = asInterior();
+		if (accountant.visit(this, MemoryAccountant::sharedBlockSize<InteriorNode>(), MemoryAccountant::BlockType::PRIME_TREE_NODE)) {
+			for (std::size_t i = 0; i < interior.m_contentAmount; ++i) {
+				interior.m_children[i]->accountMemory(accountant);
+			}
+		}
+	}
+
+	void PersistentBitVector::InteriorNode::attach(std::shared_ptr<const Node> child) {
+		m_bits += child->m_bits;
+		m_count += child->m_count;
+		m_children[m_contentAmount++] = std::move(child);
+	}
+}
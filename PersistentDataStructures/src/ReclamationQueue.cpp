@@ -0,0 +1,81 @@
+#include "../include/ReclamationQueue.h"
+
+namespace pds {
+	ReclamationQueue::~ReclamationQueue() {
+		stopBackground();
+		reclaimAll();
+	}
+
+	std::size_t ReclamationQueue::reclaim(std::size_t budget) {
+		std::size_t out = 0;
+		while (out < budget && stepOnce()) {
+			++out;
+		}
+		return out;
+	}
+
+	std::size_t ReclamationQueue::reclaimAll() {
+		std::size_t out = 0;
+		while (stepOnce()) {
+			++out;
+		}
+		return out;
+	}
+
+	std::size_t ReclamationQueue::pending() const {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_items.size();
+	}
+
+	void ReclamationQueue::startBackground() {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_background.joinable()) {
+			return;
+		}
+		m_stop = false;
+		m_background = std::thread([this]() { runBackground(); });
+	}
+
+	void ReclamationQueue::stopBackground() {
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (!m_background.joinable()) {
+				return;
+			}
+			m_stop = true;
+		}
+		m_wakeUp.notify_all();
+		m_background.join();
+		m_background = std::thread();
+	}
+
+	bool ReclamationQueue::stepOnce() {
+		Item item;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (m_items.empty()) {
+				return false;
+			}
+			auto& front = m_items.front();
+			front.relocate(&front.pointer, &item.pointer);
+			item.step = front.step;
+			m_items.pop_front();
+		}
+		// the step may push the references of the freed object, so it is done without the lock
+		item.step(&item.pointer, *this);
+		return true;
+	}
+
+	void ReclamationQueue::runBackground() {
+		while (true) {
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_wakeUp.wait(lock, [this]() { return m_stop || !m_items.empty(); });
+				if (m_stop) {
+					return;
+				}
+			}
+			reclaim(BACKGROUND_SLICE);
+		}
+	}
+}
@@ -0,0 +1,101 @@
+#include "../include/Statistics.h"
+
+#include <mutex>
+#include <unordered_set>
+
+namespace pds {
+	OperationCounters& OperationCounters::operator+=(const OperationCounters& other) {
+		nodeAllocations += other.nodeAllocations;
+		pathCopies += other.pathCopies;
+		pathCopyLength += other.pathCopyLength;
+		inPlaceEdits += other.inPlaceEdits;
+		findNodeSteps += other.findNodeSteps;
+		mapRehashes += other.mapRehashes;
+		bucketLookups += other.bucketLookups;
+		bucketProbes += other.bucketProbes;
+		iteratorDescents += other.iteratorDescents;
+		return *this;
+	}
+
+	namespace Statistics {
+		namespace {
+			struct Registry {
+				std::mutex mutex;
+				std::unordered_set<ThreadCounters*> threads;
+				OperationCounters finished;
+			};
+
+			// never destroyed, so threads finishing after the static destruction can still unregister
+			Registry& registry() {
+				static Registry* out = new Registry();
+				return *out;
+			}
+		}
+
+		ThreadCounters::ThreadCounters() {
+			for (auto& cell : m_counters) {
+				cell.store(0, std::memory_order_relaxed);
+			}
+			auto& reg = registry();
+			std::lock_guard<std::mutex> lock(reg.mutex);
+			reg.threads.insert(this);
+		}
+
+		ThreadCounters::~ThreadCounters() {
+			auto& reg = registry();
+			std::lock_guard<std::mutex> lock(reg.mutex);
+			reg.finished += snapshot();
+			reg.threads.erase(this);
+		}
+
+		OperationCounters ThreadCounters::snapshot() const {
+			auto get = [this](Counter counter) {
+				return m_counters[static_cast<std::size_t>(counter)].load(std::memory_order_relaxed);
+			};
+			OperationCounters out;
+			out.nodeAllocations = get(Counter::NODE_ALLOCATIONS);
+			out.pathCopies = get(Counter::PATH_COPIES);
+			out.pathCopyLength = get(Counter::PATH_COPY_LENGTH);
+			out.inPlaceEdits = get(Counter::IN_PLACE_EDITS);
+			out.findNodeSteps = get(Counter::FIND_NODE_STEPS);
+			out.mapRehashes = get(Counter::MAP_REHASHES);
+			out.bucketLookups = get(Counter::BUCKET_LOOKUPS);
+			out.bucketProbes = get(Counter::BUCKET_PROBES);
+			out.iteratorDescents = get(Counter::ITERATOR_DESCENTS);
+			return out;
+		}
+
+		void ThreadCounters::reset() {
+			for (auto& cell : m_counters) {
+				cell.store(0, std::memory_order_relaxed);
+			}
+		}
+
+		OperationCounters threadSnapshot() {
+			return threadCounters().snapshot();
+		}
+
+		OperationCounters processSnapshot() {
+			auto& reg = registry();
+			std::lock_guard<std::mutex> lock(reg.mutex);
+			auto out = reg.finished;
+			for (auto thread : reg.threads) {
+				out += thread->snapshot();
+			}
+			return out;
+		}
+
+		void resetThread() {
+			threadCounters().reset();
+		}
+
+		void resetProcess() {
+			auto& reg = registry();
+			std::lock_guard<std::mutex> lock(reg.mutex);
+			reg.finished = OperationCounters();
+			for (auto thread : reg.threads) {
+				thread->reset();
+			}
+		}
+	}
+}
@@ -0,0 +1,66 @@
+#include "Benchmark.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+namespace bench {
+	bool Runner::enabled(const std::string& benchmark, const std::string& container) const {
+		return m_options.filter.empty() || (benchmark + "/" + container).find(m_options.filter) != std::string::npos;
+	}
+
+	void Runner::addResult(const std::string& benchmark, const std::string& container, std::size_t size,
+	                       std::size_t operations, std::vector<double> nanoseconds)
+	{
+		std::sort(nanoseconds.begin(), nanoseconds.end());
+		Result result;
+		result.benchmark = benchmark;
+		result.container = container;
+		result.size = size;
+		result.operations = operations;
+		result.repetitions = nanoseconds.size();
+		result.minNsPerOp = nanoseconds.front() / operations;
+		result.medianNsPerOp = nanoseconds[nanoseconds.size() / 2] / operations;
+		m_results.push_back(result);
+		std::cerr << benchmark << "/" << container << "/" << size << ": " << result.medianNsPerOp << " ns/op" << std::endl;
+	}
+
+	void Runner::report() const {
+		std::ofstream file;
+		if (!m_options.output.empty()) {
+			file.open(m_options.output);
+		}
+		std::ostream& out = m_options.output.empty() ? std::cout : file;
+		if (m_options.format == "json") {
+			out << "[\n";
+			for (std::size_t i = 0; i < m_results.size(); ++i) {
+				const auto& r = m_results[i];
+				out << "  {\"benchmark\": \"" << r.benchmark << "\", \"container\": \"" << r.container
+					<< "\", \"size\": " << r.size << ", \"operations\": " << r.operations
+					<< ", \"repetitions\": " << r.repetitions << ", \"min_ns_per_op\": " << r.minNsPerOp
+					<< ", \"median_ns_per_op\": " << r.medianNsPerOp
+					<< ", \"ops_per_sec\": " << 1e9 / r.medianNsPerOp << "}"
+					<< (i + 1 == m_results.size() ? "\n" : ",\n");
+			}
+			out << "]\n";
+		}
+		else {
+			out << "benchmark,container,size,operations,repetitions,min_ns_per_op,median_ns_per_op,ops_per_sec\n";
+			for (const auto& r : m_results) {
+				out << r.benchmark << "," << r.container << "," << r.size << "," << r.operations << ","
+					<< r.repetitions << "," << r.minNsPerOp << "," << r.medianNsPerOp << ","
+					<< 1e9 / r.medianNsPerOp << "\n";
+			}
+		}
+	}
+
+	std::vector<std::size_t> randomIndexes(std::size_t count, std::size_t size, std::uint64_t seed) {
+		std::mt19937_64 generator(seed);
+		std::uniform_int_distribution<std::size_t> distribution(0, size - 1);
+		std::vector<std::size_t> out(count);
+		for (auto& index : out) {
+			index = distribution(generator);
+		}
+		return out;
+	}
+}
@@ -0,0 +1,99 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+/*
+*
+*   Minimal benchmark harness: every benchmark is measured several times,
+*       the fixture is prepared by setup() outside of the measured region,
+*       results are printed as CSV or JSON.
+*
+*/
+namespace bench {
+    struct Options {
+        std::vector<std::size_t> sizes = { 1000, 10000, 100000 };
+        std::size_t repetitions = 5;
+        // operations of copy-on-write baselines are O(n), so their number is limited
+        std::size_t baselineOperations = 1000;
+        std::string filter;
+        std::string format = "csv";
+        std::string output;
+    };
+
+    struct Result {
+        std::string benchmark;
+        std::string container;
+        std::size_t size;
+        std::size_t operations;
+        std::size_t repetitions;
+        double minNsPerOp;
+        double medianNsPerOp;
+    };
+
+    // Keeps the compiler from optimizing away the computation of a value
+    template<typename T>
+    inline void doNotOptimize(const T& value) {
+#if defined(__GNUC__) || defined(__clang__)
+        asm volatile("" : : "g"(&value) : "memory");
+#else
+        static volatile const void* sink;
+        sink = &value;
+#endif
+    }
+
+    class Runner {
+    public:
+        explicit Runner(Options options) : m_options(std::move(options)) {}
+
+        const Options& options() const { return m_options; }
+
+        bool enabled(const std::string& benchmark, const std::string& container) const;
+
+        // body(fixture) performs `operations` operations on the fixture returned by setup()
+        template<typename Setup, typename Body>
+        void measure(const std::string& benchmark, const std::string& container,
+                     std::size_t size, std::size_t operations, Setup setup, Body body);
+
+        const std::vector<Result>& results() const { return m_results; }
+
+        void report() const;
+
+    private:
+        void addResult(const std::string& benchmark, const std::string& container, std::size_t size,
+                       std::size_t operations, std::vector<double> nanoseconds);
+
+        Options m_options;
+        std::vector<Result> m_results;
+    };
+
+    template<typename Setup, typename Body>
+    void Runner::measure(const std::string& benchmark, const std::string& container,
+                         std::size_t size, std::size_t operations, Setup setup, Body body)
+    {
+        if (!enabled(benchmark, container) || 0 == operations) {
+            return;
+        }
+        std::vector<double> nanoseconds;
+        for (std::size_t i = 0; i < m_options.repetitions; ++i) {
+            auto fixture = setup();
+            auto start = std::chrono::steady_clock::now();
+            body(fixture);
+            auto finish = std::chrono::steady_clock::now();
+            doNotOptimize(fixture);
+            nanoseconds.push_back(static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(finish - start).count()));
+        }
+        addResult(benchmark, container, size, operations, std::move(nanoseconds));
+    }
+
+    // Reproducible random indexes in [0, size)
+    std::vector<std::size_t> randomIndexes(std::size_t count, std::size_t size, std::uint64_t seed = 42);
+
+    void runVectorBenchmarks(Runner& runner);
+    void runMapBenchmarks(Runner& runner);
+    void runListBenchmarks(Runner& runner);
+}
@@ -0,0 +1,70 @@
+#include "Benchmark.h"
+
+#include <iostream>
+#include <sstream>
+#include <string>
+
+namespace {
+	const char* USAGE =
+		"Usage: PersistentDataStructures_bench [options]\n"
+		"  --sizes=N[,N...]          container sizes (default 1000,10000,100000)\n"
+		"  --repetitions=N           measurements per benchmark, the median is reported (default 5)\n"
+		"  --baseline-operations=N   operations of copy-on-write baselines (default 1000)\n"
+		"  --filter=TEXT             run only benchmarks whose \"benchmark/container\" contains TEXT\n"
+		"  --format=csv|json         output format (default csv)\n"
+		"  --out=FILE                write results to FILE instead of stdout\n";
+
+	bool startsWith(const std::string& str, const std::string& prefix) {
+		return str.compare(0, prefix.size(), prefix) == 0;
+	}
+
+	std::size_t toSize(const std::string& str) {
+		return static_cast<std::size_t>(std::stoull(str));
+	}
+}
+
+int main(int argc, char** argv) {
+	bench::Options options;
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		auto value = arg.substr(arg.find('=') + 1);
+		if (startsWith(arg, "--sizes=")) {
+			options.sizes.clear();
+			std::stringstream sizes(value);
+			std::string size;
+			while (std::getline(sizes, size, ',')) {
+				options.sizes.push_back(toSize(size));
+			}
+		}
+		else if (startsWith(arg, "--repetitions=")) {
+			options.repetitions = toSize(value);
+		}
+		else if (startsWith(arg, "--baseline-operations=")) {
+			options.baselineOperations = toSize(value);
+		}
+		else if (startsWith(arg, "--filter=")) {
+			options.filter = value;
+		}
+		else if (startsWith(arg, "--format=") && (value == "csv" || value == "json")) {
+			options.format = value;
+		}
+		else if (startsWith(arg, "--out=")) {
+			options.output = value;
+		}
+		else {
+			std::cerr << USAGE;
+			return arg == "--help" ? 0 : 1;
+		}
+	}
+	if (0 == options.repetitions) {
+		std::cerr << USAGE;
+		return 1;
+	}
+
+	bench::Runner runner(options);
+	bench::runVectorBenchmarks(runner);
+	bench::runMapBenchmarks(runner);
+	bench::runListBenchmarks(runner);
+	runner.report();
+	return 0;
+}
@@ -0,0 +1,93 @@
+#include "Benchmark.h"
+
+#include <PersistentList.h>
+
+#include <algorithm>
+#include <list>
+#include <memory>
+
+namespace bench {
+	namespace {
+		using Value = int;
+		using List = pds::persistent_linked_list<Value>;
+		using CowList = std::shared_ptr<const std::list<Value>>;
+
+		std::list<Value> makeStdList(std::size_t size) {
+			std::list<Value> out;
+			for (std::size_t i = 0; i < size; ++i) {
+				out.push_back(static_cast<Value>(i));
+			}
+			return out;
+		}
+
+		void runPushBack(Runner& runner, std::size_t size) {
+			auto source = makeStdList(size);
+			runner.measure("push_back", "persistent_linked_list", size, size,
+				[&]() { return List(source.cbegin(), source.cend()); },
+				[&](List& l) {
+					for (std::size_t i = 0; i < size; ++i) {
+						l = l.push_back(static_cast<Value>(i));
+					}
+				});
+			auto operations = std::min(size, runner.options().baselineOperations);
+			runner.measure("push_back", "std::list(cow)", size, operations,
+				[&]() { return std::make_shared<const std::list<Value>>(source); },
+				[&](CowList& l) {
+					for (std::size_t i = 0; i < operations; ++i) {
+						auto next = std::make_shared<std::list<Value>>(*l);
+						next->push_back(static_cast<Value>(i));
+						l = std::move(next);
+					}
+				});
+		}
+
+		void runInsert(Runner& runner, std::size_t size) {
+			// insertion into the middle walks half of the list in both containers
+			auto source = makeStdList(size);
+			auto operations = std::min(size, runner.options().baselineOperations);
+			runner.measure("insert_middle", "persistent_linked_list", size, operations,
+				[&]() { return List(source.cbegin(), source.cend()); },
+				[&](List& l) {
+					for (std::size_t i = 0; i < operations; ++i) {
+						l = l.insert(l.size() / 2, static_cast<Value>(i));
+					}
+				});
+			runner.measure("insert_middle", "std::list(cow)", size, operations,
+				[&]() { return std::make_shared<const std::list<Value>>(source); },
+				[&](CowList& l) {
+					for (std::size_t i = 0; i < operations; ++i) {
+						auto next = std::make_shared<std::list<Value>>(*l);
+						next->insert(std::next(next->begin(), next->size() / 2), static_cast<Value>(i));
+						l = std::move(next);
+					}
+				});
+		}
+
+		void runIteration(Runner& runner, std::size_t size) {
+			auto source = makeStdList(size);
+			List plist(source.cbegin(), source.cend());
+			runner.measure("iterate", "persistent_linked_list", size, size,
+				[&]() { return Value(0); },
+				[&](Value& sum) {
+					for (auto it = plist.cbegin(); it != plist.cend(); ++it) {
+						sum += *it;
+					}
+				});
+			runner.measure("iterate", "std::list(cow)", size, size,
+				[&]() { return Value(0); },
+				[&](Value& sum) {
+					for (auto value : source) {
+						sum += value;
+					}
+				});
+		}
+	}
+
+	void runListBenchmarks(Runner& runner) {
+		for (auto size : runner.options().sizes) {
+			runPushBack(runner, size);
+			runInsert(runner, size);
+			runIteration(runner, size);
+		}
+	}
+}
@@ -0,0 +1,125 @@
+#include "Benchmark.h"
+
+#include <PersistentMap.h>
+
+#include <algorithm>
+#include <memory>
+#include <unordered_map>
+
+namespace bench {
+	namespace {
+		using Key = std::size_t;
+		using Value = std::size_t;
+		using Map = pds::PersistentMap<Key, Value>;
+		using CowMap = std::shared_ptr<const std::unordered_map<Key, Value>>;
+
+		Map makeMap(std::size_t size, std::size_t buckets) {
+			std::vector<std::pair<Key, Value>> source;
+			for (std::size_t i = 0; i < size; ++i) {
+				source.emplace_back(i, i);
+			}
+			return Map(source.cbegin(), source.cend(), buckets);
+		}
+
+		std::unordered_map<Key, Value> makeStdMap(std::size_t size) {
+			std::unordered_map<Key, Value> out;
+			for (std::size_t i = 0; i < size; ++i) {
+				out.emplace(i, i);
+			}
+			return out;
+		}
+
+		void runSet(Runner& runner, std::size_t size) {
+			// new keys, the table is rehashed when it becomes half full
+			auto pmap = makeMap(size, 2 * size + 2);
+			runner.measure("set", "PersistentMap", size, size,
+				[&]() { return pmap; },
+				[&](Map& m) {
+					for (std::size_t i = 0; i < size; ++i) {
+						m = m.set(size + i, i);
+					}
+				});
+			auto operations = std::min(size, runner.options().baselineOperations);
+			auto stdMap = makeStdMap(size);
+			runner.measure("set", "std::unordered_map(cow)", size, operations,
+				[&]() { return std::make_shared<const std::unordered_map<Key, Value>>(stdMap); },
+				[&](CowMap& m) {
+					for (std::size_t i = 0; i < operations; ++i) {
+						auto next = std::make_shared<std::unordered_map<Key, Value>>(*m);
+						(*next)[size + i] = i;
+						m = std::move(next);
+					}
+				});
+		}
+
+		void runFind(Runner& runner, std::size_t size) {
+			auto keys = randomIndexes(size, size);
+			auto pmap = makeMap(size, 2 * size + 2);
+			runner.measure("find", "PersistentMap", size, size,
+				[&]() { return Value(0); },
+				[&](Value& sum) {
+					for (auto key : keys) {
+						sum += pmap.find(key)->second;
+					}
+				});
+			auto stdMap = makeStdMap(size);
+			runner.measure("find", "std::unordered_map(cow)", size, size,
+				[&]() { return Value(0); },
+				[&](Value& sum) {
+					for (auto key : keys) {
+						sum += stdMap.find(key)->second;
+					}
+				});
+		}
+
+		void runErase(Runner& runner, std::size_t size) {
+			auto pmap = makeMap(size, 2 * size + 2);
+			runner.measure("erase", "PersistentMap", size, size,
+				[&]() { return pmap; },
+				[&](Map& m) {
+					for (std::size_t i = 0; i < size; ++i) {
+						m = m.erase(i);
+					}
+				});
+			auto operations = std::min(size, runner.options().baselineOperations);
+			auto stdMap = makeStdMap(size);
+			runner.measure("erase", "std::unordered_map(cow)", size, operations,
+				[&]() { return std::make_shared<const std::unordered_map<Key, Value>>(stdMap); },
+				[&](CowMap& m) {
+					for (std::size_t i = 0; i < operations; ++i) {
+						auto next = std::make_shared<std::unordered_map<Key, Value>>(*m);
+						next->erase(i);
+						m = std::move(next);
+					}
+				});
+		}
+
+		void runRehash(Runner& runner, std::size_t size) {
+			// the next new key makes the table more than half full
+			auto pmap = makeMap(size, 2 * size);
+			runner.measure("rehash", "PersistentMap", size, 1,
+				[&]() { return pmap; },
+				[&](Map& m) {
+					m = m.set(size, size);
+				});
+			auto stdMap = makeStdMap(size);
+			runner.measure("rehash", "std::unordered_map(cow)", size, 1,
+				[&]() { return std::make_shared<const std::unordered_map<Key, Value>>(stdMap); },
+				[&](CowMap& m) {
+					auto next = std::make_shared<std::unordered_map<Key, Value>>(*m);
+					next->rehash(2 * next->bucket_count());
+					(*next)[size] = size;
+					m = std::move(next);
+				});
+		}
+	}
+
+	void runMapBenchmarks(Runner& runner) {
+		for (auto size : runner.options().sizes) {
+			runSet(runner, size);
+			runFind(runner, size);
+			runErase(runner, size);
+			runRehash(runner, size);
+		}
+	}
+}
@@ -0,0 +1,562 @@
+#include "Benchmark.h"
+
+#include <PersistentVector.h>
+#include <PackedVector.h>
+#include <PersistentBitVector.h>
+#include <VectorView.h>
+#include <EpochReclamation.h>
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace bench {
+	namespace {
+		using Value = std::size_t;
+		using CowVector = std::shared_ptr<const std::vector<Value>>;
+		using SingleThreadVector = pds::PersistentVector<Value, void, pds::SingleThreadRefCount>;
+
+		std::vector<Value> sequence(std::size_t size) {
+			std::vector<Value> out(size);
+			for (std::size_t i = 0; i < size; ++i) {
+				out[i] = i;
+			}
+			return out;
+		}
+
+		void runPushBack(Runner& runner, std::size_t size) {
+			auto source = sequence(size);
+			runner.measure("push_back", "PersistentVector", size, size,
+				[&]() { return pds::PersistentVector<Value>(source.cbegin(), source.cend()); },
+				[&](pds::PersistentVector<Value>& v) {
+					for (std::size_t i = 0; i < size; ++i) {
+						v = v.push_back(i);
+					}
+				});
+			runner.measure("push_back", "PersistentVector(single-thread rc)", size, size,
+				[&]() { return SingleThreadVector(source.cbegin(), source.cend()); },
+				[&](SingleThreadVector& v) {
+					for (std::size_t i = 0; i < size; ++i) {
+						v = v.push_back(i);
+					}
+				});
+			auto operations = std::min(size, runner.options().baselineOperations);
+			runner.measure("push_back", "std::vector(cow)", size, operations,
+				[&]() { return std::make_shared<const std::vector<Value>>(source); },
+				[&](CowVector& v) {
+					for (std::size_t i = 0; i < operations; ++i) {
+						auto next = std::make_shared<std::vector<Value>>(*v);
+						next->push_back(i);
+						v = std::move(next);
+					}
+				});
+		}
+
+		// The vector used as a queue and a stack at the front
+		void runFront(Runner& runner, std::size_t size) {
+			auto source = sequence(size);
+			runner.measure("push_front", "PersistentVector", size, size,
+				[&]() { return pds::PersistentVector<Value>(source.cbegin(), source.cend()); },
+				[&](pds::PersistentVector<Value>& v) {
+					for (std::size_t i = 0; i < size; ++i) {
+						v = v.push_front(i);
+					}
+				});
+			runner.measure("pop_front", "PersistentVector", size, size,
+				[&]() { return pds::PersistentVector<Value>(source.cbegin(), source.cend()); },
+				[&](pds::PersistentVector<Value>& v) {
+					for (std::size_t i = 0; i < size; ++i) {
+						v = v.push_back(i).pop_front();
+					}
+				});
+			auto operations = std::min(size, runner.options().baselineOperations);
+			runner.measure("push_front", "std::vector(cow)", size, operations,
+				[&]() { return std::make_shared<const std::vector<Value>>(source); },
+				[&](CowVector& v) {
+					for (std::size_t i = 0; i < operations; ++i) {
+						auto next = std::make_shared<std::vector<Value>>();
+						next->reserve(v->size() + 1);
+						next->push_back(i);
+						next->insert(next->end(), v->cbegin(), v->cend());
+						v = std::move(next);
+					}
+				});
+		}
+
+		void runBuild(Runner& runner, std::size_t size) {
+			auto source = sequence(size);
+			runner.measure("build", "PersistentVector(first, last)", size, size,
+				[&]() { return pds::PersistentVector<Value>(); },
+				[&](pds::PersistentVector<Value>& v) {
+					v = pds::PersistentVector<Value>(source.cbegin(), source.cend());
+				});
+			runner.measure("build", "PersistentVector::build_parallel", size, size,
+				[&]() { return pds::PersistentVector<Value>(); },
+				[&](pds::PersistentVector<Value>& v) {
+					v = pds::PersistentVector<Value>::build_parallel(source.cbegin(), source.cend());
+				});
+		}
+
+		// Batches appended to a vector of the given size, as log ingestion does
+		constexpr std::size_t APPEND_BATCH = 4096;
+
+		void runAppend(Runner& runner, std::size_t size) {
+			auto source = sequence(size);
+			auto batch = sequence(APPEND_BATCH);
+			pds::PersistentVector<Value> pvector(source.cbegin(), source.cend());
+			runner.measure("append_batch", "PersistentVector::append", size, APPEND_BATCH,
+				[&]() { return pvector; },
+				[&](pds::PersistentVector<Value>& v) {
+					v = v.append(batch.cbegin(), batch.cend());
+				});
+			runner.measure("append_batch", "PersistentVector::push_back", size, APPEND_BATCH,
+				[&]() { return pvector; },
+				[&](pds::PersistentVector<Value>& v) {
+					for (auto value : batch) {
+						v = v.push_back(value);
+					}
+				});
+		}
+
+		void runRandomGet(Runner& runner, std::size_t size) {
+			auto source = sequence(size);
+			auto indexes = randomIndexes(size, size);
+			pds::PersistentVector<Value> pvector(source.cbegin(), source.cend());
+			runner.measure("random_get", "PersistentVector", size, size,
+				[&]() { return Value(0); },
+				[&](Value& sum) {
+					for (auto index : indexes) {
+						sum += pvector[index];
+					}
+				});
+			runner.measure("random_get_many", "PersistentVector", size, size,
+				[&]() { return std::vector<Value>(size); },
+				[&](std::vector<Value>& out) {
+					pvector.get_many(indexes, out.begin());
+				});
+			pds::PackedVector<Value> packed(source.cbegin(), source.cend());
+			runner.measure("random_get", "PackedVector", size, size,
+				[&]() { return Value(0); },
+				[&](Value& sum) {
+					for (auto index : indexes) {
+						sum += packed[index];
+					}
+				});
+			// an irregular step keeps the leaves in DELTA with codes of a few bits, each get adds them up
+			std::vector<Value> stamps(size);
+			for (std::size_t i = 0; i < size; ++i) {
+				stamps[i] = i * 1000 + (i * 7919) % 13;
+			}
+			pds::PackedVector<Value> deltas(stamps.cbegin(), stamps.cend());
+			runner.measure("random_get", "PackedVector(delta)", size, size,
+				[&]() { return Value(0); },
+				[&](Value& sum) {
+					for (auto index : indexes) {
+						sum += deltas[index];
+					}
+				});
+			runner.measure("random_get", "std::vector(cow)", size, size,
+				[&]() { return Value(0); },
+				[&](Value& sum) {
+					for (auto index : indexes) {
+						sum += source[index];
+					}
+				});
+		}
+
+		void runRandomSet(Runner& runner, std::size_t size) {
+			auto source = sequence(size);
+			auto indexes = randomIndexes(size, size);
+			pds::PersistentVector<Value> pvector(source.cbegin(), source.cend());
+			runner.measure("random_set", "PersistentVector", size, size,
+				[&]() { return pvector; },
+				[&](pds::PersistentVector<Value>& v) {
+					for (auto index : indexes) {
+						v = v.set(index, index);
+					}
+				});
+			SingleThreadVector single(source.cbegin(), source.cend());
+			runner.measure("random_set", "PersistentVector(single-thread rc)", size, size,
+				[&]() { return single; },
+				[&](SingleThreadVector& v) {
+					for (auto index : indexes) {
+						v = v.set(index, index);
+					}
+				});
+			auto operations = std::min(size, runner.options().baselineOperations);
+			runner.measure("random_set", "std::vector(cow)", size, operations,
+				[&]() { return std::make_shared<const std::vector<Value>>(source); },
+				[&](CowVector& v) {
+					for (std::size_t i = 0; i < operations; ++i) {
+						auto next = std::make_shared<std::vector<Value>>(*v);
+						(*next)[indexes[i]] = i;
+						v = std::move(next);
+					}
+				});
+		}
+
+		// Counters: every operation increments an element, one by one or over a range
+		void runReadModifyWrite(Runner& runner, std::size_t size) {
+			auto source = sequence(size);
+			auto indexes = randomIndexes(size, size);
+			pds::PersistentVector<Value> pvector(source.cbegin(), source.cend());
+			runner.measure("read_modify_write", "PersistentVector::set", size, size,
+				[&]() { return pvector; },
+				[&](pds::PersistentVector<Value>& v) {
+					for (auto index : indexes) {
+						v = v.set(index, v[index] + 1);
+					}
+				});
+			runner.measure("read_modify_write", "PersistentVector::update", size, size,
+				[&]() { return pvector; },
+				[&](pds::PersistentVector<Value>& v) {
+					for (auto index : indexes) {
+						v = v.update(index, [](Value value) { return value + 1; });
+					}
+				});
+			auto first = size / 4;
+			auto last = size - size / 4;
+			runner.measure("range_increment", "PersistentVector::set", size, last - first,
+				[&]() { return pvector; },
+				[&](pds::PersistentVector<Value>& v) {
+					for (auto i = first; i < last; ++i) {
+						v = v.set(i, v[i] + 1);
+					}
+				});
+			runner.measure("range_increment", "PersistentVector::update_range", size, last - first,
+				[&]() { return pvector; },
+				[&](pds::PersistentVector<Value>& v) {
+					v = v.update_range(first, last, [](Value value) { return value + 1; });
+				});
+		}
+
+		void runIteration(Runner& runner, std::size_t size) {
+			auto source = sequence(size);
+			pds::PersistentVector<Value> pvector(source.cbegin(), source.cend());
+			runner.measure("iterate", "PersistentVector", size, size,
+				[&]() { return Value(0); },
+				[&](Value& sum) {
+					for (auto it = pvector.cbegin(); it != pvector.cend(); ++it) {
+						sum += *it;
+					}
+				});
+			pds::PackedVector<Value> packed(source.cbegin(), source.cend());
+			runner.measure("iterate", "PackedVector", size, size,
+				[&]() { return Value(0); },
+				[&](Value& sum) {
+					for (auto it = packed.cbegin(); it != packed.cend(); ++it) {
+						sum += *it;
+					}
+				});
+			runner.measure("export", "PersistentVector::copy_to", size, size,
+				[&]() { return std::vector<Value>(size); },
+				[&](std::vector<Value>& out) {
+					pvector.copy_to(out.data());
+				});
+			runner.measure("export", "PersistentVector(iterator)", size, size,
+				[&]() { return std::vector<Value>(size); },
+				[&](std::vector<Value>& out) {
+					std::copy(pvector.cbegin(), pvector.cend(), out.begin());
+				});
+			runner.measure("export", "PackedVector::copy_to", size, size,
+				[&]() { return std::vector<Value>(size); },
+				[&](std::vector<Value>& out) {
+					packed.copy_to(out.data());
+				});
+			runner.measure("iterate", "std::vector(cow)", size, size,
+				[&]() { return Value(0); },
+				[&](Value& sum) {
+					for (auto value : source) {
+						sum += value;
+					}
+				});
+		}
+
+		// Derived vectors read only partially downstream: every stage of the pipeline used to be a whole vector
+		void runPipeline(Runner& runner, std::size_t size) {
+			auto source = sequence(size);
+			pds::PersistentVector<Value> pvector(source.cbegin(), source.cend());
+			auto scale = [](Value value) { return value * 3; };
+			auto even = [](Value value) { return value % 2 == 0; };
+			runner.measure("pipeline", "PersistentVector::view", size, size,
+				[&]() { return pds::PersistentVector<Value>(); },
+				[&](pds::PersistentVector<Value>& v) {
+					v = pvector.view().transform(scale).filter(even).transform(scale).materialize();
+				});
+			runner.measure("pipeline", "PersistentVector(per stage)", size, size,
+				[&]() { return pds::PersistentVector<Value>(); },
+				[&](pds::PersistentVector<Value>& v) {
+					std::vector<Value> scaled;
+					std::transform(pvector.cbegin(), pvector.cend(), std::back_inserter(scaled), scale);
+					pds::PersistentVector<Value> first(scaled.cbegin(), scaled.cend());
+					std::vector<Value> filtered;
+					std::copy_if(first.cbegin(), first.cend(), std::back_inserter(filtered), even);
+					pds::PersistentVector<Value> second(filtered.cbegin(), filtered.cend());
+					std::vector<Value> rescaled;
+					std::transform(second.cbegin(), second.cend(), std::back_inserter(rescaled), scale);
+					v = pds::PersistentVector<Value>(rescaled.cbegin(), rescaled.cend());
+				});
+		}
+
+		// Versioned bitmaps: the set bits of two versions differing in a few positions
+		void runBitmaps(Runner& runner, std::size_t size) {
+			auto source = randomIndexes(size, 2);
+			std::vector<bool> bits(source.cbegin(), source.cend());
+			pds::PersistentBitVector base(bits.cbegin(), bits.cend());
+			auto changed = base.flip(0).flip(size / 2);
+			runner.measure("bitmap_and_count", "PersistentBitVector", size, size,
+				[&]() { return std::size_t(0); },
+				[&](std::size_t& sum) {
+					sum += (base & changed).count();
+				});
+			pds::PersistentVector<bool> pbase(bits.cbegin(), bits.cend());
+			auto pchanged = pbase.set(0, !bits[0]).set(size / 2, !bits[size / 2]);
+			runner.measure("bitmap_and_count", "PersistentVector<bool>", size, size,
+				[&]() { return std::size_t(0); },
+				[&](std::size_t& sum) {
+					for (std::size_t i = 0; i < size; ++i) {
+						sum += pbase[i] && pchanged[i] ? 1 : 0;
+					}
+				});
+			runner.measure("bitmap_scan", "PersistentBitVector::find_next", size, size,
+				[&]() { return std::size_t(0); },
+				[&](std::size_t& sum) {
+					for (auto pos = base.find_first(); pos != pds::PersistentBitVector::npos; pos = base.find_next(pos)) {
+						sum += pos;
+					}
+				});
+			runner.measure("bitmap_scan", "PersistentVector<bool>", size, size,
+				[&]() { return std::size_t(0); },
+				[&](std::size_t& sum) {
+					std::size_t pos = 0;
+					for (auto it = pbase.cbegin(); it != pbase.cend(); ++it, ++pos) {
+						sum += *it ? pos : 0;
+					}
+				});
+		}
+
+		void runSort(Runner& runner, std::size_t size) {
+			auto source = randomIndexes(size, size);
+			pds::PersistentVector<Value> pvector(source.cbegin(), source.cend());
+			runner.measure("sorted", "PersistentVector", size, size,
+				[&]() { return pvector; },
+				[&](pds::PersistentVector<Value>& v) {
+					v = v.sorted();
+				});
+			// the way it has to be done without sorted(): copy out, sort and reset
+			runner.measure("sorted", "std::sort+reset", size, size,
+				[&]() { return pvector; },
+				[&](pds::PersistentVector<Value>& v) {
+					std::vector<Value> values(v.cbegin(), v.cend());
+					std::sort(values.begin(), values.end());
+					v = v.reset(values.cbegin(), values.cend());
+				});
+		}
+
+		void runLowerBound(Runner& runner, std::size_t size) {
+			auto source = sequence(size);
+			auto keys = randomIndexes(size, size);
+			pds::PersistentVector<Value> pvector(source.cbegin(), source.cend());
+			runner.measure("lower_bound", "PersistentVector", size, size,
+				[&]() { return Value(0); },
+				[&](Value& sum) {
+					for (auto key : keys) {
+						sum += *pvector.lower_bound(key);
+					}
+				});
+			runner.measure("lower_bound", "std::lower_bound(iterator)", size, size,
+				[&]() { return Value(0); },
+				[&](Value& sum) {
+					for (auto key : keys) {
+						sum += *std::lower_bound(pvector.cbegin(), pvector.cend(), key);
+					}
+				});
+		}
+
+		void runUndoRedo(Runner& runner, std::size_t size) {
+			pds::PersistentVector<Value> pvector;
+			for (std::size_t i = 0; i < size; ++i) {
+				pvector = pvector.push_back(i);
+			}
+			runner.measure("undo_redo", "PersistentVector", size, 2 * size,
+				[&]() { return pvector; },
+				[&](pds::PersistentVector<Value>& v) {
+					for (std::size_t i = 0; i < size; ++i) {
+						v = v.undo();
+					}
+					for (std::size_t i = 0; i < size; ++i) {
+						v = v.redo();
+					}
+				});
+			// history of copy-on-write versions, undo and redo only move the current position
+			auto operations = std::min(size, runner.options().baselineOperations);
+			std::vector<CowVector> history;
+			history.push_back(std::make_shared<const std::vector<Value>>());
+			for (std::size_t i = 0; i < operations; ++i) {
+				auto next = std::make_shared<std::vector<Value>>(*history.back());
+				next->push_back(i);
+				history.push_back(std::move(next));
+			}
+			runner.measure("undo_redo", "std::vector(cow)", size, 2 * operations,
+				[&]() { return history.size() - 1; },
+				[&](std::size_t& current) {
+					for (std::size_t i = 0; i < operations; ++i) {
+						doNotOptimize(history[--current]);
+					}
+					for (std::size_t i = 0; i < operations; ++i) {
+						doNotOptimize(history[++current]);
+					}
+				});
+		}
+
+		// An index read in every version of a history of random sets
+		void runHistoryReads(Runner& runner, std::size_t size) {
+			auto source = sequence(size);
+			auto indexes = randomIndexes(size, size);
+			pds::PersistentVector<Value> pvector(source.cbegin(), source.cend());
+			for (auto index : indexes) {
+				pvector = pvector.set(index, index);
+			}
+			auto versions = std::min(size, runner.options().baselineOperations);
+			std::vector<std::size_t> steps(versions);
+			for (std::size_t i = 0; i < versions; ++i) {
+				steps[i] = i;
+			}
+			runner.measure("history_read", "PersistentVector::get_history", size, versions,
+				[&]() { return std::vector<Value>(); },
+				[&](std::vector<Value>& values) {
+					pvector.get_history(size / 2, steps, std::back_inserter(values));
+				});
+			runner.measure("history_read", "PersistentVector(undo)", size, versions,
+				[&]() { return std::vector<Value>(); },
+				[&](std::vector<Value>& values) {
+					auto version = pvector;
+					for (std::size_t i = 0; i < versions; ++i) {
+						values.push_back(version[size / 2]);
+						version = version.undo();
+					}
+				});
+		}
+
+		// Every thread looks up the latest version for each read, as readers of a published version do
+		void runConcurrentReads(Runner& runner, std::size_t size) {
+			auto source = sequence(size);
+			auto indexes = randomIndexes(size, size);
+			std::size_t threads = std::max<std::size_t>(2, std::thread::hardware_concurrency());
+			auto readConcurrently = [&](const std::function<Value(std::size_t)>& read) {
+				std::vector<Value> sums(threads);
+				std::vector<std::thread> workers;
+				for (std::size_t t = 0; t < threads; ++t) {
+					workers.emplace_back([&, t]() {
+						for (auto index : indexes) {
+							sums[t] += read(index);
+						}
+					});
+				}
+				for (auto& worker : workers) {
+					worker.join();
+				}
+				doNotOptimize(sums);
+			};
+
+			auto handle = std::make_shared<const pds::PersistentVector<Value>>(source.cbegin(), source.cend());
+			runner.measure("concurrent_read", "shared_ptr copy", size, threads * size,
+				[&]() { return 0; },
+				[&](int&) {
+					readConcurrently([&](std::size_t index) {
+						auto current = std::atomic_load(&handle);
+						return (*current)[index];
+					});
+				});
+			pds::EpochDomain domain;
+			pds::SharedVersion<pds::PersistentVector<Value>> shared(domain, *handle);
+			runner.measure("concurrent_read", "epoch guard", size, threads * size,
+				[&]() { return 0; },
+				[&](int&) {
+					readConcurrently([&](std::size_t index) {
+						pds::EpochDomain::Guard guard(domain);
+						return shared.read(guard)[index];
+					});
+				});
+		}
+
+		// Many short vectors, as in the buckets of PersistentMap; sizes do not depend on --sizes
+		constexpr std::size_t SMALL_SIZES[] = { 0, 1, 2, 3, 4, 5, 8, 16, 32, 64 };
+		constexpr std::size_t SMALL_VECTORS = 10000;
+
+		void runSmallVectors(Runner& runner, std::size_t size) {
+			runner.measure("small_build", "PersistentVector", size, SMALL_VECTORS,
+				[&]() { return std::vector<pds::PersistentVector<Value>>(); },
+				[&](std::vector<pds::PersistentVector<Value>>& vectors) {
+					vectors.reserve(SMALL_VECTORS);
+					for (std::size_t i = 0; i < SMALL_VECTORS; ++i) {
+						pds::PersistentVector<Value> v;
+						for (std::size_t j = 0; j < size; ++j) {
+							v = v.push_back(j);
+						}
+						vectors.push_back(std::move(v));
+					}
+				});
+			runner.measure("small_build", "std::vector(cow)", size, SMALL_VECTORS,
+				[&]() { return std::vector<CowVector>(); },
+				[&](std::vector<CowVector>& vectors) {
+					vectors.reserve(SMALL_VECTORS);
+					for (std::size_t i = 0; i < SMALL_VECTORS; ++i) {
+						auto v = std::make_shared<const std::vector<Value>>();
+						for (std::size_t j = 0; j < size; ++j) {
+							auto next = std::make_shared<std::vector<Value>>(*v);
+							next->push_back(j);
+							v = std::move(next);
+						}
+						vectors.push_back(std::move(v));
+					}
+				});
+
+			std::vector<pds::PersistentVector<Value>> pvectors(SMALL_VECTORS, pds::PersistentVector<Value>(size, 1));
+			runner.measure("small_scan", "PersistentVector", size, SMALL_VECTORS,
+				[&]() { return Value(0); },
+				[&](Value& sum) {
+					for (const auto& v : pvectors) {
+						for (std::size_t j = 0; j < v.size(); ++j) {
+							sum += v[j];
+						}
+					}
+				});
+			std::vector<CowVector> vectors(SMALL_VECTORS, std::make_shared<const std::vector<Value>>(size, 1));
+			runner.measure("small_scan", "std::vector(cow)", size, SMALL_VECTORS,
+				[&]() { return Value(0); },
+				[&](Value& sum) {
+					for (const auto& v : vectors) {
+						for (auto value : *v) {
+							sum += value;
+						}
+					}
+				});
+		}
+	}
+
+	void runVectorBenchmarks(Runner& runner) {
+		for (auto size : runner.options().sizes) {
+			runPushBack(runner, size);
+			runFront(runner, size);
+			runAppend(runner, size);
+			runBuild(runner, size);
+			runRandomGet(runner, size);
+			runRandomSet(runner, size);
+			runReadModifyWrite(runner, size);
+			runIteration(runner, size);
+			runUndoRedo(runner, size);
+			runHistoryReads(runner, size);
+			runPipeline(runner, size);
+			runBitmaps(runner, size);
+			runSort(runner, size);
+			runLowerBound(runner, size);
+			runConcurrentReads(runner, size);
+		}
+		for (auto size : SMALL_SIZES) {
+			runSmallVectors(runner, size);
+		}
+	}
+}
@@ -0,0 +1,116 @@
+#include <gtest/gtest.h>
+#include <EpochReclamation.h>
+#include <PersistentVector.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace {
+	using namespace pds;
+	using namespace std;
+
+	struct Counted {
+		explicit Counted(std::atomic<int>& alive) : m_alive(alive) { ++m_alive; }
+		~Counted() { --m_alive; }
+		std::atomic<int>& m_alive;
+	};
+
+	TEST(PEpochReclamation, RetiredObjectOutlivesReader) {
+		std::atomic<int> alive{ 0 };
+		EpochDomain domain;
+		auto object = new Counted(alive);
+		{
+			EpochDomain::Guard reader(domain);
+			{
+				EpochDomain::Guard writer(domain);
+				writer.retire(object);
+			}
+			domain.reclaim();
+			domain.reclaim();
+			EXPECT_EQ(alive, 1);
+			EXPECT_EQ(domain.pending(), 1);
+		}
+		EXPECT_EQ(domain.reclaim(), 1);
+		EXPECT_EQ(alive, 0);
+		EXPECT_EQ(domain.pending(), 0);
+	}
+
+	TEST(PEpochReclamation, DestructorDeletesPending) {
+		std::atomic<int> alive{ 0 };
+		{
+			EpochDomain domain;
+			EpochDomain::Guard guard(domain);
+			for (int i = 0; i < 10; ++i) {
+				guard.retire(new Counted(alive));
+			}
+			EXPECT_EQ(alive, 10);
+		}
+		EXPECT_EQ(alive, 0);
+	}
+
+	TEST(PEpochReclamation, GuardsReclaimPeriodically) {
+		std::atomic<int> alive{ 0 };
+		EpochDomain domain;
+		for (size_t i = 0; i < 10 * EpochDomain::RECLAIM_PERIOD; ++i) {
+			EpochDomain::Guard guard(domain);
+			guard.retire(new Counted(alive));
+		}
+		EXPECT_LE(domain.pending(), 2 * EpochDomain::RECLAIM_PERIOD);
+		EXPECT_EQ(static_cast<size_t>(alive), domain.pending());
+	}
+
+	TEST(PEpochReclamation, SharedVersion) {
+		EpochDomain domain;
+		SharedVersion<PersistentVector<size_t>> shared(domain, PersistentVector<size_t>());
+		auto version = shared.load().push_back(1).push_back(2);
+		shared.publish(version);
+		{
+			EpochDomain::Guard guard(domain);
+			const auto& current = shared.read(guard);
+			EXPECT_EQ(current.size(), 2);
+			EXPECT_EQ(current[1], 2);
+		}
+		shared.publish(shared.load().pop_back());
+		EXPECT_EQ(shared.load().size(), 1);
+		EXPECT_EQ(domain.pending(), 2);
+		domain.reclaim();
+		EXPECT_EQ(domain.pending(), 0);
+	}
+
+	TEST(PEpochReclamation, ConcurrentReaders) {
+		const size_t VERSIONS = 2000;
+		EpochDomain domain;
+		SharedVersion<PersistentVector<size_t>> shared(domain, PersistentVector<size_t>());
+		std::atomic<bool> done{ false };
+		std::atomic<bool> failed{ false };
+		std::vector<std::thread> readers;
+		for (size_t i = 0; i < 4; ++i) {
+			readers.emplace_back([&]() {
+				size_t lastSize = 0;
+				while (!done) {
+					EpochDomain::Guard guard(domain);
+					const auto& current = shared.read(guard);
+					// every version i holds 0, 1, ..., i - 1
+					auto size = current.size();
+					if (size < lastSize || (size > 0 && current[size - 1] != size - 1)) {
+						failed = true;
+					}
+					lastSize = size;
+				}
+			});
+		}
+		auto version = shared.load();
+		for (size_t i = 0; i < VERSIONS; ++i) {
+			version = version.push_back(i);
+			shared.publish(version);
+		}
+		done = true;
+		for (auto& reader : readers) {
+			reader.join();
+		}
+		EXPECT_FALSE(failed);
+		EXPECT_EQ(shared.load().size(), VERSIONS);
+		domain.reclaim();
+		EXPECT_EQ(domain.pending(), 0);
+	}
+}
@@ -0,0 +1,215 @@
+#include <gtest/gtest.h>
+#include <PackedVector.h>
+#include <PersistentVector.h>
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <vector>
+
+namespace {
+	using namespace pds;
+	using namespace std;
+
+	template<typename T>
+	void ExpectRoundTrip(const std::vector<T>& values) {
+		PackedLeaf<T> leaf(values.data(), values.size());
+		ASSERT_EQ(leaf.size(), values.size());
+		// decoded into a full-sized buffer, as PackedVector does
+		std::vector<T> decoded(PackedLeaf<T>::MAX_SIZE);
+		leaf.decode(decoded.data());
+		decoded.resize(values.size());
+		EXPECT_EQ(decoded, values);
+		for (size_t i = 0; i < values.size(); ++i) {
+			EXPECT_EQ(leaf.get(i), values[i]);
+		}
+	}
+
+	/*
+	*	Leaf codecs
+	*/
+
+	TEST(PackedLeaf, FrameOfReference) {
+		std::vector<std::uint32_t> values = { 1000, 1003, 1001, 1007, 1002, 1000 };
+		PackedLeaf<std::uint32_t> leaf(values.data(), values.size());
+		EXPECT_EQ(leaf.encoding(), PackedLeaf<std::uint32_t>::Encoding::FRAME_OF_REFERENCE);
+		EXPECT_EQ(leaf.bitWidth(), 3);
+		EXPECT_EQ(leaf.packedBytes(), 8);
+		ExpectRoundTrip(values);
+	}
+
+	TEST(PackedLeaf, Delta) {
+		std::vector<std::int64_t> timestamps;
+		for (std::int64_t i = 0; i < 32; ++i) {
+			timestamps.push_back(1700000000000 + i * 1000 + (i % 3));
+		}
+		PackedLeaf<std::int64_t> leaf(timestamps.data(), timestamps.size());
+		EXPECT_EQ(leaf.encoding(), PackedLeaf<std::int64_t>::Encoding::DELTA);
+		EXPECT_LE(leaf.bitWidth(), 3);
+		ExpectRoundTrip(timestamps);
+	}
+
+	TEST(PackedLeaf, DeltaRandomAccess) {
+		// get() starts from the sum stored before every ANCHOR_STEP-th value; the values wrap around 2^64,
+		// so the widest codes are still cheaper as DELTA in a leaf of 16 values, whose sum is kept modulo 2^64
+		std::mt19937_64 gen(35);
+		for (std::uint32_t width : { 4, 20, 58 }) {
+			for (size_t size : { 8, 9, 16, 17, 31, 32, 33, 48, 63, 64 }) {
+				std::vector<std::uint64_t> values = { std::numeric_limits<std::uint64_t>::max() - (gen() & 0xffff) };
+				for (size_t i = 1; i < size; ++i) {
+					values.push_back(values.back() + 1000 + (gen() & ((std::uint64_t(1) << width) - 1)));
+				}
+				PackedLeaf<std::uint64_t> leaf(values.data(), values.size());
+				if (width < 58 || size == 16) {
+					EXPECT_EQ(leaf.encoding(), PackedLeaf<std::uint64_t>::Encoding::DELTA);
+				}
+				ExpectRoundTrip(values);
+			}
+		}
+	}
+
+	TEST(PackedLeaf, RegularStepTakesNoBits) {
+		std::vector<std::uint64_t> values;
+		for (std::uint64_t i = 0; i < 32; ++i) {
+			values.push_back(500 - i * 7);
+		}
+		PackedLeaf<std::uint64_t> leaf(values.data(), values.size());
+		EXPECT_EQ(leaf.encoding(), PackedLeaf<std::uint64_t>::Encoding::DELTA);
+		EXPECT_EQ(leaf.bitWidth(), 0);
+		EXPECT_EQ(leaf.packedBytes(), 0);
+		ExpectRoundTrip(values);
+	}
+
+	TEST(PackedLeaf, Extremes) {
+		ExpectRoundTrip(std::vector<std::int64_t>{ std::numeric_limits<std::int64_t>::min(), std::numeric_limits<std::int64_t>::max(), 0, -1, 1 });
+		ExpectRoundTrip(std::vector<std::uint64_t>{ 0, std::numeric_limits<std::uint64_t>::max(), 12345, std::numeric_limits<std::uint64_t>::max() - 1 });
+		ExpectRoundTrip(std::vector<std::int8_t>{ -128, 127, 0, -1 });
+		ExpectRoundTrip(std::vector<int>{ 42 });
+		ExpectRoundTrip(std::vector<int>{});
+	}
+
+	TEST(PackedLeaf, Random) {
+		std::mt19937_64 gen(3);
+		for (std::uint32_t width = 1; width <= 64; ++width) {
+			std::vector<std::uint64_t> values;
+			for (size_t i = 0; i < 32; ++i) {
+				values.push_back(width == 64 ? gen() : gen() & ((std::uint64_t(1) << width) - 1));
+			}
+			ExpectRoundTrip(values);
+		}
+	}
+
+	/*
+	*	Vector
+	*/
+
+	TEST(PackedVector, Creation) {
+		PackedVector<int> empty;
+		EXPECT_TRUE(empty.empty());
+		EXPECT_EQ(empty.cbegin(), empty.cend());
+		PackedVector<int> pvector = { 5, -3, 7 };
+		ASSERT_EQ(pvector.size(), 3);
+		EXPECT_EQ(pvector[0], 5);
+		EXPECT_EQ(pvector[1], -3);
+		EXPECT_EQ(pvector.back(), 7);
+		EXPECT_THROW(pvector.at(3), std::out_of_range);
+	}
+
+	TEST(PackedVector, BuildAndIterate) {
+		for (size_t size : { 1, 31, 32, 33, 1024, 1025, 40000 }) {
+			std::vector<std::int64_t> values(size);
+			for (size_t i = 0; i < size; ++i) {
+				values[i] = static_cast<std::int64_t>(i * i % 1001) - 500;
+			}
+			PackedVector<std::int64_t> pvector(values.cbegin(), values.cend());
+			ASSERT_EQ(pvector.size(), size);
+			for (size_t i = 0; i < size; ++i) {
+				ASSERT_EQ(pvector[i], values[i]);
+			}
+			EXPECT_EQ(std::vector<std::int64_t>(pvector.cbegin(), pvector.cend()), values);
+		}
+	}
+
+	TEST(PackedVector, PushAndPopAcrossLevels) {
+		PackedVector<std::uint32_t> pvector;
+		std::vector<PackedVector<std::uint32_t>> versions = { pvector };
+		for (std::uint32_t i = 0; i < 1100; ++i) {
+			pvector = pvector.push_back(i * 3);
+			versions.push_back(pvector);
+		}
+		for (size_t size : { 0, 1, 32, 33, 1024, 1025, 1100 }) {
+			ASSERT_EQ(versions[size].size(), size);
+			for (size_t i = 0; i < size; ++i) {
+				ASSERT_EQ(versions[size][i], i * 3);
+			}
+		}
+		for (size_t size = 1100; size > 0; --size) {
+			pvector = pvector.pop_back();
+			ASSERT_EQ(pvector.size(), size - 1);
+			ASSERT_EQ(pvector, versions[size - 1]);
+		}
+		EXPECT_TRUE(pvector.empty());
+	}
+
+	TEST(PackedVector, SetKeepsOldVersions) {
+		std::vector<int> values(3000, 7);
+		PackedVector<int> pvector(values.cbegin(), values.cend());
+		auto changed = pvector.set(2500, -1).set(0, 100000);
+		EXPECT_EQ(pvector[2500], 7);
+		EXPECT_EQ(pvector[0], 7);
+		EXPECT_EQ(changed[2500], -1);
+		EXPECT_EQ(changed[0], 100000);
+		EXPECT_EQ(changed[1], 7);
+		EXPECT_NE(pvector, changed);
+	}
+
+	TEST(PackedVector, VersionsShareLeaves) {
+		std::vector<std::uint64_t> values(10000);
+		for (size_t i = 0; i < values.size(); ++i) {
+			values[i] = i;
+		}
+		PackedVector<std::uint64_t> pvector(values.cbegin(), values.cend());
+		std::vector<PackedVector<std::uint64_t>> versions = { pvector, pvector.set(5000, 1), pvector.push_back(1) };
+		auto usage = versionsMemoryUsage(versions.cbegin(), versions.cend());
+		// set copies one leaf, push_back - the last leaf
+		EXPECT_EQ(usage.total.leaves, pvector.memoryUsage().leaves + 2);
+	}
+
+	TEST(PackedVector, CopyTo) {
+		std::vector<std::int32_t> values(5000);
+		std::mt19937 gen(9);
+		for (auto& value : values) {
+			value = static_cast<std::int32_t>(gen() % 1000) - 500;
+		}
+		PackedVector<std::int32_t> pvector(values.cbegin(), values.cend());
+		EXPECT_EQ(pvector.to_std_vector(), values);
+		EXPECT_TRUE(PackedVector<std::int32_t>().to_std_vector().empty());
+		for (size_t first = 0; first < values.size(); first += 77) {
+			for (size_t last = first; last <= values.size(); last += 301) {
+				std::vector<std::int32_t> out(last - first);
+				EXPECT_EQ(pvector.copy_to(out.data(), first, last), out.data() + out.size());
+				EXPECT_EQ(out, std::vector<std::int32_t>(values.begin() + first, values.begin() + last));
+				std::vector<std::int64_t> wide;
+				pvector.copy_to(std::back_inserter(wide), first, last);
+				EXPECT_TRUE(std::equal(wide.begin(), wide.end(), values.begin() + first, values.begin() + last));
+			}
+		}
+		EXPECT_THROW(pvector.copy_to(values.data(), 0, 5001), std::out_of_range);
+	}
+
+	TEST(PackedVector, SmallerThanPersistentVector) {
+		std::vector<std::int64_t> timestamps(100000);
+		std::mt19937 gen(5);
+		std::int64_t time = 1700000000000;
+		for (auto& timestamp : timestamps) {
+			time += 1000 + gen() % 16;
+			timestamp = time;
+		}
+		PackedVector<std::int64_t> packed(timestamps.cbegin(), timestamps.cend());
+		PersistentVector<std::int64_t> pvector(timestamps.cbegin(), timestamps.cend());
+		auto packedBytes = packed.memoryUsage().totalBytes();
+		EXPECT_LT(packedBytes * 8, pvector.memoryUsage().totalBytes());
+		// the nodes themselves take more than the packed differences
+		EXPECT_LT(packedBytes * 2, timestamps.size() * sizeof(std::int64_t));
+	}
+}
@@ -0,0 +1,202 @@
+#include <gtest/gtest.h>
+#include <PersistentBitVector.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+namespace {
+	using namespace pds;
+	using namespace std;
+
+	std::vector<bool> RandomBits(size_t size, unsigned seed, double density = 0.5) {
+		std::mt19937 generator(seed);
+		std::bernoulli_distribution distribution(density);
+		std::vector<bool> out(size);
+		for (size_t i = 0; i < size; ++i) {
+			out[i] = distribution(generator);
+		}
+		return out;
+	}
+
+	void ExpectBits(const PersistentBitVector& bits, const std::vector<bool>& expected) {
+		ASSERT_EQ(bits.size(), expected.size());
+		EXPECT_TRUE(std::equal(bits.cbegin(), bits.cend(), expected.cbegin()));
+		EXPECT_EQ(bits.count(), static_cast<size_t>(std::count(expected.cbegin(), expected.cend(), true)));
+	}
+
+	/*
+	*	Construction and access
+	*/
+
+	TEST(PBitVector, Empty) {
+		PersistentBitVector bits;
+		EXPECT_TRUE(bits.empty());
+		EXPECT_EQ(bits.count(), 0);
+		EXPECT_EQ(bits.find_first(), PersistentBitVector::npos);
+		EXPECT_TRUE(bits.cbegin() == bits.cend());
+		EXPECT_THROW(bits.at(0), std::out_of_range);
+	}
+
+	TEST(PBitVector, FromRange) {
+		for (size_t size : { 1, 63, 64, 65, 2047, 2048, 2049, 70000, 2048 * 32 + 1 }) {
+			auto expected = RandomBits(size, static_cast<unsigned>(size));
+			PersistentBitVector bits(expected.cbegin(), expected.cend());
+			ExpectBits(bits, expected);
+			for (size_t i = 0; i < size; i += 97) {
+				EXPECT_EQ(bits[i], expected[i]);
+			}
+			EXPECT_EQ(bits.back(), expected.back());
+		}
+	}
+
+	TEST(PBitVector, Filled) {
+		PersistentBitVector ones(100000, true);
+		EXPECT_EQ(ones.count(), 100000);
+		EXPECT_TRUE(ones.all());
+		EXPECT_TRUE(ones[99999]);
+		PersistentBitVector zeros(100000, false);
+		EXPECT_FALSE(zeros.any());
+		EXPECT_EQ(zeros.find_first(), PersistentBitVector::npos);
+		std::vector<bool> expected(100000, true);
+		EXPECT_EQ(ones, PersistentBitVector(expected.cbegin(), expected.cend()));
+		// full subtrees are shared: one leaf and one node of every level besides the partial ones
+		EXPECT_LT(zeros.memoryUsage().leaves, 3);
+	}
+
+	TEST(PBitVector, InitializerList) {
+		PersistentBitVector bits = { true, false, true, true };
+		EXPECT_EQ(bits.size(), 4);
+		EXPECT_EQ(bits.count(), 3);
+		EXPECT_FALSE(bits[1]);
+		EXPECT_TRUE(bits.front());
+	}
+
+	/*
+	*	Modification
+	*/
+
+	TEST(PBitVector, SetAndFlip) {
+		auto expected = RandomBits(10000, 1);
+		PersistentBitVector bits(expected.cbegin(), expected.cend());
+		auto original = bits;
+		std::mt19937 generator(2);
+		for (size_t i = 0; i < 1000; ++i) {
+			auto pos = generator() % expected.size();
+			if (0 == i % 2) {
+				bits = bits.flip(pos);
+				expected[pos] = !expected[pos];
+			}
+			else {
+				bits = bits.set(pos, 0 == i % 3);
+				expected[pos] = 0 == i % 3;
+			}
+		}
+		ExpectBits(bits, expected);
+		ExpectBits(original, RandomBits(10000, 1));
+	}
+
+	TEST(PBitVector, PushAndPop) {
+		std::vector<bool> expected;
+		PersistentBitVector bits;
+		auto source = RandomBits(2048 * 33 + 5, 3);
+		for (bool bit : source) {
+			bits = bits.push_back(bit);
+			expected.push_back(bit);
+		}
+		ExpectBits(bits, expected);
+		auto full = bits;
+		while (bits.size() > 100) {
+			bits = bits.pop_back();
+			expected.pop_back();
+		}
+		ExpectBits(bits, expected);
+		ExpectBits(full, source);
+		while (!bits.empty()) {
+			bits = bits.pop_back();
+		}
+		EXPECT_EQ(bits.count(), 0);
+		EXPECT_EQ(bits.push_back(true).count(), 1);
+	}
+
+	/*
+	*	Search
+	*/
+
+	TEST(PBitVector, FindSetBits) {
+		for (double density : { 0.0001, 0.01, 0.5 }) {
+			auto expected = RandomBits(200000, 4, density);
+			PersistentBitVector bits(expected.cbegin(), expected.cend());
+			std::vector<size_t> found;
+			for (auto pos = bits.find_first(); pos != PersistentBitVector::npos; pos = bits.find_next(pos)) {
+				found.push_back(pos);
+			}
+			std::vector<size_t> positions;
+			for (size_t i = 0; i < expected.size(); ++i) {
+				if (expected[i]) {
+					positions.push_back(i);
+				}
+			}
+			EXPECT_EQ(found, positions);
+		}
+	}
+
+	TEST(PBitVector, FindLastBit) {
+		auto bits = PersistentBitVector(100000, false).set(99999);
+		EXPECT_EQ(bits.find_first(), 99999);
+		EXPECT_EQ(bits.find_next(99999), PersistentBitVector::npos);
+		EXPECT_EQ(bits.set(5).find_next(5), 99999);
+	}
+
+	/*
+	*	Word-wise operations
+	*/
+
+	TEST(PBitVector, BitwiseOperations) {
+		auto left = RandomBits(50000, 5);
+		auto right = RandomBits(50000, 6);
+		PersistentBitVector lbits(left.cbegin(), left.cend());
+		PersistentBitVector rbits(right.cbegin(), right.cend());
+		std::vector<bool> conjunction(left.size()), disjunction(left.size()), difference(left.size());
+		for (size_t i = 0; i < left.size(); ++i) {
+			conjunction[i] = left[i] && right[i];
+			disjunction[i] = left[i] || right[i];
+			difference[i] = left[i] != right[i];
+		}
+		ExpectBits(lbits & rbits, conjunction);
+		ExpectBits(lbits | rbits, disjunction);
+		ExpectBits(lbits ^ rbits, difference);
+		EXPECT_THROW(lbits & lbits.push_back(true), std::invalid_argument);
+	}
+
+	TEST(PBitVector, OperationsShareSubtrees) {
+		auto expected = RandomBits(2048 * 1024, 7);
+		PersistentBitVector base(expected.cbegin(), expected.cend());
+		auto changed = base.flip(10).flip(2048 * 1000);
+		auto leaves = changed.memoryUsage().leaves;
+		// only the two changed leaves differ, the rest are taken from the versions as is
+		auto conjunction = changed & base;
+		auto disjunction = changed | base;
+		MemoryAccountant accountant;
+		changed.accountMemory(accountant);
+		conjunction.accountMemory(accountant);
+		disjunction.accountMemory(accountant);
+		EXPECT_EQ(accountant.usage().leaves, leaves + 4);
+		auto difference = changed ^ base;
+		EXPECT_EQ(difference.count(), 2);
+		EXPECT_EQ(difference.find_first(), 10);
+		EXPECT_EQ(difference.find_next(10), 2048 * 1000);
+		// the leaves without differences are one shared zero leaf
+		EXPECT_EQ(difference.memoryUsage().leaves, 3);
+		EXPECT_EQ(changed ^ changed, PersistentBitVector(changed.size(), false));
+	}
+
+	TEST(PBitVector, Equality) {
+		auto expected = RandomBits(30000, 8);
+		PersistentBitVector bits(expected.cbegin(), expected.cend());
+		PersistentBitVector same(expected.cbegin(), expected.cend());
+		EXPECT_EQ(bits, same);
+		EXPECT_NE(bits, same.flip(29999));
+		EXPECT_NE(bits, bits.pop_back());
+		EXPECT_EQ(bits.flip(0).flip(0), bits);
+	}
+}
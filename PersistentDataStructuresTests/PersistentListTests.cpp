@@ -38,4 +38,40 @@ namespace {
         EXPECT_EQ(pList.size(), 0);
         EXPECT_TRUE(pList.empty());
     }
+
+    TEST(PListMemoryUsage, Nodes)
+    {
+        persistent_linked_list<int> pList;
+        pList = pList.push_back(1).push_back(2).push_back(3);
+        auto usage = pList.memoryUsage();
+        EXPECT_GE(usage.listNodes, 3);
+        EXPECT_EQ(usage.elements, usage.listNodes);
+        EXPECT_GE(usage.fatNodes, 3);
+        EXPECT_GT(usage.versionNodes, 3);
+        EXPECT_EQ(usage.primeTreeNodes, 0);
+    }
+
+    TEST(PListMemoryUsage, SharedBetweenVersions)
+    {
+        persistent_linked_list<int> base;
+        base = base.push_back(1).push_back(2);
+        auto changed = base.push_back(3);
+        std::vector<persistent_linked_list<int>> versions = { base, changed };
+        auto usage = versionsMemoryUsage(versions.cbegin(), versions.cend());
+        EXPECT_GT(usage.sharedBytes, 0);
+        EXPECT_GT(usage.exclusiveBytes[1], 0);
+    }
+
+    TEST(PListSingleThread, Versions)
+    {
+        persistent_linked_list<int, SingleThreadRefCount> list;
+        auto a = list.push_back(1).push_back(2).push_front(0);
+        auto b = a.set(1, 10);
+        EXPECT_EQ(a.size(), 3);
+        EXPECT_EQ(*++a.cbegin(), 1);
+        EXPECT_EQ(*++b.cbegin(), 10);
+        EXPECT_EQ(b.back(), 2);
+        EXPECT_EQ(b.undo().front(), 0);
+        EXPECT_TRUE(list.empty());
+    }
 }
@@ -729,6 +729,59 @@ namespace {
 
 
 
+	/*
+	*	Memory usage
+	*/
+
+	TEST(PMapMemoryUsage, Elements) {
+		PersistentMap<size_t, size_t> pmap(16);
+		pmap = pmap.set(1, 1).set(2, 2).set(3, 3);
+		auto usage = pmap.memoryUsage();
+		// every version of every bucket is kept by the history
+		EXPECT_GE(usage.elements, 16 + 3);
+		EXPECT_GT(usage.leaves, 0);
+		EXPECT_GT(usage.versionNodes, 0);
+	}
+
+	TEST(PMapMemoryUsage, SharedBetweenVersions) {
+		PersistentMap<size_t, size_t> base(16);
+		base = base.set(1, 1).set(2, 2);
+		auto changed = base.set(1, 10);
+		std::vector<PersistentMap<size_t, size_t>> versions = { base, changed };
+		auto usage = versionsMemoryUsage(versions.cbegin(), versions.cend());
+		EXPECT_GT(usage.sharedBytes, 0);
+		// only the handle of the base version is not reachable from the changed one
+		using Buckets = PersistentVector<PersistentVector<pair<size_t, size_t>>>;
+		EXPECT_EQ(usage.exclusiveBytes[0], MemoryAccountant::sharedBlockSize<Buckets>());
+		EXPECT_GT(usage.exclusiveBytes[1], 0);
+		EXPECT_LT(usage.exclusiveBytes[1], usage.versionBytes[1]);
+	}
+
+	/*
+	*	Single-threaded reference counting
+	*/
+
+	TEST(PMapSingleThread, SetEraseUndo) {
+		using SingleThreadMap = PersistentMap<size_t, size_t, std::hash<size_t>, SingleThreadRefCount>;
+		SingleThreadMap pmap(16);
+		for (size_t i = 0; i < 100; ++i) {
+			pmap = pmap.set(i, i * 2);
+		}
+		auto erased = pmap.erase(50);
+		EXPECT_EQ(pmap.size(), 100);
+		EXPECT_EQ(erased.size(), 99);
+		EXPECT_FALSE(erased.contains(50));
+		EXPECT_EQ(pmap.at(50), 100);
+		EXPECT_EQ(erased.undo(), pmap);
+		size_t count = 0;
+		for (auto it = erased.cbegin(); it != erased.cend(); ++it) {
+			++count;
+		}
+		EXPECT_EQ(count, 99);
+	}
+
+
+
 	/*
 	*	Concurrency
 	*/
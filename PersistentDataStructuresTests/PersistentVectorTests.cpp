@@ -1,7 +1,15 @@
-#include <gtest/gtest.h>
+﻿#include <gtest/gtest.h>
 #include <PersistentVector.h>
+#include <PersistentMap.h>
+#include <Monoids.h>
+#include <VectorView.h>
+#include <algorithm>
 #include <thread>
 #include <chrono>
+#include <deque>
+#include <numeric>
+#include <random>
+#include <string>
 
 
 namespace {
@@ -666,6 +674,24 @@ namespace {
 		EXPECT_TRUE(pvector2 == pvector2_copy);
 	}
 
+	TEST(PVectorSwap, DifferentSizes) {
+		PersistentVector<size_t> small = { 1, 2 };
+		PersistentVector<size_t> large(5000, 7);
+		small.swap(large);
+		ASSERT_EQ(small.size(), 5000);
+		ASSERT_EQ(large.size(), 2);
+		EXPECT_EQ(small[4999], 7);
+		EXPECT_EQ(large[1], 2);
+		// the handles keep reading their versions after the edits of rvalues
+		large = std::move(large).push_back(3).push_back(4).push_back(5);
+		small = std::move(small).resize(3);
+		ASSERT_EQ(large.size(), 5);
+		EXPECT_EQ(large[4], 5);
+		ASSERT_EQ(small.size(), 3);
+		EXPECT_EQ(small[2], 7);
+		EXPECT_EQ(small.undo().size(), 5000);
+	}
+
 
 
 	/*
@@ -1177,6 +1203,1507 @@ namespace {
 
 
 
+	/*
+	*	Copies and moves of elements
+	*/
+
+	namespace {
+		struct CopyCounter {
+			static size_t copies;
+			static size_t moves;
+
+			size_t value;
+
+			CopyCounter() : value(0) {}
+			CopyCounter(size_t value) : value(value) {}
+			CopyCounter(size_t first, size_t second) : value(first + second) {}
+			CopyCounter(const CopyCounter& other) : value(other.value) { ++copies; }
+			CopyCounter(CopyCounter&& other) noexcept : value(other.value) { ++moves; }
+
+			CopyCounter& operator=(const CopyCounter& other) { value = other.value; ++copies; return *this; }
+			CopyCounter& operator=(CopyCounter&& other) noexcept { value = other.value; ++moves; return *this; }
+
+			bool operator!=(const CopyCounter& other) const { return value != other.value; }
+
+			static void reset() {
+				copies = 0;
+				moves = 0;
+			}
+		};
+
+		size_t CopyCounter::copies = 0;
+		size_t CopyCounter::moves = 0;
+	}
+
+	TEST(PVectorCopies, PushBackLvalue) {
+		PersistentVector<CopyCounter> pvector;
+		CopyCounter value(1);
+		CopyCounter::reset();
+		for (size_t i = 0; i < 100; ++i) {
+			pvector = pvector.push_back(value);
+		}
+		EXPECT_EQ(CopyCounter::copies, 100);
+		EXPECT_EQ(CopyCounter::moves, 0);
+	}
+
+	TEST(PVectorCopies, PushBackRvalue) {
+		PersistentVector<CopyCounter> pvector;
+		CopyCounter::reset();
+		for (size_t i = 0; i < 100; ++i) {
+			pvector = pvector.push_back(CopyCounter(i));
+		}
+		EXPECT_EQ(CopyCounter::copies, 0);
+		EXPECT_EQ(CopyCounter::moves, 100);
+		EXPECT_EQ(pvector[99].value, 99);
+	}
+
+	TEST(PVectorCopies, EmplaceBack) {
+		PersistentVector<CopyCounter> pvector;
+		CopyCounter::reset();
+		for (size_t i = 0; i < 100; ++i) {
+			pvector = pvector.emplace_back(i, 1);
+		}
+		EXPECT_EQ(CopyCounter::copies, 0);
+		EXPECT_EQ(CopyCounter::moves, 0);
+		EXPECT_EQ(pvector[99].value, 100);
+	}
+
+	TEST(PVectorCopies, Set) {
+		PersistentVector<CopyCounter> pvector(100);
+		CopyCounter value(1);
+		CopyCounter::reset();
+		pvector = pvector.set(10, value);
+		EXPECT_EQ(CopyCounter::copies, 1);
+		pvector = pvector.set(20, CopyCounter(2));
+		EXPECT_EQ(CopyCounter::copies, 1);
+		EXPECT_EQ(CopyCounter::moves, 1);
+		EXPECT_EQ(pvector[10].value, 1);
+		EXPECT_EQ(pvector[20].value, 2);
+	}
+
+	TEST(PVectorCopies, Creation) {
+		CopyCounter::reset();
+		PersistentVector<CopyCounter> defaults(100);
+		EXPECT_EQ(CopyCounter::copies, 0);
+		PersistentVector<CopyCounter> values(100, CopyCounter(1));
+		EXPECT_EQ(CopyCounter::copies, 100);
+
+		std::vector<CopyCounter> source(100);
+		CopyCounter::reset();
+		PersistentVector<CopyCounter> copied(source.begin(), source.end());
+		EXPECT_EQ(CopyCounter::copies, 100);
+		PersistentVector<CopyCounter> moved(std::make_move_iterator(source.begin()), std::make_move_iterator(source.end()));
+		EXPECT_EQ(CopyCounter::copies, 100);
+		EXPECT_EQ(CopyCounter::moves, 100);
+	}
+
+	TEST(PVectorCopies, PathCopyDoesNotCopyElements) {
+		PersistentVector<CopyCounter> pvector(1000);
+		CopyCounter::reset();
+		pvector = pvector.pop_back().resize(500).undo().undo();
+		pvector = pvector.resize(1200);
+		EXPECT_EQ(CopyCounter::copies, 0);
+		EXPECT_EQ(CopyCounter::moves, 0);
+		EXPECT_EQ(pvector.size(), 1200);
+	}
+
+
+
+	/*
+	*	Memory usage
+	*/
+
+	TEST(PVectorMemoryUsage, Empty) {
+		PersistentVector<size_t> pvector;
+		auto usage = pvector.memoryUsage();
+		EXPECT_EQ(usage.elements, 0);
+		EXPECT_EQ(usage.leaves, 0);
+		EXPECT_EQ(usage.primeTreeNodes, 0);
+		// version tree node and prime tree root
+		EXPECT_EQ(usage.versionNodes, 2);
+		EXPECT_EQ(usage.totalBytes(), usage.versionNodeBytes);
+	}
+
+	TEST(PVectorMemoryUsage, NodesAndElements) {
+		constexpr size_t size = (1 << 10) + 1;
+		PersistentVector<size_t> pvector(size, 12345);
+		auto usage = pvector.memoryUsage();
+		EXPECT_EQ(usage.elements, size);
+		EXPECT_EQ(usage.leaves, (size + 31) / 32);
+		// root of the third level and two nodes of the second one
+		EXPECT_EQ(usage.primeTreeNodes, 3);
+		EXPECT_GT(usage.leafBytes, 0);
+		EXPECT_GE(usage.elementBytes, size * sizeof(size_t));
+	}
+
+	TEST(PVectorMemoryUsage, SharedWithHistory) {
+		PersistentVector<size_t> base(100, 0);
+		auto changed = base.set(0, 1);
+		std::vector<PersistentVector<size_t>> versions = { base, changed };
+		auto usage = versionsMemoryUsage(versions.cbegin(), versions.cend());
+		// the base version is a part of the history of the changed one
+		EXPECT_EQ(usage.exclusiveBytes[0], 0);
+		EXPECT_GT(usage.exclusiveBytes[1], 0);
+		EXPECT_EQ(usage.sharedBytes, usage.versionBytes[0]);
+		EXPECT_EQ(usage.sharedBytes + usage.exclusiveBytes[1], usage.versionBytes[1]);
+		EXPECT_EQ(usage.total.totalBytes(), usage.versionBytes[1]);
+		// one new leaf, one copied node and one new element
+		EXPECT_EQ(usage.total.leaves, base.memoryUsage().leaves + 1);
+		EXPECT_EQ(usage.total.elements, 101);
+	}
+
+	TEST(PVectorMemoryUsage, Independent) {
+		std::vector<PersistentVector<size_t>> versions = { PersistentVector<size_t>(100, 0), PersistentVector<size_t>(200, 0) };
+		auto usage = versionsMemoryUsage(versions.cbegin(), versions.cend());
+		EXPECT_EQ(usage.sharedBytes, 0);
+		EXPECT_EQ(usage.exclusiveBytes[0], usage.versionBytes[0]);
+		EXPECT_EQ(usage.exclusiveBytes[1], usage.versionBytes[1]);
+		EXPECT_EQ(usage.total.elements, 300);
+	}
+
+	TEST(PVectorMemoryUsage, Nested) {
+		PersistentVector<size_t> inner(10, 1);
+		PersistentVector<PersistentVector<size_t>> pvector(5, inner);
+		auto usage = pvector.memoryUsage();
+		// five handles which share the same inner vector
+		EXPECT_EQ(usage.elements, 5 + 10);
+	}
+
+
+
+	/*
+	*	Batched lookups
+	*/
+
+	TEST(PVectorGetMany, Empty) {
+		PersistentVector<size_t> pvector = { 1, 2, 3 };
+		std::vector<size_t> indexes;
+		std::vector<size_t> out;
+		pvector.get_many(indexes, std::back_inserter(out));
+		EXPECT_TRUE(out.empty());
+	}
+
+	TEST(PVectorGetMany, Small) {
+		PersistentVector<size_t> pvector = { 1, 2, 3 };
+		std::vector<size_t> indexes = { 2, 0, 1, 2 };
+		std::vector<size_t> out(indexes.size());
+		auto end = pvector.get_many(indexes.cbegin(), indexes.cend(), out.begin());
+		EXPECT_EQ(end, out.end());
+		EXPECT_EQ(out, std::vector<size_t>({ 3, 1, 2, 3 }));
+	}
+
+	TEST(PVectorGetMany, SameAsOperator) {
+		for (size_t size : { 5, 32, 33, 1024, 1025, 40000 }) {
+			PersistentVector<size_t> pvector;
+			for (size_t i = 0; i < size; ++i) {
+				pvector = pvector.push_back(i * 3);
+			}
+			std::mt19937 generator(size);
+			std::vector<size_t> indexes(1000);
+			for (auto& index : indexes) {
+				index = generator() % size;
+			}
+			std::vector<size_t> out;
+			pvector.get_many(indexes, std::back_inserter(out));
+			ASSERT_EQ(out.size(), indexes.size());
+			for (size_t i = 0; i < indexes.size(); ++i) {
+				EXPECT_EQ(out[i], pvector[indexes[i]]);
+			}
+		}
+	}
+
+	TEST(PVectorGetMany, Strings) {
+		PersistentVector<string> pvector;
+		for (size_t i = 0; i < 100; ++i) {
+			pvector = pvector.push_back(to_string(i));
+		}
+		std::vector<string> out;
+		pvector.get_many(std::vector<size_t>({ 99, 0, 50 }), std::back_inserter(out));
+		EXPECT_EQ(out, std::vector<string>({ "99", "0", "50" }));
+	}
+
+	TEST(PVectorGetHistory, SameAsUndo) {
+		PersistentVector<size_t> pvector;
+		// the history crosses the small representation and two growths of the depth
+		for (size_t i = 0; i < 1100; ++i) {
+			pvector = pvector.push_back(i);
+		}
+		std::mt19937 generator(7);
+		for (size_t i = 0; i < 2000; ++i) {
+			pvector = pvector.set(generator() % 3 == 0 ? 3 : generator() % pvector.size(), i * 10);
+		}
+		std::vector<size_t> steps = { 0, 1, 5, 2000, 1500, 2001, 2000, 2500, 3096 };
+		for (size_t pos : { 0, 3, 4, 1099 }) {
+			std::vector<size_t> out;
+			if (pos >= 4) {
+				EXPECT_THROW(pvector.get_history(pos, steps, std::back_inserter(out)), std::out_of_range);
+				continue;
+			}
+			pvector.get_history(pos, steps, std::back_inserter(out));
+			ASSERT_EQ(out.size(), steps.size());
+			for (size_t i = 0; i < steps.size(); ++i) {
+				auto version = pvector;
+				for (size_t j = 0; j < steps[i]; ++j) {
+					version = version.undo();
+				}
+				EXPECT_EQ(out[i], version[pos]);
+			}
+		}
+		std::vector<size_t> out;
+		pvector.get_history(1099, std::vector<size_t>({ 0, 100, 2000 }), std::back_inserter(out));
+		EXPECT_EQ(out.back(), 1099);
+		EXPECT_THROW(pvector.get_history(0, std::vector<size_t>({ 3101 }), std::back_inserter(out)), std::out_of_range);
+	}
+
+	TEST(PVectorGetHistory, VersionsEditedInPlace) {
+		PersistentVector<size_t> pvector(100, 0);
+		for (size_t i = 1; i <= 50; ++i) {
+			pvector = std::move(pvector).set(10, i);
+		}
+		std::vector<size_t> steps(51);
+		for (size_t i = 0; i < steps.size(); ++i) {
+			steps[i] = i;
+		}
+		std::vector<size_t> out;
+		pvector.get_history(10, steps, std::back_inserter(out));
+		for (size_t i = 0; i < steps.size(); ++i) {
+			EXPECT_EQ(out[i], 50 - i);
+		}
+	}
+
+	/*
+	*	Deque operations
+	*/
+
+	TEST(PVectorDeque, SameAsDeque) {
+		std::mt19937 generator(49);
+		PersistentVector<size_t> pvector;
+		std::deque<size_t> expected;
+		std::vector<pair<PersistentVector<size_t>, std::deque<size_t>>> versions;
+		for (size_t i = 0; i < 20000; ++i) {
+			auto operation = generator() % 10;
+			if (operation < 4) {
+				pvector = pvector.push_front(i);
+				expected.push_front(i);
+			}
+			else if (operation < 6) {
+				pvector = pvector.push_back(i);
+				expected.push_back(i);
+			}
+			else if (operation < 8 && !expected.empty()) {
+				pvector = pvector.pop_front();
+				expected.pop_front();
+			}
+			else if (operation < 9 && !expected.empty()) {
+				pvector = pvector.pop_back();
+				expected.pop_back();
+			}
+			else if (!expected.empty()) {
+				auto pos = generator() % expected.size();
+				pvector = pvector.set(pos, i);
+				expected[pos] = i;
+			}
+			ASSERT_EQ(pvector.size(), expected.size());
+			if (!expected.empty()) {
+				EXPECT_EQ(pvector.front(), expected.front());
+				EXPECT_EQ(pvector.back(), expected.back());
+			}
+			if (0 == i % 1000) {
+				versions.emplace_back(pvector, expected);
+			}
+		}
+		for (const auto& version : versions) {
+			ASSERT_EQ(version.first.size(), version.second.size());
+			EXPECT_TRUE(std::equal(version.second.cbegin(), version.second.cend(), version.first.cbegin()));
+		}
+	}
+
+	TEST(PVectorDeque, PushAndPopFront) {
+		PersistentVector<size_t> pvector;
+		for (size_t i = 0; i < 40000; ++i) {
+			pvector = pvector.push_front(i);
+		}
+		auto full = pvector;
+		for (size_t i = 0; i < full.size(); ++i) {
+			ASSERT_EQ(full[i], 39999 - i);
+		}
+		// the elements leave the front leaf by leaf and then the body leaves by the offset
+		pvector = pvector.push_back(40000);
+		for (size_t i = 0; i < 39999; ++i) {
+			pvector = pvector.pop_front();
+			ASSERT_EQ(pvector.front(), 39998 - i);
+		}
+		EXPECT_EQ(pvector.size(), 2);
+		EXPECT_EQ(pvector.back(), 40000);
+		EXPECT_TRUE(pvector.pop_front().pop_front().empty());
+		EXPECT_EQ(full.undo().size(), 39999);
+		EXPECT_EQ(full.front(), 39999);
+
+		PersistentVector<size_t> body(10000, 1);
+		for (size_t i = 0; i < 9990; ++i) {
+			body = body.pop_front();
+		}
+		body = body.set(0, 2).push_back(3);
+		EXPECT_EQ(std::vector<size_t>(body.cbegin(), body.cend()), std::vector<size_t>({ 2, 1, 1, 1, 1, 1, 1, 1, 1, 1, 3 }));
+	}
+
+	TEST(PVectorDeque, SharedFrontPart) {
+		// the versions made by the operations on the body share the front part, the ones which change it copy it
+		PersistentVector<size_t> pvector(100, 1);
+		auto pushed = pvector.push_front(0);
+		auto appended = pushed.push_back(2);
+		auto popped = appended.pop_front();
+		auto changed = appended.set(0, 5);
+		auto prepended = appended.push_front(3);
+		EXPECT_EQ(pushed.size(), 101);
+		EXPECT_EQ(pushed.front(), 0);
+		EXPECT_EQ(appended.front(), 0);
+		EXPECT_EQ(appended.back(), 2);
+		EXPECT_EQ(appended.size(), 102);
+		EXPECT_EQ(popped.front(), 1);
+		EXPECT_EQ(popped.size(), 101);
+		EXPECT_EQ(changed.front(), 5);
+		EXPECT_EQ(changed[1], 1);
+		EXPECT_EQ(prepended.front(), 3);
+		EXPECT_EQ(prepended[1], 0);
+		EXPECT_EQ(pvector.size(), 100);
+		// popping the front of the body and pushing before it again
+		auto shifted = pvector.pop_front().pop_front().push_front(7);
+		EXPECT_EQ(shifted.size(), 99);
+		EXPECT_EQ(shifted.front(), 7);
+		EXPECT_EQ(shifted.back(), 1);
+		EXPECT_EQ(pvector.pop_front().size(), 99);
+	}
+
+	TEST(PVectorDeque, BulkOperations) {
+		using SumVector = PersistentVector<long long, SumMonoid<long long>>;
+		std::deque<long long> expected;
+		SumVector pvector(1000, 1);
+		expected.assign(1000, 1);
+		for (long long i = 0; i < 3000; ++i) {
+			pvector = pvector.push_front(i);
+			expected.push_front(i);
+		}
+		for (size_t i = 0; i < 500; ++i) {
+			pvector = pvector.pop_front().pop_back();
+			expected.pop_front();
+			expected.pop_back();
+		}
+		ASSERT_EQ(pvector.size(), expected.size());
+		EXPECT_EQ(pvector.summary(), std::accumulate(expected.cbegin(), expected.cend(), 0ll));
+		EXPECT_EQ(pvector.aggregate(100, 2600), std::accumulate(expected.cbegin() + 100, expected.cbegin() + 2600, 0ll));
+		std::vector<long long> copied;
+		pvector.copy_to(std::back_inserter(copied), 10, 2990);
+		EXPECT_TRUE(std::equal(copied.cbegin(), copied.cend(), expected.cbegin() + 10));
+		auto sorted = pvector.sorted();
+		std::sort(expected.begin(), expected.end());
+		EXPECT_TRUE(std::equal(expected.cbegin(), expected.cend(), sorted.cbegin()));
+		EXPECT_EQ(sorted.push_front(-1).lower_bound(1000) - sorted.cbegin(), std::lower_bound(expected.cbegin(), expected.cend(), 1000) - expected.cbegin() + 1);
+		auto resized = pvector.resize(10);
+		EXPECT_EQ(resized.size(), 10);
+		EXPECT_EQ(resized[0], pvector[0]);
+		EXPECT_EQ(pvector.resize(pvector.size() + 5, 7).back(), 7);
+		// the versions made by the deque operations are copied instead of edited in place
+		auto moved = pvector;
+		auto appended = std::move(moved).push_back(5).set(0, 9);
+		EXPECT_EQ(appended.back(), 5);
+		EXPECT_EQ(appended.front(), 9);
+		EXPECT_NE(pvector.front(), 9);
+	}
+
+	TEST(PVectorDeque, FrontPartSummaries) {
+		// the hash depends on the order, so the front part has to be combined in the order of the vector
+		using HashVector = PersistentVector<int, HashMonoid<int>>;
+		HashVector pvector;
+		std::deque<int> expected;
+		for (int i = 0; i < 5000; ++i) {
+			pvector = pvector.push_front(i);
+			expected.push_front(i);
+		}
+		for (int i = 0; i < 100; ++i) {
+			pvector = pvector.push_back(-i);
+			expected.push_back(-i);
+		}
+		auto check = [](const HashVector& pvector, const std::deque<int>& expected) {
+			HashVector plain(expected.cbegin(), expected.cend());
+			ASSERT_EQ(pvector.size(), plain.size());
+			EXPECT_EQ(pvector.content_hash(), plain.content_hash());
+			EXPECT_TRUE(pvector == plain);
+			auto size = plain.size();
+			std::vector<std::pair<size_t, size_t>> ranges = { { 0, size }, { 1, size / 2 }, { 31, 33 }, { size / 3, size - 1 }, { size - 1, size } };
+			for (const auto& range : ranges) {
+				EXPECT_EQ(pvector.aggregate(range.first, range.second), plain.aggregate(range.first, range.second));
+			}
+			EXPECT_EQ(pvector.prefix(size / 2), plain.prefix(size / 2));
+			std::vector<int> copied;
+			pvector.copy_to(std::back_inserter(copied), 7, size - 3);
+			EXPECT_TRUE(std::equal(copied.cbegin(), copied.cend(), expected.cbegin() + 7));
+			EXPECT_EQ(copied.size(), size - 10);
+		};
+		check(pvector, expected);
+		// the body is popped out first, then the front part is popped from its start
+		for (int i = 0; i < 4000; ++i) {
+			pvector = pvector.pop_back();
+			expected.pop_back();
+			ASSERT_EQ(pvector.back(), expected.back());
+			if (0 == i % 500) {
+				check(pvector, expected);
+			}
+		}
+		check(pvector, expected);
+		for (int i = 0; i < 1000; ++i) {
+			if (i % 2) {
+				pvector = pvector.pop_front();
+				expected.pop_front();
+			}
+			else {
+				pvector = pvector.pop_back();
+				expected.pop_back();
+			}
+		}
+		EXPECT_TRUE(std::equal(expected.cbegin(), expected.cend(), pvector.cbegin()));
+		check(pvector, expected);
+	}
+
+
+	/*
+	*	Read-modify-write
+	*/
+
+	TEST(PVectorUpdate, SameAsSet) {
+		for (size_t size : { 3, 5, 33, 5000 }) {
+			PersistentVector<size_t> pvector(size, 1);
+			auto original = pvector;
+			auto expected = pvector;
+			std::mt19937 generator(size);
+			for (size_t i = 0; i < 300; ++i) {
+				auto pos = generator() % size;
+				pvector = pvector.update(pos, [i](size_t&& value) { return value * 3 + i; });
+				expected = expected.set(pos, expected[pos] * 3 + i);
+			}
+			EXPECT_EQ(pvector, expected);
+			EXPECT_EQ(original, PersistentVector<size_t>(size, 1));
+			EXPECT_EQ(pvector.undo(), expected.undo());
+		}
+	}
+
+	TEST(PVectorUpdate, MovedCopy) {
+		PersistentVector<string> pvector(100, "value");
+		auto updated = pvector.update(42, [](string&& value) {
+			value += "!";
+			return std::move(value);
+		});
+		EXPECT_EQ(updated[42], "value!");
+		EXPECT_EQ(pvector[42], "value");
+		// the consumed version is edited in place and restored by undo
+		auto edited = std::move(updated).update(42, [](string value) { return value + "?"; });
+		EXPECT_EQ(edited[42], "value!?");
+		EXPECT_EQ(edited.undo()[42], "value!");
+	}
+
+	TEST(PVectorUpdate, Range) {
+		PersistentVector<size_t> base(100000, 0);
+		auto updated = base.update_range(1000, 2000, [](size_t value) { return value + 1; });
+		for (size_t i = 0; i < base.size(); i += 7) {
+			ASSERT_EQ(updated[i], i >= 1000 && i < 2000 ? 1 : 0);
+		}
+		EXPECT_EQ(updated[999] + updated[1000] + updated[1999] + updated[2000], 2);
+		EXPECT_EQ(base.update_range(5, 5, [](size_t) { return size_t(1); }), base);
+		// the leaves of [992, 2016) are copied once each
+		std::vector<PersistentVector<size_t>> versions = { base, updated };
+		auto usage = versionsMemoryUsage(versions.cbegin(), versions.cend());
+		EXPECT_EQ(usage.total.leaves, base.memoryUsage().leaves + 32);
+		EXPECT_EQ(updated.undo(), base);
+		auto increment = [](size_t value) { return value + 1; };
+		EXPECT_THROW(base.update_range(99990, 100001, increment), std::out_of_range);
+		EXPECT_THROW(base.update_range(20, 10, increment), std::out_of_range);
+	}
+
+	TEST(PVectorUpdate, SmallAndDeque) {
+		for (size_t size : { 4, 40 }) {
+			PersistentVector<size_t> pvector(size, 1);
+			for (size_t i = 0; i < 70; ++i) {
+				pvector = pvector.push_front(i);
+			}
+			pvector = pvector.pop_front();
+			std::vector<size_t> expected(pvector.cbegin(), pvector.cend());
+			auto updated = pvector.update_range(3, pvector.size() - 2, [](size_t value) { return value * 2; });
+			for (size_t i = 3; i < expected.size() - 2; ++i) {
+				expected[i] *= 2;
+			}
+			EXPECT_EQ(std::vector<size_t>(updated.cbegin(), updated.cend()), expected);
+			expected[0] += 5;
+			EXPECT_EQ(updated.update(0, [](size_t value) { return value + 5; })[0], expected[0]);
+		}
+		auto small = PersistentVector<size_t>(3, 2).update_range(0, 3, [](size_t value) { return value + 1; });
+		EXPECT_EQ(small, PersistentVector<size_t>(3, 3));
+	}
+
+
+
+	/*
+	*	Sorting and search
+	*/
+
+	TEST(PVectorSorted, SameAsStableSort) {
+		for (size_t size : { 0, 1, 4, 5, 33, 1000, 70000 }) {
+			std::mt19937 generator(size);
+			std::vector<size_t> source(size);
+			for (auto& value : source) {
+				value = generator() % 1000;
+			}
+			PersistentVector<size_t> pvector(source.cbegin(), source.cend());
+			auto sorted = pvector.sorted();
+			std::stable_sort(source.begin(), source.end());
+			ASSERT_EQ(sorted.size(), size);
+			EXPECT_TRUE(std::equal(source.cbegin(), source.cend(), sorted.cbegin()));
+			EXPECT_EQ(sorted.undo(), pvector);
+		}
+	}
+
+	TEST(PVectorSorted, Stable) {
+		std::vector<pair<size_t, size_t>> source;
+		for (size_t i = 0; i < 50000; ++i) {
+			source.emplace_back((i * 7919) % 10, i);
+		}
+		PersistentVector<pair<size_t, size_t>> pvector(source.cbegin(), source.cend());
+		auto sorted = pvector.sorted([](const pair<size_t, size_t>& left, const pair<size_t, size_t>& right) {
+			return left.first > right.first;
+		});
+		for (size_t i = 1; i < sorted.size(); ++i) {
+			ASSERT_GE(sorted[i - 1].first, sorted[i].first);
+			if (sorted[i - 1].first == sorted[i].first) {
+				ASSERT_LT(sorted[i - 1].second, sorted[i].second);
+			}
+		}
+	}
+
+	TEST(PVectorSorted, DoesNotCopyElements) {
+		PersistentVector<CopyCounter> pvector;
+		for (size_t i = 0; i < 100; ++i) {
+			pvector = pvector.emplace_back(100 - i);
+		}
+		CopyCounter::reset();
+		auto sorted = pvector.sorted([](const CopyCounter& left, const CopyCounter& right) {
+			return left.value < right.value;
+		});
+		EXPECT_EQ(CopyCounter::copies, 0);
+		EXPECT_EQ(CopyCounter::moves, 0);
+		EXPECT_EQ(sorted[0].value, 1);
+		EXPECT_EQ(sorted[99].value, 100);
+	}
+
+	TEST(PVectorBounds, SameAsStd) {
+		for (size_t size : { 0, 3, 5, 32, 33, 1024, 1025, 5000 }) {
+			std::vector<size_t> source(size);
+			for (size_t i = 0; i < size; ++i) {
+				// every value is repeated three times
+				source[i] = i / 3 * 2;
+			}
+			PersistentVector<size_t> pvector(source.cbegin(), source.cend());
+			for (size_t value = 0; value <= size + 1; ++value) {
+				auto expectedLower = std::lower_bound(source.cbegin(), source.cend(), value) - source.cbegin();
+				auto expectedUpper = std::upper_bound(source.cbegin(), source.cend(), value) - source.cbegin();
+				ASSERT_EQ(pvector.lower_bound(value) - pvector.cbegin(), expectedLower);
+				ASSERT_EQ(pvector.upper_bound(value) - pvector.cbegin(), expectedUpper);
+				auto range = pvector.equal_range(value);
+				ASSERT_EQ(range.second - range.first, expectedUpper - expectedLower);
+			}
+		}
+	}
+
+	TEST(PVectorBounds, Records) {
+		std::vector<pair<size_t, string>> source;
+		for (size_t i = 0; i < 1000; ++i) {
+			source.emplace_back(1000 - i, to_string(i));
+		}
+		auto byKey = [](const pair<size_t, string>& left, const pair<size_t, string>& right) { return left.first < right.first; };
+		auto sorted = PersistentVector<pair<size_t, string>>(source.cbegin(), source.cend()).sorted(byKey);
+		struct KeyLess {
+			bool operator()(const pair<size_t, string>& record, size_t key) const { return record.first < key; }
+			bool operator()(size_t key, const pair<size_t, string>& record) const { return key < record.first; }
+		};
+		auto it = sorted.lower_bound(size_t(10), KeyLess());
+		EXPECT_EQ(it->second, "990");
+		EXPECT_EQ(sorted.upper_bound(size_t(1000), KeyLess()), sorted.cend());
+		EXPECT_EQ(sorted.lower_bound(size_t(0), KeyLess()), sorted.cbegin());
+	}
+
+
+
+	/*
+	*	In-place edits of rvalues
+	*/
+
+	TEST(PVectorInPlace, PushBackLinear) {
+		PersistentVector<size_t> pvector;
+		for (size_t i = 0; i < 1000; ++i) {
+			pvector = std::move(pvector).push_back(i);
+		}
+		for (size_t i = 0; i < 1000; ++i) {
+			EXPECT_EQ(pvector[i], i);
+		}
+		// no leaf was copied, so only the leaves of the last version exist
+		EXPECT_EQ(pvector.memoryUsage().leaves, 32);
+		EXPECT_EQ(pvector.memoryUsage().elements, 1000);
+	}
+
+	TEST(PVectorInPlace, UndoRestoresEditedVersions) {
+		PersistentVector<size_t> pvector;
+		for (size_t i = 0; i < 100; ++i) {
+			pvector = std::move(pvector).push_back(i);
+		}
+		pvector = std::move(pvector).set(50, 500);
+		pvector = std::move(pvector).pop_back();
+		pvector = std::move(pvector).resize(120, 7);
+		EXPECT_EQ(pvector.size(), 120);
+		EXPECT_EQ(pvector[50], 500);
+		EXPECT_EQ(pvector[119], 7);
+
+		pvector = pvector.undo();
+		EXPECT_EQ(pvector.size(), 99);
+		pvector = pvector.undo();
+		EXPECT_EQ(pvector.size(), 100);
+		EXPECT_EQ(pvector[99], 99);
+		pvector = pvector.undo();
+		EXPECT_EQ(pvector[50], 50);
+		for (size_t i = 100; i > 0; --i) {
+			EXPECT_EQ(pvector.size(), i);
+			EXPECT_EQ(pvector.back(), i - 1);
+			pvector = pvector.undo();
+		}
+		EXPECT_TRUE(pvector.empty());
+		EXPECT_FALSE(pvector.canUndo());
+		for (size_t i = 0; i < 103; ++i) {
+			pvector = pvector.redo();
+		}
+		EXPECT_EQ(pvector.size(), 120);
+		EXPECT_EQ(pvector[50], 500);
+	}
+
+	TEST(PVectorInPlace, SharedVersionIsNotModified) {
+		PersistentVector<size_t> pvector(100, 1);
+		auto copy = pvector;
+		auto other = std::move(pvector).set(10, 2).push_back(3).pop_back().pop_back();
+		EXPECT_EQ(copy.size(), 100);
+		EXPECT_EQ(copy[10], 1);
+		EXPECT_EQ(copy[99], 1);
+		EXPECT_EQ(other.size(), 99);
+		EXPECT_EQ(other[10], 2);
+	}
+
+	TEST(PVectorInPlace, SharedNodesAreCopied) {
+		PersistentVector<size_t> pvector(1000, 1);
+		auto next = pvector.set(0, 2);
+		for (size_t i = 0; i < 1000; ++i) {
+			next = std::move(next).set(i, 3);
+		}
+		next = std::move(next).pop_back().push_back(4).resize(2000, 5);
+		for (size_t i = 0; i < 1000; ++i) {
+			EXPECT_EQ(pvector[i], 1);
+		}
+		EXPECT_EQ(next[998], 3);
+		EXPECT_EQ(next[999], 4);
+		EXPECT_EQ(next[1999], 5);
+		EXPECT_EQ(next.undo().undo().undo()[0], 3);
+	}
+
+	TEST(PVectorInPlace, VersionReachedByUndo) {
+		PersistentVector<size_t> pvector = { 1, 2, 3 };
+		pvector = pvector.push_back(4);
+		auto undone = pvector.undo();
+		auto next = std::move(undone).push_back(5);
+		EXPECT_EQ(next.size(), 4);
+		EXPECT_EQ(next[3], 5);
+		EXPECT_EQ(pvector[3], 4);
+		EXPECT_EQ(next.undo().size(), 3);
+		EXPECT_FALSE(next.undo().canUndo());
+	}
+
+	TEST(PVectorInPlace, ResizeDoesNotModifySource) {
+		PersistentVector<size_t> pvector(33, 1);
+		auto resized = pvector.resize(40, 2);
+		auto pushed = pvector.push_back(3);
+		EXPECT_EQ(pushed.size(), 34);
+		EXPECT_EQ(pushed[33], 3);
+		EXPECT_EQ(resized[39], 2);
+	}
+
+	TEST(PVectorInPlace, ConcurrentUndo) {
+		PersistentVector<size_t> pvector;
+		for (size_t i = 0; i < 100; ++i) {
+			pvector = std::move(pvector).push_back(i);
+		}
+		std::thread threads[8];
+		for (auto& thread : threads) {
+			thread = std::thread([&pvector]() {
+				auto undone = pvector.undo();
+				for (size_t i = 0; i < 10; ++i) {
+					undone = undone.undo();
+				}
+				EXPECT_EQ(undone.size(), 89);
+				EXPECT_EQ(undone.back(), 88);
+			});
+		}
+		for (auto& thread : threads) {
+			thread.join();
+		}
+	}
+
+
+
+	/*
+	*	Small vectors
+	*/
+
+	TEST(PVectorSmall, GrowAndShrink) {
+		PersistentVector<size_t> pvector;
+		std::vector<PersistentVector<size_t>> versions = { pvector };
+		for (size_t i = 0; i < 40; ++i) {
+			pvector = pvector.push_back(i);
+			versions.push_back(pvector);
+		}
+		for (size_t size = 0; size <= 40; ++size) {
+			ASSERT_EQ(versions[size].size(), size);
+			for (size_t i = 0; i < size; ++i) {
+				EXPECT_EQ(versions[size][i], i);
+			}
+		}
+		for (size_t size = 40; size > 0; --size) {
+			pvector = pvector.pop_back();
+			ASSERT_EQ(pvector.size(), size - 1);
+			for (size_t i = 0; i + 1 < size; ++i) {
+				EXPECT_EQ(pvector[i], i);
+			}
+		}
+	}
+
+	TEST(PVectorSmall, ResizeAcrossThreshold) {
+		PersistentVector<size_t> pvector = { 1, 2, 3 };
+		auto big = pvector.resize(100, 7);
+		auto small = big.resize(2);
+		auto grown = small.resize(6);
+		EXPECT_EQ(pvector.size(), 3);
+		EXPECT_EQ(big[2], 3);
+		EXPECT_EQ(big[99], 7);
+		ASSERT_EQ(small.size(), 2);
+		EXPECT_EQ(small[1], 2);
+		ASSERT_EQ(grown.size(), 6);
+		EXPECT_EQ(grown[1], 2);
+		EXPECT_EQ(grown[5], 0);
+	}
+
+	TEST(PVectorSmall, Set) {
+		PersistentVector<size_t> pvector = { 1, 2 };
+		auto changed = pvector.set(1, 5);
+		EXPECT_EQ(pvector[1], 2);
+		EXPECT_EQ(changed[1], 5);
+		changed = std::move(changed).set(0, 4);
+		EXPECT_EQ(changed[0], 4);
+		EXPECT_EQ(changed.undo()[0], 1);
+	}
+
+	TEST(PVectorSmall, InPlaceAcrossThreshold) {
+		PersistentVector<size_t> pvector;
+		for (size_t i = 0; i < 8; ++i) {
+			pvector = std::move(pvector).push_back(i);
+		}
+		for (size_t i = 0; i < 6; ++i) {
+			pvector = std::move(pvector).pop_back();
+		}
+		ASSERT_EQ(pvector.size(), 2);
+		EXPECT_EQ(pvector[1], 1);
+		for (size_t size = 3; size <= 8; ++size) {
+			pvector = pvector.undo();
+			ASSERT_EQ(pvector.size(), size);
+			EXPECT_EQ(pvector.back(), size - 1);
+		}
+	}
+
+	TEST(PVectorSmall, OneSmallBlock) {
+		PersistentVector<size_t> pvector = { 1, 2, 3 };
+		auto usage = pvector.memoryUsage();
+		EXPECT_EQ(usage.leaves, 1);
+		EXPECT_EQ(usage.primeTreeNodes, 0);
+		EXPECT_EQ(usage.elements, 3);
+		// the block has SMALL_SIZE slots, a leaf has 32 of them
+		auto leafUsage = pvector.push_back(4).push_back(5).memoryUsage();
+		EXPECT_LT(usage.leafBytes * 4, leafUsage.leafBytes);
+	}
+
+	TEST(PVectorSmall, VersionsShareTheBlock) {
+		PersistentVector<size_t> pvector = { 1, 2, 3 };
+		auto other = pvector.set(1, 7);
+		EXPECT_EQ(pvector[1], 2);
+		EXPECT_EQ(other[1], 7);
+		auto moved = std::move(other).set(2, 8);
+		EXPECT_EQ(moved[1], 7);
+		EXPECT_EQ(moved[2], 8);
+		EXPECT_EQ(pvector[2], 3);
+		auto popped = pvector.pop_back().pop_back().pop_back();
+		EXPECT_TRUE(popped.empty());
+		EXPECT_EQ(pvector.size(), 3);
+	}
+
+
+
+	/*
+	*	Range aggregates
+	*/
+
+	namespace {
+		using SumVector = PersistentVector<long long, SumMonoid<long long>>;
+
+		// Compares aggregate() with a scan on a sample of the ranges of the vector
+		void ExpectSums(const SumVector& pvector) {
+			std::vector<long long> values(pvector.cbegin(), pvector.cend());
+			std::vector<long long> prefixes(values.size() + 1);
+			for (size_t i = 0; i < values.size(); ++i) {
+				prefixes[i + 1] = prefixes[i] + values[i];
+			}
+			ASSERT_EQ(pvector.summary(), prefixes.back());
+			size_t step = std::max<size_t>(1, values.size() / 37);
+			for (size_t first = 0; first <= values.size(); first += step) {
+				for (size_t last = first; last <= values.size(); last += step) {
+					ASSERT_EQ(pvector.aggregate(first, last), prefixes[last] - prefixes[first]) << first << " " << last;
+				}
+				ASSERT_EQ(pvector.prefix(first), prefixes[first]);
+			}
+		}
+	}
+
+	TEST(PVectorAggregate, Empty) {
+		SumVector pvector;
+		EXPECT_EQ(pvector.summary(), 0);
+		EXPECT_EQ(pvector.aggregate(0, 0), 0);
+		EXPECT_THROW(pvector.aggregate(0, 1), std::out_of_range);
+	}
+
+	TEST(PVectorAggregate, PushBack) {
+		SumVector pvector;
+		std::vector<SumVector> versions;
+		for (long long i = 0; i < 1100; ++i) {
+			pvector = pvector.push_back(i * 7 % 13 - 5);
+			if (i % 97 == 0 || i < 40) {
+				versions.push_back(pvector);
+			}
+		}
+		for (const auto& version : versions) {
+			ExpectSums(version);
+		}
+		ExpectSums(pvector);
+		EXPECT_THROW(pvector.aggregate(5, 4), std::out_of_range);
+		EXPECT_THROW(pvector.aggregate(0, pvector.size() + 1), std::out_of_range);
+	}
+
+	TEST(PVectorAggregate, SetAndPopBack) {
+		SumVector pvector;
+		for (long long i = 0; i < 2000; ++i) {
+			pvector = pvector.push_back(i);
+		}
+		auto changed = pvector.set(1500, -1000000).set(3, 42);
+		auto popped = changed;
+		for (size_t i = 0; i < 1000; ++i) {
+			popped = popped.pop_back();
+		}
+		ExpectSums(pvector);
+		ExpectSums(changed);
+		ExpectSums(popped);
+		ExpectSums(pvector.resize(700));
+		ExpectSums(pvector.resize(3000, 3));
+	}
+
+	TEST(PVectorAggregate, InPlace) {
+		SumVector pvector;
+		for (long long i = 0; i < 1500; ++i) {
+			pvector = std::move(pvector).push_back(i);
+		}
+		for (size_t i = 0; i < 1500; i += 11) {
+			pvector = std::move(pvector).set(i, 1);
+		}
+		for (size_t i = 0; i < 300; ++i) {
+			pvector = std::move(pvector).pop_back();
+		}
+		ExpectSums(pvector);
+		auto undone = pvector;
+		for (size_t i = 0; i < 250; ++i) {
+			undone = undone.undo();
+			ASSERT_EQ(undone.summary(), std::accumulate(undone.cbegin(), undone.cend(), 0LL));
+		}
+		ExpectSums(undone);
+	}
+
+	TEST(PVectorAggregate, Sorted) {
+		SumVector pvector;
+		std::mt19937 gen(7);
+		for (size_t i = 0; i < 5000; ++i) {
+			pvector = std::move(pvector).push_back(static_cast<long long>(gen() % 1000));
+		}
+		ExpectSums(pvector.sorted());
+	}
+
+	TEST(PVectorAggregate, MinMax) {
+		PersistentVector<int, MinMonoid<int>> minimums;
+		PersistentVector<int, MaxMonoid<int>> maximums;
+		std::vector<int> values;
+		std::mt19937 gen(11);
+		for (size_t i = 0; i < 3000; ++i) {
+			int value = static_cast<int>(gen() % 100000) - 50000;
+			values.push_back(value);
+			minimums = std::move(minimums).push_back(value);
+			maximums = std::move(maximums).push_back(value);
+		}
+		EXPECT_EQ(minimums.aggregate(10, 10), std::numeric_limits<int>::max());
+		for (size_t first = 0; first < values.size(); first += 131) {
+			for (size_t last = first + 1; last <= values.size(); last += 173) {
+				EXPECT_EQ(minimums.aggregate(first, last), *std::min_element(values.begin() + first, values.begin() + last));
+				EXPECT_EQ(maximums.aggregate(first, last), *std::max_element(values.begin() + first, values.begin() + last));
+			}
+		}
+	}
+
+
+
+	/*
+	*	Bulk export
+	*/
+
+	TEST(PVectorCopyTo, WholeVector) {
+		for (size_t size : { 0, 3, 4, 5, 32, 33, 1024, 1025, 40000 }) {
+			std::vector<size_t> values(size);
+			for (size_t i = 0; i < size; ++i) {
+				values[i] = i * 3;
+			}
+			PersistentVector<size_t> pvector(values.cbegin(), values.cend());
+			EXPECT_EQ(pvector.to_std_vector(), values);
+			std::vector<size_t> out(size);
+			EXPECT_EQ(pvector.copy_to(out.data()), out.data() + size);
+			EXPECT_EQ(out, values);
+		}
+	}
+
+	TEST(PVectorCopyTo, Ranges) {
+		PersistentVector<std::string> pvector;
+		std::vector<std::string> values;
+		for (size_t i = 0; i < 3000; ++i) {
+			values.push_back(std::to_string(i));
+			pvector = std::move(pvector).push_back(values.back());
+		}
+		for (size_t first = 0; first < values.size(); first += 97) {
+			for (size_t last = first; last <= values.size(); last += 211) {
+				std::vector<std::string> out;
+				pvector.copy_to(std::back_inserter(out), first, last);
+				EXPECT_EQ(out, std::vector<std::string>(values.begin() + first, values.begin() + last));
+			}
+		}
+		EXPECT_THROW(pvector.copy_to(values.begin(), 10, 3001), std::out_of_range);
+		EXPECT_THROW(pvector.copy_to(values.begin(), 11, 10), std::out_of_range);
+	}
+
+	TEST(PVectorCopyTo, OldVersions) {
+		PersistentVector<int> pvector(100, 1);
+		auto changed = pvector.set(50, 2).pop_back();
+		std::vector<int> expected(99, 1);
+		expected[50] = 2;
+		EXPECT_EQ(changed.to_std_vector(), expected);
+		EXPECT_EQ(pvector.to_std_vector(), std::vector<int>(100, 1));
+	}
+
+
+
+	/*
+	*	Bulk append
+	*/
+
+	TEST(PVectorAppend, MatchesPushBack) {
+		for (size_t size : { 0, 2, 4, 5, 31, 32, 100, 1024, 1025, 33000 }) {
+			for (size_t count : { 0, 1, 3, 27, 32, 64, 1000, 40000 }) {
+				PersistentVector<size_t> pvector;
+				std::vector<size_t> expected;
+				for (size_t i = 0; i < size; ++i) {
+					pvector = pvector.push_back(i);
+					expected.push_back(i);
+				}
+				std::vector<size_t> batch(count);
+				for (size_t i = 0; i < count; ++i) {
+					batch[i] = size + i * 7;
+				}
+				auto appended = pvector.append(batch.cbegin(), batch.cend());
+				ASSERT_EQ(pvector.to_std_vector(), expected) << size << " " << count;
+				expected.insert(expected.end(), batch.cbegin(), batch.cend());
+				ASSERT_EQ(appended.to_std_vector(), expected) << size << " " << count;
+				// the result keeps growing as usual
+				appended = appended.push_back(1);
+				expected.push_back(1);
+				ASSERT_EQ(appended.to_std_vector(), expected) << size << " " << count;
+			}
+		}
+	}
+
+	TEST(PVectorAppend, OneVersion) {
+		PersistentVector<int> pvector(100, 1);
+		std::vector<int> batch(5000, 2);
+		auto appended = pvector.append(batch.cbegin(), batch.cend());
+		EXPECT_EQ(appended.size(), 5100);
+		EXPECT_TRUE(appended.canUndo());
+		EXPECT_EQ(appended.undo(), pvector);
+		EXPECT_EQ(appended.undo().redo(), appended);
+		EXPECT_EQ(pvector.append(batch.cend(), batch.cend()), pvector);
+	}
+
+	TEST(PVectorAppend, SharesOldLeaves) {
+		PersistentVector<size_t> pvector(10000, 1);
+		std::vector<size_t> batch(1000, 2);
+		std::vector<PersistentVector<size_t>> versions = { pvector, pvector.append(batch.cbegin(), batch.cend()) };
+		auto usage = versionsMemoryUsage(versions.cbegin(), versions.cend());
+		// the partial last leaf of 16 elements is copied and filled, 984 elements take 31 new leaves
+		EXPECT_EQ(usage.total.leaves, pvector.memoryUsage().leaves + 1 + 31);
+		EXPECT_EQ(usage.total.elements, 11000);
+	}
+
+	TEST(PVectorAppend, InPlace) {
+		PersistentVector<std::string> pvector;
+		std::vector<std::string> expected;
+		for (size_t step = 0; step < 20; ++step) {
+			std::vector<std::string> batch;
+			for (size_t i = 0; i < step * 37; ++i) {
+				batch.push_back(std::to_string(expected.size() + i));
+			}
+			auto previous = pvector;
+			pvector = std::move(pvector).append(batch.cbegin(), batch.cend());
+			EXPECT_EQ(previous.to_std_vector(), expected);
+			expected.insert(expected.end(), batch.cbegin(), batch.cend());
+			ASSERT_EQ(pvector.to_std_vector(), expected);
+		}
+		// the history is the same as for the copying overload
+		for (size_t step = 19; step > 0; --step) {
+			pvector = pvector.undo();
+			expected.resize(expected.size() - step * 37);
+			ASSERT_EQ(pvector.to_std_vector(), expected);
+		}
+	}
+
+	TEST(PVectorAppend, InPlaceRestoresConsumedVersion) {
+		PersistentVector<size_t> pvector;
+		for (size_t i = 0; i < 1000; ++i) {
+			pvector = std::move(pvector).push_back(i);
+		}
+		std::vector<size_t> batch(3000, 5);
+		auto appended = std::move(pvector).append(batch.cbegin(), batch.cend());
+		auto undone = appended.undo();
+		ASSERT_EQ(undone.size(), 1000);
+		EXPECT_EQ(undone.back(), 999);
+		EXPECT_EQ(appended.size(), 4000);
+		EXPECT_EQ(appended[1000], 5);
+	}
+
+	TEST(PVectorAppend, Aggregates) {
+		SumVector pvector;
+		std::mt19937 gen(3);
+		for (size_t step = 0; step < 10; ++step) {
+			std::vector<long long> batch(gen() % 3000);
+			for (auto& value : batch) {
+				value = static_cast<long long>(gen() % 1000);
+			}
+			pvector = pvector.append(batch.cbegin(), batch.cend());
+			ExpectSums(pvector);
+		}
+	}
+
+
+
+	/*
+	*	Parallel construction
+	*/
+
+	TEST(PVectorBuildParallel, SameAsSequential) {
+		for (size_t size : { 0, 3, 4, 5, 1000, 16384, 16385, 100000, 1 << 20 }) {
+			std::vector<size_t> values(size);
+			std::iota(values.begin(), values.end(), 0);
+			for (size_t threads : { 1, 2, 3, 8 }) {
+				auto pvector = PersistentVector<size_t>::build_parallel(values.cbegin(), values.cend(), threads);
+				ASSERT_EQ(pvector.size(), size);
+				ASSERT_EQ(pvector.to_std_vector(), values) << size << " " << threads;
+				EXPECT_FALSE(pvector.canUndo());
+			}
+		}
+	}
+
+	TEST(PVectorBuildParallel, SameShape) {
+		std::vector<size_t> values(70000, 1);
+		auto pvector = PersistentVector<size_t>::build_parallel(values.cbegin(), values.cend(), 4);
+		PersistentVector<size_t> sequential(values.cbegin(), values.cend());
+		EXPECT_EQ(pvector.memoryUsage().totalBytes(), sequential.memoryUsage().totalBytes());
+		// the vector grows and shrinks as the one built by push_back
+		for (size_t i = 0; i < 5000; ++i) {
+			pvector = std::move(pvector).push_back(i);
+		}
+		for (size_t i = 0; i < 6000; ++i) {
+			pvector = std::move(pvector).pop_back();
+		}
+		EXPECT_EQ(pvector.size(), 69000);
+		EXPECT_EQ(pvector.back(), 1);
+	}
+
+	TEST(PVectorBuildParallel, Aggregates) {
+		std::vector<long long> values(50000);
+		std::mt19937 gen(13);
+		for (auto& value : values) {
+			value = static_cast<long long>(gen() % 1000);
+		}
+		ExpectSums(SumVector::build_parallel(values.cbegin(), values.cend(), 4));
+	}
+
+	TEST(PVectorBuildParallel, ExceptionIsRethrown) {
+		struct Throwing {
+			Throwing(size_t value) : value(value) {}
+			Throwing(const Throwing& other) : value(other.value) {
+				if (value == 40000) {
+					throw std::runtime_error("copy failed");
+				}
+			}
+			size_t value;
+		};
+		std::vector<Throwing> values;
+		for (size_t i = 0; i < 50000; ++i) {
+			values.emplace_back(i);
+		}
+		EXPECT_THROW(PersistentVector<Throwing>::build_parallel(values.cbegin(), values.cend(), 4), std::runtime_error);
+	}
+
+
+
+	/*
+	*	Lazy views
+	*/
+
+	TEST(PVectorView, TransformAndFilter) {
+		std::vector<int> values(5000);
+		std::iota(values.begin(), values.end(), 0);
+		PersistentVector<int> pvector(values.cbegin(), values.cend());
+		auto view = pvector.view()
+			.transform([](int value) { return value * 3; })
+			.filter([](int value) { return value % 2 == 0; })
+			.transform([](int value) { return std::to_string(value); });
+		std::vector<std::string> expected;
+		for (auto value : values) {
+			if (value * 3 % 2 == 0) {
+				expected.push_back(std::to_string(value * 3));
+			}
+		}
+		std::vector<std::string> out;
+		view.copy_to(std::back_inserter(out));
+		EXPECT_EQ(out, expected);
+		auto materialized = view.materialize();
+		EXPECT_EQ(materialized.to_std_vector(), expected);
+		EXPECT_FALSE(materialized.canUndo());
+		// the view can be consumed again
+		EXPECT_EQ(view.materialize(), materialized);
+	}
+
+	TEST(PVectorView, Lazy) {
+		PersistentVector<int> pvector(1000, 1);
+		size_t calls = 0;
+		auto view = pvector.view().transform([&calls](int value) { ++calls; return value + 1; });
+		auto filtered = view.filter([](int value) { return value > 1; });
+		EXPECT_EQ(calls, 0);
+		size_t count = 0;
+		filtered.for_each([&count](int value) { count += static_cast<size_t>(value); });
+		EXPECT_EQ(calls, 1000);
+		EXPECT_EQ(count, 2000);
+	}
+
+	TEST(PVectorView, StopsEarly) {
+		std::vector<size_t> values(10000);
+		std::iota(values.begin(), values.end(), 0);
+		PersistentVector<size_t> pvector(values.cbegin(), values.cend());
+		size_t calls = 0;
+		auto view = pvector.view(100, 10000).transform([&calls](size_t value) { ++calls; return value; })
+			.filter([](size_t value) { return value % 2 == 0; });
+		size_t seen = 0;
+		EXPECT_FALSE(view.for_each_while([&seen](size_t) { return ++seen < 3; }));
+		// the third even value stops the walk: 100, 101, ..., 104
+		EXPECT_EQ(seen, 3);
+		EXPECT_EQ(calls, 5);
+		calls = 0;
+		std::vector<size_t> first;
+		view.copy_n(4, std::back_inserter(first));
+		EXPECT_EQ(first, std::vector<size_t>({ 100, 102, 104, 106 }));
+		EXPECT_EQ(calls, 7);
+		calls = 0;
+		EXPECT_TRUE(pvector.view(0, 40).transform([&calls](size_t value) { ++calls; return value; })
+			.for_each_while([](size_t) { return true; }));
+		EXPECT_EQ(calls, 40);
+		std::vector<size_t> all;
+		pvector.view(9990, 10000).copy_n(100, std::back_inserter(all));
+		EXPECT_EQ(all.size(), 10);
+	}
+
+	TEST(PVectorView, Ranges) {
+		std::vector<size_t> values(3000);
+		std::iota(values.begin(), values.end(), 0);
+		PersistentVector<size_t> pvector(values.cbegin(), values.cend());
+		for (size_t first = 0; first < values.size(); first += 211) {
+			for (size_t last = first; last <= values.size(); last += 307) {
+				auto materialized = pvector.view(first, last).filter([](size_t value) { return value % 3 != 0; }).materialize();
+				std::vector<size_t> expected;
+				std::copy_if(values.begin() + first, values.begin() + last, std::back_inserter(expected), [](size_t value) { return value % 3 != 0; });
+				ASSERT_EQ(materialized.to_std_vector(), expected) << first << " " << last;
+			}
+		}
+		EXPECT_THROW(pvector.view(10, 3001), std::out_of_range);
+		EXPECT_TRUE(PersistentVector<size_t>().view().materialize().empty());
+	}
+
+	TEST(PVectorView, KeepsSourceAlive) {
+		auto view = PersistentVector<int>(100, 2).view().transform([](int value) { return value * value; });
+		auto materialized = view.materialize();
+		ASSERT_EQ(materialized.size(), 100);
+		EXPECT_EQ(materialized[99], 4);
+	}
+
+
+
+	/*
+	*	Content hashing
+	*/
+
+	using HashedVector = PersistentVector<int, HashMonoid<int>>;
+
+	TEST(PVectorContentHash, IndependentOfShape) {
+		std::vector<int> values(5000);
+		std::iota(values.begin(), values.end(), 0);
+		HashedVector built(values.cbegin(), values.cend());
+		HashedVector pushed;
+		for (auto value : values) {
+			pushed = pushed.push_back(value);
+		}
+		auto edited = HashedVector(5000, 7);
+		for (int i = 0; i < 5000; ++i) {
+			edited = edited.set(i, i);
+		}
+		EXPECT_EQ(built.content_hash(), pushed.content_hash());
+		EXPECT_EQ(built.content_hash(), edited.content_hash());
+		EXPECT_EQ(built.content_hash(), HashedVector(5000, 7).reset(values.cbegin(), values.cend()).content_hash());
+		// vectors without HashMonoid hash their elements to the same value
+		PersistentVector<int> plain(values.cbegin(), values.cend());
+		EXPECT_EQ(plain.content_hash(), built.content_hash());
+		EXPECT_EQ(std::hash<HashedVector>()(built), built.content_hash());
+	}
+
+	TEST(PVectorContentHash, DetectsChanges) {
+		HashedVector pvector(1000, 1);
+		auto hash = pvector.content_hash();
+		EXPECT_NE(pvector.set(999, 2).content_hash(), hash);
+		EXPECT_NE(pvector.push_back(1).content_hash(), hash);
+		EXPECT_NE(pvector.pop_back().content_hash(), hash);
+		EXPECT_EQ(pvector.set(500, 2).set(500, 1).content_hash(), hash);
+		EXPECT_EQ(pvector.set(500, 2).undo().content_hash(), hash);
+		// order matters
+		HashedVector ordered = { 1, 2, 3 };
+		HashedVector reversed = { 3, 2, 1 };
+		EXPECT_NE(ordered.content_hash(), reversed.content_hash());
+		EXPECT_NE(HashedVector().content_hash(), HashedVector({ 0 }).content_hash());
+	}
+
+	TEST(PVectorContentHash, Equality) {
+		HashedVector left(3000, 5);
+		auto right = HashedVector(3000, 6).reset(left.cbegin(), left.cend());
+		EXPECT_EQ(left, right);
+		EXPECT_NE(left, right.set(1234, 0));
+		EXPECT_NE(left.set(0, 1), left.set(0, 2));
+	}
+
+	TEST(PVectorContentHash, MapKey) {
+		PersistentMap<HashedVector, int> pmap;
+		HashedVector key = { 1, 2, 3 };
+		pmap = pmap.set(key, 1).set(key.push_back(4), 2);
+		EXPECT_EQ(pmap.size(), 2);
+		HashedVector same;
+		same = same.push_back(1).push_back(2).push_back(3);
+		EXPECT_EQ(pmap[same], 1);
+		EXPECT_TRUE(pmap.contains(same.push_back(4)));
+		EXPECT_FALSE(pmap.contains(same.pop_back()));
+	}
+
+	/*
+	*	Interning
+	*/
+
+	TEST(PVectorIntern, IndependentVersionsShareNodes) {
+		std::vector<std::string> values;
+		for (size_t i = 0; i < 2000; ++i) {
+			values.push_back(std::to_string(i));
+		}
+		PersistentVector<std::string> first(values.cbegin(), values.cend());
+		auto second = PersistentVector<std::string>().reset(values.cbegin(), values.cend());
+		// every node and element of the second version is replaced by the one of the first version
+		auto replaced = second.memoryUsage();
+		PersistentVector<std::string>::InternTable table;
+		first = first.intern(table);
+		second = second.intern(table);
+		EXPECT_TRUE(first == second);
+		std::vector<PersistentVector<std::string>> versions = { first, second };
+		auto usage = versionsMemoryUsage(versions.cbegin(), versions.cend());
+		EXPECT_EQ(usage.total.leaves, first.memoryUsage().leaves);
+		EXPECT_EQ(usage.total.elements, 2000);
+		// only the roots and the version nodes are not shared
+		EXPECT_EQ(usage.total.totalBytes() - usage.sharedBytes, usage.total.versionNodeBytes);
+		const auto& statistics = table.statistics();
+		// 63 leaves, 2 nodes of the second level and the root
+		EXPECT_EQ(statistics.sharedNodes, 66);
+		EXPECT_EQ(statistics.sharedElements, 2000);
+		EXPECT_EQ(statistics.bytesSaved, replaced.primeTreeNodeBytes + replaced.leafBytes + replaced.elementBytes);
+	}
+
+	TEST(PVectorIntern, EqualLeavesOfOneVector) {
+		PersistentVector<size_t> pvector(32 * 100, 7);
+		PersistentVector<size_t>::InternTable table;
+		auto interned = pvector.intern(table);
+		EXPECT_EQ(interned.memoryUsage().leaves, 1);
+		EXPECT_EQ(interned.size(), pvector.size());
+		EXPECT_EQ(interned[1234], 7);
+		EXPECT_FALSE(interned.canUndo());
+	}
+
+	TEST(PVectorIntern, ReplacesVersionInHistory) {
+		PersistentVector<size_t> pvector(100, 1);
+		auto changed = pvector.set(5, 2);
+		PersistentVector<size_t>::InternTable table;
+		auto interned = changed.intern(table);
+		EXPECT_EQ(interned, changed);
+		ASSERT_TRUE(interned.canUndo());
+		EXPECT_EQ(interned.undo(), pvector);
+		EXPECT_FALSE(interned.canRedo());
+	}
+
+	TEST(PVectorIntern, ParentEditedInPlace) {
+		PersistentVector<size_t> v;
+		for (size_t i = 0; i < 100; ++i) {
+			v = std::move(v).push_back(i);
+		}
+		auto w = std::move(v).push_back(100);
+		PersistentVector<size_t>::InternTable table;
+		auto interned = w.intern(table);
+		// the parent was edited in place by w and has to outlive it
+		w = {};
+		auto previous = interned.undo();
+		ASSERT_EQ(previous.size(), 100);
+		EXPECT_EQ(previous.back(), 99);
+	}
+
+	TEST(PVectorIntern, DifferentLeavesAreKept) {
+		PersistentVector<size_t> pvector;
+		for (size_t i = 0; i < 1000; ++i) {
+			pvector = pvector.push_back(i);
+		}
+		auto changed = pvector.set(500, 0);
+		PersistentVector<size_t>::InternTable table;
+		auto first = pvector.intern(table);
+		auto second = changed.intern(table);
+		EXPECT_EQ(first[500], 500);
+		EXPECT_EQ(second[500], 0);
+		std::vector<PersistentVector<size_t>> versions = { first, second };
+		auto usage = versionsMemoryUsage(versions.cbegin(), versions.cend());
+		EXPECT_EQ(usage.total.leaves, first.memoryUsage().leaves + 1);
+	}
+
+	TEST(PVectorIntern, EditsOfInternedVersions) {
+		PersistentVector<size_t> pvector(100, 1);
+		PersistentVector<size_t>::InternTable table;
+		auto interned = pvector.intern(table);
+		auto other = PersistentVector<size_t>(100, 1).intern(table);
+		interned = std::move(interned).set(10, 5);
+		interned = std::move(interned).push_back(3);
+		EXPECT_EQ(interned[10], 5);
+		EXPECT_EQ(interned.back(), 3);
+		for (size_t i = 0; i < other.size(); ++i) {
+			EXPECT_EQ(other[i], 1);
+		}
+	}
+
+	TEST(PVectorIntern, FreedNodesAreDropped) {
+		PersistentVector<size_t>::InternTable table;
+		{
+			auto pvector = PersistentVector<size_t>(3000, 1).set(0, 2).intern(table);
+		}
+		// three different leaves, three nodes of the second level and the root
+		EXPECT_EQ(table.size(), 7);
+		auto pvector = PersistentVector<size_t>(3000, 1).set(0, 2).intern(table);
+		// 91 of the 92 full leaves of ones are replaced in both vectors
+		EXPECT_EQ(table.statistics().sharedNodes, 2 * 91);
+		table.purge();
+		EXPECT_EQ(table.size(), 7);
+	}
+
+	/*
+	*	Single-threaded reference counting
+	*/
+
+	using SingleThreadVector = PersistentVector<size_t, void, SingleThreadRefCount>;
+
+	static_assert(AtomicRefCount::is_atomic, "shared_ptr counters are atomic");
+#if defined(__GLIBCXX__)
+	static_assert(!SingleThreadRefCount::is_atomic, "libstdc++ has the non-atomic shared_ptr");
+#else
+	static_assert(SingleThreadRefCount::is_atomic, "the policy falls back to the atomic counters");
+#endif
+
+	TEST(PVectorSingleThread, SameAsAtomic) {
+		std::mt19937 gen(7);
+		PersistentVector<size_t> atomic;
+		SingleThreadVector single;
+		for (size_t i = 0; i < 5000; ++i) {
+			auto operation = gen() % 8;
+			if (operation < 4 || atomic.empty()) {
+				atomic = atomic.push_back(i);
+				single = single.push_back(i);
+			}
+			else if (operation < 6) {
+				auto pos = gen() % atomic.size();
+				atomic = atomic.set(pos, i);
+				single = single.set(pos, i);
+			}
+			else if (operation < 7) {
+				atomic = atomic.pop_back();
+				single = single.pop_back();
+			}
+			else {
+				atomic = atomic.undo();
+				single = single.undo();
+			}
+			ASSERT_EQ(single.size(), atomic.size());
+		}
+		EXPECT_TRUE(std::equal(single.cbegin(), single.cend(), atomic.cbegin(), atomic.cend()));
+		EXPECT_EQ(single.memoryUsage().primeTreeNodes, atomic.memoryUsage().primeTreeNodes);
+	}
+
+	TEST(PVectorSingleThread, VersionsAreKept) {
+		SingleThreadVector pvector(1000, 1);
+		auto changed = pvector.set(500, 2).resize(2000, 3);
+		EXPECT_EQ(pvector[500], 1);
+		EXPECT_EQ(pvector.size(), 1000);
+		EXPECT_EQ(changed[500], 2);
+		EXPECT_EQ(changed[1999], 3);
+		auto restored = changed.undo().undo();
+		EXPECT_EQ(restored, pvector);
+		EXPECT_EQ(changed.undo().redo(), changed);
+	}
+
+	TEST(PVectorSingleThread, Algorithms) {
+		PersistentVector<int, SumMonoid<int>, SingleThreadRefCount> pvector = { 5, 3, 9, 1 };
+		EXPECT_EQ(pvector.aggregate(0, 4), 18);
+		auto sorted = pvector.sorted();
+		EXPECT_EQ(sorted.front(), 1);
+		EXPECT_EQ(sorted.back(), 9);
+		EXPECT_EQ(*sorted.lower_bound(4), 5);
+		decltype(pvector)::InternTable table;
+		auto interned = PersistentVector<int, SumMonoid<int>, SingleThreadRefCount>(1000, 2).intern(table);
+		EXPECT_EQ(interned.aggregate(0, 1000), 2000);
+	}
+
+
+
 	/*
 	*	Concurrency
 	*/
@@ -0,0 +1,137 @@
+#include <gtest/gtest.h>
+#include <ReclamationQueue.h>
+#include <PersistentVector.h>
+#include <PersistentMap.h>
+#include <PersistentList.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+namespace {
+	using namespace pds;
+	using namespace std;
+
+	std::atomic<int> alive{ 0 };
+
+	struct Counted {
+		Counted() : value(0) { ++alive; }
+		Counted(std::size_t value) : value(value) { ++alive; }
+		Counted(const Counted& other) : value(other.value) { ++alive; }
+		~Counted() { --alive; }
+		bool operator==(const Counted& other) const { return value == other.value; }
+		std::size_t value;
+	};
+
+	TEST(PReclamationQueue, FreesInBoundedSlices) {
+		alive = 0;
+		ReclamationQueue queue;
+		{
+			PersistentVector<Counted> pvector(10000, Counted(1));
+			pvector = pvector.set(pvector.size() / 2, Counted(2));
+			std::move(pvector).retire(queue);
+		}
+		EXPECT_EQ(alive, 10001);
+		std::size_t slices = 0;
+		while (queue.pending() > 0) {
+			EXPECT_LE(queue.reclaim(16), 16);
+			++slices;
+		}
+		// every node of both versions takes a step
+		EXPECT_GT(slices, 10000 / 32 / 16);
+		EXPECT_EQ(alive, 0);
+	}
+
+	TEST(PReclamationQueue, SharedNodesSurvive) {
+		ReclamationQueue queue;
+		PersistentVector<size_t> base(5000, 1);
+		auto changed = base.set(10, 2).push_back(3);
+		std::move(base).retire(queue);
+		// base is in the history of changed, so only the reference of the handle is dropped
+		EXPECT_EQ(queue.reclaimAll(), 1);
+		ASSERT_EQ(changed.size(), 5001);
+		EXPECT_EQ(changed[10], 2);
+		EXPECT_EQ(changed[4999], 1);
+		EXPECT_EQ(changed.back(), 3);
+		EXPECT_EQ(changed.undo().undo()[10], 1);
+		std::move(changed).retire(queue);
+		EXPECT_GT(queue.reclaimAll(), 5000 / 32);
+	}
+
+	TEST(PReclamationQueue, LongHistory) {
+		ReclamationQueue queue;
+		PersistentVector<size_t> pvector;
+		for (size_t i = 0; i < 100000; ++i) {
+			pvector = pvector.push_back(i);
+		}
+		auto undone = pvector.undo();
+		std::move(pvector).retire(queue);
+		queue.reclaimAll();
+		EXPECT_EQ(undone.size(), 99999);
+		EXPECT_EQ(undone.redo().back(), 99999);
+	}
+
+	TEST(PReclamationQueue, VectorOfVectors) {
+		alive = 0;
+		ReclamationQueue queue;
+		{
+			PersistentVector<PersistentVector<Counted>> pvector(100, PersistentVector<Counted>(50, Counted(1)));
+			pvector = pvector.set(pvector.size() - 1, PersistentVector<Counted>(3, Counted(2)));
+			std::move(pvector).retire(queue);
+		}
+		EXPECT_GT(alive, 0);
+		queue.reclaimAll();
+		EXPECT_EQ(alive, 0);
+	}
+
+	TEST(PReclamationQueue, Map) {
+		ReclamationQueue queue;
+		PersistentMap<size_t, size_t> pmap(64);
+		for (size_t i = 0; i < 1000; ++i) {
+			pmap = pmap.set(i, i);
+		}
+		auto erased = pmap.erase(500);
+		std::move(pmap).retire(queue);
+		EXPECT_GT(queue.reclaimAll(), 0);
+		EXPECT_EQ(erased.size(), 999);
+		EXPECT_EQ(erased[499], 499);
+		EXPECT_FALSE(erased.contains(500));
+	}
+
+	TEST(PReclamationQueue, List) {
+		ReclamationQueue queue;
+		persistent_linked_list<int> list;
+		list = list.push_back(1).push_back(2).push_back(3);
+		auto changed = list.set(1, 20);
+		std::move(list).retire(queue);
+		EXPECT_GT(queue.reclaimAll(), 0);
+		EXPECT_EQ(changed.size(), 3);
+		EXPECT_EQ(*++changed.cbegin(), 20);
+		EXPECT_EQ(changed.back(), 3);
+	}
+
+	TEST(PReclamationQueue, Background) {
+		alive = 0;
+		ReclamationQueue queue;
+		queue.startBackground();
+		for (size_t i = 0; i < 10; ++i) {
+			PersistentVector<Counted> pvector(3000, Counted(i));
+			std::move(pvector).retire(queue);
+		}
+		for (size_t i = 0; i < 10000 && (queue.pending() > 0 || alive > 0); ++i) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		EXPECT_EQ(queue.pending(), 0);
+		EXPECT_EQ(alive, 0);
+		queue.stopBackground();
+	}
+
+	TEST(PReclamationQueue, DestructorFreesPending) {
+		alive = 0;
+		{
+			ReclamationQueue queue;
+			PersistentVector<Counted>(1000, Counted(1)).retire(queue);
+			EXPECT_EQ(alive, 1000);
+		}
+		EXPECT_EQ(alive, 0);
+	}
+}
@@ -0,0 +1,102 @@
+#include <gtest/gtest.h>
+#include <PersistentVector.h>
+#include <PersistentMap.h>
+#include <PersistentList.h>
+#include <Statistics.h>
+#include <thread>
+
+
+namespace {
+	using namespace pds;
+	using namespace std;
+
+	/*
+	*	Counters are zero unless the library is built with PDS_ENABLE_STATISTICS
+	*/
+
+	TEST(PStatistics, VectorPathCopies) {
+		PersistentVector<size_t> pvector(100, 0);
+		Statistics::resetThread();
+		// the intermediate versions are kept, so none of them is edited in place
+		auto set = pvector.set(50, 1);
+		auto pushed = set.push_back(2);
+		pvector = pushed.pop_back();
+		auto counters = Statistics::threadSnapshot();
+		if (Statistics::ENABLED) {
+			EXPECT_EQ(counters.pathCopies, 3);
+			EXPECT_EQ(counters.inPlaceEdits, 0);
+			// set copies the root node and a leaf
+			EXPECT_GE(counters.pathCopyLength, 2);
+			EXPECT_GE(counters.nodeAllocations, counters.pathCopyLength);
+		}
+		else {
+			EXPECT_EQ(counters.pathCopies, 0);
+			EXPECT_EQ(counters.nodeAllocations, 0);
+		}
+	}
+
+	TEST(PStatistics, VectorInPlaceEdits) {
+		PersistentVector<size_t> pvector(100, 0);
+		Statistics::resetThread();
+		// the temporaries made by set and push_back are the only owners of their roots
+		pvector = pvector.set(50, 1).push_back(2).pop_back();
+		auto counters = Statistics::threadSnapshot();
+		EXPECT_EQ(counters.pathCopies, Statistics::ENABLED ? 1 : 0);
+		EXPECT_EQ(counters.inPlaceEdits, Statistics::ENABLED ? 2 : 0);
+		EXPECT_EQ(pvector.size(), 100);
+		EXPECT_EQ(pvector[50], 1);
+	}
+
+	TEST(PStatistics, VectorIteratorDescents) {
+		PersistentVector<size_t> pvector(10, 0);
+		Statistics::resetThread();
+		size_t sum = 0;
+		for (auto it = pvector.cbegin(); it != pvector.cend(); ++it) {
+			sum += *it;
+		}
+		EXPECT_EQ(sum, 0);
+		EXPECT_EQ(Statistics::threadSnapshot().iteratorDescents, Statistics::ENABLED ? 10 : 0);
+	}
+
+	TEST(PStatistics, MapRehashesAndProbes) {
+		PersistentMap<size_t, size_t> pmap(4);
+		Statistics::resetThread();
+		for (size_t i = 0; i < 16; ++i) {
+			pmap = pmap.set(i, i);
+		}
+		auto found = pmap.find(3) != pmap.cend();
+		EXPECT_TRUE(found);
+		auto counters = Statistics::threadSnapshot();
+		if (Statistics::ENABLED) {
+			EXPECT_GT(counters.mapRehashes, 0);
+			EXPECT_EQ(counters.bucketLookups, 17);
+			EXPECT_GT(counters.bucketProbes, 0);
+		}
+		else {
+			EXPECT_EQ(counters.mapRehashes, 0);
+			EXPECT_EQ(counters.bucketLookups, 0);
+		}
+	}
+
+	TEST(PStatistics, ListFindNodeSteps) {
+		persistent_linked_list<int> plist;
+		plist = plist.push_back(1).push_back(2).push_back(3);
+		Statistics::resetThread();
+		EXPECT_EQ(plist.front(), 1);
+		EXPECT_EQ(Statistics::threadSnapshot().findNodeSteps > 0, Statistics::ENABLED);
+	}
+
+	TEST(PStatistics, ProcessAggregate) {
+		Statistics::resetProcess();
+		std::thread worker([]() {
+			PersistentVector<size_t> pvector;
+			for (size_t i = 0; i < 100; ++i) {
+				pvector = pvector.push_back(i);
+			}
+		});
+		worker.join();
+		auto counters = Statistics::processSnapshot();
+		EXPECT_EQ(counters.pathCopies, Statistics::ENABLED ? 100 : 0);
+		EXPECT_EQ(Statistics::threadSnapshot().pathCopies, 0);
+	}
+}